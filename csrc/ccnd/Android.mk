@@ -23,7 +23,7 @@ LOCAL_C_INCLUDES	+= $(LOCAL_PATH)/../include
 LOCAL_C_INCLUDES	+= $(LOCAL_PATH)/../../android/external/openssl-armv5/include
 
 CCNDOBJ := ccnd.o ccnd_msg.o ccnd_internal_client.o ccnd_stats.o \
-			android_main.o android_msg.o
+			ccnd_content_tree.o ccnd_cs_policy.o ccnd_nonce.o android_main.o android_msg.o
 
 CCNDSRC := $(CCNDOBJ:.o=.c)
 
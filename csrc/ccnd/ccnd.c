@@ -21,6 +21,10 @@
  * Main program of ccnd - the CCNx Daemon
  */
 
+#if defined(__linux__)
+#define _GNU_SOURCE /* for recvmmsg and sendmmsg */
+#endif
+
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
@@ -39,15 +43,27 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <netinet/in.h>
 
+#if defined(__linux__)
+#define CCND_HAVE_EPOLL 1
+#include <sys/epoll.h>
+#define CCND_HAVE_MMSG 1
+#endif
+
+/** Largest datagram we expect to handle */
+#define CCND_DGRAM_MAX 8800
+#define CCND_DGRAM_NIOV 4
+
 #if defined(NEED_GETADDRINFO_COMPAT)
     #include "getaddrinfo.h"
     #include "dummyin6.h"
 #endif
 
 #include <ccn/bloom.h>
+#include <ccn/btree_content.h>
 #include <ccn/ccn.h>
 #include <ccn/ccn_private.h>
 #include <ccn/ccnd.h>
@@ -55,7 +71,9 @@
 #include <ccn/face_mgmt.h>
 #include <ccn/hashtb.h>
 #include <ccn/indexbuf.h>
+#include <ccn/nametrie.h>
 #include <ccn/schedule.h>
+#include <ccn/slab.h>
 #include <ccn/reg_mgmt.h>
 #include <ccn/uri.h>
 
@@ -74,8 +92,13 @@ static void process_input_message(struct ccnd_handle *h, struct face *face,
                                   unsigned char *msg, size_t size, int pdu_ok);
 static void process_input(struct ccnd_handle *h, int fd);
 static int ccn_stuff_interest(struct ccnd_handle *h,
-                              struct face *face, struct ccn_charbuf *c);
+                              struct face *face, struct ccn_charbuf *c,
+                              size_t extra);
+static void stuff_queue_remove(struct propagating_entry *pe);
 static void do_deferred_write(struct ccnd_handle *h, int fd);
+static void ccnd_flush_dgrams(struct ccnd_handle *h);
+static void register_poll_fd(struct ccnd_handle *h, struct face *face);
+static void unregister_poll_fd(struct ccnd_handle *h, int fd);
 static void clean_needed(struct ccnd_handle *h);
 static struct face *get_dgram_source(struct ccnd_handle *h, struct face *face,
                                      struct sockaddr *addr, socklen_t addrlen,
@@ -88,6 +111,8 @@ static void mark_stale(struct ccnd_handle *h,
                        struct content_entry *content);
 static ccn_accession_t content_skiplist_next(struct ccnd_handle *h,
                                              struct content_entry *content);
+static void content_index_remove(struct ccnd_handle *h,
+                                 struct content_entry *content);
 static void reap_needed(struct ccnd_handle *h, int init_delay_usec);
 static void check_comm_file(struct ccnd_handle *h);
 static const char *unlink_this_at_exit = NULL;
@@ -103,7 +128,12 @@ static void update_forward_to(struct ccnd_handle *h,
                               struct nameprefix_entry *npe);
 static void stuff_and_send(struct ccnd_handle *h, struct face *face,
                            const unsigned char *data1, size_t size1,
-                           const unsigned char *data2, size_t size2);
+                           const unsigned char *data2, size_t size2,
+                           struct content_entry *pin);
+static void ccnd_sendv(struct ccnd_handle *h, struct face *face,
+                       const struct iovec *iov, int iovcnt,
+                       struct content_entry *pin);
+static void shaper_destroy(struct ccnd_handle *h, struct ccnd_shaper **ps);
 static void ccn_link_state_init(struct ccnd_handle *h, struct face *face);
 static void ccn_append_link_stuff(struct ccnd_handle *h,
                                   struct face *face,
@@ -296,8 +326,9 @@ content_queue_create(struct ccnd_handle *h, struct face *face, enum cq_delay_cla
         q->min_usec = usec;
         q->rand_usec = 2 * usec;
         q->nrun = 0;
-        q->send_queue = ccn_indexbuf_create();
-        if (q->send_queue == NULL) {
+        q->size = 8;
+        q->ring = calloc(q->size, sizeof(q->ring[0]));
+        if (q->ring == NULL) {
             free(q);
             return(NULL);
         }
@@ -312,7 +343,8 @@ content_queue_destroy(struct ccnd_handle *h, struct content_queue **pq)
     struct content_queue *q;
     if (*pq != NULL) {
         q = *pq;
-        ccn_indexbuf_destroy(&q->send_queue);
+        free(q->ring);
+        q->ring = NULL;
         if (q->sender != NULL) {
             ccn_schedule_cancel(h->sched, q->sender);
             q->sender = NULL;
@@ -322,6 +354,71 @@ content_queue_destroy(struct ccnd_handle *h, struct content_queue **pq)
     }
 }
 
+/**
+ * Address of the i'th entry of a content queue, counting from the head.
+ */
+#define CQ_AT(q, i) ((q)->ring[((q)->head + (i)) & ((q)->size - 1)])
+
+/**
+ * Find an accession number in a content queue.
+ * @returns its position relative to the head, or -1 if absent.
+ */
+static int
+content_queue_member(struct content_queue *q, ccn_accession_t accession)
+{
+    unsigned i;
+    
+    for (i = 0; i < q->n; i++)
+        if (CQ_AT(q, i) == accession)
+            return(i);
+    return(-1);
+}
+
+/**
+ * Add an accession number at the tail of a content queue, unless present.
+ * @returns its position relative to the head, or -1 for no memory.
+ */
+static int
+content_queue_append(struct content_queue *q, ccn_accession_t accession)
+{
+    ccn_accession_t *ring;
+    unsigned i;
+    int ans;
+    
+    ans = content_queue_member(q, accession);
+    if (ans >= 0)
+        return(ans);
+    if (q->n == q->size) {
+        ring = calloc(2 * q->size, sizeof(ring[0]));
+        if (ring == NULL)
+            return(-1);
+        for (i = 0; i < q->n; i++)
+            ring[i] = CQ_AT(q, i);
+        free(q->ring);
+        q->ring = ring;
+        q->size *= 2;
+        q->head = 0;
+    }
+    CQ_AT(q, q->n) = accession;
+    return(q->n++);
+}
+
+/**
+ * Remove and return the accession number at the head of a content queue.
+ */
+static ccn_accession_t
+content_queue_shift(struct content_queue *q)
+{
+    ccn_accession_t ans;
+    
+    if (q->n == 0)
+        return(0);
+    ans = q->ring[q->head];
+    q->head = (q->head + 1) & (q->size - 1);
+    q->n--;
+    return(ans);
+}
+
 /**
  * Close an open file descriptor quietly.
  */
@@ -369,8 +466,10 @@ finalize_face(struct hashtb_enumerator *e)
     if (i < h->face_limit && h->faces_by_faceid[i] == face) {
         if ((face->flags & CCN_FACE_UNDECIDED) == 0)
             ccnd_face_status_change(h, face->faceid);
-        if (e->ht == h->faces_by_fd)
+        if (e->ht == h->faces_by_fd) {
+            unregister_poll_fd(h, face->recv_fd);
             ccnd_close_fd(h, face->faceid, &face->recv_fd);
+        }
         h->faces_by_faceid[i] = NULL;
         if ((face->flags & CCN_FACE_UNDECIDED) != 0 &&
               face->faceid == ((h->face_rover - 1) | h->face_gen)) {
@@ -380,6 +479,7 @@ finalize_face(struct hashtb_enumerator *e)
         }
         for (c = 0; c < CCN_CQ_N; c++)
             content_queue_destroy(h, &(face->q[c]));
+        shaper_destroy(h, &face->shaper);
         ccnd_msg(h, "%s face id %u (slot %u)",
             recycle ? "recycling" : "releasing",
             face->faceid, face->faceid & MAXFACES);
@@ -387,6 +487,8 @@ finalize_face(struct hashtb_enumerator *e)
     }
     else if (face->faceid != CCN_NOFACEID)
         ccnd_msg(h, "orphaned face %u", face->faceid);
+    while (face->stuff_head != NULL)
+        stuff_queue_remove(face->stuff_head);
     for (m = 0; m < CCND_FACE_METER_N; m++)
         ccnd_meter_destroy(&face->meter[m]);
 }
@@ -511,9 +613,12 @@ finalize_content(struct hashtb_enumerator *content_enumerator)
     struct ccnd_handle *h = hashtb_get_param(content_enumerator->ht, NULL);
     struct content_entry *entry = content_enumerator->data;
     unsigned i = entry->accession - h->accession_base;
+    /* Queued datagrams may point into this entry; send them now */
+    if ((entry->flags & CCN_CONTENT_ENTRY_PINNED) != 0)
+        ccnd_flush_dgrams(h);
     if (i < h->content_by_accession_window &&
           h->content_by_accession[i] == entry) {
-        content_skiplist_remove(h, entry);
+        content_index_remove(h, entry);
         h->content_by_accession[i] = NULL;
     }
     else {
@@ -528,16 +633,41 @@ finalize_content(struct hashtb_enumerator *content_enumerator)
             hashtb_end(e);
             return;
         }
-        content_skiplist_remove(h, entry);
+        content_index_remove(h, entry);
         hashtb_delete(e);
         hashtb_end(e);
     }
+    if (entry->overhead != 0) {
+        h->cs_resident_bytes -= entry->size;
+        h->cs_overhead_bytes -= entry->overhead;
+        entry->overhead = 0;
+    }
     if (entry->comps != NULL) {
-        free(entry->comps);
+        ccn_slab_free(h->slab, entry->comps,
+                      entry->ncomps * sizeof(entry->comps[0]));
         entry->comps = NULL;
     }
+    if (entry->flatname != NULL) {
+        free(entry->flatname);
+        entry->flatname = NULL;
+    }
+    if (entry->digest != NULL) {
+        ccn_slab_free(h->slab, entry->digest, 32);
+        entry->digest = NULL;
+    }
+    if (h->cs_policy != NULL)
+        ccnd_cs_policy_remove(h->cs_policy, entry);
 }
 
+/**
+ * Find the skiplist predecessors of a name at each level.
+ *
+ * Entries with the same name (possible when digests are deferred, if
+ * signatures differ) are ordered by descending accession.  With
+ * wanted_old, the predecessors are those of that entry among them;
+ * otherwise they are those of the first entry with the name.
+ * @returns the number of levels.
+ */
 static int
 content_skiplist_findbefore(struct ccnd_handle *h,
                             const unsigned char *key,
@@ -567,7 +697,8 @@ content_skiplist_findbefore(struct ccnd_handle *h,
                                       key, keysize);
             if (order > 0)
                 break;
-            if (order == 0 && (wanted_old == content || wanted_old == NULL))
+            if (order == 0 && (wanted_old == NULL ||
+                               content->accession <= wanted_old->accession))
                 break;
             if (content->skiplinks == NULL || i >= content->skiplinks->n)
                 abort();
@@ -579,6 +710,8 @@ content_skiplist_findbefore(struct ccnd_handle *h,
 }
 
 #define CCN_SKIPLIST_MAX_DEPTH 30
+#define SKIPLINKS_SIZE(content, d) \
+    (sizeof(*(content)->skiplinks) + (d) * sizeof((content)->skiplinks->buf[0]))
 static void
 content_skiplist_insert(struct ccnd_handle *h, struct content_entry *content)
 {
@@ -596,12 +729,17 @@ content_skiplist_insert(struct ccnd_handle *h, struct content_entry *content)
     end = content->comps[content->ncomps - 1];
     i = content_skiplist_findbefore(h,
                                     content->key + start - 1,
-                                    end - start + 2, NULL, pred);
+                                    end - start + 2, content, pred);
     if (i < d)
         d = i; /* just in case */
-    content->skiplinks = ccn_indexbuf_create();
+    /* These never grow, so allocate them all in one piece */
+    content->skiplinks = ccn_slab_alloc(h->slab, SKIPLINKS_SIZE(content, d));
+    if (content->skiplinks == NULL)
+        abort();
+    content->skiplinks->buf = (void *)(content->skiplinks + 1);
+    content->skiplinks->n = content->skiplinks->limit = d;
     for (i = 0; i < d; i++) {
-        ccn_indexbuf_append_element(content->skiplinks, pred[i]->buf[i]);
+        content->skiplinks->buf[i] = pred[i]->buf[i];
         pred[i]->buf[i] = content->accession;
     }
 }
@@ -625,7 +763,91 @@ content_skiplist_remove(struct ccnd_handle *h, struct content_entry *content)
     for (i = 0; i < d; i++) {
         pred[i]->buf[i] = content->skiplinks->buf[i];
     }
-    ccn_indexbuf_destroy(&content->skiplinks);
+    ccn_slab_free(h->slab, content->skiplinks,
+                  SKIPLINKS_SIZE(content, content->skiplinks->limit));
+    content->skiplinks = NULL;
+}
+
+/**
+ * Add a content entry to the name-ordered index.
+ *
+ * The content store is kept in name order either by the skiplist
+ * (the default) or by a content_tree, as selected by CCND_CONTENT_INDEX.
+ * @returns 0, or -1 if the entry could not be indexed.
+ */
+static int
+content_index_insert(struct ccnd_handle *h, struct content_entry *content)
+{
+    struct ccn_charbuf *flat;
+    int res;
+    
+    if (h->ctree == NULL) {
+        content_skiplist_insert(h, content);
+        return(0);
+    }
+    flat = charbuf_obtain(h);
+    res = ccn_flatname_from_ccnb(flat, content->key, content->size);
+    if (res >= 0) {
+        content->flatname = malloc(flat->length + 1);
+        if (content->flatname == NULL)
+            res = -1;
+    }
+    if (res >= 0) {
+        memcpy(content->flatname, flat->buf, flat->length);
+        content->flatname_size = flat->length;
+        res = ccnd_content_tree_insert(h->ctree, content);
+    }
+    charbuf_release(h, flat);
+    return(res < 0 ? -1 : 0);
+}
+
+static void
+content_index_remove(struct ccnd_handle *h, struct content_entry *content)
+{
+    if (h->ctree == NULL)
+        content_skiplist_remove(h, content);
+    else
+        ccnd_content_tree_remove(h->ctree, content);
+}
+
+/**
+ * Find the first content entry with a name not less than the given one.
+ * @param name is a ccnb-encoded Name.
+ */
+static struct content_entry *
+content_index_lookup_ge(struct ccnd_handle *h,
+                        const unsigned char *name, size_t size)
+{
+    struct ccn_indexbuf *pred[CCN_SKIPLIST_MAX_DEPTH] = {NULL};
+    struct ccn_charbuf *flat;
+    struct content_entry *content = NULL;
+    int res;
+    
+    if (h->ctree == NULL) {
+        res = content_skiplist_findbefore(h, name, size, NULL, pred);
+        if (res == 0)
+            return(NULL);
+        return(content_from_accession(h, pred[0]->buf[0]));
+    }
+    flat = charbuf_obtain(h);
+    res = ccn_flatname_from_ccnb(flat, name, size);
+    if (res >= 0)
+        content = ccnd_content_tree_lookup_ge(h->ctree, flat->buf, flat->length);
+    charbuf_release(h, flat);
+    return(content);
+}
+
+/**
+ * Step to the next content entry in name order.
+ */
+static struct content_entry *
+content_index_next(struct ccnd_handle *h, struct content_entry *content)
+{
+    if (content == NULL)
+        return(NULL);
+    if (h->ctree == NULL)
+        return(content_from_accession(h, content_skiplist_next(h, content)));
+    return(ccnd_content_tree_next(h->ctree, content));
 }
 
 static struct content_entry *
@@ -633,8 +855,7 @@ find_first_match_candidate(struct ccnd_handle *h,
                            const unsigned char *interest_msg,
                            const struct ccn_parsed_interest *pi)
 {
-    int res;
-    struct ccn_indexbuf *pred[CCN_SKIPLIST_MAX_DEPTH] = {NULL};
+    struct content_entry *content;
     size_t start = pi->offset[CCN_PI_B_Name];
     size_t end = pi->offset[CCN_PI_E_Name];
     struct ccn_charbuf *namebuf = NULL;
@@ -673,18 +894,39 @@ find_first_match_candidate(struct ccnd_handle *h,
             }
         }
     }
-    if (namebuf == NULL) {
-        res = content_skiplist_findbefore(h, interest_msg + start, end - start,
-                                          NULL, pred);
-    }
+    if (namebuf == NULL)
+        content = content_index_lookup_ge(h, interest_msg + start, end - start);
     else {
-        res = content_skiplist_findbefore(h, namebuf->buf, namebuf->length,
-                                          NULL, pred);
+        content = content_index_lookup_ge(h, namebuf->buf, namebuf->length);
         ccn_charbuf_destroy(&namebuf);
     }
-    if (res == 0)
-        return(NULL);
-    return(content_from_accession(h, pred[0]->buf[0]));
+    return(content);
+}
+
+/**
+ * Find the first content entry that might match, looking only at
+ * the first prefix_comps components of the interest name.
+ *
+ * This is for interests that may name a deferred digest, which
+ * is not part of the content index.
+ */
+static struct content_entry *
+find_first_prefix_candidate(struct ccnd_handle *h,
+                            const unsigned char *interest_msg,
+                            const struct ccn_parsed_interest *pi,
+                            struct ccn_indexbuf *comps,
+                            int prefix_comps)
+{
+    struct content_entry *content;
+    struct ccn_charbuf *namebuf = charbuf_obtain(h);
+    size_t start = pi->offset[CCN_PI_B_Name];
+    
+    ccn_charbuf_append(namebuf, interest_msg + start,
+                       comps->buf[prefix_comps] - start);
+    ccn_charbuf_append_closer(namebuf);
+    content = content_index_lookup_ge(h, namebuf->buf, namebuf->length);
+    charbuf_release(h, namebuf);
+    return(content);
 }
 
 static int
@@ -710,6 +952,82 @@ content_matches_interest_prefix(struct ccnd_handle *h,
     return(1);
 }
 
+/**
+ * Test whether stored content matches an interest.
+ *
+ * When digests are deferred, the stored content is in on-wire form,
+ * so the digest component is implicit.  It is computed only if the
+ * interest calls for it, and then remembered in the content entry.
+ * pc may be NULL.
+ */
+static int
+stored_content_matches_interest(struct ccnd_handle *h,
+                                struct content_entry *content,
+                                struct ccn_parsed_ContentObject *pc,
+                                const unsigned char *interest_msg,
+                                size_t interest_size,
+                                const struct ccn_parsed_interest *pi)
+{
+    struct ccn_parsed_ContentObject pc_store;
+    int res;
+    
+    if (!h->digest_deferred)
+        return(ccn_content_matches_interest(content->key, content->size, 0, pc,
+                                            interest_msg, interest_size, pi));
+    if (pc == NULL) {
+        res = ccn_parse_ContentObject(content->key, content->size,
+                                      &pc_store, NULL);
+        if (res < 0)
+            return(0);
+        pc = &pc_store;
+    }
+    if (pc->digest_bytes == 0 && content->digest != NULL) {
+        memcpy(pc->digest, content->digest, sizeof(pc->digest));
+        pc->digest_bytes = sizeof(pc->digest);
+    }
+    res = ccn_content_matches_interest(content->key, content->size, 1, pc,
+                                       interest_msg, interest_size, pi);
+    if (content->digest == NULL && pc->digest_bytes == 32) {
+        content->digest = ccn_slab_alloc(h->slab, 32);
+        if (content->digest != NULL)
+            memcpy(content->digest, pc->digest, 32);
+    }
+    return(res);
+}
+
+/**
+ * Get the digest of stored content, computing it if it is deferred.
+ *
+ * The result is remembered in the content entry.
+ * @returns a pointer to the 32 digest bytes, or NULL.
+ */
+static const unsigned char *
+content_digest(struct ccnd_handle *h, struct content_entry *content,
+               struct ccn_parsed_ContentObject *pc)
+{
+    struct ccn_parsed_ContentObject pc_store;
+    int res;
+    
+    if (content->digest != NULL)
+        return(content->digest);
+    if (pc == NULL || pc->digest_bytes != 32) {
+        if (pc == NULL) {
+            res = ccn_parse_ContentObject(content->key, content->size,
+                                          &pc_store, NULL);
+            if (res < 0)
+                return(NULL);
+            pc = &pc_store;
+        }
+        ccn_digest_ContentObject(content->key, pc);
+        if (pc->digest_bytes != 32)
+            return(NULL);
+    }
+    content->digest = ccn_slab_alloc(h->slab, 32);
+    if (content->digest != NULL)
+        memcpy(content->digest, pc->digest, 32);
+    return(content->digest);
+}
+
 static ccn_accession_t
 content_skiplist_next(struct ccnd_handle *h, struct content_entry *content)
 {
@@ -720,10 +1038,86 @@ content_skiplist_next(struct ccnd_handle *h, struct content_entry *content)
     return(content->skiplinks->buf[0]);
 }
 
+/**
+ * Build the pending interest table key: the interest minus its Nonce.
+ */
+static void
+pit_key(struct ccn_charbuf *key, const unsigned char *msg,
+        const struct ccn_parsed_interest *pi)
+{
+    key->length = 0;
+    ccn_charbuf_append(key, msg, pi->offset[CCN_PI_B_Nonce]);
+    ccn_charbuf_append(key, msg + pi->offset[CCN_PI_E_Nonce],
+                       pi->offset[CCN_PI_E] - pi->offset[CCN_PI_E_Nonce]);
+}
+
+/**
+ * Add a pending interest to its pit entry, creating that if needed.
+ * @returns the pit entry, or NULL for no memory.
+ */
+static struct pit_entry *
+pit_link(struct ccnd_handle *h, struct ccn_charbuf *key,
+         struct propagating_entry *pe)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct pit_entry *pit;
+    int res;
+    
+    hashtb_start(h->pit_tab, e);
+    res = hashtb_seek(e, key->buf, key->length, 0);
+    pit = e->data;
+    if (res == HT_NEW_ENTRY) {
+        pit->key = e->key;
+        pit->keysize = e->keysize;
+    }
+    hashtb_end(e);
+    if (pit == NULL)
+        return(NULL);
+    pe->pit = pit;
+    pe->pit_newer = NULL;
+    pe->pit_older = pit->newest;
+    if (pit->newest != NULL)
+        pit->newest->pit_newer = pe;
+    pit->newest = pe;
+    pit->n++;
+    return(pit);
+}
+
+/**
+ * Take a pe out of its pit entry, removing that if it becomes empty.
+ */
+static void
+pit_unlink(struct ccnd_handle *h, struct propagating_entry *pe)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct pit_entry *pit = pe->pit;
+    
+    if (pit == NULL)
+        return;
+    if (pe->pit_newer != NULL)
+        pe->pit_newer->pit_older = pe->pit_older;
+    else
+        pit->newest = pe->pit_older;
+    if (pe->pit_older != NULL)
+        pe->pit_older->pit_newer = pe->pit_newer;
+    pe->pit = NULL;
+    pe->pit_newer = pe->pit_older = NULL;
+    if (--pit->n == 0) {
+        hashtb_start(h->pit_tab, e);
+        if (hashtb_seek(e, pit->key, pit->keysize, 0) == HT_OLD_ENTRY)
+            hashtb_delete(e);
+        hashtb_end(e);
+    }
+}
+
 static void
 consume(struct ccnd_handle *h, struct propagating_entry *pe)
 {
     struct face *face = NULL;
+    pit_unlink(h, pe);
+    stuff_queue_remove(pe);
     ccn_indexbuf_destroy(&pe->outbound);
     if (pe->interest_msg != NULL) {
         free(pe->interest_msg);
@@ -750,6 +1144,9 @@ finalize_nameprefix(struct hashtb_enumerator *e)
         while (head->next != head)
             consume(h, head->next);
     }
+    if (h->nameprefix_trie != NULL)
+        ccn_nametrie_remove(h->nameprefix_trie, npe->trie_node);
+    npe->trie_node = NULL;
     ccn_indexbuf_destroy(&npe->forward_to);
     ccn_indexbuf_destroy(&npe->tap);
     while (npe->forwarding != NULL) {
@@ -906,6 +1303,8 @@ record_connection(struct ccnd_handle *h, int fd,
             hashtb_delete(e);
             face = NULL;
         }
+        else
+            register_poll_fd(h, face);
     }
     hashtb_end(e);
     return(face);
@@ -996,6 +1395,7 @@ make_connection(struct ccnd_handle *h,
         ccnd_msg(h, "connecting to client fd=%d id=%u", fd, face->faceid);
         face->outbufindex = 0;
         face->outbuf = ccn_charbuf_create();
+        ccnd_face_poll_update(h, face);
     }
     else
         ccnd_msg(h, "connected client fd=%d id=%u", fd, face->faceid);
@@ -1114,6 +1514,7 @@ shutdown_client_fd(struct ccnd_handle *h, int fd)
             hashtb_end(e);
             return;
         }
+        unregister_poll_fd(h, fd);
         close(fd);
         face->recv_fd = -1;
         ccnd_msg(h, "shutdown client fd=%d id=%u", fd, faceid);
@@ -1144,9 +1545,10 @@ send_content(struct ccnd_handle *h, struct face *face, struct content_entry *con
     if (n < 2) abort();
     a = content->comps[n - 2];
     b = content->comps[n - 1];
-    if (b - a != 36)
+    if (b - a != 36 && !(b == a && h->digest_deferred))
         abort(); /* strange digest length */
-    stuff_and_send(h, face, content->key, a, content->key + b, size - b);
+    stuff_and_send(h, face, content->key, a, content->key + b, size - b,
+                   content);
     ccnd_meter_bump(h, face->meter[FM_DATO], 1);
     h->content_items_sent += 1;
 }
@@ -1182,63 +1584,386 @@ randomize_content_delay(struct ccnd_handle *h, struct content_queue *q)
     return(usec);
 }
 
+/**
+ * Clock for the token buckets, in microseconds.
+ */
+static long long
+shaper_now(struct ccnd_handle *h)
+{
+    return(h->sec * 1000000LL + h->usec);
+}
+
+static void
+finalize_flow(struct hashtb_enumerator *e)
+{
+    struct ccnd_flow *f = e->data;
+    
+    free(f->q.ring);
+    f->q.ring = NULL;
+}
+
+static struct ccnd_shaper *
+shaper_create(struct ccnd_handle *h)
+{
+    struct ccnd_shaper *s;
+    struct hashtb_param param = {0};
+    
+    s = calloc(1, sizeof(*s));
+    if (s == NULL)
+        return(NULL);
+    param.finalize = &finalize_flow;
+    s->flows = hashtb_create(sizeof(struct ccnd_flow), &param);
+    if (s->flows == NULL) {
+        free(s);
+        return(NULL);
+    }
+    s->flowcomps = CCND_FLOW_COMPONENTS;
+    s->stamp = shaper_now(h);
+    return(s);
+}
+
+static void
+shaper_destroy(struct ccnd_handle *h, struct ccnd_shaper **ps)
+{
+    struct ccnd_shaper *s = *ps;
+    
+    if (s == NULL)
+        return;
+    if (s->sender != NULL) {
+        ccn_schedule_cancel(h->sched, s->sender);
+        s->sender = NULL;
+    }
+    hashtb_destroy(&s->flows);
+    free(s);
+    *ps = NULL;
+}
+
+/**
+ * Take an empty flow out of the round and forget it.
+ * @param prev is the flow before f in the round, or NULL if f is first.
+ */
+static void
+shaper_remove_flow(struct ccnd_shaper *s,
+                   struct ccnd_flow *prev, struct ccnd_flow *f)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    
+    if (prev == NULL)
+        s->head = f->next;
+    else
+        prev->next = f->next;
+    if (s->tail == f)
+        s->tail = prev;
+    hashtb_start(s->flows, e);
+    if (hashtb_seek(e, f->key, f->keysize, 0) == HT_OLD_ENTRY)
+        hashtb_delete(e);
+    hashtb_end(e);
+}
+
+/**
+ * Drop the oldest object of the longest flow, to make room.
+ */
+static void
+shaper_drop(struct ccnd_shaper *s)
+{
+    struct ccnd_flow *f;
+    struct ccnd_flow *prev;
+    struct ccnd_flow *worst = NULL;
+    struct ccnd_flow *worst_prev = NULL;
+    
+    for (prev = NULL, f = s->head; f != NULL; prev = f, f = f->next) {
+        if (worst == NULL || f->q.n > worst->q.n) {
+            worst = f;
+            worst_prev = prev;
+        }
+    }
+    if (worst == NULL)
+        return;
+    content_queue_shift(&worst->q);
+    s->qlen--;
+    s->drops++;
+    if (worst->q.n == 0)
+        shaper_remove_flow(s, worst_prev, worst);
+}
+
 static int
-content_sender(struct ccn_schedule *sched,
-    void *clienth,
-    struct ccn_scheduled_event *ev,
-    int flags)
+shaper_sender(struct ccn_schedule *sched,
+              void *clienth,
+              struct ccn_scheduled_event *ev,
+              int flags);
+
+/**
+ * Hold content for a shaped face, in the flow for its name prefix.
+ */
+static int
+shaper_enqueue(struct ccnd_handle *h, struct face *face,
+               struct content_entry *content)
+{
+    struct ccnd_shaper *s = face->shaper;
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccnd_flow *f;
+    unsigned n;
+    int j;
+    int res;
+    
+    j = content->ncomps - 2;
+    if (j > s->flowcomps)
+        j = s->flowcomps;
+    if (j < 0)
+        j = 0;
+    hashtb_start(s->flows, e);
+    res = hashtb_seek(e, content->key + content->comps[0],
+                      content->comps[j] - content->comps[0], 0);
+    f = e->data;
+    if (res == HT_NEW_ENTRY) {
+        f->key = e->key;
+        f->keysize = e->keysize;
+        f->q.size = 8;
+        f->q.ring = calloc(f->q.size, sizeof(f->q.ring[0]));
+        if (f->q.ring == NULL) {
+            hashtb_delete(e);
+            hashtb_end(e);
+            return(-1);
+        }
+        if (s->tail == NULL)
+            s->head = f;
+        else
+            s->tail->next = f;
+        s->tail = f;
+    }
+    hashtb_end(e);
+    if (f == NULL)
+        return(-1);
+    n = f->q.n;
+    res = content_queue_append(&f->q, content->accession);
+    if (f->q.n > n) {
+        s->qlen++;
+        if (s->qlen > s->qmax)
+            s->qmax = s->qlen;
+        if (s->qlen > CCND_SHAPER_QLIMIT)
+            shaper_drop(s);
+    }
+    if (s->sender == NULL)
+        s->sender = ccn_schedule_event(h->sched, 1, shaper_sender,
+                                       s, face->faceid);
+    return(res);
+}
+
+/**
+ * Send held content as the token bucket allows.
+ *
+ * Flows take turns in deficit round robin: each turn credits a flow
+ * with CCND_SHAPER_QUANTUM bytes, and it sends while its head object
+ * fits within its credit.  When the bucket runs dry, we sleep until
+ * it holds enough for the next object.
+ *
+ * An object larger than the burst could never be paid for up front,
+ * so it goes once the bucket is full, and is charged in full.  The
+ * bucket goes negative, and that debt is paid off by later refills
+ * before anything else is sent, so the long-run rate still holds.
+ */
+static int
+shaper_sender(struct ccn_schedule *sched,
+              void *clienth,
+              struct ccn_scheduled_event *ev,
+              int flags)
 {
-    int i, j;
-    int delay;
-    int nsec;
-    int burst_nsec;
-    int burst_max;
     struct ccnd_handle *h = clienth;
-    struct content_entry *content = NULL;
+    struct ccnd_shaper *s = ev->evdata;
     unsigned faceid = ev->evint;
     struct face *face = NULL;
-    struct content_queue *q = ev->evdata;
+    struct content_entry *content;
+    struct ccnd_flow *f;
+    long long now;
+    long long need;
+    int size;
+    int i;
     (void)sched;
     
     if ((flags & CCN_SCHEDULE_CANCEL) != 0)
-        goto Bail;
+        return(0);
     face = face_from_faceid(h, faceid);
-    if (face == NULL)
-        goto Bail;
-    if (q->send_queue == NULL)
+    if (face == NULL || face->shaper != s)
+        return(0);
+    now = shaper_now(h);
+    if (now > s->stamp) {
+        s->tokens += (now - s->stamp) * s->rate / 1000000;
+        if (s->tokens > s->burst)
+            s->tokens = s->burst;
+    }
+    s->stamp = now;
+    for (i = 0; s->head != NULL && i < h->send_burst;) {
+        f = s->head;
+        if (f->q.n == 0) {
+            shaper_remove_flow(s, NULL, f);
+            continue;
+        }
+        content = content_from_accession(h, CQ_AT(&f->q, 0));
+        if (content == NULL) {
+            content_queue_shift(&f->q);
+            s->qlen--;
+            continue;
+        }
+        if (!f->turn) {
+            f->deficit += CCND_SHAPER_QUANTUM;
+            f->turn = 1;
+        }
+        size = content->size;
+        if (size > f->deficit) {
+            /* Turn is over, go to the back of the line */
+            f->turn = 0;
+            if (f->next != NULL) {
+                s->head = f->next;
+                f->next = NULL;
+                s->tail->next = f;
+                s->tail = f;
+            }
+            continue;
+        }
+        /* Larger objects wait for a full bucket, and leave a debt */
+        need = size < (int)s->burst ? size : s->burst;
+        if (s->tokens < need) {
+            /* Wait for the bucket to fill */
+            need = (need - s->tokens) * 1000000 / s->rate + 1;
+            return(need < 1000000 ? (int)need : 1000000);
+        }
+        content_queue_shift(&f->q);
+        s->qlen--;
+        s->tokens -= size;
+        f->deficit -= size;
+        if (f->q.n == 0) {
+            f->deficit = 0;
+            f->turn = 0;
+            shaper_remove_flow(s, NULL, f);
+        }
+        send_content(h, face, content);
+        s->sent++;
+        i++;
+        /* face may have vanished, bail out if it did */
+        if (face_from_faceid(h, faceid) == NULL)
+            return(0);
+    }
+    if (s->head != NULL)
+        return(1);
+    s->sender = NULL;
+    return(0);
+}
+
+/**
+ * Set the output rate limit for a face; 0 removes the limit.
+ *
+ * A negative burst picks a default of 1/8 second at the given rate.
+ * Content held when the limit is removed is sent right away.
+ */
+static int
+face_set_shaper(struct ccnd_handle *h, struct face *face, int rate, int burst)
+{
+    struct ccnd_shaper *s = face->shaper;
+    struct content_entry *content;
+    struct ccnd_flow *f;
+    unsigned faceid = face->faceid;
+    
+    if (rate < 0)
+        return(0);
+    if (rate == 0) {
+        if (s == NULL)
+            return(0);
+        face->shaper = NULL;
+        for (f = s->head; f != NULL; f = f->next) {
+            while (f->q.n > 0) {
+                content = content_from_accession(h, content_queue_shift(&f->q));
+                /* Sending may have torn down the face */
+                face = face_from_faceid(h, faceid);
+                if (content != NULL && face != NULL)
+                    send_content(h, face, content);
+            }
+        }
+        shaper_destroy(h, &s);
+        return(0);
+    }
+    if (s == NULL) {
+        s = shaper_create(h);
+        if (s == NULL)
+            return(-1);
+        face->shaper = s;
+    }
+    if (burst <= 0) {
+        burst = rate / 8;
+        if (burst < 16384)
+            burst = 16384;
+    }
+    s->rate = rate;
+    s->burst = burst;
+    if (s->tokens > burst)
+        s->tokens = burst;
+    return(0);
+}
+
+static int
+content_sender(struct ccn_schedule *sched,
+    void *clienth,
+    struct ccn_scheduled_event *ev,
+    int flags)
+{
+    int i;
+    int delay;
+    int nsec;
+    int nbytes;
+    int burst_nsec;
+    int burst_max;
+    struct ccnd_handle *h = clienth;
+    struct content_entry *content = NULL;
+    unsigned faceid = ev->evint;
+    struct face *face = NULL;
+    struct content_queue *q = ev->evdata;
+    (void)sched;
+    
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0)
+        goto Bail;
+    face = face_from_faceid(h, faceid);
+    if (face == NULL)
+        goto Bail;
+    if (q->ring == NULL)
         goto Bail;
     if ((face->flags & CCN_FACE_NOSEND) != 0)
         goto Bail;
     /* Send the content at the head of the queue */
-    if (q->ready > q->send_queue->n ||
+    if (q->ready > q->n ||
         (q->ready == 0 && q->nrun >= 12 && q->nrun < 120))
-        q->ready = q->send_queue->n;
+        q->ready = q->n;
     nsec = 0;
+    nbytes = 0;
     burst_nsec = q->burst_nsec;
-    burst_max = 2;
+    burst_max = h->send_burst;
     if (q->ready < burst_max)
         burst_max = q->ready;
     if (burst_max == 0)
         q->nrun = 0;
-    for (i = 0; i < burst_max && nsec < 1000000; i++) {
-        content = content_from_accession(h, q->send_queue->buf[i]);
+    for (i = 0; i < burst_max && nsec < 1000000 &&
+                nbytes < h->send_burst_bytes; i++) {
+        content = content_from_accession(h, content_queue_shift(q));
         if (content == NULL)
             q->nrun = 0;
         else {
-            send_content(h, face, content);
+            if (face->shaper != NULL)
+                shaper_enqueue(h, face, content);
+            else
+                send_content(h, face, content);
             /* face may have vanished, bail out if it did */
             if (face_from_faceid(h, faceid) == NULL)
                 goto Bail;
-            nsec += burst_nsec * (unsigned)((content->size + 1023) / 1024);
+            /* A shaped face paces by its token bucket instead */
+            if (face->shaper == NULL) {
+                nsec += burst_nsec * (unsigned)((content->size + 1023) / 1024);
+                nbytes += content->size;
+            }
             q->nrun++;
         }
     }
     if (q->ready < i) abort();
     q->ready -= i;
-    /* Update queue */
-    for (j = 0; i < q->send_queue->n; i++, j++)
-        q->send_queue->buf[j] = q->send_queue->buf[i];
-    q->send_queue->n = j;
     /* Do a poll before going on to allow others to preempt send. */
     delay = (nsec + 499) / 1000 + 1;
     if (q->ready > 0) {
@@ -1247,10 +1972,10 @@ content_sender(struct ccn_schedule *sched,
                      faceid, q->ready, delay, q->nrun, face->surplus);
         return(delay);
     }
-    q->ready = j;
+    q->ready = q->n;
     if (q->nrun >= 12 && q->nrun < 120) {
         /* We seem to be a preferred provider, forgo the randomized delay */
-        if (j == 0)
+        if (q->n == 0)
             delay += burst_nsec / 50;
         if (h->debug & 8)
             ccnd_msg(h, "face %u ready %u delay %i nrun %u surplus %u",
@@ -1258,8 +1983,8 @@ content_sender(struct ccn_schedule *sched,
         return(delay);
     }
     /* Determine when to run again */
-    for (i = 0; i < q->send_queue->n; i++) {
-        content = content_from_accession(h, q->send_queue->buf[i]);
+    for (i = 0; i < (int)q->n; i++) {
+        content = content_from_accession(h, CQ_AT(q, i));
         if (content != NULL) {
             q->nrun = 0;
             delay = randomize_content_delay(h, q);
@@ -1269,7 +1994,7 @@ content_sender(struct ccn_schedule *sched,
             return(delay);
         }
     }
-    q->send_queue->n = q->ready = 0;
+    q->n = q->head = q->ready = 0;
 Bail:
     q->sender = NULL;
     return(0);
@@ -1295,7 +2020,7 @@ face_send_queue_insert(struct ccnd_handle *h,
     /* Check the other queues first, it might be in one of them */
     for (k = 0; k < CCN_CQ_N; k++) {
         if (k != c && face->q[k] != NULL) {
-            ans = ccn_indexbuf_member(face->q[k]->send_queue, content->accession);
+            ans = content_queue_member(face->q[k], content->accession);
             if (ans >= 0) {
                 if (h->debug & 8)
                     ccnd_debug_ccnb(h, __LINE__, "content_otherq", face,
@@ -1304,10 +2029,10 @@ face_send_queue_insert(struct ccnd_handle *h,
             }
         }
     }
-    ans = ccn_indexbuf_set_insert(q->send_queue, content->accession);
+    ans = content_queue_append(q, content->accession);
     if (q->sender == NULL) {
         delay = randomize_content_delay(h, q);
-        q->ready = q->send_queue->n;
+        q->ready = q->n;
         q->sender = ccn_schedule_event(h->sched, delay,
                                        content_sender, q, face->faceid);
         if (h->debug & 8)
@@ -1361,21 +2086,18 @@ consume_matching_interests(struct ccnd_handle *h,
     struct propagating_entry *head;
     struct propagating_entry *next;
     struct propagating_entry *p;
-    const unsigned char *content_msg;
-    size_t content_size;
     struct face *f;
     
     head = &npe->pe_head;
-    content_msg = content->key;
-    content_size = content->size;
     f = face;
     for (p = head->next; p != head; p = next) {
         next = p->next;
         if (p->interest_msg != NULL &&
             ((face == NULL && (f = face_from_faceid(h, p->faceid)) != NULL) ||
              (face != NULL && p->faceid == face->faceid))) {
-            if (ccn_content_matches_interest(content_msg, content_size, 0, pc,
-                                             p->interest_msg, p->size, NULL)) {
+            if (stored_content_matches_interest(h, content, pc,
+                                                p->interest_msg, p->size,
+                                                &p->pi)) {
                 face_send_queue_insert(h, f, content);
                 if (h->debug & (32 | 8))
                     ccnd_debug_ccnb(h, __LINE__, "consume", f,
@@ -1486,15 +2208,36 @@ match_interests(struct ccnd_handle *h, struct content_entry *content,
     int new_matches;
     int ci;
     int cm = 0;
-    unsigned c0 = content->comps[0];
-    const unsigned char *key = content->key + c0;
     struct nameprefix_entry *npe = NULL;
-    for (ci = content->ncomps - 1; ci >= 0; ci--) {
-        int size = content->comps[ci] - c0;
-        npe = hashtb_lookup(h->nameprefix_tab, key, size);
-        if (npe != NULL)
-            break;
+    struct ccn_indexbuf *comps = indexbuf_obtain(h);
+    for (ci = 0; ci < content->ncomps; ci++)
+        ccn_indexbuf_append_element(comps, content->comps[ci]);
+    npe = ccn_nametrie_longest(h->nameprefix_trie, content->key, comps,
+                               content->ncomps - 1, &ci);
+    /*
+     * With a deferred digest the key stops at the name, but interests
+     * that name the digest are filed under it, so look there as well.
+     */
+    if (h->digest_deferred && npe != NULL && npe->children != 0 &&
+        ci == content->ncomps - 2) {
+        const unsigned char *digest = content_digest(h, content, pc);
+        struct nameprefix_entry *dnpe = NULL;
+        struct ccn_charbuf *name = NULL;
+        if (digest != NULL) {
+            name = charbuf_obtain(h);
+            ccn_charbuf_append(name, content->key, content->comps[ci]);
+            ccnb_append_tagged_blob(name, CCN_DTAG_Component, digest, 32);
+            comps->buf[ci + 1] = name->length;
+            dnpe = ccn_nametrie_lookup(h->nameprefix_trie, name->buf,
+                                       comps, ci + 1);
+            charbuf_release(h, name);
+        }
+        if (dnpe != NULL) {
+            npe = dnpe;
+            ci++;
+        }
     }
+    indexbuf_release(h, comps);
     for (; npe != NULL; npe = npe->parent, ci--) {
         if (npe->fgen != h->forward_to_gen)
             update_forward_to(h, npe);
@@ -1515,42 +2258,45 @@ match_interests(struct ccnd_handle *h, struct content_entry *content,
 /**
  * Send a message in a PDU, possibly stuffing other interest messages into it.
  * The message may be in two pieces.
+ *
+ * The pieces are not copied; any framing and stuffing go in a scratch
+ * buffer, and the whole is sent as an i/o vector.  If the message lives
+ * in a content entry, pin is that entry.
  */
 static void
 stuff_and_send(struct ccnd_handle *h, struct face *face,
                const unsigned char *data1, size_t size1,
-               const unsigned char *data2, size_t size2) {
+               const unsigned char *data2, size_t size2,
+               struct content_entry *pin) {
     struct ccn_charbuf *c = NULL;
+    struct iovec iov[4];
+    size_t hdr;
+    int n = 0;
     
-    if ((face->flags & CCN_FACE_LINK) != 0) {
-        c = charbuf_obtain(h);
-        ccn_charbuf_reserve(c, size1 + size2 + 5 + 8);
+    c = charbuf_obtain(h);
+    if ((face->flags & CCN_FACE_LINK) != 0)
         ccn_charbuf_append_tt(c, CCN_DTAG_CCNProtocolDataUnit, CCN_DTAG);
-        ccn_charbuf_append(c, data1, size1);
-		if (size2 != 0)
-            ccn_charbuf_append(c, data2, size2);
-        ccn_stuff_interest(h, face, c);
-        ccn_append_link_stuff(h, face, c);
+    hdr = c->length;
+    ccn_stuff_interest(h, face, c, size1 + size2);
+    ccn_append_link_stuff(h, face, c);
+    if ((face->flags & CCN_FACE_LINK) != 0)
         ccn_charbuf_append_closer(c);
+    if (hdr != 0) {
+        iov[n].iov_base = c->buf;
+        iov[n++].iov_len = hdr;
     }
-    else if (size2 != 0 || h->mtu > size1 + size2 ||
-             (face->flags & (CCN_FACE_SEQOK | CCN_FACE_SEQPROBE)) != 0 ||
-             face->recvcount == 0) {
-        c = charbuf_obtain(h);
-        ccn_charbuf_append(c, data1, size1);
-		if (size2 != 0)
-            ccn_charbuf_append(c, data2, size2);
-        ccn_stuff_interest(h, face, c);
-        ccn_append_link_stuff(h, face, c);
+    iov[n].iov_base = (void *)data1;
+    iov[n++].iov_len = size1;
+    if (size2 != 0) {
+        iov[n].iov_base = (void *)data2;
+        iov[n++].iov_len = size2;
     }
-    else {
-        /* avoid a copy in this case */
-        ccnd_send(h, face, data1, size1);
-        return;
+    if (c->length > hdr) {
+        iov[n].iov_base = c->buf + hdr;
+        iov[n++].iov_len = c->length - hdr;
     }
-    ccnd_send(h, face, c->buf, c->length);
+    ccnd_sendv(h, face, iov, n, pin);
     charbuf_release(h, c);
-    return;
 }
 
 /**
@@ -1598,61 +2344,129 @@ Bail:
     return(ans);
 }
 
+/**
+ * Take a pending interest off the stuffing queue it is on, if any.
+ */
+static void
+stuff_queue_remove(struct propagating_entry *pe)
+{
+    struct face *face = pe->stuff_face;
+    
+    if (face == NULL)
+        return;
+    if (pe->stuff_prev != NULL)
+        pe->stuff_prev->stuff_next = pe->stuff_next;
+    else
+        face->stuff_head = pe->stuff_next;
+    if (pe->stuff_next != NULL)
+        pe->stuff_next->stuff_prev = pe->stuff_prev;
+    else
+        face->stuff_tail = pe->stuff_prev;
+    pe->stuff_next = pe->stuff_prev = NULL;
+    pe->stuff_face = NULL;
+}
+
+/**
+ * Put a pending interest on the stuffing queue of the face it will
+ * be sent to next, if it may be stuffed at all.
+ *
+ * Called whenever do_propagate has had its way with the entry, so
+ * stuffing need not go looking for candidates.
+ */
+static void
+stuff_queue_update(struct ccnd_handle *h, struct propagating_entry *pe)
+{
+    struct face *face;
+    
+    stuff_queue_remove(pe);
+    if (h->mtu <= 0 || pe->interest_msg == NULL || pe->size > h->mtu ||
+        pe->outbound == NULL || pe->sent >= pe->outbound->n ||
+        (pe->flags & (CCN_PR_STUFFED1 | CCN_PR_WAIT1)) != 0)
+        return;
+    face = face_from_faceid(h, pe->outbound->buf[pe->sent]);
+    if (face == NULL || face == h->face0)
+        return;
+    pe->stuff_face = face;
+    pe->stuff_prev = face->stuff_tail;
+    if (face->stuff_tail != NULL)
+        face->stuff_tail->stuff_next = pe;
+    else
+        face->stuff_head = pe;
+    face->stuff_tail = pe;
+}
+
+#define CCN_STUFF_MAX 64 /* most interests stuffed into one PDU */
+
 /**
  * Stuff a PDU with interest messages that will fit.
  *
  * Note by default stuffing does not happen due to the setting of h->mtu.
+ * The PDU holds extra bytes besides those already in c.
+ * The candidates come from the face's stuffing queue, in order; those
+ * that do not fit are passed over (up to CCN_STUFF_MAX of them), and
+ * those that have gone ineligible since they were queued are dropped.
  * @returns the number of messages that were stuffed.
  */
 static int
 ccn_stuff_interest(struct ccnd_handle *h,
-                   struct face *face, struct ccn_charbuf *c)
+                   struct face *face, struct ccn_charbuf *c, size_t extra)
 {
-    struct hashtb_enumerator ee;
-    struct hashtb_enumerator *e = &ee;
+    struct pit_entry *stuffed[CCN_STUFF_MAX];
+    struct propagating_entry *p;
+    struct propagating_entry *next;
     int n_stuffed = 0;
     int remaining_space;
+    int skipped = 0;
+    int k = 0;
+    int i;
     if (stuff_link_check(h, face, c) > 0)
         n_stuffed++;
-    remaining_space = h->mtu - c->length;
+    remaining_space = h->mtu - (int)(c->length + extra);
     if (remaining_space < 20 || face == h->face0)
         return(0);
-    for (hashtb_start(h->nameprefix_tab, e);
-         remaining_space >= 20 && e->data != NULL; hashtb_next(e)) {
-        struct nameprefix_entry *npe = e->data;
-        struct propagating_entry *head = &npe->pe_head;
-        struct propagating_entry *p;
-        for (p = head->next; p != head; p = p->next) {
-            if (p->outbound != NULL &&
-                p->outbound->n > p->sent &&
-                p->size <= remaining_space &&
-                p->interest_msg != NULL &&
-                ((p->flags & (CCN_PR_STUFFED1 | CCN_PR_WAIT1)) == 0) &&
-                ((p->flags & CCN_PR_UNSENT) == 0 ||
-                 p->outbound->buf[p->sent] == face->faceid) &&
-                promote_outbound(p, face->faceid) != -1) {
-                remaining_space -= p->size;
-                if ((p->flags & CCN_PR_UNSENT) != 0) {
-                    p->flags &= ~CCN_PR_UNSENT;
-                    p->flags |= CCN_PR_STUFFED1;
-                }
-                p->sent++;
-                n_stuffed++;
-                ccn_charbuf_append(c, p->interest_msg, p->size);
-                ccnd_meter_bump(h, face->meter[FM_INTO], 1);
-                h->interests_stuffed++;
-                if (h->debug & 2)
-                    ccnd_debug_ccnb(h, __LINE__, "stuff_interest_to", face,
-                                    p->interest_msg, p->size);
-                /*
-                 * Don't stuff multiple interests with same prefix
-                 * to avoid subverting attempts at redundancy.
-                 */
+    for (p = face->stuff_head;
+         p != NULL && remaining_space >= 20 && k < CCN_STUFF_MAX; p = next) {
+        next = p->stuff_next;
+        if (p->interest_msg == NULL ||
+            p->outbound == NULL ||
+            p->sent >= p->outbound->n ||
+            p->outbound->buf[p->sent] != face->faceid ||
+            (p->flags & (CCN_PR_STUFFED1 | CCN_PR_WAIT1)) != 0) {
+            stuff_queue_remove(p);
+            continue;
+        }
+        if (p->size > remaining_space) {
+            if (++skipped >= CCN_STUFF_MAX)
                 break;
-            }
+            continue;
+        }
+        /*
+         * Don't stuff multiple similar interests
+         * to avoid subverting attempts at redundancy.
+         * Without a pit entry there is nothing to compare.
+         */
+        if (p->pit != NULL) {
+            for (i = 0; i < k && stuffed[i] != p->pit; i++)
+                continue;
+            if (i < k)
+                continue;
         }
+        stuffed[k++] = p->pit;
+        remaining_space -= p->size;
+        if ((p->flags & CCN_PR_UNSENT) != 0) {
+            p->flags &= ~CCN_PR_UNSENT;
+            p->flags |= CCN_PR_STUFFED1;
+        }
+        p->sent++;
+        n_stuffed++;
+        ccn_charbuf_append(c, p->interest_msg, p->size);
+        ccnd_meter_bump(h, face->meter[FM_INTO], 1);
+        h->interests_stuffed++;
+        if (h->debug & 2)
+            ccnd_debug_ccnb(h, __LINE__, "stuff_interest_to", face,
+                            p->interest_msg, p->size);
+        stuff_queue_update(h, p);
     }
-    hashtb_end(e);
     return(n_stuffed);
 }
 
@@ -1979,6 +2793,52 @@ remove_content(struct ccnd_handle *h, struct content_entry *content)
     return(0);
 }
 
+/**
+ * Estimate the memory used to keep a content entry, apart from the
+ * ContentObject itself.
+ */
+static unsigned
+content_overhead(struct ccnd_handle *h, struct content_entry *content)
+{
+    unsigned ans;
+    
+    /* hashtb node header and bucket slot, and our entry */
+    ans = ccn_slab_size(h->slab, 4 * sizeof(size_t) + sizeof(*content) +
+                                 content->size);
+    ans += sizeof(void *) - content->size;
+    ans += ccn_slab_size(h->slab, content->ncomps * sizeof(content->comps[0]));
+    if (content->skiplinks != NULL)
+        ans += ccn_slab_size(h->slab,
+                   SKIPLINKS_SIZE(content, content->skiplinks->limit));
+    if (content->flatname != NULL)
+        ans += content->flatname_size + 1;
+    return(ans);
+}
+
+/**
+ * Add newly stored content to the memory totals.
+ */
+static void
+content_account(struct ccnd_handle *h, struct content_entry *content)
+{
+    content->overhead = content_overhead(h, content);
+    h->cs_resident_bytes += content->size;
+    h->cs_overhead_bytes += content->overhead;
+}
+
+/**
+ * Test whether the content store is holding too much.
+ *
+ * @param n is the number of content entries to consider.
+ * @param bytes is the memory they use, including overhead.
+ */
+static int
+content_store_over(struct ccnd_handle *h, unsigned long n,
+                   unsigned long long bytes)
+{
+    return(n > h->capacity || bytes > h->byte_capacity);
+}
+
 /**
  * Periodic content cleaning
  */
@@ -1992,6 +2852,7 @@ clean_deamon(struct ccn_schedule *sched,
     (void)(sched);
     (void)(ev);
     unsigned long n;
+    unsigned long long bytes;
     ccn_accession_t limit;
     ccn_accession_t a;
     ccn_accession_t min_stale;
@@ -2011,7 +2872,7 @@ clean_deamon(struct ccn_schedule *sched,
         return(0);
     }
     n = hashtb_n(h->content_tab);
-    if (n <= h->capacity)
+    if (!content_store_over(h, n, h->cs_resident_bytes + h->cs_overhead_bytes))
         return(15000000);
     /* Toss unsolicited content first */
     for (i = 0; i < h->unsol->n; i++) {
@@ -2024,8 +2885,9 @@ clean_deamon(struct ccn_schedule *sched,
         a = h->unsol->buf[i];
         content = content_from_accession(h, a);
         if (content != NULL &&
-            (content->flags & CCN_CONTENT_ENTRY_PRECIOUS) == 0)
-            remove_content(h, content);
+            (content->flags & CCN_CONTENT_ENTRY_PRECIOUS) == 0 &&
+            remove_content(h, content) == 0)
+            h->cs_evictions++;
     }
     n = hashtb_n(h->content_tab);
     h->unsol->n = 0;
@@ -2040,7 +2902,8 @@ clean_deamon(struct ccn_schedule *sched,
             a = h->min_stale;
         else
             min_stale = h->min_stale;
-        for (; a <= limit && n > h->capacity; a++) {
+        for (; a <= limit && content_store_over(h, n, h->cs_resident_bytes +
+                                                 h->cs_overhead_bytes); a++) {
             if (check_limit-- <= 0) {
                 ev->evint = a;
                 break;
@@ -2056,6 +2919,7 @@ clean_deamon(struct ccn_schedule *sched,
                 else {
                     content = NULL;
                     n -= 1;
+                    h->cs_evictions++;
                 }
             }
         }
@@ -2070,15 +2934,32 @@ clean_deamon(struct ccn_schedule *sched,
         if (check_limit <= 0)
             return(5000);
     }
+    else if (h->cs_policy != NULL) {
+        /* Let the replacement policy choose what goes */
+        for (; content_store_over(h, n, h->cs_resident_bytes +
+                                         h->cs_overhead_bytes); n--) {
+            if (check_limit-- <= 0)
+                return(5000);
+            content = ccnd_cs_policy_victim(h->cs_policy);
+            if (content == NULL || remove_content(h, content) < 0)
+                break;
+            h->cs_evictions++;
+        }
+        ev->evint = 0;
+        return(1000000);
+    }
     else {
         /* Make oldish content stale, for cleanup on next round */
         limit = h->accession;
         ignore = CCN_CONTENT_ENTRY_STALE | CCN_CONTENT_ENTRY_PRECIOUS;
-        for (a = h->accession_base; a <= limit && n > h->capacity; a++) {
+        bytes = h->cs_resident_bytes + h->cs_overhead_bytes;
+        for (a = h->accession_base;
+             a <= limit && content_store_over(h, n, bytes); a++) {
             content = content_from_accession(h, a);
             if (content != NULL && (content->flags & ignore) == 0) {
                 mark_stale(h, content);
                 n--;
+                bytes -= content->size + content->overhead;
             }
         }
         ev->evint = 0;
@@ -2162,6 +3043,23 @@ age_forwarding_needed(struct ccnd_handle *h)
                                                NULL, 0);
 }
 
+static int
+age_nonces(struct ccn_schedule *sched,
+           void *clienth,
+           struct ccn_scheduled_event *ev,
+           int flags)
+{
+    struct ccnd_handle *h = clienth;
+    (void)(sched);
+    (void)(ev);
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0) {
+        h->age_nonces = NULL;
+        return(0);
+    }
+    ccnd_nonce_filter_age(h->nonce_filter);
+    return(h->nonce_window);
+}
+
 static struct ccn_forwarding *
 seek_forwarding(struct ccnd_handle *h,
                 struct nameprefix_entry *npe, unsigned faceid)
@@ -2406,6 +3304,7 @@ ccnd_req_newface(struct ccnd_handle *h,
     struct face *face = NULL;
     struct face *reqface = NULL;
     struct face *newface = NULL;
+    unsigned faceid;
     int save;
     int nackallowed = 0;
 
@@ -2499,6 +3398,27 @@ ccnd_req_newface(struct ccnd_handle *h,
     }
     if (newface != NULL) {
         newface->flags |= CCN_FACE_PERMANENT;
+        if ((face_instance->limits & CCN_FACE_RATE_LIMIT) != 0) {
+            faceid = newface->faceid;
+            if (face_set_shaper(h, newface, face_instance->rate,
+                                (face_instance->limits & CCN_FACE_BURST_LIMIT) != 0 ?
+                                face_instance->burst : -1) < 0) {
+                res = ccnd_nack(h, reply_body, 450, "could not set rate limit");
+                goto Finish;
+            }
+            /* Removing a limit sends held content, which may fail the face */
+            newface = face_from_faceid(h, faceid);
+            if (newface == NULL) {
+                res = ccnd_nack(h, reply_body, 450, "face went away");
+                goto Finish;
+            }
+        }
+        face_instance->limits = 0;
+        if (newface->shaper != NULL) {
+            face_instance->rate = newface->shaper->rate;
+            face_instance->burst = newface->shaper->burst;
+            face_instance->limits = CCN_FACE_RATE_LIMIT | CCN_FACE_BURST_LIMIT;
+        }
         face_instance->action = NULL;
         face_instance->ccnd_id = h->ccnd_id;
         face_instance->ccnd_id_size = sizeof(h->ccnd_id);
@@ -2969,6 +3889,28 @@ pe_next_usec(struct ccnd_handle *h,
 
 static void replan_propagation(struct ccnd_handle *, struct propagating_entry *);
 
+/**
+ * Remove a consumed propagating entry from the table.
+ *
+ * This may only be done when no event refers to it.  The nonce filter
+ * is reminded of the nonce, which it may have aged out of by now.
+ */
+static void
+forget_propagating(struct ccnd_handle *h, struct propagating_entry *pe)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    
+    if (pe->nonce == NULL)
+        return;
+    if (h->nonce_filter != NULL)
+        ccnd_nonce_filter_check(h->nonce_filter, pe->nonce, pe->noncesize);
+    hashtb_start(h->propagating_tab, e);
+    if (hashtb_seek(e, pe->nonce, pe->noncesize, 0) >= 0)
+        hashtb_delete(e);
+    hashtb_end(e);
+}
+
 static int
 do_propagate(struct ccn_schedule *sched,
              void *clienth,
@@ -2980,8 +3922,12 @@ do_propagate(struct ccn_schedule *sched,
     (void)(sched);
     int next_delay = 1;
     int special_delay = 0;
-    if (pe->interest_msg == NULL)
+    if (pe->interest_msg == NULL) {
+        /* Consumed since we were last here */
+        if ((flags & CCN_SCHEDULE_CANCEL) == 0)
+            forget_propagating(h, pe);
         return(0);
+    }
     if (flags & CCN_SCHEDULE_CANCEL) {
         consume(h, pe);
         return(0);
@@ -2996,6 +3942,7 @@ do_propagate(struct ccn_schedule *sched,
                             face_from_faceid(h, pe->faceid),
                             pe->interest_msg, pe->size);
         consume(h, pe);
+        forget_propagating(h, pe);
         reap_needed(h, 0);
         return(0);        
     }
@@ -3024,7 +3971,7 @@ do_propagate(struct ccn_schedule *sched,
                 pe->flags |= CCN_PR_WAIT1;
                 next_delay = special_delay = ev->evint;
             }
-            stuff_and_send(h, face, pe->interest_msg, pe->size, NULL, 0);
+            stuff_and_send(h, face, pe->interest_msg, pe->size, NULL, 0, NULL);
             ccnd_meter_bump(h, face->meter[FM_INTO], 1);
         }
         else
@@ -3048,6 +3995,7 @@ do_propagate(struct ccn_schedule *sched,
         if (face != NULL && (face->flags & CCN_FACE_DC) != 0)
             next_delay += 60000;
     }
+    stuff_queue_update(h, pe);
     next_delay = pe_next_usec(h, pe, next_delay, __LINE__);
     return(next_delay);
 }
@@ -3055,6 +4003,7 @@ do_propagate(struct ccn_schedule *sched,
 /**
  * Adjust the outbound face list for a new Interest, based upon
  * existing similar interests.
+ * @param pit holds the similar interests, or is NULL if there are none.
  * @result besides possibly updating the outbound set, returns
  *         an extra delay time before propagation.  A negative return value
  *         indicates the interest should be dropped.
@@ -3066,14 +4015,10 @@ adjust_outbound_for_existing_interests(struct ccnd_handle *h, struct face *face,
                                        unsigned char *msg,
                                        struct ccn_parsed_interest *pi,
                                        struct nameprefix_entry *npe,
+                                       struct pit_entry *pit,
                                        struct ccn_indexbuf *outbound)
 {
-    struct propagating_entry *head = &npe->pe_head;
     struct propagating_entry *p;
-    size_t presize = pi->offset[CCN_PI_B_Nonce];
-    size_t postsize = pi->offset[CCN_PI_E] - pi->offset[CCN_PI_E_Nonce];
-    size_t minsize = presize + postsize;
-    unsigned char *post = msg + pi->offset[CCN_PI_E_Nonce];
     int k = 0;
     int max_redundant = 3; /* Allow this many dups from same face */
     int i;
@@ -3083,13 +4028,9 @@ adjust_outbound_for_existing_interests(struct ccnd_handle *h, struct face *face,
 
     if ((face->flags & (CCN_FACE_MCAST | CCN_FACE_LINK)) != 0)
         max_redundant = 0;
-    if (outbound != NULL) {
-        for (p = head->prev; p != head && outbound->n > 0; p = p->prev) {
-            if (p->size > minsize &&
-                p->interest_msg != NULL &&
-                p->usec > 0 &&
-                0 == memcmp(msg, p->interest_msg, presize) &&
-                0 == memcmp(post, p->interest_msg + p->size - postsize, postsize)) {
+    if (outbound != NULL && pit != NULL) {
+        for (p = pit->newest; p != NULL && outbound->n > 0; p = p->pit_older) {
+            if (p->interest_msg != NULL && p->usec > 0) {
                 /* Matches everything but the Nonce */
                 otherface = face_from_faceid(h, p->faceid);
                 if (otherface == NULL)
@@ -3215,12 +4156,17 @@ propagate_interest(struct ccnd_handle *h,
     int delaymask;
     int extra_delay = 0;
     struct ccn_indexbuf *outbound = NULL;
+    struct ccn_charbuf *key = NULL;
     intmax_t lifetime;
     
     lifetime = ccn_interest_lifetime(msg, pi);
     outbound = get_outbound_faces(h, face, msg, pi, npe);
+    key = charbuf_obtain(h);
+    pit_key(key, msg, pi);
     if (outbound->n != 0) {
-        extra_delay = adjust_outbound_for_existing_interests(h, face, msg, pi, npe, outbound);
+        extra_delay = adjust_outbound_for_existing_interests(h, face, msg, pi, npe,
+                          hashtb_lookup(h->pit_tab, key->buf, key->length),
+                          outbound);
         if (extra_delay < 0) {
             /*
              * Completely subsumed by other interests.
@@ -3232,6 +4178,7 @@ propagate_interest(struct ccnd_handle *h,
                                 msg_out, msg_out_size);
             h->interests_dropped += 1;
             ccn_indexbuf_destroy(&outbound);
+            charbuf_release(h, key);
             return(0);
         }
     }
@@ -3243,6 +4190,8 @@ propagate_interest(struct ccnd_handle *h,
         nonce_start = cb->length;
         (h->appnonce)(h, face, cb);
         noncesize = cb->length - nonce_start;
+        if (h->nonce_filter != NULL)
+            ccnd_nonce_filter_check(h->nonce_filter, cb->buf + nonce_start, noncesize);
         ccn_charbuf_append(cb, msg + pi->offset[CCN_PI_B_OTHER],
                                pi->offset[CCN_PI_E] - pi->offset[CCN_PI_B_OTHER]);
         nonce = cb->buf + nonce_start;
@@ -3268,6 +4217,13 @@ propagate_interest(struct ccnd_handle *h,
             memcpy(m, msg_out, msg_out_size);
             pe->interest_msg = m;
             pe->size = msg_out_size;
+            pe->nonce = e->key;
+            pe->noncesize = e->keysize;
+            /* Keep the parse, so matching content need not redo it */
+            if (msg_out == msg)
+                pe->pi = *pi;
+            else
+                ccn_parse_interest(m, msg_out_size, &pe->pi, NULL);
             pe->faceid = face->faceid;
             face->pending_interests += 1;
             if (lifetime < INT_MAX / (1000000 >> 6) * (4096 >> 6))
@@ -3286,6 +4242,7 @@ propagate_interest(struct ccnd_handle *h,
                 pe->flags |= CCN_PR_SCOPE2;
             pe->fgen = h->forward_to_gen;
             link_propagating_interest_to_nameprefix(h, pe, npe);
+            pit_link(h, key, pe);
             ntap = reorder_outbound_using_history(h, npe, pe);
             if (outbound->n > ntap &&
                   outbound->buf[ntap] == npe->src &&
@@ -3301,6 +4258,7 @@ propagate_interest(struct ccnd_handle *h,
                 usec = (nrand48(h->seed) & delaymask) + 1 + extra_delay;
             usec = pe_next_usec(h, pe, usec, __LINE__);
             ccn_schedule_event(h->sched, usec, do_propagate, pe, npe->usec);
+            stuff_queue_update(h, pe);
         }
     }
     else {
@@ -3311,6 +4269,7 @@ propagate_interest(struct ccnd_handle *h,
     hashtb_end(e);
     if (cb != NULL)
         charbuf_release(h, cb);
+    charbuf_release(h, key);
     ccn_indexbuf_destroy(&outbound);
     return(res);
 }
@@ -3388,23 +4347,20 @@ static int
 is_duplicate_flooded(struct ccnd_handle *h, unsigned char *msg,
                      struct ccn_parsed_interest *pi, unsigned faceid)
 {
-    struct hashtb_enumerator ee;
-    struct hashtb_enumerator *e = &ee;
     struct propagating_entry *pe = NULL;
-    int res;
     size_t nonce_start = pi->offset[CCN_PI_B_Nonce];
     size_t nonce_size = pi->offset[CCN_PI_E_Nonce] - nonce_start;
     if (nonce_size == 0)
         return(0);
-    hashtb_start(h->propagating_tab, e);
-    res = hashtb_seek(e, msg + nonce_start, nonce_size, 0);
-    if (res == HT_OLD_ENTRY) {
-        pe = e->data;
+    pe = hashtb_lookup(h->propagating_tab, msg + nonce_start, nonce_size);
+    if (pe != NULL) {
         if (promote_outbound(pe, faceid) != -1)
             pe->sent++;
+        return(1);
     }
-    hashtb_end(e);
-    return(res == HT_OLD_ENTRY);
+    if (h->nonce_filter == NULL)
+        return(0);
+    return(ccnd_nonce_filter_check(h->nonce_filter, msg + nonce_start, nonce_size));
 }
 
 /**
@@ -3414,22 +4370,13 @@ is_duplicate_flooded(struct ccnd_handle *h, unsigned char *msg,
 nameprefix_longest_match(struct ccnd_handle *h, const unsigned char *msg,
                          struct ccn_indexbuf *comps, int ncomps)
 {
-    int i;
-    int base;
     int answer = 0;
-    struct nameprefix_entry *npe = NULL;
 
     if (ncomps + 1 > comps->n)
         return(-1);
-    base = comps->buf[0];
-    for (i = 0; i <= ncomps; i++) {
-        npe = hashtb_lookup(h->nameprefix_tab, msg + base, comps->buf[i] - base);
-        if (npe == NULL)
-            break;
-        answer = i;
-        if (npe->children == 0)
-            break;
-    }
+    ccn_nametrie_longest(h->nameprefix_trie, msg, comps, ncomps, &answer);
+    if (answer < 0)
+        answer = 0;
     ccnd_msg(h, "nameprefix_longest_match returning %d", answer);
     return(answer);
 }
@@ -3437,6 +4384,10 @@ nameprefix_longest_match(struct ccnd_handle *h, const unsigned char *msg,
 /**
  * Creates a nameprefix entry if it does not already exist, together
  * with all of its parents.
+ *
+ * The prefixes that already exist are found with one walk of the
+ * nameprefix trie, so only the missing ones need hash table probes,
+ * and the hashes for those are computed together.
  */
 static int
 nameprefix_seek(struct ccnd_handle *h, struct hashtb_enumerator *e,
@@ -3448,12 +4399,24 @@ nameprefix_seek(struct ccnd_handle *h, struct hashtb_enumerator *e,
     struct nameprefix_entry *parent = NULL;
     struct nameprefix_entry *npe = NULL;
     struct propagating_entry *head = NULL;
+    struct ccn_indexbuf *hashes = NULL;
 
     if (ncomps + 1 > comps->n)
         return(-1);
     base = comps->buf[0];
-    for (i = 0; i <= ncomps; i++) {
-        res = hashtb_seek(e, msg + base, comps->buf[i] - base, 0);
+    parent = ccn_nametrie_longest(h->nameprefix_trie, msg, comps, ncomps, &i);
+    if (parent == NULL)
+        i = 0;
+    else if (i < ncomps)
+        i += 1;
+    hashes = indexbuf_obtain(h);
+    if (ccn_name_prefix_hashes(msg, comps, ncomps, hashes) < 0) {
+        indexbuf_release(h, hashes);
+        return(-1);
+    }
+    for (; i <= ncomps; i++) {
+        res = hashtb_seek_hashed(e, msg + base, comps->buf[i] - base, 0,
+                                 hashes->buf[i]);
         if (res < 0)
             break;
         npe = e->data;
@@ -3477,9 +4440,19 @@ nameprefix_seek(struct ccnd_handle *h, struct hashtb_enumerator *e,
                 npe->src = npe->osrc = CCN_NOFACEID;
                 npe->usec = (nrand48(h->seed) % 4096U) + 8192;
             }
+            npe->trie_node = ccn_nametrie_insert(h->nameprefix_trie,
+                                                 msg, comps, i, npe);
+            if (npe->trie_node == NULL) {
+                if (parent != NULL)
+                    parent->children--;
+                hashtb_delete(e);
+                res = -1;
+                break;
+            }
         }
         parent = npe;
     }
+    indexbuf_release(h, hashes);
     return(res);
 }
 
@@ -3489,8 +4462,6 @@ next_child_at_level(struct ccnd_handle *h,
 {
     struct content_entry *next = NULL;
     struct ccn_charbuf *name;
-    struct ccn_indexbuf *pred[CCN_SKIPLIST_MAX_DEPTH] = {NULL};
-    int d;
     int res;
     
     if (content == NULL)
@@ -3508,12 +4479,10 @@ next_child_at_level(struct ccnd_handle *h,
     if (h->debug & 8)
         ccnd_debug_ccnb(h, __LINE__, "child_successor", NULL,
                         name->buf, name->length);
-    d = content_skiplist_findbefore(h, name->buf, name->length,
-                                    NULL, pred);
-    next = content_from_accession(h, pred[0]->buf[0]);
+    next = content_index_lookup_ge(h, name->buf, name->length);
     if (next == content) {
         // XXX - I think this case should not occur, but just in case, avoid a loop.
-        next = content_from_accession(h, content_skiplist_next(h, content));
+        next = content_index_next(h, content);
         ccnd_debug_ccnb(h, __LINE__, "bump", NULL, next->key, next->size);
     }
     ccn_charbuf_destroy(&name);
@@ -3534,6 +4503,7 @@ process_incoming_interest(struct ccnd_handle *h, struct face *face,
     int try;
     int matched;
     int s_ok;
+    int pfx;
     struct nameprefix_entry *npe = NULL;
     struct content_entry *content = NULL;
     struct content_entry *last_match = NULL;
@@ -3594,6 +4564,15 @@ process_incoming_interest(struct ccnd_handle *h, struct face *face,
         h->interests_accepted += 1;
         s_ok = (pi->answerfrom & CCN_AOK_STALE) != 0;
         matched = 0;
+        pfx = pi->prefix_comps;
+        /*
+         * A deferred digest is not in the content names, so the store
+         * is searched one level up for an interest that might name one.
+         * The interest is still filed and forwarded by its full prefix.
+         */
+        if (h->digest_deferred && pfx > 0 &&
+            comps->buf[pfx] - comps->buf[pfx - 1] == 36)
+            pfx--;
         hashtb_start(h->nameprefix_tab, e);
         res = nameprefix_seek(h, e, msg, comps, pi->prefix_comps);
         npe = e->data;
@@ -3607,14 +4586,17 @@ process_incoming_interest(struct ccnd_handle *h, struct face *face,
         }
         if ((pi->answerfrom & CCN_AOK_CS) != 0) {
             last_match = NULL;
-            content = find_first_match_candidate(h, msg, pi);
+            if (pfx < pi->prefix_comps)
+                content = find_first_prefix_candidate(h, msg, pi, comps, pfx);
+            else
+                content = find_first_match_candidate(h, msg, pi);
             if (content != NULL && (h->debug & 8))
                 ccnd_debug_ccnb(h, __LINE__, "first_candidate", NULL,
                                 content->key,
                                 content->size);
             if (content != NULL &&
                 !content_matches_interest_prefix(h, content, msg, comps,
-                                                 pi->prefix_comps)) {
+                                                 pfx)) {
                 if (h->debug & 8)
                     ccnd_debug_ccnb(h, __LINE__, "prefix_mismatch", NULL,
                                     msg, size);
@@ -3622,9 +4604,8 @@ process_incoming_interest(struct ccnd_handle *h, struct face *face,
             }
             for (try = 0; content != NULL; try++) {
                 if ((s_ok || (content->flags & CCN_CONTENT_ENTRY_STALE) == 0) &&
-                    ccn_content_matches_interest(content->key,
-                                       content->size,
-                                       0, NULL, msg, size, pi)) {
+                    stored_content_matches_interest(h, content, NULL,
+                                                    msg, size, pi)) {
                     if ((pi->orderpref & 1) == 0 && // XXX - should be symbolic
                         pi->prefix_comps != comps->n - 1 &&
                         comps->n == content->ncomps &&
@@ -3647,11 +4628,11 @@ process_incoming_interest(struct ccnd_handle *h, struct face *face,
                     goto check_next_prefix;
                 }
             move_along:
-                content = content_from_accession(h, content_skiplist_next(h, content));
+                content = content_index_next(h, content);
             check_next_prefix:
                 if (content != NULL &&
                     !content_matches_interest_prefix(h, content, msg,
-                                                     comps, pi->prefix_comps)) {
+                                                     comps, pfx)) {
                     if (h->debug & 8)
                         ccnd_debug_ccnb(h, __LINE__, "prefix_mismatch", NULL,
                                         content->key,
@@ -3666,7 +4647,7 @@ process_incoming_interest(struct ccnd_handle *h, struct face *face,
                 enum cq_delay_class c;
                 for (c = 0, k = -1; c < CCN_CQ_N && k == -1; c++)
                     if (face->q[c] != NULL)
-                        k = ccn_indexbuf_member(face->q[c]->send_queue, content->accession);
+                        k = content_queue_member(face->q[c], content->accession);
                 if (k == -1) {
                     k = face_send_queue_insert(h, face, content);
                     if (k >= 0) {
@@ -3679,7 +4660,12 @@ process_incoming_interest(struct ccnd_handle *h, struct face *face,
                 if ((pi->answerfrom & CCN_AOK_EXPIRE) != 0)
                     mark_stale(h, content);
                 matched = 1;
+                h->cs_hits++;
+                if (h->cs_policy != NULL)
+                    ccnd_cs_policy_hit(h->cs_policy, content);
             }
+            else
+                h->cs_misses++;
         }
         if (!matched && pi->scope != 0 && npe != NULL)
             propagate_interest(h, face, msg, pi, npe);
@@ -3710,81 +4696,298 @@ mark_stale(struct ccnd_handle *h, struct content_entry *content)
 }
 
 /**
- * Scheduled event that makes content stale when its FreshnessSeconds
- * has exported.
+ * Make content stale when its FreshnessSeconds has expired.
  *
  * May actually remove the content if we are over quota.
  */
-static int
-expire_content(struct ccn_schedule *sched,
-               void *clienth,
-               struct ccn_scheduled_event *ev,
-               int flags)
+static void
+expire_content(struct ccnd_handle *h, struct content_entry *content)
 {
-    struct ccnd_handle *h = clienth;
-    ccn_accession_t accession = ev->evint;
-    struct content_entry *content = NULL;
     int res;
     unsigned n;
-    if ((flags & CCN_SCHEDULE_CANCEL) != 0)
-        return(0);
-    content = content_from_accession(h, accession);
-    if (content != NULL) {
-        n = hashtb_n(h->content_tab);
-        /* The fancy test here lets existing stale content go away, too. */
-        if ((n - (n >> 3)) > h->capacity ||
-            (n > h->capacity && h->min_stale > h->max_stale)) {
-            res = remove_content(h, content);
-            if (res == 0)
-                return(0);
+    unsigned long long bytes;
+    
+    n = hashtb_n(h->content_tab);
+    bytes = h->cs_resident_bytes + h->cs_overhead_bytes;
+    /* The fancy test here lets existing stale content go away, too. */
+    if (content_store_over(h, n - (n >> 3), bytes - (bytes >> 3)) ||
+        (content_store_over(h, n, bytes) && h->min_stale > h->max_stale)) {
+        res = remove_content(h, content);
+        if (res == 0) {
+            h->cs_evictions++;
+            return;
         }
-        mark_stale(h, content);
     }
-    return(0);
+    mark_stale(h, content);
 }
 
 /**
- * Schedules content expiration based on its FreshnessSeconds.
+ * Current freshness wheel tick.
+ */
+static unsigned
+fresh_now(struct ccnd_handle *h)
+{
+    long long usec;
+    
+    usec = (h->sec - h->starttime) * 1000000LL + h->usec - h->starttime_usec;
+    if (usec < 0)
+        usec = 0;
+    return(usec / CCND_FRESH_TICK_USEC);
+}
+
+/**
+ * Put an accession into the bucket for the given tick.
  *
+ * Ticks that are already past go into the next bucket to be swept.
+ * @returns the tick actually used.
  */
-static void
-set_content_timer(struct ccnd_handle *h, struct content_entry *content,
-                  struct ccn_parsed_ContentObject *pco)
+static unsigned
+fresh_place(struct ccnd_freshness *w, ccn_accession_t accession, unsigned tick)
 {
-    int seconds = 0;
-    int microseconds = 0;
-    size_t start = pco->offset[CCN_PCO_B_FreshnessSeconds];
-    size_t stop  = pco->offset[CCN_PCO_E_FreshnessSeconds];
-    if (h->force_zero_freshness) {
-        /* Keep around for long enough to make it through the queues */
-        microseconds = 8 * h->data_pause_microsec + 10000;
-        goto Finish;
-    }
-    if (start == stop)
-        return;
-    seconds = ccn_fetch_tagged_nonNegativeInteger(
-                CCN_DTAG_FreshnessSeconds,
-                content->key,
-                start, stop);
-    if (seconds <= 0)
-        return;
-    if (seconds > ((1U<<31) / 1000000)) {
-        ccnd_debug_ccnb(h, __LINE__, "FreshnessSeconds_too_large", NULL,
-            content->key, pco->offset[CCN_PCO_E]);
-        return;
+    struct ccn_indexbuf **slot;
+    unsigned delta;
+    
+    if ((int)(tick - w->tick) < 0)
+        tick = w->tick;
+    delta = tick - w->tick;
+    if (delta < CCND_FRESH_SLOTS)
+        slot = &w->slot[0][tick % CCND_FRESH_SLOTS];
+    else {
+        if (delta >= CCND_FRESH_SLOTS * CCND_FRESH_SLOTS)
+            tick = w->tick + CCND_FRESH_SLOTS * CCND_FRESH_SLOTS - 1;
+        slot = &w->slot[1][(tick / CCND_FRESH_SLOTS) % CCND_FRESH_SLOTS];
     }
-    microseconds = seconds * 1000000;
-Finish:
-    ccn_schedule_event(h->sched, microseconds,
-                       &expire_content, NULL, content->accession);
+    if (*slot == NULL)
+        *slot = ccn_indexbuf_create();
+    ccn_indexbuf_append_element(*slot, accession);
+    w->n++;
+    return(tick);
 }
 
-static void
+/**
+ * Move a level 1 bucket down to level 0 as its ticks come into range.
+ */
+static void
+fresh_cascade(struct ccnd_handle *h, struct ccnd_freshness *w)
+{
+    struct ccn_indexbuf *x;
+    struct content_entry *content;
+    unsigned window = w->tick / CCND_FRESH_SLOTS;
+    size_t i;
+    
+    x = w->slot[1][window % CCND_FRESH_SLOTS];
+    if (x == NULL || x->n == 0)
+        return;
+    w->slot[1][window % CCND_FRESH_SLOTS] = NULL;
+    w->n -= x->n;
+    for (i = 0; i < x->n; i++) {
+        content = content_from_accession(h, x->buf[i]);
+        if (content != NULL && content->stale_tick != 0 &&
+              content->stale_tick / CCND_FRESH_SLOTS == window)
+            fresh_place(w, content->accession, content->stale_tick);
+    }
+    ccn_indexbuf_destroy(&x);
+}
+
+/**
+ * Scheduled event that sweeps the freshness wheel up to the present,
+ * making content stale in batches.
+ */
+static int
+fresh_sweep(struct ccn_schedule *sched,
+            void *clienth,
+            struct ccn_scheduled_event *ev,
+            int flags)
+{
+    struct ccnd_handle *h = clienth;
+    struct ccnd_freshness *w = h->fresh;
+    struct ccn_indexbuf *x;
+    struct content_entry *content;
+    unsigned now;
+    unsigned lag;
+    long long usec;
+    size_t i;
+    
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0) {
+        w->sweeper = NULL;
+        return(0);
+    }
+    now = fresh_now(h);
+    usec = (h->sec - h->starttime) * 1000000LL + h->usec - h->starttime_usec;
+    for (; (int)(now - w->tick) >= 0 && w->n > 0; w->tick++) {
+        if (w->tick % CCND_FRESH_SLOTS == 0)
+            fresh_cascade(h, w);
+        x = w->slot[0][w->tick % CCND_FRESH_SLOTS];
+        if (x == NULL || x->n == 0)
+            continue;
+        lag = usec - (long long)w->tick * CCND_FRESH_TICK_USEC;
+        for (i = 0; i < x->n; i++) {
+            content = content_from_accession(h, x->buf[i]);
+            if (content == NULL || content->stale_tick != w->tick)
+                continue;
+            content->stale_tick = 0;
+            w->expired++;
+            w->lag_usec += lag;
+            if (lag > w->lag_max_usec)
+                w->lag_max_usec = lag;
+            expire_content(h, content);
+        }
+        w->n -= x->n;
+        x->n = 0;
+    }
+    if (w->n == 0) {
+        w->tick = now + 1;
+        w->sweeper = NULL;
+        return(0);
+    }
+    usec = (long long)w->tick * CCND_FRESH_TICK_USEC - usec;
+    return(usec > 0 ? usec : 1);
+}
+
+/**
+ * Arrange for content to go stale after the given number of microseconds,
+ * rounded up to the next freshness wheel tick.
+ */
+static void
+fresh_insert(struct ccnd_handle *h, struct content_entry *content,
+             int microseconds)
+{
+    struct ccnd_freshness *w = h->fresh;
+    long long usec;
+    
+    if (w->n == 0)
+        w->tick = fresh_now(h) + 1;
+    usec = (h->sec - h->starttime) * 1000000LL + h->usec - h->starttime_usec;
+    content->stale_tick = fresh_place(w, content->accession,
+        (usec + microseconds + CCND_FRESH_TICK_USEC - 1) / CCND_FRESH_TICK_USEC);
+    if (w->sweeper == NULL) {
+        usec = (long long)w->tick * CCND_FRESH_TICK_USEC - usec;
+        w->sweeper = ccn_schedule_event(h->sched, usec > 0 ? usec : 1,
+                                        &fresh_sweep, NULL, 0);
+    }
+}
+
+/**
+ * Schedules content expiration based on its FreshnessSeconds.
+ *
+ */
+static void
+set_content_timer(struct ccnd_handle *h, struct content_entry *content,
+                  struct ccn_parsed_ContentObject *pco)
+{
+    int seconds = 0;
+    int microseconds = 0;
+    size_t start = pco->offset[CCN_PCO_B_FreshnessSeconds];
+    size_t stop  = pco->offset[CCN_PCO_E_FreshnessSeconds];
+    if (h->force_zero_freshness) {
+        /* Keep around for long enough to make it through the queues */
+        microseconds = 8 * h->data_pause_microsec + 10000;
+        goto Finish;
+    }
+    if (start == stop)
+        return;
+    seconds = ccn_fetch_tagged_nonNegativeInteger(
+                CCN_DTAG_FreshnessSeconds,
+                content->key,
+                start, stop);
+    if (seconds <= 0)
+        return;
+    if (seconds > ((1U<<31) / 1000000)) {
+        ccnd_debug_ccnb(h, __LINE__, "FreshnessSeconds_too_large", NULL,
+            content->key, pco->offset[CCN_PCO_E]);
+        return;
+    }
+    microseconds = seconds * 1000000;
+Finish:
+    fresh_insert(h, content, microseconds);
+}
+
+static void
+fresh_destroy(struct ccnd_freshness **pw)
+{
+    struct ccnd_freshness *w = *pw;
+    int i;
+    
+    if (w == NULL)
+        return;
+    for (i = 0; i < 2 * CCND_FRESH_SLOTS; i++)
+        ccn_indexbuf_destroy(&w->slot[i / CCND_FRESH_SLOTS][i % CCND_FRESH_SLOTS]);
+    free(w);
+    *pw = NULL;
+}
+
+/**
+ * Make the ContentObject-digest name component explicit.
+ *
+ * Rather than re-encoding and re-parsing the message, the encoded
+ * component is placed in dcomp, and the parsed offsets and name
+ * component boundaries are adjusted as if it had been spliced in
+ * at the end of the name.  The digest of msg must already be in pco.
+ * @returns the splice point within msg.
+ */
+static size_t
+content_splice_digest(struct ccn_parsed_ContentObject *pco,
+                      struct ccn_indexbuf *comps,
+                      struct ccn_charbuf *dcomp)
+{
+    size_t at = comps->buf[comps->n - 1];
+    int i;
+    
+    ccn_charbuf_append_tt(dcomp, CCN_DTAG_Component, CCN_DTAG);
+    ccn_charbuf_append_tt(dcomp, pco->digest_bytes, CCN_BLOB);
+    ccn_charbuf_append(dcomp, pco->digest, pco->digest_bytes);
+    ccn_charbuf_append_closer(dcomp);
+    for (i = CCN_PCO_E_ComponentLast; i <= CCN_PCO_E; i++)
+        pco->offset[i] += dcomp->length;
+    ccn_indexbuf_append_element(comps, at + dcomp->length);
+    pco->name_ncomps += 1;
+    return(at);
+}
+
+/**
+ * Find or add the content entry for an incoming ContentObject.
+ *
+ * The message is copied just once, from msg into the content table,
+ * with the digest component spliced into the key on the way.
+ * The digest must already be in pco.
+ * If digests are deferred, the message is stored as it is, and
+ * an empty digest component is noted in comps instead.
+ * On return, pco and comps describe the stored copy.
+ * The enumerator is left positioned at the entry; the caller must
+ * call hashtb_end.
+ * @returns HT_NEW_ENTRY or HT_OLD_ENTRY as for hashtb_seek, or -1.
+ */
+static int
+content_seek(struct ccnd_handle *h, struct hashtb_enumerator *e,
+             const unsigned char *msg, size_t size,
+             struct ccn_parsed_ContentObject *pco,
+             struct ccn_indexbuf *comps)
+{
+    struct ccn_charbuf *dcomp;
+    size_t at;
+    int res;
+    
+    if (h->digest_deferred) {
+        ccn_indexbuf_append_element(comps, comps->buf[comps->n - 1]);
+        hashtb_start(h->content_tab, e);
+        return(hashtb_seek(e, msg, pco->offset[CCN_PCO_B_Content],
+                           size - pco->offset[CCN_PCO_B_Content]));
+    }
+    dcomp = charbuf_obtain(h);
+    at = content_splice_digest(pco, comps, dcomp);
+    hashtb_start(h->content_tab, e);
+    res = hashtb_seek_spliced(e, msg, at, dcomp->buf, dcomp->length,
+                              pco->offset[CCN_PCO_B_Content],
+                              size + dcomp->length -
+                              pco->offset[CCN_PCO_B_Content]);
+    charbuf_release(h, dcomp);
+    return(res);
+}
+
+static void
 process_incoming_content(struct ccnd_handle *h, struct face *face,
-                         unsigned char *wire_msg, size_t wire_size)
+                         unsigned char *msg, size_t size)
 {
-    unsigned char *msg;
-    size_t size;
     struct hashtb_enumerator ee;
     struct hashtb_enumerator *e = &ee;
     struct ccn_parsed_ContentObject obj = {0};
@@ -3795,10 +4998,6 @@ process_incoming_content(struct ccnd_handle *h, struct face *face,
     struct content_entry *content = NULL;
     int i;
     struct ccn_indexbuf *comps = indexbuf_obtain(h);
-    struct ccn_charbuf *cb = charbuf_obtain(h);
-    
-    msg = wire_msg;
-    size = wire_size;
     
     res = ccn_parse_ContentObject(msg, size, &obj, comps);
     if (res < 0) {
@@ -3814,24 +5013,6 @@ process_incoming_content(struct ccnd_handle *h, struct face *face,
         res = -__LINE__;
         goto Bail;
     }
-    /* Make the ContentObject-digest name component explicit */
-    ccn_digest_ContentObject(msg, &obj);
-    if (obj.digest_bytes != 32) {
-        ccnd_debug_ccnb(h, __LINE__, "indigestible", face, msg, size);
-        goto Bail;
-    }
-    i = comps->buf[comps->n - 1];
-    ccn_charbuf_append(cb, msg, i);
-    ccn_charbuf_append_tt(cb, CCN_DTAG_Component, CCN_DTAG);
-    ccn_charbuf_append_tt(cb, obj.digest_bytes, CCN_BLOB);
-    ccn_charbuf_append(cb, obj.digest, obj.digest_bytes);
-    ccn_charbuf_append_closer(cb);
-    ccn_charbuf_append(cb, msg + i, size - i);
-    msg = cb->buf;
-    size = cb->length;
-    res = ccn_parse_ContentObject(msg, size, &obj, comps);
-    if (res < 0) abort(); /* must have just messed up */
-    
     if (obj.magic != 20090415) {
         if (++(h->oldformatcontent) == h->oldformatcontentgrumble) {
             h->oldformatcontentgrumble *= 10;
@@ -3842,11 +5023,17 @@ process_incoming_content(struct ccnd_handle *h, struct face *face,
     }
     if (h->debug & 4)
         ccnd_debug_ccnb(h, __LINE__, "content_from", face, msg, size);
+    if (!h->digest_deferred) {
+        ccn_digest_ContentObject(msg, &obj);
+        if (obj.digest_bytes != 32) {
+            ccnd_debug_ccnb(h, __LINE__, "indigestible", face, msg, size);
+            goto Bail;
+        }
+    }
+    tail = msg + obj.offset[CCN_PCO_B_Content];
+    tailsize = size - obj.offset[CCN_PCO_B_Content];
+    res = content_seek(h, e, msg, size, &obj, comps);
     keysize = obj.offset[CCN_PCO_B_Content];
-    tail = msg + keysize;
-    tailsize = size - keysize;
-    hashtb_start(h->content_tab, e);
-    res = hashtb_seek(e, msg, keysize, tailsize);
     content = e->data;
     if (res == HT_OLD_ENTRY) {
         if (tailsize != e->extsize ||
@@ -3855,7 +5042,13 @@ process_incoming_content(struct ccnd_handle *h, struct face *face,
             ccnd_debug_ccnb(h, __LINE__, "new", face, msg, size);
             ccnd_debug_ccnb(h, __LINE__, "old", NULL, e->key, e->keysize + e->extsize);
             content = NULL;
-            hashtb_delete(e); /* XXX - Mercilessly throw away both of them. */
+            /*
+             * A deferred key has no digest, so objects with the same
+             * name and signature bits but different content land here.
+             * Keep the one already stored rather than losing both.
+             */
+            if (!h->digest_deferred)
+                hashtb_delete(e); /* XXX - Mercilessly throw away both of them. */
             res = -__LINE__;
         }
         else if ((content->flags & CCN_CONTENT_ENTRY_STALE) != 0) {
@@ -3878,7 +5071,8 @@ process_incoming_content(struct ccnd_handle *h, struct face *face,
         enroll_content(h, content);
         if (content == content_from_accession(h, content->accession)) {
             content->ncomps = comps->n;
-            content->comps = calloc(comps->n, sizeof(comps[0]));
+            content->comps = ccn_slab_alloc(h->slab,
+                                            comps->n * sizeof(content->comps[0]));
             if (content->comps == NULL) {
                 ccnd_msg(h, "could not enroll ContentObject (accession %llu)",
                          (unsigned long long)content->accession);
@@ -3895,17 +5089,26 @@ process_incoming_content(struct ccnd_handle *h, struct face *face,
         content->key = e->key;
         for (i = 0; i < comps->n; i++)
             content->comps[i] = comps->buf[i];
-        content_skiplist_insert(h, content);
+        if (content_index_insert(h, content) < 0) {
+            ccnd_msg(h, "could not index ContentObject (accession %llu)",
+                     (unsigned long long)content->accession);
+            content = NULL;
+            hashtb_delete(e);
+            res = -__LINE__;
+            hashtb_end(e);
+            goto Bail;
+        }
+        content_account(h, content);
         set_content_timer(h, content, &obj);
         /* Mark public keys supplied at startup as precious. */
         if (obj.type == CCN_CONTENT_KEY && content->accession <= (h->capacity + 7)/8)
             content->flags |= CCN_CONTENT_ENTRY_PRECIOUS;
+        else if (h->cs_policy != NULL)
+            ccnd_cs_policy_admit(h->cs_policy, content);
     }
     hashtb_end(e);
 Bail:
     indexbuf_release(h, comps);
-    charbuf_release(h, cb);
-    cb = NULL;
     if (res >= 0 && content != NULL) {
         int n_matches;
         enum cq_delay_class c;
@@ -3924,7 +5127,7 @@ Bail:
         for (c = 0; c < CCN_CQ_N; c++) {
             q = face->q[c];
             if (q != NULL) {
-                i = ccn_indexbuf_member(q->send_queue, content->accession);
+                i = content_queue_member(q, content->accession);
                 if (i >= 0) {
                     /*
                      * In the case this consumed any interests from this source,
@@ -3932,7 +5135,7 @@ Bail:
                      */
                     if (h->debug & 8)
                         ccnd_debug_ccnb(h, __LINE__, "content_nosend", face, msg, size);
-                    q->send_queue->buf[i] = 0;
+                    CQ_AT(q, i) = 0;
                 }
             }
         }
@@ -4136,6 +5339,160 @@ process_input_buffer(struct ccnd_handle *h, struct face *face)
     memset(d, 0, sizeof(*d));
 }
 
+/**
+ * Buffers for batched datagram i/o.
+ *
+ * For input, all n_slots are handed to recvmmsg(2).
+ * For output, datagrams destined for the same socket accumulate here
+ * until ccnd_flush_dgrams() hands them to sendmmsg(2).  An output slot
+ * may have up to CCND_DGRAM_NIOV pieces, some pointing into a pinned
+ * content entry rather than the slot's buffer.
+ */
+struct ccnd_dgram_ring {
+    int n_slots;                    /**< capacity, in datagrams */
+    int n;                          /**< number of pending output datagrams */
+    int fd;                         /**< socket for pending output */
+    unsigned char *buf;             /**< n_slots * CCND_DGRAM_MAX bytes */
+    struct sockaddr_storage *addr;  /**< per-slot addresses */
+    unsigned *faceid;               /**< per-slot faceids, for output */
+    struct content_entry **pin;     /**< per-slot pinned content, or NULL */
+#if CCND_HAVE_MMSG
+    struct iovec *iov;              /**< CCND_DGRAM_NIOV per slot */
+    struct mmsghdr *msgs;
+#endif
+};
+
+static void
+dgram_ring_destroy(struct ccnd_dgram_ring **pr)
+{
+    struct ccnd_dgram_ring *r = *pr;
+    if (r == NULL)
+        return;
+    free(r->buf);
+    free(r->addr);
+    free(r->faceid);
+    free(r->pin);
+#if CCND_HAVE_MMSG
+    free(r->iov);
+    free(r->msgs);
+#endif
+    free(r);
+    *pr = NULL;
+}
+
+static struct ccnd_dgram_ring *
+dgram_ring_create(int n_slots)
+{
+    struct ccnd_dgram_ring *r = NULL;
+#if CCND_HAVE_MMSG
+    int i;
+    
+    r = calloc(1, sizeof(*r));
+    if (r == NULL)
+        return(NULL);
+    r->n_slots = n_slots;
+    r->fd = -1;
+    r->buf = malloc((size_t)n_slots * CCND_DGRAM_MAX);
+    r->addr = calloc(n_slots, sizeof(r->addr[0]));
+    r->faceid = calloc(n_slots, sizeof(r->faceid[0]));
+    r->pin = calloc(n_slots, sizeof(r->pin[0]));
+    r->iov = calloc((size_t)n_slots * CCND_DGRAM_NIOV, sizeof(r->iov[0]));
+    r->msgs = calloc(n_slots, sizeof(r->msgs[0]));
+    if (r->buf == NULL || r->addr == NULL || r->faceid == NULL ||
+          r->pin == NULL || r->iov == NULL || r->msgs == NULL) {
+        dgram_ring_destroy(&r);
+        return(NULL);
+    }
+    for (i = 0; i < n_slots; i++) {
+        r->iov[i * CCND_DGRAM_NIOV].iov_base = r->buf + (size_t)i * CCND_DGRAM_MAX;
+        r->iov[i * CCND_DGRAM_NIOV].iov_len = CCND_DGRAM_MAX;
+        r->msgs[i].msg_hdr.msg_iov = &r->iov[i * CCND_DGRAM_NIOV];
+        r->msgs[i].msg_hdr.msg_iovlen = 1;
+        r->msgs[i].msg_hdr.msg_name = &r->addr[i];
+        r->msgs[i].msg_hdr.msg_namelen = sizeof(r->addr[i]);
+    }
+#endif
+    return(r);
+}
+
+/**
+ * Process one datagram that has arrived on the given face.
+ *
+ * Each datagram must hold a whole number of ccnb-encoded messages.
+ */
+static void
+process_input_dgram(struct ccnd_handle *h, struct face *face,
+                    unsigned char *buf, size_t size,
+                    struct sockaddr *addr, socklen_t addrlen)
+{
+    struct face *source = NULL;
+    struct ccn_skeleton_decoder decoder = {0};
+    struct ccn_skeleton_decoder *d = &decoder;
+    size_t msgstart;
+    
+    source = get_dgram_source(h, face, addr, addrlen, (size == 1) ? 1 : 2);
+    if (source == NULL)
+        return;
+    ccnd_meter_bump(h, source->meter[FM_BYTI], size);
+    source->recvcount++;
+    source->surplus = 0;
+    if (size <= 1) {
+        if (h->debug & 128)
+            ccnd_msg(h, "%d-byte heartbeat on %d", (int)size, source->faceid);
+        return;
+    }
+    msgstart = 0;
+    ccn_skeleton_decode(d, buf, size);
+    while (d->state == 0) {
+        process_input_message(h, source, buf + msgstart, d->index - msgstart,
+                              (face->flags & CCN_FACE_LOCAL) != 0);
+        msgstart = d->index;
+        if (msgstart == size)
+            return;
+        ccn_skeleton_decode(d, buf + msgstart, size - msgstart);
+    }
+    ccnd_msg(h, "protocol error on face %u, discarding %u bytes",
+             source->faceid, (unsigned)(size - msgstart));
+}
+
+/**
+ * Drain up to h->dgram_batch datagrams from a datagram socket
+ * with a single system call.
+ */
+static void
+process_input_dgram_batch(struct ccnd_handle *h, struct face *face)
+{
+#if CCND_HAVE_MMSG
+    struct ccnd_dgram_ring *r = h->dgram_in;
+    int fd = face->recv_fd;
+    int i;
+    int n;
+    
+    for (i = 0; i < r->n_slots; i++) {
+        r->msgs[i].msg_hdr.msg_namelen = sizeof(r->addr[i]);
+        r->msgs[i].msg_len = 0;
+    }
+    n = recvmmsg(fd, r->msgs, r->n_slots, 0, NULL);
+    if (n == -1) {
+        if (errno != EAGAIN)
+            ccnd_msg(h, "recvmmsg face %u :%s (errno = %d)",
+                     face->faceid, strerror(errno), errno);
+        return;
+    }
+    h->dgram_recv_calls++;
+    h->dgram_recv_msgs += n;
+    for (i = 0; i < n; i++) {
+        /* Processing might conceivably have closed the face */
+        if (i > 0 && face != hashtb_lookup(h->faces_by_fd, &fd, sizeof(fd)))
+            return;
+        process_input_dgram(h, face, r->msgs[i].msg_hdr.msg_iov[0].iov_base,
+                            r->msgs[i].msg_len,
+                            (struct sockaddr *)&r->addr[i],
+                            r->msgs[i].msg_hdr.msg_namelen);
+    }
+#endif
+}
+
 /**
  * Process the input from a socket.
  *
@@ -4177,15 +5534,23 @@ process_input(struct ccnd_handle *h, int fd)
             return;
         }
     }
+    if ((face->flags & CCN_FACE_DGRAM) != 0 && h->dgram_in != NULL) {
+        process_input_dgram_batch(h, face);
+        return;
+    }
     d = &face->decoder;
     if (face->inbuf == NULL)
         face->inbuf = ccn_charbuf_create();
     if (face->inbuf->length == 0)
         memset(d, 0, sizeof(*d));
-    buf = ccn_charbuf_reserve(face->inbuf, 8800);
+    buf = ccn_charbuf_reserve(face->inbuf, CCND_DGRAM_MAX);
     memset(&sstor, 0, sizeof(sstor));
     res = recvfrom(face->recv_fd, buf, face->inbuf->limit - face->inbuf->length,
             /* flags */ 0, addr, &addrlen);
+    if ((face->flags & CCN_FACE_DGRAM) != 0 && res >= 0) {
+        h->dgram_recv_calls++;
+        h->dgram_recv_msgs++;
+    }
     if (res == -1)
         ccnd_msg(h, "recvfrom face %u :%s (errno = %d)",
                     face->faceid, strerror(errno), errno);
@@ -4278,6 +5643,7 @@ handle_send_error(struct ccnd_handle *h, int errnum, struct face *face,
         face->flags |= CCN_FACE_NOSEND;
         face->outbufindex = 0;
         ccn_charbuf_destroy(&face->outbuf);
+        ccnd_face_poll_update(h, face);
     }
     else {
         ccnd_msg(h, "send to face %u failed: %s (errno = %d)",
@@ -4316,6 +5682,152 @@ sending_fd(struct ccnd_handle *h, struct face *face)
     return(-1);
 }
 
+/**
+ * Queue a datagram for a later sendmmsg(2).
+ *
+ * Pieces that lie within the pinned content entry are referred to in place,
+ * and the entry is flagged so that it will not be freed until they have
+ * been sent.  Other pieces are copied, so the caller's buffers may be
+ * reused immediately.
+ * Datagrams going out on different sockets are not mixed in a batch.
+ * @returns 0 if queued, or -1 if the caller should send directly.
+ */
+static int
+queue_dgram(struct ccnd_handle *h, struct face *face,
+            const struct iovec *iov, int iovcnt, struct content_entry *pin)
+{
+#if CCND_HAVE_MMSG
+    struct ccnd_dgram_ring *r = h->dgram_out;
+    struct iovec *v;
+    const unsigned char *base;
+    unsigned char *p;
+    size_t size = 0;
+    size_t len;
+    int fd;
+    int i;
+    int j;
+    int k;
+    
+    if (r == NULL || face->addr == NULL || face->addrlen > sizeof(r->addr[0]))
+        return(-1);
+    for (j = 0; j < iovcnt; j++)
+        size += iov[j].iov_len;
+    if (size > CCND_DGRAM_MAX || iovcnt > CCND_DGRAM_NIOV) {
+        ccnd_flush_dgrams(h);
+        return(-1);
+    }
+    fd = sending_fd(h, face);
+    if (fd == -1)
+        return(-1);
+    if (r->n > 0 && r->fd != fd)
+        ccnd_flush_dgrams(h);
+    i = r->n++;
+    r->fd = fd;
+    r->pin[i] = NULL;
+    v = r->msgs[i].msg_hdr.msg_iov;
+    p = r->buf + (size_t)i * CCND_DGRAM_MAX;
+    for (j = 0, k = 0; j < iovcnt; j++) {
+        base = iov[j].iov_base;
+        len = iov[j].iov_len;
+        if (len == 0)
+            continue;
+        if (pin != NULL && base >= pin->key && base + len <= pin->key + pin->size) {
+            v[k].iov_base = (void *)base;
+            v[k++].iov_len = len;
+            r->pin[i] = pin;
+            h->out_direct_bytes += len;
+            continue;
+        }
+        memcpy(p, base, len);
+        h->out_copied_bytes += len;
+        if (k > 0 && (unsigned char *)v[k - 1].iov_base + v[k - 1].iov_len == p)
+            v[k - 1].iov_len += len;
+        else {
+            v[k].iov_base = p;
+            v[k++].iov_len = len;
+        }
+        p += len;
+    }
+    r->msgs[i].msg_hdr.msg_iovlen = k;
+    if (r->pin[i] != NULL)
+        pin->flags |= CCN_CONTENT_ENTRY_PINNED;
+    memcpy(&r->addr[i], face->addr, face->addrlen);
+    r->msgs[i].msg_hdr.msg_namelen = face->addrlen;
+    r->faceid[i] = face->faceid;
+    if (r->n == r->n_slots)
+        ccnd_flush_dgrams(h);
+    return(0);
+#else
+    return(-1);
+#endif
+}
+
+#if CCND_HAVE_MMSG
+static size_t
+dgram_length(const struct msghdr *m)
+{
+    size_t size = 0;
+    size_t i;
+    
+    for (i = 0; i < m->msg_iovlen; i++)
+        size += m->msg_iov[i].iov_len;
+    return(size);
+}
+#endif
+
+/**
+ * Send any datagrams that have been queued by queue_dgram().
+ *
+ * This is called from the main loop before waiting for events, so
+ * all of the datagrams generated in one pass are sent together.
+ */
+static void
+ccnd_flush_dgrams(struct ccnd_handle *h)
+{
+#if CCND_HAVE_MMSG
+    struct ccnd_dgram_ring *r = h->dgram_out;
+    struct face *face;
+    int i;
+    int j;
+    int res;
+    
+    if (r == NULL || r->n == 0)
+        return;
+    for (i = 0; i < r->n;) {
+        res = sendmmsg(r->fd, r->msgs + i, r->n - i, 0);
+        h->dgram_send_calls++;
+        if (res > 0) {
+            h->dgram_send_msgs += res;
+            for (j = i; j < i + res; j++) {
+                face = face_from_faceid(h, r->faceid[j]);
+                if (face != NULL)
+                    ccnd_meter_bump(h, face->meter[FM_BYTO], r->msgs[j].msg_len);
+                if (r->msgs[j].msg_len != dgram_length(&r->msgs[j].msg_hdr))
+                    ccnd_msg(h, "sendto short");
+            }
+            i += res;
+            continue;
+        }
+        /* The first datagram failed - deal with it and go on to the rest */
+        face = face_from_faceid(h, r->faceid[i]);
+        if (face != NULL &&
+              handle_send_error(h, errno, face,
+                                r->msgs[i].msg_hdr.msg_iov[0].iov_base,
+                                dgram_length(&r->msgs[i].msg_hdr)) == 0)
+            ccnd_msg(h, "sendto short");
+        i++;
+    }
+    for (i = 0; i < r->n; i++) {
+        if (r->pin[i] != NULL) {
+            r->pin[i]->flags &= ~CCN_CONTENT_ENTRY_PINNED;
+            r->pin[i] = NULL;
+        }
+    }
+    r->n = 0;
+    r->fd = -1;
+#endif
+}
+
 /**
  * Send data to the face.
  *
@@ -4326,31 +5838,79 @@ ccnd_send(struct ccnd_handle *h,
           struct face *face,
           const void *data, size_t size)
 {
+    struct iovec iov;
+    
+    iov.iov_base = (void *)data;
+    iov.iov_len = size;
+    ccnd_sendv(h, face, &iov, 1, NULL);
+}
+
+/**
+ * Send a message, given in pieces, to the face.
+ *
+ * The pieces go to the kernel in place where possible.  Copies are made
+ * only for the internal client, for datagrams held for batching (except
+ * pieces within the pinned content entry), and for whatever a stream
+ * socket does not accept at once.
+ */
+static void
+ccnd_sendv(struct ccnd_handle *h, struct face *face,
+           const struct iovec *iov, int iovcnt, struct content_entry *pin)
+{
+    struct ccn_charbuf *c = NULL;
+    struct msghdr msg = {0};
     ssize_t res;
+    size_t size = 0;
+    size_t skip;
+    int i;
+    
     if ((face->flags & CCN_FACE_NOSEND) != 0)
         return;
+    for (i = 0; i < iovcnt; i++)
+        size += iov[i].iov_len;
     face->surplus++;
     if (face->outbuf != NULL) {
-        ccn_charbuf_append(face->outbuf, data, size);
+        for (i = 0; i < iovcnt; i++)
+            ccn_charbuf_append(face->outbuf, iov[i].iov_base, iov[i].iov_len);
+        h->out_copied_bytes += size;
         return;
     }
     if (face == h->face0) {
         ccnd_meter_bump(h, face->meter[FM_BYTO], size);
-        ccn_dispatch_message(h->internal_client, (void *)data, size);
+        if (iovcnt == 1)
+            ccn_dispatch_message(h->internal_client, iov[0].iov_base, size);
+        else {
+            c = charbuf_obtain(h);
+            for (i = 0; i < iovcnt; i++)
+                ccn_charbuf_append(c, iov[i].iov_base, iov[i].iov_len);
+            h->out_copied_bytes += size;
+            ccn_dispatch_message(h->internal_client, c->buf, c->length);
+            charbuf_release(h, c);
+        }
         process_internal_client_buffer(h);
         return;
     }
     if ((face->flags & CCN_FACE_DGRAM) == 0)
-        res = send(face->recv_fd, data, size, 0);
-    else
-        res = sendto(sending_fd(h, face), data, size, 0,
-                     face->addr, face->addrlen);
-    if (res > 0)
+        res = writev(face->recv_fd, iov, iovcnt);
+    else {
+        if (queue_dgram(h, face, iov, iovcnt, pin) == 0)
+            return;
+        msg.msg_name = (void *)face->addr;
+        msg.msg_namelen = face->addrlen;
+        msg.msg_iov = (struct iovec *)iov;
+        msg.msg_iovlen = iovcnt;
+        res = sendmsg(sending_fd(h, face), &msg, 0);
+        h->dgram_send_calls++;
+        h->dgram_send_msgs++;
+    }
+    if (res > 0) {
         ccnd_meter_bump(h, face->meter[FM_BYTO], res);
+        h->out_direct_bytes += res;
+    }
     if (res == size)
         return;
     if (res == -1) {
-        res = handle_send_error(h, errno, face, data, size);
+        res = handle_send_error(h, errno, face, iov[0].iov_base, size);
         if (res == -1)
             return;
     }
@@ -4364,8 +5924,19 @@ ccnd_send(struct ccnd_handle *h,
         ccnd_msg(h, "do_write: %s", strerror(errno));
         return;
     }
-    ccn_charbuf_append(face->outbuf,
-                       ((const unsigned char *)data) + res, size - res);
+    /* Keep what the socket did not take */
+    for (i = 0, skip = res; i < iovcnt; i++) {
+        if (skip >= iov[i].iov_len) {
+            skip -= iov[i].iov_len;
+            continue;
+        }
+        ccn_charbuf_append(face->outbuf,
+                           ((const unsigned char *)iov[i].iov_base) + skip,
+                           iov[i].iov_len - skip);
+        h->out_copied_bytes += iov[i].iov_len - skip;
+        skip = 0;
+    }
+    ccnd_face_poll_update(h, face);
 }
 
 static void
@@ -4385,6 +5956,7 @@ do_deferred_write(struct ccnd_handle *h, int fd)
                     face->flags |= CCN_FACE_NOSEND;
                     face->outbufindex = 0;
                     ccn_charbuf_destroy(&face->outbuf);
+                    ccnd_face_poll_update(h, face);
                     return;
                 }
                 ccnd_msg(h, "send: %s (errno = %d)", strerror(errno), errno);
@@ -4396,6 +5968,8 @@ do_deferred_write(struct ccnd_handle *h, int fd)
                 ccn_charbuf_destroy(&face->outbuf);
                 if ((face->flags & CCN_FACE_CLOSING) != 0)
                     shutdown_client_fd(h, fd);
+                else
+                    ccnd_face_poll_update(h, face);
                 return;
             }
             face->outbufindex += res;
@@ -4404,14 +5978,153 @@ do_deferred_write(struct ccnd_handle *h, int fd)
         face->outbufindex = 0;
         ccn_charbuf_destroy(&face->outbuf);
     }
-    if ((face->flags & CCN_FACE_CLOSING) != 0)
+    if ((face->flags & CCN_FACE_CLOSING) != 0) {
         shutdown_client_fd(h, fd);
-    else if ((face->flags & CCN_FACE_CONNECTING) != 0) {
+        return;
+    }
+    if ((face->flags & CCN_FACE_CONNECTING) != 0) {
         face->flags &= ~CCN_FACE_CONNECTING;
         ccnd_face_status_change(h, face->faceid);
     }
     else
         ccnd_msg(h, "ccnd:do_deferred_write: something fishy on %d", fd);
+    ccnd_face_poll_update(h, face);
+}
+
+/**
+ * Compute the poll(2) events of interest for a face.
+ */
+static int
+face_poll_events(struct face *face)
+{
+    int events = ((face->flags & CCN_FACE_NORECV) == 0) ? POLLIN : 0;
+    if ((face->outbuf != NULL || (face->flags & CCN_FACE_CLOSING) != 0))
+        events |= POLLOUT;
+    return(events);
+}
+
+#if CCND_HAVE_EPOLL
+/**
+ * The epoll data for an fd carries the fd itself, plus a bit to mark
+ * multicast receivers so that they may be serviced first.
+ */
+#define CCND_EPOLL_MCAST ((uint64_t)1 << 32)
+
+static uint32_t
+epoll_events_from_poll(int events)
+{
+    uint32_t ans = 0;
+    if ((events & POLLIN) != 0)
+        ans |= EPOLLIN;
+    if ((events & POLLOUT) != 0)
+        ans |= EPOLLOUT;
+    return(ans);
+}
+
+static int
+poll_events_from_epoll(uint32_t events)
+{
+    int ans = 0;
+    if ((events & EPOLLIN) != 0)
+        ans |= POLLIN;
+    if ((events & EPOLLOUT) != 0)
+        ans |= POLLOUT;
+    if ((events & EPOLLERR) != 0)
+        ans |= POLLERR;
+    if ((events & EPOLLHUP) != 0)
+        ans |= POLLHUP;
+    return(ans);
+}
+
+/**
+ * Give up on epoll, reverting to poll(2) for the rest of the run.
+ */
+static void
+abandon_epoll(struct ccnd_handle *h, const char *why, int fd)
+{
+    ccnd_msg(h, "epoll_ctl %s fd=%d: %s (errno = %d) - reverting to poll",
+             why, fd, strerror(errno), errno);
+    close(h->epfd);
+    h->epfd = -1;
+}
+#endif
+
+/**
+ * Add the fd of a newly recorded face to the epoll set, if we are using one.
+ */
+static void
+register_poll_fd(struct ccnd_handle *h, struct face *face)
+{
+#if CCND_HAVE_EPOLL
+    struct epoll_event ev;
+    int res;
+    
+    if (h->epfd == -1 || face->recv_fd == -1)
+        return;
+    memset(&ev, 0, sizeof(ev));
+    face->pollevents = face_poll_events(face);
+    ev.events = epoll_events_from_poll(face->pollevents);
+    ev.data.u64 = (uint32_t)face->recv_fd;
+    if ((face->flags & CCN_FACE_MCAST) != 0)
+        ev.data.u64 |= CCND_EPOLL_MCAST;
+    res = epoll_ctl(h->epfd, EPOLL_CTL_ADD, face->recv_fd, &ev);
+    if (res == -1)
+        abandon_epoll(h, "ADD", face->recv_fd);
+#endif
+}
+
+/**
+ * Remove an fd from the epoll set, if we are using one.
+ *
+ * This is called just before the fd is closed.
+ */
+static void
+unregister_poll_fd(struct ccnd_handle *h, int fd)
+{
+#if CCND_HAVE_EPOLL
+    struct epoll_event ev;
+    
+    if (h->epfd == -1 || fd == -1)
+        return;
+    memset(&ev, 0, sizeof(ev));
+    epoll_ctl(h->epfd, EPOLL_CTL_DEL, fd, &ev);
+#endif
+}
+
+/**
+ * Bring the registered epoll events for a face up to date.
+ *
+ * This should be called whenever the face's outbuf comes or goes,
+ * or when CCN_FACE_CLOSING is set, so that POLLOUT is requested only
+ * while there is something to do about it.  It is cheap when nothing
+ * has changed, and a no-op when we are using poll(2).
+ */
+void
+ccnd_face_poll_update(struct ccnd_handle *h, struct face *face)
+{
+#if CCND_HAVE_EPOLL
+    struct epoll_event ev;
+    int events;
+    int res;
+    
+    if (h->epfd == -1 || face->recv_fd == -1 || face == h->face0)
+        return;
+    events = face_poll_events(face);
+    if (events == face->pollevents)
+        return;
+    /* datagram faces borrow the fd of their receiving face */
+    if (face != hashtb_lookup(h->faces_by_fd, &face->recv_fd, sizeof(int)))
+        return;
+    memset(&ev, 0, sizeof(ev));
+    face->pollevents = events;
+    ev.events = epoll_events_from_poll(events);
+    ev.data.u64 = (uint32_t)face->recv_fd;
+    if ((face->flags & CCN_FACE_MCAST) != 0)
+        ev.data.u64 |= CCND_EPOLL_MCAST;
+    res = epoll_ctl(h->epfd, EPOLL_CTL_MOD, face->recv_fd, &ev);
+    if (res == -1)
+        abandon_epoll(h, "MOD", face->recv_fd);
+#endif
 }
 
 /**
@@ -4440,22 +6153,94 @@ prepare_poll_fds(struct ccnd_handle *h)
         else
             j = --k;
         h->fds[j].fd = face->recv_fd;
-        h->fds[j].events = ((face->flags & CCN_FACE_NORECV) == 0) ? POLLIN : 0;
-        if ((face->outbuf != NULL || (face->flags & CCN_FACE_CLOSING) != 0))
-            h->fds[j].events |= POLLOUT;
+        h->fds[j].events = face_poll_events(face);
     }
     hashtb_end(e);
     if (i < k)
         abort();
 }
 
+/**
+ * Act upon the events reported for one fd.
+ */
+static void
+dispatch_fd_events(struct ccnd_handle *h, int fd, int revents)
+{
+    if (revents & (POLLERR | POLLNVAL | POLLHUP)) {
+        if (revents & (POLLIN))
+            process_input(h, fd);
+        else
+            shutdown_client_fd(h, fd);
+        return;
+    }
+    if (revents & (POLLOUT))
+        do_deferred_write(h, fd);
+    else if (revents & (POLLIN))
+        process_input(h, fd);
+}
+
+/**
+ * Wait for events using poll(2).
+ *
+ * The whole array of fds is rebuilt and scanned each time.
+ * @returns the result of poll(2).
+ */
+static int
+ccnd_poll_wait(struct ccnd_handle *h, int timeout_ms)
+{
+    int i;
+    int n;
+    int res;
+    
+    prepare_poll_fds(h);
+    if (0) ccnd_msg(h, "at ccnd.c:%d poll(h->fds, %d, %d)", __LINE__, h->nfds, timeout_ms);
+    res = poll(h->fds, h->nfds, timeout_ms);
+    for (i = 0, n = res; n > 0 && i < h->nfds; i++) {
+        if (h->fds[i].revents != 0) {
+            n--;
+            dispatch_fd_events(h, h->fds[i].fd, h->fds[i].revents);
+        }
+    }
+    return(res);
+}
+
+#if CCND_HAVE_EPOLL
+/**
+ * Wait for events using epoll.
+ *
+ * The fds are registered as faces come and go, so the cost here is
+ * proportional to the number of ready fds rather than the number of faces.
+ * Multicast receivers are serviced first, to match the poll(2) ordering.
+ * @returns the result of epoll_wait(2).
+ */
+static int
+ccnd_epoll_wait(struct ccnd_handle *h, int timeout_ms)
+{
+    int i;
+    int mcast;
+    int res;
+    uint64_t u;
+    
+    res = epoll_wait(h->epfd, h->epev, h->nepev, timeout_ms);
+    for (mcast = 1; mcast >= 0; mcast--) {
+        for (i = 0; i < res; i++) {
+            u = h->epev[i].data.u64;
+            if (((u & CCND_EPOLL_MCAST) != 0) != mcast)
+                continue;
+            dispatch_fd_events(h, (int)(uint32_t)u,
+                               poll_events_from_epoll(h->epev[i].events));
+        }
+    }
+    return(res);
+}
+#endif
+
 /**
  * Run the main loop of the ccnd
  */
 void
 ccnd_run(struct ccnd_handle *h)
 {
-    int i;
     int res;
     int timeout_ms = -1;
     int prev_timeout_ms = -1;
@@ -4467,31 +6252,19 @@ ccnd_run(struct ccnd_handle *h)
         if (timeout_ms == 0 && prev_timeout_ms == 0)
             timeout_ms = 1;
         process_internal_client_buffer(h);
-        prepare_poll_fds(h);
-        if (0) ccnd_msg(h, "at ccnd.c:%d poll(h->fds, %d, %d)", __LINE__, h->nfds, timeout_ms);
-        res = poll(h->fds, h->nfds, timeout_ms);
+        ccnd_flush_dgrams(h);
+#if CCND_HAVE_EPOLL
+        if (h->epfd != -1)
+            res = ccnd_epoll_wait(h, timeout_ms);
+        else
+#endif
+        res = ccnd_poll_wait(h, timeout_ms);
         prev_timeout_ms = ((res == 0) ? timeout_ms : 1);
         if (-1 == res) {
             ccnd_msg(h, "poll: %s (errno = %d)", strerror(errno), errno);
             sleep(1);
             continue;
         }
-        for (i = 0; res > 0 && i < h->nfds; i++) {
-            if (h->fds[i].revents != 0) {
-                res--;
-                if (h->fds[i].revents & (POLLERR | POLLNVAL | POLLHUP)) {
-                    if (h->fds[i].revents & (POLLIN))
-                        process_input(h, h->fds[i].fd);
-                    else
-                        shutdown_client_fd(h, h->fds[i].fd);
-                    continue;
-                }
-                if (h->fds[i].revents & (POLLOUT))
-                    do_deferred_write(h, h->fds[i].fd);
-                else if (h->fds[i].revents & (POLLIN))
-                    process_input(h, h->fds[i].fd);
-            }
-        }
     }
 }
 
@@ -4793,6 +6566,36 @@ ccnd_parse_uri_list(struct ccnd_handle *h, const char *what, const char *uris)
     return(ans);
 }
 
+/**
+ * Choose the mechanism used to wait for socket events.
+ *
+ * epoll is used where available, unless poll(2) is requested explicitly.
+ */
+static void
+ccnd_init_poll_method(struct ccnd_handle *h, const char *poll_method)
+{
+    h->epfd = -1;
+    if (poll_method != NULL && poll_method[0] != 0 &&
+          strcmp(poll_method, "poll") != 0 &&
+          strcmp(poll_method, "epoll") != 0)
+        ccnd_msg(h, "CCND_POLL_METHOD=%s not recognized", poll_method);
+#if CCND_HAVE_EPOLL
+    if (poll_method == NULL || strcmp(poll_method, "poll") != 0) {
+        h->nepev = 128;
+        h->epev = calloc(h->nepev, sizeof(h->epev[0]));
+        if (h->epev != NULL)
+            h->epfd = epoll_create(h->nepev);
+        if (h->epfd == -1) {
+            ccnd_msg(h, "epoll_create: %s (errno = %d)", strerror(errno), errno);
+            free(h->epev);
+            h->epev = NULL;
+            h->nepev = 0;
+        }
+    }
+#endif
+    ccnd_msg(h, "CCND_POLL_METHOD=%s", h->epfd != -1 ? "epoll" : "poll");
+}
+
 /**
  * Start a new ccnd instance
  * @param progname - name of program binary, used for locating helpers
@@ -4810,6 +6613,16 @@ ccnd_create(const char *progname, ccnd_logger logger, void *loggerdata)
     const char *data_pause;
     const char *autoreg;
     const char *listen_on;
+    const char *poll_method;
+    const char *dgram_batch;
+    const char *send_burst;
+    const char *content_index;
+    const char *cs_policy;
+    const char *bytelimit;
+    const char *slab;
+    const char *sched;
+    const char *nonce_window;
+    const char *defer_digest;
     int fd;
     struct ccnd_handle *h;
     struct hashtb_param param = {0};
@@ -4832,21 +6645,34 @@ ccnd_create(const char *progname, ccnd_logger logger, void *loggerdata)
     h->faces_by_fd = hashtb_create(sizeof(struct face), &param);
     h->dgram_faces = hashtb_create(sizeof(struct face), &param);
     param.finalize = &finalize_content;
+    slab = getenv("CCND_SLAB");
+    if (slab == NULL || slab[0] == 0 || atoi(slab) != 0)
+        h->slab = ccn_slab_create();
+    param.slab = h->slab;
     h->content_tab = hashtb_create(sizeof(struct content_entry), &param);
+    param.slab = NULL;
     param.finalize = &finalize_nameprefix;
+    param.hash = &ccn_name_prefix_hash;
     h->nameprefix_tab = hashtb_create(sizeof(struct nameprefix_entry), &param);
+    h->nameprefix_trie = ccn_nametrie_create();
+    param.hash = NULL;
     param.finalize = &finalize_propagating;
     h->propagating_tab = hashtb_create(sizeof(struct propagating_entry), &param);
     param.finalize = 0;
+    h->pit_tab = hashtb_create(sizeof(struct pit_entry), &param);
+    h->nonce_filter = ccnd_nonce_filter_create();
     h->sparse_straggler_tab = hashtb_create(sizeof(struct sparse_straggler_entry), NULL);
     h->min_stale = ~0;
     h->max_stale = 0;
     h->unsol = ccn_indexbuf_create();
+    h->fresh = calloc(1, sizeof(*h->fresh));
     h->ticktock.descr[0] = 'C';
     h->ticktock.micros_per_base = 1000000;
     h->ticktock.gettime = &ccnd_gettime;
     h->ticktock.data = h;
-    h->sched = ccn_schedule_create(h, &h->ticktock);
+    sched = getenv("CCND_SCHEDULE");
+    h->sched = ccn_schedule_create_flags(h, &h->ticktock,
+        (sched != NULL && strcmp(sched, "wheel") == 0) ? CCN_SCHEDULE_WHEEL : 0);
     h->starttime = h->sec;
     h->starttime_usec = h->usec;
     h->oldformatcontentgrumble = 1;
@@ -4873,6 +6699,45 @@ ccnd_create(const char *progname, ccnd_logger logger, void *loggerdata)
         if (h->capacity <= 0)
             h->capacity = 10;
     }
+    h->byte_capacity = ~0ULL;
+    bytelimit = getenv("CCND_CAP_BYTES");
+    if (bytelimit != NULL && bytelimit[0] != 0) {
+        char *ep = NULL;
+        h->byte_capacity = strtoull(bytelimit, &ep, 10);
+        switch (ep[0]) {
+            case 'g': case 'G':
+                h->byte_capacity <<= 10;
+                /* FALLTHROUGH */
+            case 'm': case 'M':
+                h->byte_capacity <<= 10;
+                /* FALLTHROUGH */
+            case 'k': case 'K':
+                h->byte_capacity <<= 10;
+                break;
+            default:
+                break;
+        }
+        if (h->byte_capacity < 65536)
+            h->byte_capacity = 65536;
+        ccnd_msg(h, "CCND_CAP_BYTES=%llu", h->byte_capacity);
+    }
+    content_index = getenv("CCND_CONTENT_INDEX");
+    if (content_index != NULL && strcmp(content_index, "btree") == 0)
+        h->ctree = ccnd_content_tree_create();
+    else if (content_index != NULL && content_index[0] != 0 &&
+             strcmp(content_index, "skiplist") != 0)
+        ccnd_msg(h, "CCND_CONTENT_INDEX=%s not recognized", content_index);
+    ccnd_msg(h, "CCND_CONTENT_INDEX=%s",
+             h->ctree != NULL ? "btree" : "skiplist");
+    cs_policy = getenv("CCND_CS_POLICY");
+    if (cs_policy != NULL && cs_policy[0] != 0 &&
+          strcmp(cs_policy, "fifo") != 0) {
+        h->cs_policy = ccnd_cs_policy_create(cs_policy, h->capacity);
+        if (h->cs_policy == NULL)
+            ccnd_msg(h, "CCND_CS_POLICY=%s not recognized", cs_policy);
+    }
+    ccnd_msg(h, "CCND_CS_POLICY=%s",
+             h->cs_policy != NULL ? ccnd_cs_policy_name(h->cs_policy) : "fifo");
     h->mtu = 0;
     mtu = getenv("CCND_MTU");
     if (mtu != NULL && mtu[0] != 0) {
@@ -4892,6 +6757,61 @@ ccnd_create(const char *progname, ccnd_logger logger, void *loggerdata)
     }
     listen_on = getenv("CCND_LISTEN_ON");
     autoreg = getenv("CCND_AUTOREG");
+    poll_method = getenv("CCND_POLL_METHOD");
+    ccnd_init_poll_method(h, poll_method);
+    h->dgram_batch = 32;
+    dgram_batch = getenv("CCND_DGRAM_BATCH");
+    if (dgram_batch != NULL && dgram_batch[0] != 0) {
+        h->dgram_batch = atoi(dgram_batch);
+        if (h->dgram_batch < 1)
+            h->dgram_batch = 1;
+        if (h->dgram_batch > 1024)
+            h->dgram_batch = 1024;
+    }
+    if (h->dgram_batch > 1) {
+        h->dgram_in = dgram_ring_create(h->dgram_batch);
+        h->dgram_out = dgram_ring_create(h->dgram_batch);
+    }
+    ccnd_msg(h, "CCND_DGRAM_BATCH=%d",
+             (h->dgram_in != NULL && h->dgram_out != NULL) ? h->dgram_batch : 1);
+    h->send_burst = 16;
+    send_burst = getenv("CCND_SEND_BURST");
+    if (send_burst != NULL && send_burst[0] != 0) {
+        h->send_burst = atoi(send_burst);
+        if (h->send_burst < 1)
+            h->send_burst = 1;
+    }
+    h->send_burst_bytes = 65536;
+    send_burst = getenv("CCND_SEND_BURST_BYTES");
+    if (send_burst != NULL && send_burst[0] != 0) {
+        h->send_burst_bytes = atoi(send_burst);
+        if (h->send_burst_bytes < 1)
+            h->send_burst_bytes = 1;
+    }
+    ccnd_msg(h, "CCND_SEND_BURST=%d CCND_SEND_BURST_BYTES=%d",
+             h->send_burst, h->send_burst_bytes);
+    h->nonce_window = 2 * CCN_INTEREST_LIFETIME_MICROSEC;
+    nonce_window = getenv("CCND_NONCE_WINDOW");
+    if (nonce_window != NULL && nonce_window[0] != 0) {
+        char *ep = NULL;
+        long secs = strtol(nonce_window, &ep, 10);
+        if (ep[0] != 0)
+            ccnd_msg(h, "CCND_NONCE_WINDOW=%s not recognized", nonce_window);
+        else {
+            /* The window is kept in microseconds, in an int */
+            if (secs < 1)
+                secs = 1;
+            if (secs > INT_MAX / 1000000)
+                secs = INT_MAX / 1000000;
+            h->nonce_window = secs * 1000000;
+        }
+        ccnd_msg(h, "CCND_NONCE_WINDOW=%d", h->nonce_window / 1000000);
+    }
+    defer_digest = getenv("CCND_DEFER_DIGEST");
+    if (defer_digest != NULL && defer_digest[0] != 0) {
+        h->digest_deferred = (atoi(defer_digest) != 0);
+        ccnd_msg(h, "CCND_DEFER_DIGEST=%d", h->digest_deferred);
+    }
     ccnd_msg(h, "CCND_DEBUG=%d CCND_CAP=%lu", h->debug, h->capacity);
     if (autoreg != NULL && autoreg[0] != 0) {
         h->autoreg = ccnd_parse_uri_list(h, "CCND_AUTOREG", autoreg);
@@ -4924,6 +6844,9 @@ ccnd_create(const char *progname, ccnd_logger logger, void *loggerdata)
     ccnd_listen_on(h, listen_on);
     clean_needed(h);
     age_forwarding_needed(h);
+    if (h->nonce_filter != NULL)
+        h->age_nonces = ccn_schedule_event(h->sched, h->nonce_window,
+                                           age_nonces, NULL, 0);
     ccnd_internal_client_start(h);
     free(sockname);
     sockname = NULL;
@@ -4957,20 +6880,37 @@ ccnd_destroy(struct ccnd_handle **pccnd)
     struct ccnd_handle *h = *pccnd;
     if (h == NULL)
         return;
+    ccnd_flush_dgrams(h);
     ccnd_shutdown_listeners(h);
     ccnd_internal_client_stop(h);
     ccn_schedule_destroy(&h->sched);
+    fresh_destroy(&h->fresh);
     hashtb_destroy(&h->dgram_faces);
     hashtb_destroy(&h->faces_by_fd);
     hashtb_destroy(&h->content_tab);
     hashtb_destroy(&h->propagating_tab);
     hashtb_destroy(&h->nameprefix_tab);
+    hashtb_destroy(&h->pit_tab);
+    ccnd_nonce_filter_destroy(&h->nonce_filter);
+    ccn_nametrie_destroy(&h->nameprefix_trie);
     hashtb_destroy(&h->sparse_straggler_tab);
+    ccn_slab_destroy(&h->slab);
     if (h->fds != NULL) {
         free(h->fds);
         h->fds = NULL;
         h->nfds = 0;
     }
+    if (h->epfd != -1) {
+        close(h->epfd);
+        h->epfd = -1;
+    }
+    if (h->epev != NULL) {
+        free(h->epev);
+        h->epev = NULL;
+        h->nepev = 0;
+    }
+    dgram_ring_destroy(&h->dgram_in);
+    dgram_ring_destroy(&h->dgram_out);
     if (h->faces_by_faceid != NULL) {
         free(h->faces_by_faceid);
         h->faces_by_faceid = NULL;
@@ -4984,6 +6924,8 @@ ccnd_destroy(struct ccnd_handle **pccnd)
     ccn_charbuf_destroy(&h->scratch_charbuf);
     ccn_charbuf_destroy(&h->autoreg);
     ccn_indexbuf_destroy(&h->skiplinks);
+    ccnd_content_tree_destroy(&h->ctree);
+    ccnd_cs_policy_destroy(&h->cs_policy);
     ccn_indexbuf_destroy(&h->scratch_indexbuf);
     ccn_indexbuf_destroy(&h->unsol);
     if (h->face0 != NULL) {
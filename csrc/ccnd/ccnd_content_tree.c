@@ -0,0 +1,697 @@
+/**
+ * @file ccnd_content_tree.c
+ *
+ * Name-ordered index of the content store, kept as a B+tree.
+ *
+ * Part of ccnd - the CCNx Daemon.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * This is an alternative to the skiplist for keeping the content store
+ * in name order.
+ *
+ * The keys are flatnames (see ccn/btree_content.h), so plain lexical
+ * comparison gives the canonical ordering of names.  Leaf nodes hold
+ * pointers to the content entries, and each content entry points back
+ * at its leaf so that stepping to the next entry is cheap.  Interior
+ * nodes hold separator keys that have been cut down to the shortest
+ * prefix that still separates the neighboring subtrees.  Duplicate names
+ * are allowed, so a separator is not less than any key to its left, and
+ * not greater than any key to its right.
+ *
+ * To keep most comparisons within the node, each node also holds an
+ * abbreviated key for every slot: the 8 bytes that follow the prefix that
+ * is common to all of the keys in the node.  The full key is consulted only
+ * when the abbreviated keys are equal.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ccnd_private.h"
+
+#define CT_FANOUT 32    /**< maximum number of slots in a node */
+#define CT_MAXDEPTH 24  /**< far more than enough */
+
+struct ct_sep {
+    unsigned char *key;
+    size_t size;
+};
+
+struct content_tree_node {
+    struct content_tree_node *parent;
+    struct content_tree_node *prev;     /**< leaves only - left sibling */
+    struct content_tree_node *next;     /**< leaves only - right sibling */
+    struct ct_sep *sep;                 /**< interior only - separators */
+    int leaf;                           /**< nonzero for a leaf */
+    int n;                              /**< number of slots in use */
+    size_t lcp;                         /**< size of prefix common to keys */
+    uint64_t ak[CT_FANOUT + 1];         /**< abbreviated keys */
+    void *p[CT_FANOUT + 1];             /**< content entries or children */
+};
+
+struct content_tree {
+    struct content_tree_node *root;
+    int depth;                          /**< number of levels */
+    unsigned long n;                    /**< number of content entries */
+    unsigned long nodes;                /**< number of nodes */
+};
+
+static struct content_tree_node *
+node_create(struct content_tree *t, int leaf)
+{
+    struct content_tree_node *x;
+
+    x = calloc(1, sizeof(*x));
+    if (x == NULL)
+        return(NULL);
+    x->leaf = leaf;
+    if (!leaf) {
+        x->sep = calloc(CT_FANOUT + 1, sizeof(x->sep[0]));
+        if (x->sep == NULL) {
+            free(x);
+            return(NULL);
+        }
+    }
+    t->nodes++;
+    return(x);
+}
+
+static void
+node_destroy(struct content_tree *t, struct content_tree_node *x)
+{
+    int i;
+
+    if (x->sep != NULL) {
+        for (i = 0; i < x->n; i++)
+            free(x->sep[i].key);
+        free(x->sep);
+    }
+    free(x);
+    t->nodes--;
+}
+
+/**
+ * Get the key for a slot.
+ *
+ * Slot 0 of an interior node has no key.
+ */
+static const unsigned char *
+slot_key(struct content_tree_node *x, int i, size_t *sizep)
+{
+    struct content_entry *content;
+
+    if (x->leaf) {
+        content = x->p[i];
+        *sizep = content->flatname_size;
+        return(content->flatname);
+    }
+    *sizep = x->sep[i].size;
+    return(x->sep[i].key);
+}
+
+/**
+ * Make an abbreviated key from the 8 bytes of key following skip.
+ */
+static uint64_t
+abbrev(const unsigned char *key, size_t size, size_t skip)
+{
+    uint64_t ans = 0;
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        ans <<= 8;
+        if (skip + i < size)
+            ans |= key[skip + i];
+    }
+    return(ans);
+}
+
+/**
+ * Recompute the common prefix and abbreviated keys after a change.
+ */
+static void
+node_rekey(struct content_tree_node *x)
+{
+    const unsigned char *a;
+    const unsigned char *b;
+    const unsigned char *k;
+    size_t asize;
+    size_t bsize;
+    size_t size;
+    size_t i;
+    int lo = x->leaf ? 0 : 1;
+    int j;
+
+    x->lcp = 0;
+    if (x->n <= lo)
+        return;
+    /* Since the keys are in order, the first and last suffice */
+    a = slot_key(x, lo, &asize);
+    b = slot_key(x, x->n - 1, &bsize);
+    for (i = 0; i < asize && i < bsize && a[i] == b[i]; i++)
+        continue;
+    x->lcp = i;
+    for (j = lo; j < x->n; j++) {
+        k = slot_key(x, j, &size);
+        x->ak[j] = abbrev(k, size, x->lcp);
+    }
+}
+
+/**
+ * Compare key against the common prefix of the node.
+ *
+ * @returns -1 if key is less than all of the node's keys, 1 if it is
+ *          greater than all of them, or 0 if the key has the common
+ *          prefix, so that the abbreviated keys may be used.
+ */
+static int
+prefix_check(struct content_tree_node *x, const unsigned char *key, size_t size)
+{
+    const unsigned char *k;
+    size_t ksize;
+    size_t m;
+    int res;
+
+    if (x->lcp == 0)
+        return(0);
+    k = slot_key(x, x->leaf ? 0 : 1, &ksize);
+    m = (size < x->lcp) ? size : x->lcp;
+    res = memcmp(key, k, m);
+    if (res != 0)
+        return((res < 0) ? -1 : 1);
+    if (size < x->lcp)
+        return(-1);
+    return(0);
+}
+
+/**
+ * Compare key with the key in slot i, given the abbreviated form of key.
+ *
+ * Only valid if prefix_check() has returned 0.
+ * @returns negative, zero, or positive as key is less than, equal to,
+ *          or greater than the key in slot i.
+ */
+static int
+slot_compare(struct content_tree_node *x, int i,
+             const unsigned char *key, size_t size, uint64_t kak)
+{
+    const unsigned char *k;
+    size_t ksize;
+    size_t skip;
+    size_t m;
+    int res;
+
+    if (kak != x->ak[i])
+        return((kak < x->ak[i]) ? -1 : 1);
+    k = slot_key(x, i, &ksize);
+    skip = x->lcp + 8;
+    m = (size < ksize) ? size : ksize;
+    if (skip < m) {
+        res = memcmp(key + skip, k + skip, m - skip);
+        if (res != 0)
+            return(res);
+    }
+    if (size == ksize)
+        return(0);
+    return((size < ksize) ? -1 : 1);
+}
+
+/**
+ * Find the index of the first entry in a leaf that is not less than key.
+ */
+static int
+leaf_lower_bound(struct content_tree_node *x,
+                 const unsigned char *key, size_t size)
+{
+    uint64_t kak;
+    int lo;
+    int hi;
+    int mid;
+    int res;
+
+    res = prefix_check(x, key, size);
+    if (res != 0)
+        return((res < 0) ? 0 : x->n);
+    kak = abbrev(key, size, x->lcp);
+    for (lo = 0, hi = x->n; lo < hi;) {
+        mid = (lo + hi) / 2;
+        if (slot_compare(x, mid, key, size, kak) > 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return(lo);
+}
+
+/**
+ * Choose the child of an interior node whose subtree should hold key.
+ *
+ * This is the last child whose separator is less than key.  Because
+ * entries with equal names may straddle a separator, the caller may
+ * need to continue into the following leaf.
+ */
+static int
+interior_child(struct content_tree_node *x,
+               const unsigned char *key, size_t size)
+{
+    uint64_t kak;
+    int lo;
+    int hi;
+    int mid;
+    int res;
+
+    if (x->n <= 1)
+        return(0);
+    res = prefix_check(x, key, size);
+    if (res != 0)
+        return((res < 0) ? 0 : x->n - 1);
+    kak = abbrev(key, size, x->lcp);
+    for (lo = 1, hi = x->n; lo < hi;) {
+        mid = (lo + hi) / 2;
+        if (slot_compare(x, mid, key, size, kak) > 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return(lo - 1);
+}
+
+static struct content_tree_node *
+find_leaf(struct content_tree *t, const unsigned char *key, size_t size)
+{
+    struct content_tree_node *x = t->root;
+
+    while (x != NULL && !x->leaf)
+        x = x->p[interior_child(x, key, size)];
+    return(x);
+}
+
+static int
+child_index(struct content_tree_node *parent, struct content_tree_node *x)
+{
+    int j;
+
+    for (j = 0; j < parent->n; j++)
+        if (parent->p[j] == x)
+            return(j);
+    abort();
+}
+
+/**
+ * Nodes and separator storage reserved for an insertion, so that
+ * running out of memory midway does not leave the tree damaged.
+ */
+struct ct_reserve {
+    int n;
+    int used;
+    struct content_tree_node *node[CT_MAXDEPTH + 1];
+    struct ct_sep sep;
+};
+
+static struct content_tree_node *
+take_node(struct ct_reserve *r)
+{
+    /* Reserved from the leaf upward, and used in that order */
+    if (r->used >= r->n)
+        abort();
+    return(r->node[r->used++]);
+}
+
+/**
+ * Split a node that has overflowed, adding the new right half to the parent.
+ */
+static void
+split_node(struct content_tree *t, struct content_tree_node *x,
+           struct ct_reserve *r)
+{
+    struct content_tree_node *y;
+    struct content_tree_node *parent;
+    struct content_entry *content;
+    struct ct_sep sep;
+    int half = x->n / 2;
+    int m = x->n - half;
+    int i;
+    int j;
+
+    y = take_node(r);
+    y->leaf = x->leaf;
+    if (x->leaf) {
+        memcpy(y->p, x->p + half, m * sizeof(x->p[0]));
+        for (i = 0; i < m; i++) {
+            content = y->p[i];
+            content->ctnode = y;
+        }
+        y->next = x->next;
+        if (y->next != NULL)
+            y->next->prev = y;
+        y->prev = x;
+        x->next = y;
+        sep = r->sep;
+        r->sep.key = NULL;
+    }
+    else {
+        /* The first separator of the right half moves up */
+        sep = x->sep[half];
+        memcpy(y->p, x->p + half, m * sizeof(x->p[0]));
+        memcpy(y->sep + 1, x->sep + half + 1, (m - 1) * sizeof(x->sep[0]));
+        memset(x->sep + half, 0, m * sizeof(x->sep[0]));
+        for (i = 0; i < m; i++)
+            ((struct content_tree_node *)y->p[i])->parent = y;
+    }
+    y->n = m;
+    x->n = half;
+    node_rekey(x);
+    node_rekey(y);
+    parent = x->parent;
+    if (parent == NULL) {
+        parent = take_node(r);
+        parent->p[0] = x;
+        parent->n = 1;
+        x->parent = parent;
+        t->root = parent;
+        t->depth++;
+    }
+    j = child_index(parent, x) + 1;
+    memmove(parent->p + j + 1, parent->p + j, (parent->n - j) * sizeof(parent->p[0]));
+    memmove(parent->sep + j + 1, parent->sep + j, (parent->n - j) * sizeof(parent->sep[0]));
+    parent->p[j] = y;
+    parent->sep[j] = sep;
+    parent->n++;
+    y->parent = parent;
+    node_rekey(parent);
+    if (parent->n > CT_FANOUT)
+        split_node(t, parent, r);
+}
+
+/**
+ * Make the shortest prefix of b that is greater than a.
+ *
+ * Requires a <= b.  The result lies in the half-open interval (a, b],
+ * or is equal to both if they are the same.
+ */
+static int
+make_separator(struct ct_sep *ans,
+               const unsigned char *a, size_t asize,
+               const unsigned char *b, size_t bsize)
+{
+    size_t i;
+
+    for (i = 0; i < asize && i < bsize && a[i] == b[i]; i++)
+        continue;
+    ans->size = (i < bsize) ? i + 1 : bsize;
+    ans->key = malloc(ans->size);
+    if (ans->key == NULL)
+        return(-1);
+    memcpy(ans->key, b, ans->size);
+    return(0);
+}
+
+/**
+ * Reserve what a leaf split will need, if the insertion at index i of
+ * leaf x is going to cause one.
+ */
+static int
+reserve_for_insert(struct content_tree *t, struct content_tree_node *x,
+                   int i, struct content_entry *content, struct ct_reserve *r)
+{
+    struct content_tree_node *y;
+    struct content_entry *a;
+    struct content_entry *b;
+    int half;
+
+    r->n = 0;
+    r->used = 0;
+    r->sep.key = NULL;
+    r->sep.size = 0;
+    if (x->n < CT_FANOUT)
+        return(0);
+    /* One node for each level that splits, plus maybe a new root */
+    for (y = x; y != NULL && y->n >= CT_FANOUT; y = y->parent) {
+        if (r->n >= CT_MAXDEPTH)
+            goto Bail;
+        r->node[r->n] = node_create(t, y->leaf);
+        if (r->node[r->n++] == NULL)
+            goto Bail;
+    }
+    if (y == NULL) {
+        r->node[r->n] = node_create(t, 0);
+        if (r->node[r->n++] == NULL)
+            goto Bail;
+    }
+    /* The leaf will split between these two, counting the new entry */
+    half = (x->n + 1) / 2;
+    a = (half - 1 < i) ? x->p[half - 1] : (half - 1 == i) ? content : x->p[half - 2];
+    b = (half < i) ? x->p[half] : (half == i) ? content : x->p[half - 1];
+    if (make_separator(&r->sep, a->flatname, a->flatname_size,
+                       b->flatname, b->flatname_size) < 0)
+        goto Bail;
+    return(0);
+Bail:
+    while (r->n > 0) {
+        y = r->node[--r->n];
+        if (y != NULL)
+            node_destroy(t, y);
+    }
+    return(-1);
+}
+
+/**
+ * Create an empty content tree.
+ */
+struct content_tree *
+ccnd_content_tree_create(void)
+{
+    struct content_tree *t;
+
+    t = calloc(1, sizeof(*t));
+    return(t);
+}
+
+static void
+destroy_subtree(struct content_tree *t, struct content_tree_node *x)
+{
+    struct content_entry *content;
+    int i;
+
+    for (i = 0; i < x->n; i++) {
+        if (x->leaf) {
+            content = x->p[i];
+            content->ctnode = NULL;
+        }
+        else
+            destroy_subtree(t, x->p[i]);
+    }
+    node_destroy(t, x);
+}
+
+/**
+ * Destroy a content tree.
+ *
+ * The content entries themselves are not touched, except to forget
+ * their leaves.
+ */
+void
+ccnd_content_tree_destroy(struct content_tree **pt)
+{
+    struct content_tree *t = *pt;
+
+    if (t == NULL)
+        return;
+    if (t->root != NULL)
+        destroy_subtree(t, t->root);
+    free(t);
+    *pt = NULL;
+}
+
+/**
+ * Add a content entry to the tree.
+ *
+ * The entry's flatname must already be set up.
+ * @returns 0 for success, -1 for failure (ENOMEM).
+ */
+int
+ccnd_content_tree_insert(struct content_tree *t, struct content_entry *content)
+{
+    struct content_tree_node *x;
+    struct ct_reserve r;
+    int i;
+
+    if (content->ctnode != NULL)
+        abort();
+    if (t->root == NULL) {
+        t->root = node_create(t, 1);
+        if (t->root == NULL)
+            return(-1);
+        t->depth = 1;
+    }
+    x = find_leaf(t, content->flatname, content->flatname_size);
+    i = leaf_lower_bound(x, content->flatname, content->flatname_size);
+    if (reserve_for_insert(t, x, i, content, &r) < 0)
+        return(-1);
+    memmove(x->p + i + 1, x->p + i, (x->n - i) * sizeof(x->p[0]));
+    x->p[i] = content;
+    x->n++;
+    content->ctnode = x;
+    t->n++;
+    node_rekey(x);
+    if (x->n > CT_FANOUT)
+        split_node(t, x, &r);
+    if (r.used != r.n || r.sep.key != NULL)
+        abort();
+    return(0);
+}
+
+/**
+ * Remove a node that has become empty.
+ */
+static void
+remove_node(struct content_tree *t, struct content_tree_node *x)
+{
+    struct content_tree_node *parent = x->parent;
+    struct content_tree_node *child;
+    int j;
+
+    if (parent == NULL) {
+        if (!x->leaf) {
+            node_destroy(t, x);
+            t->root = NULL;
+            t->depth = 0;
+        }
+        return;
+    }
+    if (x->leaf) {
+        if (x->prev != NULL)
+            x->prev->next = x->next;
+        if (x->next != NULL)
+            x->next->prev = x->prev;
+    }
+    j = child_index(parent, x);
+    if (j == 0 && parent->n > 1) {
+        free(parent->sep[1].key);
+        memmove(parent->sep + 1, parent->sep + 2, (parent->n - 2) * sizeof(parent->sep[0]));
+    }
+    else if (j > 0) {
+        free(parent->sep[j].key);
+        memmove(parent->sep + j, parent->sep + j + 1, (parent->n - j - 1) * sizeof(parent->sep[0]));
+    }
+    memmove(parent->p + j, parent->p + j + 1, (parent->n - j - 1) * sizeof(parent->p[0]));
+    parent->n--;
+    memset(parent->sep + parent->n, 0, sizeof(parent->sep[0]));
+    node_destroy(t, x);
+    if (parent->n == 0) {
+        remove_node(t, parent);
+        return;
+    }
+    node_rekey(parent);
+    /* Shrink the tree from the top when possible */
+    while (t->root != NULL && !t->root->leaf && t->root->n == 1) {
+        child = t->root->p[0];
+        child->parent = NULL;
+        t->root->n = 0;
+        node_destroy(t, t->root);
+        t->root = child;
+        t->depth--;
+    }
+}
+
+/**
+ * Remove a content entry from the tree.
+ *
+ * Underfull nodes are left alone; only empty ones are removed.
+ */
+void
+ccnd_content_tree_remove(struct content_tree *t, struct content_entry *content)
+{
+    struct content_tree_node *x = content->ctnode;
+    int i;
+
+    if (x == NULL)
+        return;
+    for (i = 0; i < x->n && x->p[i] != content; i++)
+        continue;
+    if (i == x->n)
+        abort();
+    memmove(x->p + i, x->p + i + 1, (x->n - i - 1) * sizeof(x->p[0]));
+    x->n--;
+    content->ctnode = NULL;
+    t->n--;
+    /* Even an emptied root leaf must drop its stale common prefix */
+    node_rekey(x);
+    if (x->n == 0)
+        remove_node(t, x);
+}
+
+/**
+ * Find the first content entry with a name that is not less than the
+ * given flatname.
+ * @returns the entry, or NULL if there is none.
+ */
+struct content_entry *
+ccnd_content_tree_lookup_ge(struct content_tree *t,
+                            const unsigned char *flatname, size_t size)
+{
+    struct content_tree_node *x;
+    int i;
+
+    x = find_leaf(t, flatname, size);
+    if (x == NULL)
+        return(NULL);
+    i = leaf_lower_bound(x, flatname, size);
+    if (i == x->n) {
+        x = x->next;
+        i = 0;
+    }
+    if (x == NULL || x->n == 0)
+        return(NULL);
+    return(x->p[i]);
+}
+
+/**
+ * Step to the next content entry in name order.
+ * @returns the entry, or NULL if there is none.
+ */
+struct content_entry *
+ccnd_content_tree_next(struct content_tree *t, struct content_entry *content)
+{
+    struct content_tree_node *x;
+    int i;
+
+    x = content->ctnode;
+    if (x == NULL)
+        return(NULL);
+    for (i = 0; i < x->n && x->p[i] != content; i++)
+        continue;
+    if (i + 1 < x->n)
+        return(x->p[i + 1]);
+    x = x->next;
+    if (x == NULL || x->n == 0)
+        return(NULL);
+    return(x->p[0]);
+}
+
+/**
+ * Report the size of the tree.
+ */
+void
+ccnd_content_tree_stats(struct content_tree *t, unsigned long *nodes,
+                        int *depth)
+{
+    *nodes = t->nodes;
+    *depth = t->depth;
+}
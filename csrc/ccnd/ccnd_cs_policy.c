@@ -0,0 +1,473 @@
+/**
+ * @file ccnd_cs_policy.c
+ *
+ * Replacement policies for the ccnd content store.
+ *
+ * Part of ccnd - the CCNx Daemon.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * A replacement policy is told when content is admitted to the store,
+ * when it is used to answer an interest, and when it goes away.  When the
+ * store is over capacity, the cleaner asks the policy for a victim.
+ *
+ * The policies keep their state in the content entries (cs_prev, cs_next,
+ * cs_list and cs_ref), so they need no allocation per entry.
+ *
+ *  lru     - least recently used.
+ *  clock   - second chance, an inexpensive approximation to lru.
+ *  tinylfu - W-TinyLFU.  New content enters a small lru window.
+ *            When the window overflows, its oldest entry must compete
+ *            with the lru victim of the main segmented lru area, and
+ *            the one that has been requested less often (according to
+ *            a small, aging count-min sketch of name hashes) is evicted.
+ *            This keeps a burst of one-time requests (for example, a
+ *            long sequential fetch) from flushing popular content.
+ *            The areas are sized from the number of entries resident
+ *            when a victim is wanted, so the policy works the same
+ *            whether the store is limited by count or by bytes.
+ *
+ * Content marked precious is never admitted, so it is never chosen.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ccnd_private.h"
+
+#define CS_NLISTS 4
+#define CS_SKETCH_DEPTH 4
+#define CS_COUNT_MAX 15
+#define CS_SKETCH_MIN 64
+#define CS_SKETCH_MAX (1UL << 20)
+
+/* List numbers, as kept in content->cs_list */
+#define CS_MAIN         1   /**< lru and clock use just this one */
+#define CS_WINDOW       2   /**< tinylfu admission window */
+#define CS_PROBATION    3   /**< tinylfu main area, seen once */
+#define CS_PROTECTED    4   /**< tinylfu main area, seen again */
+
+struct cs_list {
+    struct content_entry *head; /**< most recently inserted */
+    struct content_entry *tail; /**< next in line for eviction */
+    unsigned long n;
+};
+
+/**
+ * Aging count-min sketch of request frequencies, with 4-bit counters
+ */
+struct cs_sketch {
+    unsigned char *count;       /**< CS_SKETCH_DEPTH rows */
+    unsigned width;             /**< counters per row, a power of 2 */
+    unsigned long samples;      /**< increments since last aging */
+    unsigned long sample_limit; /**< when to age */
+};
+
+struct ccnd_cs_policy;
+
+struct cs_policy_ops {
+    const char *name;
+    void (*admit)(struct ccnd_cs_policy *, struct content_entry *);
+    void (*hit)(struct ccnd_cs_policy *, struct content_entry *);
+    struct content_entry *(*victim)(struct ccnd_cs_policy *);
+};
+
+struct ccnd_cs_policy {
+    const struct cs_policy_ops *ops;
+    unsigned long capacity;     /**< entry limit, if any */
+    struct cs_list list[CS_NLISTS + 1];
+    struct cs_sketch sketch;
+    unsigned long window_max;   /**< tinylfu target window size */
+    unsigned long main_max;     /**< tinylfu target main area size */
+    unsigned long protected_max; /**< tinylfu target protected size */
+};
+
+static void
+list_unlink(struct ccnd_cs_policy *p, struct content_entry *content)
+{
+    struct cs_list *l = &p->list[content->cs_list];
+
+    if (content->cs_prev != NULL)
+        content->cs_prev->cs_next = content->cs_next;
+    else
+        l->head = content->cs_next;
+    if (content->cs_next != NULL)
+        content->cs_next->cs_prev = content->cs_prev;
+    else
+        l->tail = content->cs_prev;
+    content->cs_prev = content->cs_next = NULL;
+    content->cs_list = 0;
+    l->n--;
+}
+
+static void
+list_push(struct ccnd_cs_policy *p, int which, struct content_entry *content)
+{
+    struct cs_list *l = &p->list[which];
+
+    content->cs_prev = NULL;
+    content->cs_next = l->head;
+    if (l->head != NULL)
+        l->head->cs_prev = content;
+    else
+        l->tail = content;
+    l->head = content;
+    content->cs_list = which;
+    l->n++;
+}
+
+static void
+list_move(struct ccnd_cs_policy *p, int which, struct content_entry *content)
+{
+    list_unlink(p, content);
+    list_push(p, which, content);
+}
+
+/* lru */
+
+static void
+lru_admit(struct ccnd_cs_policy *p, struct content_entry *content)
+{
+    list_push(p, CS_MAIN, content);
+}
+
+static void
+lru_hit(struct ccnd_cs_policy *p, struct content_entry *content)
+{
+    list_move(p, CS_MAIN, content);
+}
+
+static struct content_entry *
+lru_victim(struct ccnd_cs_policy *p)
+{
+    return(p->list[CS_MAIN].tail);
+}
+
+/* clock */
+
+static void
+clock_hit(struct ccnd_cs_policy *p, struct content_entry *content)
+{
+    content->cs_ref = 1;
+}
+
+static struct content_entry *
+clock_victim(struct ccnd_cs_policy *p)
+{
+    struct content_entry *content;
+
+    /* Terminates, since the sweep clears the reference bits */
+    for (;;) {
+        content = p->list[CS_MAIN].tail;
+        if (content == NULL || !content->cs_ref)
+            return(content);
+        content->cs_ref = 0;
+        list_move(p, CS_MAIN, content);
+    }
+}
+
+/* tinylfu */
+
+/**
+ * Hash the name (without the implicit digest) of a content entry.
+ *
+ * The last comps entry ends the digest component, so stop at the one
+ * before.  That way the hash is the same whether or not the digest
+ * has been computed yet.
+ */
+static uint64_t
+name_hash(struct content_entry *content)
+{
+    const unsigned char *s = content->key + content->comps[0];
+    size_t n = content->comps[content->ncomps - 2] - content->comps[0];
+    uint64_t h = 14695981039346656037ULL;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        h ^= s[i];
+        h *= 1099511628211ULL;
+    }
+    return(h);
+}
+
+static unsigned char *
+sketch_counter(struct cs_sketch *s, uint64_t hash, int row)
+{
+    uint32_t lo = (uint32_t)hash;
+    uint32_t hi = (uint32_t)(hash >> 32) | 1;
+
+    return(&s->count[row * s->width + ((lo + row * hi) & (s->width - 1))]);
+}
+
+static unsigned
+sketch_estimate(struct cs_sketch *s, uint64_t hash)
+{
+    unsigned ans = CS_COUNT_MAX;
+    unsigned c;
+    int i;
+
+    for (i = 0; i < CS_SKETCH_DEPTH; i++) {
+        c = *sketch_counter(s, hash, i);
+        if (c < ans)
+            ans = c;
+    }
+    return(ans);
+}
+
+static void
+sketch_increment(struct cs_sketch *s, uint64_t hash)
+{
+    unsigned min = sketch_estimate(s, hash);
+    unsigned char *c;
+    unsigned i;
+
+    if (min >= CS_COUNT_MAX)
+        return;
+    /* Conservative update - only bump the smallest counters */
+    for (i = 0; i < CS_SKETCH_DEPTH; i++) {
+        c = sketch_counter(s, hash, i);
+        if (*c == min)
+            *c += 1;
+    }
+    if (++(s->samples) >= s->sample_limit) {
+        /* Age everything, so that old popularity fades */
+        for (i = 0; i < CS_SKETCH_DEPTH * s->width; i++)
+            s->count[i] >>= 1;
+        s->samples /= 2;
+    }
+}
+
+/**
+ * Double the width of the sketch.
+ *
+ * Each counter is copied to both of the places its hashes may now
+ * land, so no estimate goes down.
+ */
+static int
+sketch_grow(struct cs_sketch *s)
+{
+    unsigned char *count;
+    unsigned w = s->width;
+    int i;
+
+    count = malloc(CS_SKETCH_DEPTH * 2 * w);
+    if (count == NULL)
+        return(-1);
+    for (i = 0; i < CS_SKETCH_DEPTH; i++) {
+        memcpy(count + 2 * i * w, s->count + i * w, w);
+        memcpy(count + 2 * i * w + w, s->count + i * w, w);
+    }
+    free(s->count);
+    s->count = count;
+    s->width = 2 * w;
+    s->sample_limit = 10UL * s->width;
+    return(0);
+}
+
+/**
+ * Set the tinylfu area targets for a store that should hold n entries.
+ */
+static void
+tinylfu_size(struct ccnd_cs_policy *p, unsigned long n)
+{
+    if (n > p->capacity)
+        n = p->capacity;
+    p->window_max = n / 100 + 1;
+    p->main_max = n - p->window_max;
+    if (n <= p->window_max)
+        p->main_max = 1;
+    p->protected_max = p->main_max - p->main_max / 5;
+}
+
+static void
+tinylfu_admit(struct ccnd_cs_policy *p, struct content_entry *content)
+{
+    unsigned long n;
+
+    list_push(p, CS_WINDOW, content);
+    /* Keep enough counters for the store, within reason */
+    n = p->list[CS_WINDOW].n + p->list[CS_PROBATION].n +
+        p->list[CS_PROTECTED].n;
+    if (n > p->sketch.width && p->sketch.width < CS_SKETCH_MAX)
+        sketch_grow(&p->sketch);
+    sketch_increment(&p->sketch, name_hash(content));
+}
+
+static void
+tinylfu_hit(struct ccnd_cs_policy *p, struct content_entry *content)
+{
+    struct content_entry *demoted;
+
+    sketch_increment(&p->sketch, name_hash(content));
+    if (content->cs_list == CS_WINDOW) {
+        list_move(p, CS_WINDOW, content);
+        return;
+    }
+    list_move(p, CS_PROTECTED, content);
+    if (p->list[CS_PROTECTED].n > p->protected_max) {
+        demoted = p->list[CS_PROTECTED].tail;
+        list_move(p, CS_PROBATION, demoted);
+    }
+}
+
+static struct content_entry *
+tinylfu_victim(struct ccnd_cs_policy *p)
+{
+    struct content_entry *candidate;
+    struct content_entry *victim;
+    unsigned long nmain;
+
+    nmain = p->list[CS_PROBATION].n + p->list[CS_PROTECTED].n;
+    if (nmain + p->list[CS_WINDOW].n == 0)
+        return(NULL);
+    /* The store is over its limit, so it should hold one entry fewer */
+    tinylfu_size(p, nmain + p->list[CS_WINDOW].n - 1);
+    while (p->list[CS_WINDOW].n > p->window_max && nmain < p->main_max) {
+        list_move(p, CS_PROBATION, p->list[CS_WINDOW].tail);
+        nmain++;
+    }
+    /* Now one area or the other is over; its entry must compete */
+    candidate = p->list[CS_WINDOW].tail;
+    victim = p->list[CS_PROBATION].tail;
+    if (victim == NULL)
+        victim = p->list[CS_PROTECTED].tail;
+    if (candidate == NULL)
+        return(victim);
+    if (victim == NULL)
+        return(candidate);
+    if (sketch_estimate(&p->sketch, name_hash(candidate)) <=
+        sketch_estimate(&p->sketch, name_hash(victim)))
+        return(candidate);
+    list_move(p, CS_PROBATION, candidate);
+    return(victim);
+}
+
+static const struct cs_policy_ops cs_policies[] = {
+    {"lru", &lru_admit, &lru_hit, &lru_victim},
+    {"clock", &lru_admit, &clock_hit, &clock_victim},
+    {"tinylfu", &tinylfu_admit, &tinylfu_hit, &tinylfu_victim},
+    {NULL, NULL, NULL, NULL}
+};
+
+/**
+ * Create a replacement policy, given its name.
+ *
+ * @param capacity is the number of content entries the store may hold,
+ *        or ~0 if it is limited only by bytes (or not at all).
+ * @returns the new policy, or NULL if the name is not known or
+ *          there is no memory.
+ */
+struct ccnd_cs_policy *
+ccnd_cs_policy_create(const char *name, unsigned long capacity)
+{
+    struct ccnd_cs_policy *p;
+    int i;
+
+    for (i = 0; cs_policies[i].name != NULL; i++)
+        if (strcmp(name, cs_policies[i].name) == 0)
+            break;
+    if (cs_policies[i].name == NULL)
+        return(NULL);
+    p = calloc(1, sizeof(*p));
+    if (p == NULL)
+        return(NULL);
+    p->ops = &cs_policies[i];
+    p->capacity = capacity;
+    if (p->ops->admit == &tinylfu_admit) {
+        /* Resized from the resident count once eviction starts */
+        tinylfu_size(p, capacity);
+        /* Enough counters for the store, within reason; grown if need be */
+        p->sketch.width = CS_SKETCH_MIN;
+        if (capacity != ~0UL)
+            while (p->sketch.width < capacity && p->sketch.width < CS_SKETCH_MAX)
+                p->sketch.width *= 2;
+        p->sketch.sample_limit = 10UL * p->sketch.width;
+        p->sketch.count = calloc(CS_SKETCH_DEPTH, p->sketch.width);
+        if (p->sketch.count == NULL) {
+            free(p);
+            return(NULL);
+        }
+    }
+    return(p);
+}
+
+/**
+ * Destroy a replacement policy.
+ *
+ * The content entries should already be gone.
+ */
+void
+ccnd_cs_policy_destroy(struct ccnd_cs_policy **pp)
+{
+    struct ccnd_cs_policy *p = *pp;
+
+    if (p == NULL)
+        return;
+    free(p->sketch.count);
+    free(p);
+    *pp = NULL;
+}
+
+const char *
+ccnd_cs_policy_name(struct ccnd_cs_policy *p)
+{
+    return(p->ops->name);
+}
+
+/**
+ * Note the arrival of new content.
+ */
+void
+ccnd_cs_policy_admit(struct ccnd_cs_policy *p, struct content_entry *content)
+{
+    if (content->cs_list != 0)
+        abort();
+    content->cs_ref = 0;
+    (p->ops->admit)(p, content);
+}
+
+/**
+ * Note that content has been used to satisfy an interest.
+ */
+void
+ccnd_cs_policy_hit(struct ccnd_cs_policy *p, struct content_entry *content)
+{
+    if (content->cs_list != 0)
+        (p->ops->hit)(p, content);
+}
+
+/**
+ * Forget about content that is going away.
+ */
+void
+ccnd_cs_policy_remove(struct ccnd_cs_policy *p, struct content_entry *content)
+{
+    if (content->cs_list != 0)
+        list_unlink(p, content);
+}
+
+/**
+ * Choose content to evict.
+ *
+ * The victim stays in place until the caller removes it.
+ * @returns the victim, or NULL if there is nothing that may be evicted.
+ */
+struct content_entry *
+ccnd_cs_policy_victim(struct ccnd_cs_policy *p)
+{
+    return((p->ops->victim)(p));
+}
@@ -168,4 +168,26 @@ const char *ccnd_usage_message =
     "    CCND_AUTOREG=\n"
     "      List of prefixes to auto-register on new faces initiated by peers\n"
     "      example: CCND_AUTOREG=ccnx:/like/this,ccnx:/and/this\n"
+    "    CCND_POLL_METHOD=\n"
+    "      epoll (default, where available) or poll\n"
+    "    CCND_DGRAM_BATCH=\n"
+    "      Max datagrams per receive or send system call (default 32)\n"
+    "    CCND_SEND_BURST=\n"
+    "      Max content objects sent to a face per wakeup (default 16)\n"
+    "    CCND_SEND_BURST_BYTES=\n"
+    "      Max content bytes sent to a face per wakeup (default 65536)\n"
+    "    CCND_CONTENT_INDEX=\n"
+    "      Name-ordered content index: skiplist (default) or btree\n"
+    "    CCND_CAP_BYTES=\n"
+    "      Content store memory budget in bytes; K, M, G suffixes allowed\n"
+    "    CCND_CS_POLICY=\n"
+    "      Content store replacement: fifo (default), lru, clock, or tinylfu\n"
+    "    CCND_SLAB=\n"
+    "      Set to 0 to use malloc instead of slabs for content entries\n"
+    "    CCND_SCHEDULE=\n"
+    "      Event scheduler: heap (default) or wheel\n"
+    "    CCND_NONCE_WINDOW=\n"
+    "      Seconds to remember interest nonces for duplicate detection (default 8)\n"
+    "    CCND_DEFER_DIGEST=\n"
+    "      Set to 1 to compute content digests only when an interest needs one\n"
     ;
@@ -0,0 +1,293 @@
+/**
+ * @file ccnd_nonce.c
+ *
+ * Duplicate interest nonce detection for ccnd.
+ *
+ * Part of ccnd - the CCNx Daemon.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * The nonce filter remembers recently seen nonces, so that looping or
+ * flooded copies of an interest can be recognized after its propagating
+ * entry has gone away.
+ *
+ * It is made of cuckoo filters holding 16-bit fingerprints, four to a
+ * bucket.  New nonces go into the current generation.  Each time the
+ * filter is aged, the older generation is discarded and a fresh one
+ * takes its place, so a nonce is remembered for between one and two
+ * aging periods.  The fresh generation is sized from the count in the
+ * one it follows.  If it fills up anyway, it gets another filter of
+ * twice the size, and lookups check both.
+ *
+ * A nonce that was never seen is reported as seen with a probability
+ * of about 8 / 65536 per filter at full load, less when lightly loaded.
+ * A nonce that was seen within the aging period is always reported.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ccn/hashtb.h>
+
+#include "ccnd_private.h"
+
+#define NONCE_SLOTS 4           /**< fingerprints per bucket */
+#define NONCE_MIN_BUCKETS 256
+#define NONCE_MAX_KICKS 128
+
+struct nonce_seg {
+    struct nonce_seg *next;     /**< older, smaller filter of the generation */
+    unsigned nb;                /**< buckets, a power of 2 */
+    unsigned n;                 /**< fingerprints held */
+    uint16_t slot[1];           /**< NONCE_SLOTS per bucket, 0 is empty */
+};
+
+struct ccnd_nonce_filter {
+    struct nonce_seg *gen[2];   /**< current and older generations */
+    int cur;                    /**< index of current generation */
+    unsigned kick;              /**< rover for choosing a victim */
+    unsigned long grown;        /**< filters added because one was full */
+};
+
+static struct nonce_seg *
+seg_create(unsigned nb, struct nonce_seg *next)
+{
+    struct nonce_seg *g;
+    
+    g = calloc(1, sizeof(*g) + (nb * NONCE_SLOTS - 1) * sizeof(g->slot[0]));
+    if (g == NULL)
+        return(NULL);
+    g->nb = nb;
+    g->next = next;
+    return(g);
+}
+
+static void
+gen_destroy(struct nonce_seg **pg)
+{
+    struct nonce_seg *g;
+    
+    while ((g = *pg) != NULL) {
+        *pg = g->next;
+        free(g);
+    }
+}
+
+struct ccnd_nonce_filter *
+ccnd_nonce_filter_create(void)
+{
+    struct ccnd_nonce_filter *f;
+
+    f = calloc(1, sizeof(*f));
+    if (f == NULL)
+        return(NULL);
+    f->gen[0] = seg_create(NONCE_MIN_BUCKETS, NULL);
+    f->gen[1] = seg_create(NONCE_MIN_BUCKETS, NULL);
+    if (f->gen[0] == NULL || f->gen[1] == NULL)
+        ccnd_nonce_filter_destroy(&f);
+    return(f);
+}
+
+void
+ccnd_nonce_filter_destroy(struct ccnd_nonce_filter **pf)
+{
+    struct ccnd_nonce_filter *f = *pf;
+
+    if (f != NULL) {
+        gen_destroy(&f->gen[0]);
+        gen_destroy(&f->gen[1]);
+        free(f);
+        *pf = NULL;
+    }
+}
+
+/**
+ * Hash the nonce into a fingerprint and a bucket hash.
+ */
+static uint16_t
+nonce_hash(const unsigned char *nonce, size_t size, unsigned *bucket)
+{
+    uint64_t x = hashtb_hash(nonce, size);
+    uint16_t fp;
+
+    x ^= x >> 31;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 29;
+    fp = (uint16_t)(x >> 48);
+    *bucket = (unsigned)x;
+    return(fp != 0 ? fp : 1);
+}
+
+/** The other bucket for fp, given one of its buckets */
+#define ALT(g, b, fp) (((b) ^ ((fp) * 0x5bd1e995U)) & ((g)->nb - 1))
+
+static int
+bucket_has(struct nonce_seg *g, unsigned b, uint16_t fp)
+{
+    uint16_t *s = g->slot + b * NONCE_SLOTS;
+
+    return(s[0] == fp || s[1] == fp || s[2] == fp || s[3] == fp);
+}
+
+static int
+bucket_put(struct nonce_seg *g, unsigned b, uint16_t fp)
+{
+    uint16_t *s = g->slot + b * NONCE_SLOTS;
+    int i;
+
+    for (i = 0; i < NONCE_SLOTS; i++) {
+        if (s[i] == 0) {
+            s[i] = fp;
+            g->n++;
+            return(0);
+        }
+    }
+    return(-1);
+}
+
+static int
+gen_has(struct nonce_seg *g, unsigned h, uint16_t fp)
+{
+    unsigned b;
+
+    for (; g != NULL; g = g->next) {
+        b = h & (g->nb - 1);
+        if (bucket_has(g, b, fp) || bucket_has(g, ALT(g, b, fp), fp))
+            return(1);
+    }
+    return(0);
+}
+
+/**
+ * Add a fingerprint to a filter, relocating others as needed.
+ *
+ * If relocation fails, the moves are undone, so that nothing already
+ * held is lost.
+ * @returns 0, or -1 if the filter is too full.
+ */
+static int
+seg_add(struct ccnd_nonce_filter *f, struct nonce_seg *g,
+        unsigned h, uint16_t fp)
+{
+    unsigned b = h & (g->nb - 1);
+    uint16_t *s;
+    uint16_t victim;
+    unsigned path[NONCE_MAX_KICKS];
+    int i;
+    int k;
+
+    if (4 * g->n >= 3 * NONCE_SLOTS * g->nb)
+        return(-1);
+    if (bucket_put(g, b, fp) == 0 || bucket_put(g, ALT(g, b, fp), fp) == 0)
+        return(0);
+    for (k = 0; k < NONCE_MAX_KICKS; k++) {
+        i = (f->kick++) % NONCE_SLOTS;
+        s = g->slot + b * NONCE_SLOTS;
+        path[k] = b * NONCE_SLOTS + i;
+        victim = s[i];
+        s[i] = fp;
+        fp = victim;
+        b = ALT(g, b, fp);
+        if (bucket_put(g, b, fp) == 0)
+            return(0);
+    }
+    /* Put each victim back where it was */
+    while (k-- > 0) {
+        victim = g->slot[path[k]];
+        g->slot[path[k]] = fp;
+        fp = victim;
+    }
+    return(-1);
+}
+
+/**
+ * Check for a recently seen nonce, and remember it.
+ * @returns 1 if the nonce has (probably) been seen, otherwise 0.
+ */
+int
+ccnd_nonce_filter_check(struct ccnd_nonce_filter *f,
+                        const unsigned char *nonce, size_t size)
+{
+    struct nonce_seg *g;
+    unsigned h;
+    uint16_t fp;
+
+    fp = nonce_hash(nonce, size, &h);
+    if (gen_has(f->gen[f->cur], h, fp) || gen_has(f->gen[!f->cur], h, fp))
+        return(1);
+    g = f->gen[f->cur];
+    if (seg_add(f, g, h, fp) < 0) {
+        g = seg_create(2 * g->nb, g);
+        if (g == NULL)
+            return(0);
+        f->gen[f->cur] = g;
+        f->grown++;
+        seg_add(f, g, h, fp);
+    }
+    return(0);
+}
+
+/**
+ * Age the filter; call this once per aging period.
+ *
+ * The new generation gets enough buckets to hold what the outgoing
+ * current one holds, at no more than half load.
+ */
+void
+ccnd_nonce_filter_age(struct ccnd_nonce_filter *f)
+{
+    struct nonce_seg *g;
+    unsigned long n = 0;
+    unsigned nb = NONCE_MIN_BUCKETS;
+
+    for (g = f->gen[f->cur]; g != NULL; g = g->next)
+        n += g->n;
+    while (nb * NONCE_SLOTS < 2 * n)
+        nb *= 2;
+    g = seg_create(nb, NULL);
+    if (g == NULL)
+        return; /* keep the old one rather than have none */
+    gen_destroy(&f->gen[!f->cur]);
+    f->gen[!f->cur] = g;
+    f->cur = !f->cur;
+}
+
+/**
+ * Report the number of nonces held, and the bytes used to hold them.
+ * @returns the number of filters added because one was full.
+ */
+unsigned long
+ccnd_nonce_filter_stats(struct ccnd_nonce_filter *f,
+                        unsigned long *n, unsigned long *bytes)
+{
+    struct nonce_seg *g;
+    unsigned long tn = 0;
+    unsigned long tb = sizeof(*f);
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        for (g = f->gen[i]; g != NULL; g = g->next) {
+            tn += g->n;
+            tb += sizeof(*g) + (g->nb * NONCE_SLOTS - 1) * sizeof(g->slot[0]);
+        }
+    }
+    if (n != NULL)
+        *n = tn;
+    if (bytes != NULL)
+        *bytes = tb;
+    return(f->grown);
+}
@@ -31,6 +31,7 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 
+#include <ccn/ccn.h>
 #include <ccn/ccn_private.h>
 #include <ccn/coding.h>
 #include <ccn/reg_mgmt.h>
@@ -44,6 +45,9 @@
 struct ccn_charbuf;
 struct ccn_indexbuf;
 struct hashtb;
+struct ccn_slab;
+struct ccn_nametrie;
+struct ccn_nametrie_node;
 struct ccnd_meter;
 
 /*
@@ -54,9 +58,19 @@ struct face;
 struct content_entry;
 struct nameprefix_entry;
 struct propagating_entry;
+struct content_tree;
 struct content_tree_node;
+struct ccnd_cs_policy;
+struct ccnd_nonce_filter;
+struct ccnd_freshness;
 struct ccn_forwarding;
 
+/*
+ * Only needed on platforms that have epoll.
+ */
+struct epoll_event;
+struct ccnd_dgram_ring;
+
 //typedef uint_least64_t ccn_accession_t;
 typedef unsigned ccn_accession_t;
 
@@ -71,8 +85,15 @@ struct ccnd_handle {
     struct hashtb *dgram_faces;     /**< keyed by sockaddr */
     struct hashtb *content_tab;     /**< keyed by portion of ContentObject */
     struct hashtb *nameprefix_tab;  /**< keyed by name prefix components */
+    struct ccn_nametrie *nameprefix_trie; /**< nameprefix_tab by component */
     struct hashtb *propagating_tab; /**< keyed by nonce */
+    struct hashtb *pit_tab;         /**< pending interests, minus nonce */
+    struct ccnd_nonce_filter *nonce_filter; /**< recently seen nonces */
+    int nonce_window;               /**< usec between nonce filter agings */
+    int digest_deferred;            /**< content keyed without its digest */
     struct ccn_indexbuf *skiplinks; /**< skiplist for content-ordered ops */
+    struct content_tree *ctree;     /**< alternative to skiplinks, or NULL */
+    struct ccnd_cs_policy *cs_policy; /**< content replacement, or NULL */
     unsigned forward_to_gen;        /**< for forward_to updates */
     unsigned face_gen;              /**< faceid generation number */
     unsigned face_rover;            /**< for faceid allocation */
@@ -82,11 +103,20 @@ struct ccnd_handle {
     struct ccn_scheduled_event *age;
     struct ccn_scheduled_event *clean;
     struct ccn_scheduled_event *age_forwarding;
+    struct ccn_scheduled_event *age_nonces;
     const char *portstr;            /**< "main" port number */
     unsigned ipv4_faceid;           /**< wildcard IPv4, bound to port */
     unsigned ipv6_faceid;           /**< wildcard IPv6, bound to port */
     nfds_t nfds;                    /**< number of entries in fds array */
     struct pollfd *fds;             /**< used for poll system call */
+    int epfd;                       /**< epoll descriptor, or -1 for poll */
+    int nepev;                      /**< number of entries in epev array */
+    struct epoll_event *epev;       /**< used for epoll_wait system call */
+    int dgram_batch;                /**< max datagrams per system call */
+    int send_burst;                 /**< max objects per content_sender run */
+    int send_burst_bytes;           /**< max bytes per content_sender run */
+    struct ccnd_dgram_ring *dgram_in;  /**< buffers for batched receive */
+    struct ccnd_dgram_ring *dgram_out; /**< datagrams awaiting sendmmsg */
     struct ccn_gettime ticktock;    /**< our time generator */
     long sec;                       /**< cached gettime seconds */
     unsigned usec;                  /**< cached gettime microseconds */
@@ -101,12 +131,17 @@ struct ccnd_handle {
     struct content_entry **content_by_accession;
     /** The following holds stragglers that would otherwise bloat the above */
     struct hashtb *sparse_straggler_tab; /* keyed by accession */
+    struct ccn_slab *slab;          /**< storage for content entries */
     ccn_accession_t accession;      /**< newest used accession number */
     ccn_accession_t min_stale;      /**< smallest accession of stale content */
     ccn_accession_t max_stale;      /**< largest accession of stale content */
     unsigned long capacity;         /**< may toss content if there more than
                                      this many content objects in the store */
+    unsigned long long byte_capacity; /**< likewise, for bytes of memory */
+    unsigned long long cs_resident_bytes; /**< sum of content sizes */
+    unsigned long long cs_overhead_bytes; /**< bookkeeping for the content */
     unsigned long n_stale;          /**< Number of stale content objects */
+    struct ccnd_freshness *fresh;   /**< when fresh content goes stale */
     struct ccn_indexbuf *unsol;     /**< unsolicited content */
     unsigned long oldformatcontent;
     unsigned long oldformatcontentgrumble;
@@ -118,6 +153,15 @@ struct ccnd_handle {
     unsigned long interests_dropped;
     unsigned long interests_sent;
     unsigned long interests_stuffed;
+    unsigned long dgram_recv_calls; /**< datagram receive system calls */
+    unsigned long dgram_recv_msgs;  /**< datagrams received */
+    unsigned long dgram_send_calls; /**< datagram send system calls */
+    unsigned long dgram_send_msgs;  /**< datagrams sent */
+    unsigned long long out_direct_bytes; /**< output sent without copying */
+    unsigned long long out_copied_bytes; /**< output copied before sending */
+    unsigned long cs_hits;          /**< interests answered from store */
+    unsigned long cs_misses;        /**< store consulted, no answer */
+    unsigned long cs_evictions;     /**< content removed to make room */
     unsigned short seed[3];         /**< for PRNG */
     int running;                    /**< true while should be running */
     int debug;                      /**< For controlling debug output */
@@ -145,6 +189,32 @@ struct ccnd_handle {
                                     /**< pluggable nonce generation */
 };
 
+/**
+ * Freshness timing wheel.
+ *
+ * Rather than scheduling an event for each ContentObject that has a
+ * FreshnessSeconds, the accessions are kept in buckets by the tick
+ * at which the content goes stale, and a single scheduled event sweeps
+ * the buckets as they come due.  Level 0 has a bucket per tick; level 1
+ * has a bucket per CCND_FRESH_SLOTS ticks, and is cascaded into
+ * level 0 as the wheel turns.  Ticks count from ccnd start time.
+ *
+ * Buckets are not cleaned when content goes away or is freshened again;
+ * a sweep skips any accession whose entry no longer has the bucket's
+ * tick as its stale_tick.
+ */
+#define CCND_FRESH_TICK_USEC 125000
+#define CCND_FRESH_SLOTS 256
+struct ccnd_freshness {
+    unsigned tick;                  /**< next tick to be swept */
+    unsigned long n;                /**< accessions in the buckets */
+    struct ccn_indexbuf *slot[2][CCND_FRESH_SLOTS];
+    struct ccn_scheduled_event *sweeper;
+    unsigned long expired;          /**< content made stale or evicted */
+    unsigned long long lag_usec;    /**< total expiry lag */
+    unsigned lag_max_usec;          /**< worst expiry lag */
+};
+
 /**
  * Each face is referenced by a number, the faceid.  The low-order
  * bits (under the MAXFACES) constitute a slot number that is
@@ -161,9 +231,47 @@ struct content_queue {
     unsigned rand_usec;              /**< randomization range */
     unsigned ready;                  /**< # that have waited enough */
     unsigned nrun;                   /**< # sent since last randomized delay */
-    struct ccn_indexbuf *send_queue; /**< accession numbers of pending content */
+    unsigned head;                   /**< ring index of the oldest entry */
+    unsigned n;                      /**< # of entries in the ring */
+    unsigned size;                   /**< ring capacity, a power of 2 */
+    ccn_accession_t *ring;           /**< accession numbers of pending content */
+    struct ccn_scheduled_event *sender;
+};
+
+/**
+ * Optional output shaping for a face.
+ *
+ * Content leaving the delay-class queues of a shaped face is held here,
+ * in one queue per name prefix (flow).  A token bucket limits the byte
+ * rate, and deficit round robin shares it among the flows.
+ */
+struct ccnd_shaper {
+    unsigned rate;                  /**< bytes per second */
+    unsigned burst;                 /**< bucket depth in bytes */
+    int flowcomps;                  /**< name components that pick a flow */
+    long long tokens;               /**< bytes that may be sent now */
+    long long stamp;                /**< usec when tokens were counted */
+    unsigned qlen;                  /**< objects held, all flows */
+    unsigned qmax;                  /**< high-water mark of qlen */
+    unsigned long long sent;        /**< objects sent */
+    unsigned long long drops;       /**< objects dropped, queue full */
+    struct hashtb *flows;           /**< struct ccnd_flow, keyed by prefix */
+    struct ccnd_flow *head;         /**< next flow to be served */
+    struct ccnd_flow *tail;         /**< last flow in the round */
     struct ccn_scheduled_event *sender;
 };
+#define CCND_SHAPER_QLIMIT 256      /**< max objects held per face */
+#define CCND_SHAPER_QUANTUM 8192    /**< DRR bytes per flow per round */
+#define CCND_FLOW_COMPONENTS 2      /**< name components that pick a flow */
+
+struct ccnd_flow {
+    struct ccnd_flow *next;         /**< round robin link */
+    const unsigned char *key;       /**< name prefix, stored in flows */
+    size_t keysize;
+    int deficit;                    /**< bytes this flow may still send */
+    int turn;                       /**< nonzero once credited this round */
+    struct content_queue q;         /**< held content (only the ring) */
+};
 
 enum cq_delay_class {
     CCN_CQ_ASAP,
@@ -196,10 +304,14 @@ struct face {
     unsigned faceid;            /**< internal face id */
     unsigned recvcount;         /**< for activity level monitoring */
     struct content_queue *q[CCN_CQ_N]; /**< outgoing content, per delay class */
+    struct ccnd_shaper *shaper; /**< rate limit and fairness, or NULL */
+    struct propagating_entry *stuff_head; /**< interests to stuff, oldest first */
+    struct propagating_entry *stuff_tail;
     struct ccn_charbuf *inbuf;
     struct ccn_skeleton_decoder decoder;
     size_t outbufindex;
     struct ccn_charbuf *outbuf;
+    int pollevents;             /**< events registered with epoll, if used */
     const struct sockaddr *addr;
     socklen_t addrlen;
     int pending_interests;
@@ -241,6 +353,11 @@ struct face {
  *  which simplifies the matching logic.
  *  The original ContentObject may be reconstructed simply by excising this
  *  last name component, which is easily located via the comps array.
+ *
+ *  When h->digest_deferred is set, the stored copy is just the on-wire
+ *  form, and the digest component is empty (the last two comps entries
+ *  are equal).  The digest is then computed only when an interest needs
+ *  it, and kept in the digest field.
  */
 struct content_entry {
     ccn_accession_t accession;  /**< assigned in arrival order */
@@ -251,6 +368,16 @@ struct content_entry {
     int key_size;               /**< Size of fragment prior to Content */
     int size;                   /**< Size of ContentObject */
     struct ccn_indexbuf *skiplinks; /**< skiplist for name-ordered ops */
+    unsigned char *flatname;    /**< Name as a flatname, for content_tree */
+    int flatname_size;          /**< Size of flatname */
+    struct content_tree_node *ctnode; /**< content_tree leaf holding us */
+    struct content_entry *cs_prev;  /**< for the replacement policy */
+    struct content_entry *cs_next;  /**< for the replacement policy */
+    unsigned char cs_list;      /**< replacement policy list, 0 if none */
+    unsigned char cs_ref;       /**< used since the policy last looked */
+    unsigned overhead;          /**< memory used beyond size, if counted */
+    unsigned stale_tick;        /**< freshness wheel tick, 0 if none */
+    unsigned char *digest;      /**< deferred digest, once computed */
 };
 
 /**
@@ -259,6 +386,7 @@ struct content_entry {
 #define CCN_CONTENT_ENTRY_SLOWSEND  1
 #define CCN_CONTENT_ENTRY_STALE     2
 #define CCN_CONTENT_ENTRY_PRECIOUS  4
+#define CCN_CONTENT_ENTRY_PINNED    8   /* queued datagrams point into it */
 
 /**
  * The sparse_straggler hash table, keyed by accession, holds scattered
@@ -274,10 +402,13 @@ struct sparse_straggler_entry {
  * While the interest is pending, the pe is also kept in a doubly-linked
  * list off of a nameprefix_entry.
  *
+ * Similar pending interests - those that differ only in their nonces -
+ * are also gathered under a pit_entry, newest first.
+ *
  * When the interest is consumed, the pe is removed from the doubly-linked
- * list and is cleaned up by freeing unnecessary bits (including the interest
- * message itself).  It remains in the hash table for a time, in order to catch
- * duplicate nonces.
+ * lists and is cleaned up by freeing unnecessary bits (including the interest
+ * message itself).  It remains in the hash table until its do_propagate
+ * event next comes around; the nonce filter catches duplicates after that.
  */
 struct propagating_entry {
     struct propagating_entry *next; /**< next (in arrival order) */
@@ -289,7 +420,16 @@ struct propagating_entry {
     struct ccn_indexbuf *outbound; /**< in order of use */
     unsigned char *interest_msg; /**< pending interest message */
     unsigned size;              /**< size in bytes of interest_msg */
+    const unsigned char *nonce; /**< our key in propagating_tab */
+    unsigned noncesize;         /**< size in bytes of nonce */
     int fgen;                   /**< decide if outbound is stale */
+    struct ccn_parsed_interest pi; /**< parse of interest_msg, for matching */
+    struct pit_entry *pit;      /**< similar pending interests, or NULL */
+    struct propagating_entry *pit_older; /**< next in pit list */
+    struct propagating_entry *pit_newer; /**< previous in pit list */
+    struct face *stuff_face;    /**< face whose stuffing queue holds us */
+    struct propagating_entry *stuff_next; /**< next in stuffing queue */
+    struct propagating_entry *stuff_prev; /**< previous in stuffing queue */
 };
 // XXX - with new outbound/sent repr, some of these flags may not be needed.
 #define CCN_PR_UNSENT   0x01 /**< interest has not been sent anywhere yet */
@@ -301,6 +441,18 @@ struct propagating_entry {
 #define CCN_PR_SCOPE1   0x40 /**< interest scope is 1 (this host) */
 #define CCN_PR_SCOPE2   0x80 /**< interest scope is 2 (immediate neighborhood) */
 
+/**
+ * The pending interest table is keyed by the interest message with
+ * its Nonce element cut out.  Each entry gathers the propagating
+ * entries of the similar interests, and so their downstream faces.
+ */
+struct pit_entry {
+    struct propagating_entry *newest; /**< most recently arrived */
+    const unsigned char *key;   /**< interest minus nonce, held by pit_tab */
+    size_t keysize;
+    int n;                      /**< number of pending interests here */
+};
+
 /**
  * The nameprefix hash table is keyed by the Component elements of
  * the Name prefix.
@@ -317,6 +469,7 @@ struct nameprefix_entry {
     unsigned src;                /**< faceid of recent content source */
     unsigned osrc;               /**< and of older matching content */
     unsigned usec;               /**< response-time prediction */
+    struct ccn_nametrie_node *trie_node; /**< our node in nameprefix_trie */
 };
 
 /**
@@ -429,9 +582,48 @@ int ccnd_reg_uri(struct ccnd_handle *h,
 struct face *ccnd_face_from_faceid(struct ccnd_handle *, unsigned);
 void ccnd_face_status_change(struct ccnd_handle *, unsigned);
 int ccnd_destroy_face(struct ccnd_handle *h, unsigned faceid);
+void ccnd_face_poll_update(struct ccnd_handle *h, struct face *face);
 void ccnd_send(struct ccnd_handle *h, struct face *face,
                const void *data, size_t size);
 
+/*
+ * Name-ordered content index (ccnd_content_tree.c)
+ */
+struct content_tree *ccnd_content_tree_create(void);
+void ccnd_content_tree_destroy(struct content_tree **);
+int ccnd_content_tree_insert(struct content_tree *, struct content_entry *);
+void ccnd_content_tree_remove(struct content_tree *, struct content_entry *);
+struct content_entry *ccnd_content_tree_lookup_ge(struct content_tree *,
+                                                  const unsigned char *flatname,
+                                                  size_t size);
+struct content_entry *ccnd_content_tree_next(struct content_tree *,
+                                             struct content_entry *);
+void ccnd_content_tree_stats(struct content_tree *, unsigned long *nodes,
+                             int *depth);
+
+/*
+ * Content store replacement policy (ccnd_cs_policy.c)
+ */
+struct ccnd_cs_policy *ccnd_cs_policy_create(const char *name,
+                                             unsigned long capacity);
+void ccnd_cs_policy_destroy(struct ccnd_cs_policy **);
+const char *ccnd_cs_policy_name(struct ccnd_cs_policy *);
+void ccnd_cs_policy_admit(struct ccnd_cs_policy *, struct content_entry *);
+void ccnd_cs_policy_hit(struct ccnd_cs_policy *, struct content_entry *);
+void ccnd_cs_policy_remove(struct ccnd_cs_policy *, struct content_entry *);
+struct content_entry *ccnd_cs_policy_victim(struct ccnd_cs_policy *);
+
+/*
+ * Duplicate nonce detection (ccnd_nonce.c)
+ */
+struct ccnd_nonce_filter *ccnd_nonce_filter_create(void);
+void ccnd_nonce_filter_destroy(struct ccnd_nonce_filter **);
+int ccnd_nonce_filter_check(struct ccnd_nonce_filter *,
+                            const unsigned char *nonce, size_t size);
+void ccnd_nonce_filter_age(struct ccnd_nonce_filter *);
+unsigned long ccnd_nonce_filter_stats(struct ccnd_nonce_filter *,
+                                      unsigned long *n, unsigned long *bytes);
+
 /* Consider a separate header for these */
 int ccnd_stats_handle_http_connection(struct ccnd_handle *, struct face *);
 void ccnd_msg(struct ccnd_handle *, const char *, ...);
@@ -37,6 +37,7 @@
 #include <ccn/coding.h>
 #include <ccn/indexbuf.h>
 #include <ccn/schedule.h>
+#include <ccn/slab.h>
 #include <ccn/sockaddrutil.h>
 #include <ccn/hashtb.h>
 #include <ccn/uri.h>
@@ -59,6 +60,12 @@ struct ccnd_meter {
 struct ccnd_stats {
     long total_interest_counts;
     long total_flood_control;      /* done propagating, still recorded */
+    const char *cs_policy;         /* content store replacement policy */
+    unsigned long cs_hits;
+    unsigned long cs_misses;
+    unsigned long cs_evictions;
+    unsigned cs_hit_permille;      /* hits per thousand lookups */
+    unsigned fresh_lag_mean_usec;  /* mean lag in making content stale */
 };
 
 static int ccnd_collect_stats(struct ccnd_handle *h, struct ccnd_stats *ans);
@@ -147,6 +154,7 @@ ccnd_stats_handle_http_connection(struct ccnd_handle *h, struct face *face)
     else
         ccnd_send(h, face, resp405, strlen(resp405));
     face->flags |= (CCN_FACE_NOSEND | CCN_FACE_CLOSING);
+    ccnd_face_poll_update(h, face);
     ccn_charbuf_destroy(&response);
     return(0);
 }
@@ -211,11 +219,48 @@ ccnd_collect_stats(struct ccnd_handle *h, struct ccnd_stats *ans)
         ccnd_msg(h, "ccnd_collect_stats found inconsistency %ld != %ld\n",
                  (long)sum, (long)ans->total_interest_counts);
     ans->total_interest_counts = sum;
+    ans->cs_policy = "fifo";
+    if (h->cs_policy != NULL)
+        ans->cs_policy = ccnd_cs_policy_name(h->cs_policy);
+    ans->cs_hits = h->cs_hits;
+    ans->cs_misses = h->cs_misses;
+    ans->cs_evictions = h->cs_evictions;
+    ans->cs_hit_permille = 0;
+    if (h->cs_hits + h->cs_misses != 0)
+        ans->cs_hit_permille = (unsigned)((1000.0 * h->cs_hits) /
+                                          (h->cs_hits + h->cs_misses));
+    ans->fresh_lag_mean_usec = 0;
+    if (h->fresh->expired != 0)
+        ans->fresh_lag_mean_usec = h->fresh->lag_usec / h->fresh->expired;
     return(0);
 }
 
 /* HTML formatting */
 
+static void
+collect_slab_html(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    struct ccn_slab_stats st;
+    const char *sep = " ";
+    int i;
+    
+    if (h->slab == NULL)
+        return;
+    ccn_charbuf_putf(b, "<div><b>Slab classes:</b>");
+    for (i = 0; ccn_slab_stats(h->slab, i, &st) == 0; i++) {
+        if (st.slabs == 0 && st.in_use == 0)
+            continue;
+        if (st.size == 0)
+            ccn_charbuf_putf(b, "%slarge %lu in use", sep, st.in_use);
+        else
+            ccn_charbuf_putf(b, "%s%lu: %lu slabs, %lu in use, %lu free",
+                             sep, (unsigned long)st.size, st.slabs,
+                             st.in_use, st.free);
+        sep = "; ";
+    }
+    ccn_charbuf_putf(b, "</div>" NL);
+}
+
 static void
 collect_faces_html(struct ccnd_handle *h, struct ccn_charbuf *b)
 {
@@ -260,6 +305,14 @@ collect_faces_html(struct ccnd_handle *h, struct ccn_charbuf *b)
                     face->sendface != CCN_NOFACEID)
                     ccn_charbuf_putf(b, " <b>via:</b> %u", face->sendface);
             }
+            if (face->shaper != NULL)
+                ccn_charbuf_putf(b, " <b>rate:</b> %u/%u"
+                                 " <b>queued:</b> %u in %d"
+                                 " <b>drops:</b> %llu",
+                                 face->shaper->rate, face->shaper->burst,
+                                 face->shaper->qlen,
+                                 hashtb_n(face->shaper->flows),
+                                 face->shaper->drops);
             ccn_charbuf_putf(b, "</li>" NL);
         }
     }
@@ -420,10 +473,39 @@ collect_stats_html(struct ccnd_handle *h)
         stats.total_flood_control,
         h->interests_accepted, h->interests_dropped,
         h->interests_sent, h->interests_stuffed);
+    ccn_charbuf_putf(b,
+        "<div><b>Datagram batching:</b> %lu received in %lu calls,"
+        " %lu sent in %lu calls</div>" NL,
+        h->dgram_recv_msgs, h->dgram_recv_calls,
+        h->dgram_send_msgs, h->dgram_send_calls);
+    ccn_charbuf_putf(b,
+        "<div><b>Output copying:</b> %llu bytes sent in place,"
+        " %llu bytes copied</div>" NL,
+        h->out_direct_bytes, h->out_copied_bytes);
+    ccn_charbuf_putf(b,
+        "<div><b>Content memory:</b> %llu resident bytes,"
+        " %llu overhead bytes",
+        h->cs_resident_bytes, h->cs_overhead_bytes);
+    if (h->byte_capacity != ~0ULL)
+        ccn_charbuf_putf(b, ", %llu limit", h->byte_capacity);
+    ccn_charbuf_putf(b, "</div>" NL);
+    ccn_charbuf_putf(b,
+        "<div><b>Freshness:</b> %lu pending, %lu expired,"
+        " %u ms mean lag, %u ms max lag, %d scheduled events</div>" NL,
+        h->fresh->n, h->fresh->expired,
+        stats.fresh_lag_mean_usec / 1000, h->fresh->lag_max_usec / 1000,
+        ccn_schedule_n(h->sched));
+    ccn_charbuf_putf(b,
+        "<div><b>Content store:</b> %s replacement, %lu hits,"
+        " %lu misses (%u.%u%% hits), %lu evicted</div>" NL,
+        stats.cs_policy, stats.cs_hits, stats.cs_misses,
+        stats.cs_hit_permille / 10, stats.cs_hit_permille % 10,
+        stats.cs_evictions);
     if (0)
         ccn_charbuf_putf(b,
                          "<div><b>Active faces and listeners:</b> %d</div>" NL,
                          hashtb_n(h->faces_by_fd) + hashtb_n(h->dgram_faces));
+    collect_slab_html(h, b);
     collect_faces_html(h, b);
     collect_face_meter_html(h, b);
     collect_forwarding_html(h, b);
@@ -435,6 +517,30 @@ collect_stats_html(struct ccnd_handle *h)
 
 /* XML formatting */
 
+static void
+collect_slab_xml(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    struct ccn_slab_stats st;
+    int i;
+    
+    if (h->slab == NULL)
+        return;
+    ccn_charbuf_putf(b, "<slab>");
+    for (i = 0; ccn_slab_stats(h->slab, i, &st) == 0; i++) {
+        if (st.slabs == 0 && st.in_use == 0)
+            continue;
+        ccn_charbuf_putf(b,
+            "<class>"
+            "<size>%lu</size>"
+            "<slabs>%lu</slabs>"
+            "<inuse>%lu</inuse>"
+            "<free>%lu</free>"
+            "</class>",
+            (unsigned long)st.size, st.slabs, st.in_use, st.free);
+    }
+    ccn_charbuf_putf(b, "</slab>");
+}
+
 static void
 collect_meter_xml(struct ccnd_handle *h, struct ccn_charbuf *b, struct ccnd_meter *m)
 {
@@ -480,6 +586,22 @@ collect_faces_xml(struct ccnd_handle *h, struct ccn_charbuf *b)
             if (face->sendface != face->faceid &&
                 face->sendface != CCN_NOFACEID)
                 ccn_charbuf_putf(b, "<via>%u</via>", face->sendface);
+            if (face->shaper != NULL) {
+                struct ccnd_shaper *sh = face->shaper;
+                ccn_charbuf_putf(b, "<shaper>"
+                                 "<rate>%u</rate>"
+                                 "<burst>%u</burst>"
+                                 "<tokens>%lld</tokens>"
+                                 "<queued>%u</queued>"
+                                 "<queuemax>%u</queuemax>"
+                                 "<flows>%d</flows>"
+                                 "<sent>%llu</sent>"
+                                 "<drops>%llu</drops>"
+                                 "</shaper>",
+                                 sh->rate, sh->burst, sh->tokens,
+                                 sh->qlen, sh->qmax, hashtb_n(sh->flows),
+                                 sh->sent, sh->drops);
+            }
             if (face != NULL && (face->flags & CCN_FACE_PASSIVE) == 0) {
                 ccn_charbuf_putf(b, "<meters>");
                 for (m = 0; m < CCND_FACE_METER_N; m++)
@@ -591,6 +713,45 @@ collect_stats_xml(struct ccnd_handle *h)
         stats.total_flood_control,
         h->interests_accepted, h->interests_dropped,
         h->interests_sent, h->interests_stuffed);
+    ccn_charbuf_putf(b,
+        "<dgrambatch>"
+        "<recvmsgs>%lu</recvmsgs>"
+        "<recvcalls>%lu</recvcalls>"
+        "<sendmsgs>%lu</sendmsgs>"
+        "<sendcalls>%lu</sendcalls>"
+        "</dgrambatch>",
+        h->dgram_recv_msgs, h->dgram_recv_calls,
+        h->dgram_send_msgs, h->dgram_send_calls);
+    ccn_charbuf_putf(b,
+        "<output>"
+        "<directbytes>%llu</directbytes>"
+        "<copiedbytes>%llu</copiedbytes>"
+        "</output>",
+        h->out_direct_bytes, h->out_copied_bytes);
+    ccn_charbuf_putf(b,
+        "<contentstore>"
+        "<policy>%s</policy>"
+        "<hits>%lu</hits>"
+        "<misses>%lu</misses>"
+        "<evictions>%lu</evictions>"
+        "<residentbytes>%llu</residentbytes>"
+        "<overheadbytes>%llu</overheadbytes>"
+        "</contentstore>",
+        stats.cs_policy, stats.cs_hits, stats.cs_misses,
+        stats.cs_evictions,
+        h->cs_resident_bytes, h->cs_overhead_bytes);
+    ccn_charbuf_putf(b,
+        "<freshness>"
+        "<pending>%lu</pending>"
+        "<expired>%lu</expired>"
+        "<lagmeanusec>%u</lagmeanusec>"
+        "<lagmaxusec>%u</lagmaxusec>"
+        "<scheduled>%d</scheduled>"
+        "</freshness>",
+        h->fresh->n, h->fresh->expired,
+        stats.fresh_lag_mean_usec, h->fresh->lag_max_usec,
+        ccn_schedule_n(h->sched));
+    collect_slab_xml(h, b);
     collect_faces_xml(h, b);
     collect_forwarding_xml(h, b);
     ccn_charbuf_putf(b, "</ccnd>" NL);
@@ -0,0 +1,2187 @@
+/**
+ * @file ccndbench.c
+ *
+ * Microbenchmarks for the ccnd internals.
+ *
+ * Part of ccnd - the CCNx Daemon.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * These run against a bare handle, with no faces and no event loop.
+ *
+ * The benchmarks drive static parts of ccnd.c directly, so that file is
+ * compiled in here rather than linked.
+ */
+
+#include "ccnd.c"
+
+static double
+bench_secs(struct timeval *start)
+{
+    struct timeval now;
+    
+    gettimeofday(&now, NULL);
+    return((now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1e6);
+}
+
+static void
+bench_report(const char *what, const char *op, int n, struct timeval *start)
+{
+    double secs = bench_secs(start);
+    
+    printf("%-8s %-8s %8d in %10.6f secs %12.0f per sec\n",
+           what, op, n, secs, secs > 0 ? n / secs : 0.0);
+}
+
+static struct ccnd_handle *
+bench_handle(void)
+{
+    struct ccnd_handle *h;
+    struct hashtb_param param = {0};
+    
+    h = calloc(1, sizeof(*h));
+    if (h == NULL)
+        abort();
+    h->debug = 0;
+    h->skiplinks = ccn_indexbuf_create();
+    param.finalize_data = h;
+    param.finalize = &finalize_content;
+    h->content_tab = hashtb_create(sizeof(struct content_entry), &param);
+    h->sparse_straggler_tab = hashtb_create(sizeof(struct sparse_straggler_entry), NULL);
+    h->seed[1] = 1234;
+    return(h);
+}
+
+static void
+bench_free_handle(struct ccnd_handle **ph)
+{
+    struct ccnd_handle *h = *ph;
+    
+    hashtb_destroy(&h->content_tab);
+    hashtb_destroy(&h->sparse_straggler_tab);
+    ccnd_cs_policy_destroy(&h->cs_policy);
+    free(h->content_by_accession);
+    ccn_charbuf_destroy(&h->scratch_charbuf);
+    ccn_indexbuf_destroy(&h->skiplinks);
+    ccnd_content_tree_destroy(&h->ctree);
+    ccn_slab_destroy(&h->slab);
+    free(h);
+    *ph = NULL;
+}
+
+/**
+ * Make a name typical of segmented content: /bench/dNN/vNNNN/%00%NN
+ */
+static void
+bench_name(struct ccn_charbuf *name, unsigned i)
+{
+    char buf[24];
+    unsigned char seg[2];
+    
+    ccn_name_init(name);
+    ccn_name_append_str(name, "bench");
+    sprintf(buf, "d%02u", i % 97);
+    ccn_name_append_str(name, buf);
+    sprintf(buf, "v%u", (i / 97) / 16);
+    ccn_name_append_str(name, buf);
+    seg[0] = 0;
+    seg[1] = (i / 97) % 16;
+    ccn_name_append(name, seg, 2);
+}
+
+static int
+bench_compare(struct content_entry *content, struct ccn_charbuf *name)
+{
+    size_t start = content->comps[0];
+    size_t end = content->comps[content->ncomps - 1];
+    
+    return(ccn_compare_names(content->key + start - 1, end - start + 2,
+                             name->buf, name->length));
+}
+
+/**
+ * Time the name-ordered content index, as selected by kind.
+ */
+static void
+bench_index(const char *kind, int n)
+{
+    struct ccnd_handle *h;
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_charbuf **names;
+    struct ccn_charbuf *cob;
+    struct ccn_indexbuf *comps;
+    struct content_entry *content;
+    struct timeval start;
+    unsigned *order;
+    unsigned t;
+    int i;
+    int j;
+    int found;
+    
+    h = bench_handle();
+    if (strcmp(kind, "btree") == 0)
+        h->ctree = ccnd_content_tree_create();
+    names = calloc(n, sizeof(names[0]));
+    order = calloc(n, sizeof(order[0]));
+    for (i = 0; i < n; i++) {
+        names[i] = ccn_charbuf_create();
+        bench_name(names[i], i);
+        order[i] = i;
+    }
+    for (i = n - 1; i > 0; i--) {
+        j = nrand48(h->seed) % (i + 1);
+        t = order[i]; order[i] = order[j]; order[j] = t;
+    }
+    /* A stripped-down ContentObject is all the index looks at */
+    cob = ccn_charbuf_create();
+    comps = ccn_indexbuf_create();
+    gettimeofday(&start, NULL);
+    for (i = 0; i < n; i++) {
+        struct ccn_charbuf *name = names[order[i]];
+        cob->length = 0;
+        ccn_charbuf_append_tt(cob, CCN_DTAG_ContentObject, CCN_DTAG);
+        ccn_name_split(name, comps);
+        for (j = 0; j < comps->n; j++)
+            comps->buf[j] += cob->length;
+        ccn_charbuf_append_charbuf(cob, name);
+        ccn_charbuf_append_closer(cob);
+        hashtb_start(h->content_tab, e);
+        if (hashtb_seek(e, cob->buf, cob->length, 0) != HT_NEW_ENTRY)
+            abort();
+        content = e->data;
+        content->accession = ++(h->accession);
+        enroll_content(h, content);
+        content->ncomps = comps->n;
+        content->comps = ccn_slab_alloc(h->slab,
+                                        comps->n * sizeof(content->comps[0]));
+        for (j = 0; j < comps->n; j++)
+            content->comps[j] = comps->buf[j];
+        content->key_size = content->size = e->keysize;
+        content->key = e->key;
+        content_index_insert(h, content);
+        hashtb_end(e);
+    }
+    bench_report(kind, "insert", n, &start);
+    gettimeofday(&start, NULL);
+    for (i = 0, found = 0; i < n; i++) {
+        struct ccn_charbuf *name = names[order[n - 1 - i]];
+        content = content_index_lookup_ge(h, name->buf, name->length);
+        if (content != NULL)
+            found++;
+    }
+    bench_report(kind, "lookup", n, &start);
+    /* Check the answers, untimed */
+    for (i = 0; i < n; i++) {
+        content = content_index_lookup_ge(h, names[i]->buf, names[i]->length);
+        if (content != NULL && bench_compare(content, names[i]) == 0)
+            found--;
+    }
+    if (found != 0)
+        fprintf(stderr, "%s: %d wrong lookups\n", kind, found);
+    ccn_name_init(cob);
+    gettimeofday(&start, NULL);
+    content = content_index_lookup_ge(h, cob->buf, cob->length);
+    for (i = 0; content != NULL; i++)
+        content = content_index_next(h, content);
+    bench_report(kind, "scan", i, &start);
+    if (i != n)
+        fprintf(stderr, "%s: scan found %d\n", kind, i);
+    content = content_index_lookup_ge(h, cob->buf, cob->length);
+    for (i = 0; content != NULL; i++) {
+        struct content_entry *next = content_index_next(h, content);
+        if (next == NULL)
+            break;
+        cob->length = 0;
+        ccn_charbuf_append(cob, next->key + next->comps[0] - 1,
+                           next->comps[next->ncomps - 1] - next->comps[0] + 2);
+        if (bench_compare(content, cob) >= 0)
+            fprintf(stderr, "%s: scan out of order at %d\n", kind, i);
+        content = next;
+    }
+    gettimeofday(&start, NULL);
+    for (i = 0; i < n; i++) {
+        content = content_from_accession(h, order[i] + 1);
+        hashtb_start(h->content_tab, e);
+        hashtb_seek(e, content->key, content->key_size, 0);
+        hashtb_delete(e);
+        hashtb_end(e);
+    }
+    bench_report(kind, "remove", n, &start);
+    for (i = 0; i < n; i++)
+        ccn_charbuf_destroy(&names[i]);
+    free(names);
+    free(order);
+    ccn_charbuf_destroy(&cob);
+    ccn_indexbuf_destroy(&comps);
+    bench_free_handle(&h);
+}
+
+/**
+ * Replay a synthetic request trace against a replacement policy.
+ *
+ * Three quarters of the requests are drawn from a Zipf popularity
+ * distribution; the rest are a sequential scan of names that are never
+ * requested again.
+ */
+static void
+bench_cs_policy(const char *kind, int n)
+{
+    enum { U = 20000, CAP = 1000 };
+    struct ccnd_cs_policy *p;
+    struct content_entry *content;
+    struct content_entry *entries;
+    unsigned char *keys;
+    unsigned short comps[3] = {0, 4, 4}; /* empty digest at the end */
+    unsigned short seed[3] = {0, 4321, 0};
+    double *cdf;
+    double x;
+    unsigned long hits = 0;
+    unsigned long evictions = 0;
+    unsigned resident = 0;
+    unsigned scan = U;
+    unsigned id;
+    int lo, hi, mid;
+    int i;
+    struct timeval start;
+    
+    p = ccnd_cs_policy_create(strcmp(kind, "fifo") == 0 ? "lru" : kind, CAP);
+    entries = calloc(U + n, sizeof(entries[0]));
+    keys = calloc(U + n, 4);
+    cdf = calloc(U, sizeof(cdf[0]));
+    for (x = 0, i = 0; i < U; i++)
+        cdf[i] = (x += 1.0 / (i + 1));
+    for (i = 0; i < U; i++)
+        cdf[i] /= x;
+    for (i = 0; i < U + n; i++) {
+        keys[4 * i] = i >> 24; keys[4 * i + 1] = i >> 16;
+        keys[4 * i + 2] = i >> 8; keys[4 * i + 3] = i;
+        entries[i].key = keys + 4 * i;
+        entries[i].comps = comps;
+        entries[i].ncomps = 3;
+    }
+    gettimeofday(&start, NULL);
+    for (i = 0; i < n; i++) {
+        if ((nrand48(seed) & 3) == 0)
+            id = scan++;
+        else {
+            x = erand48(seed);
+            for (lo = 0, hi = U - 1; lo < hi;) {
+                mid = (lo + hi) / 2;
+                if (cdf[mid] < x)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            id = lo;
+        }
+        content = &entries[id];
+        if (content->cs_list != 0) {
+            hits++;
+            if (strcmp(kind, "fifo") != 0)
+                ccnd_cs_policy_hit(p, content);
+            continue;
+        }
+        ccnd_cs_policy_admit(p, content);
+        for (resident++; resident > CAP; resident--, evictions++)
+            ccnd_cs_policy_remove(p, ccnd_cs_policy_victim(p));
+    }
+    bench_report(kind, "replay", n, &start);
+    printf("%-8s %-8s %8lu hits %5.1f%%, %lu evicted\n", kind, "ratio",
+           hits, 100.0 * hits / n, evictions);
+    ccnd_cs_policy_destroy(&p);
+    free(entries);
+    free(keys);
+    free(cdf);
+}
+
+/**
+ * Check that tinylfu still filters admissions when no count cap is set.
+ *
+ * A long run of one-time objects streams through a store with room for
+ * 1000 of them, while each of a small popular set is requested once
+ * every 1250 arrivals - too seldom for recency alone to keep it.
+ * A popular object that is not in the store arrives again.  Once things
+ * settle, the popular requests should nearly all be hits, because the
+ * admission filter turns away one-time objects in their favor.
+ */
+static void
+bench_cs_uncapped(int n)
+{
+    enum { HOT = 50, ROOM = 1000, EVERY = 25 };
+    struct ccnd_cs_policy *p;
+    struct content_entry *content;
+    struct content_entry *entries;
+    unsigned char *keys;
+    unsigned short comps[3] = {0, 4, 4}; /* empty digest at the end */
+    unsigned resident = 0;
+    int oldest = HOT;
+    int requests = 0;
+    int hits = 0;
+    int rejected = 0;
+    int id;
+    int i;
+    
+    p = ccnd_cs_policy_create("tinylfu", ~0UL);
+    entries = calloc(HOT + n, sizeof(entries[0]));
+    keys = calloc(HOT + n, 4);
+    for (i = 0; i < HOT + n; i++) {
+        keys[4 * i] = i >> 24; keys[4 * i + 1] = i >> 16;
+        keys[4 * i + 2] = i >> 8; keys[4 * i + 3] = i;
+        entries[i].key = keys + 4 * i;
+        entries[i].comps = comps;
+        entries[i].ncomps = 3;
+    }
+    for (i = 0; i < n; i++) {
+        id = HOT + i;
+        if (i % EVERY == 0) {
+            id = (i / EVERY) % HOT;
+            if (i >= n / 2)
+                requests++;
+            if (entries[id].cs_list != 0) {
+                ccnd_cs_policy_hit(p, &entries[id]);
+                if (i >= n / 2)
+                    hits++;
+                continue;
+            }
+        }
+        ccnd_cs_policy_admit(p, &entries[id]);
+        for (resident++; resident > ROOM; resident--) {
+            content = ccnd_cs_policy_victim(p);
+            if (content == NULL)
+                abort();
+            /* Recency alone would never evict ahead of older content */
+            while (oldest < HOT + i && entries[oldest].cs_list == 0)
+                oldest++;
+            if (content > &entries[oldest])
+                rejected++;
+            ccnd_cs_policy_remove(p, content);
+        }
+    }
+    printf("%-8s %-8s %8d objects, %d rejected, popular hits %d of %d\n",
+           "tinylfu", "uncapped", n, rejected, hits, requests);
+    if (rejected == 0 || hits < requests * 9 / 10)
+        fprintf(stderr, "tinylfu: admission filter not working without a count cap\n");
+    ccnd_cs_policy_destroy(&p);
+    free(entries);
+    free(keys);
+}
+
+/**
+ * An event in a content arrival trace.
+ *
+ * A size of 0 means that the object with the given id goes away.
+ */
+struct bench_event {
+    unsigned id;
+    unsigned size;
+};
+
+/**
+ * Read a content arrival trace.
+ *
+ * Each line is either "+ id size" for an arriving ContentObject of
+ * the given encoded size, or "- id" when it leaves the store.
+ * If file is NULL, make up a trace of n arrivals with a mix of segment-
+ * sized and small objects, evicting to stay within a byte budget.
+ * @returns the number of events, or -1 on error.
+ */
+static int
+bench_slab_trace(const char *file, int n, struct bench_event **pev)
+{
+    enum { CAP = 16 << 20 };
+    struct bench_event *ev;
+    unsigned short seed[3] = {0, 7531, 0};
+    unsigned *sizes;
+    unsigned long resident = 0;
+    unsigned oldest = 0;
+    unsigned id;
+    char line[80];
+    int limit;
+    int m = 0;
+    int i;
+    FILE *f;
+    
+    if (file != NULL) {
+        f = fopen(file, "r");
+        if (f == NULL) {
+            perror(file);
+            return(-1);
+        }
+        limit = 1024;
+        ev = calloc(limit, sizeof(ev[0]));
+        while (fgets(line, sizeof(line), f) != NULL) {
+            if (m == limit)
+                ev = realloc(ev, (limit *= 2) * sizeof(ev[0]));
+            if (sscanf(line, "+ %u %u", &ev[m].id, &ev[m].size) == 2 &&
+                  ev[m].size != 0)
+                m++;
+            else if (sscanf(line, "- %u", &ev[m].id) == 1)
+                ev[m++].size = 0;
+        }
+        fclose(f);
+        *pev = ev;
+        return(m);
+    }
+    ev = calloc(2 * n, sizeof(ev[0]));
+    sizes = calloc(n, sizeof(sizes[0]));
+    for (i = 0; i < n; i++) {
+        if ((nrand48(seed) & 3) != 0)
+            sizes[i] = 4096 + nrand48(seed) % 512;
+        else
+            sizes[i] = 100 + nrand48(seed) % 1400;
+        ev[m].id = i;
+        ev[m++].size = sizes[i];
+        resident += sizes[i];
+        while (resident > CAP) {
+            /* Mostly oldest first, but sometimes stale content goes early */
+            if ((nrand48(seed) & 7) == 0)
+                id = oldest + nrand48(seed) % (i + 1 - oldest);
+            else
+                id = oldest;
+            if (sizes[id] == 0)
+                continue;
+            ev[m].id = id;
+            ev[m++].size = 0;
+            resident -= sizes[id];
+            sizes[id] = 0;
+            while (oldest <= i && sizes[oldest] == 0)
+                oldest++;
+        }
+    }
+    free(sizes);
+    *pev = ev;
+    return(m);
+}
+
+/**
+ * Replay a content arrival trace through the content store, with the
+ * entries and their side arrays allocated using malloc or a slab.
+ */
+static void
+bench_slab(const char *kind, struct bench_event *ev, int m)
+{
+    struct ccnd_handle *h;
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct hashtb_param param = {0};
+    struct ccn_charbuf *name;
+    struct ccn_charbuf *cob;
+    struct ccn_indexbuf *comps;
+    struct content_entry *content;
+    struct ccn_slab_stats st;
+    ccn_accession_t *acc;
+    unsigned char *payload;
+    unsigned maxid = 0;
+    unsigned long chunks = 0;
+    unsigned long long used = 0;
+    int i;
+    int j;
+    struct timeval start;
+    
+    h = bench_handle();
+    hashtb_destroy(&h->content_tab);
+    if (strcmp(kind, "slab") == 0)
+        h->slab = ccn_slab_create();
+    param.finalize_data = h;
+    param.finalize = &finalize_content;
+    param.slab = h->slab;
+    h->content_tab = hashtb_create(sizeof(struct content_entry), &param);
+    for (i = 0; i < m; i++)
+        if (ev[i].id > maxid)
+            maxid = ev[i].id;
+    acc = calloc(maxid + 1, sizeof(acc[0]));
+    payload = calloc(1, 65536);
+    name = ccn_charbuf_create();
+    cob = ccn_charbuf_create();
+    comps = ccn_indexbuf_create();
+    gettimeofday(&start, NULL);
+    for (i = 0; i < m; i++) {
+        if (ev[i].size == 0) {
+            content = content_from_accession(h, acc[ev[i].id]);
+            if (content == NULL)
+                continue;
+            hashtb_start(h->content_tab, e);
+            hashtb_seek(e, content->key, content->key_size, 0);
+            hashtb_delete(e);
+            hashtb_end(e);
+            continue;
+        }
+        bench_name(name, ev[i].id);
+        cob->length = 0;
+        ccn_charbuf_append_tt(cob, CCN_DTAG_ContentObject, CCN_DTAG);
+        ccn_name_split(name, comps);
+        for (j = 0; j < comps->n; j++)
+            comps->buf[j] += cob->length;
+        ccn_charbuf_append_charbuf(cob, name);
+        j = ev[i].size > cob->length + 8 ? ev[i].size - cob->length - 8 : 0;
+        ccnb_append_tagged_blob(cob, CCN_DTAG_Content, payload,
+                                j < 65536 ? j : 65536);
+        ccn_charbuf_append_closer(cob);
+        hashtb_start(h->content_tab, e);
+        if (hashtb_seek(e, cob->buf, cob->length, 0) == HT_NEW_ENTRY) {
+            content = e->data;
+            content->accession = acc[ev[i].id] = ++(h->accession);
+            enroll_content(h, content);
+            content->ncomps = comps->n;
+            content->comps = ccn_slab_alloc(h->slab,
+                                            comps->n * sizeof(content->comps[0]));
+            for (j = 0; j < comps->n; j++)
+                content->comps[j] = comps->buf[j];
+            content->key_size = content->size = e->keysize;
+            content->key = e->key;
+            content_index_insert(h, content);
+            content_account(h, content);
+        }
+        hashtb_end(e);
+    }
+    bench_report(kind, "replay", m, &start);
+    for (i = 0; ccn_slab_stats(h->slab, i, &st) == 0; i++) {
+        chunks += st.slabs;
+        used += (unsigned long long)st.size * st.in_use;
+    }
+    printf("%-8s %-8s %8d objects, %llu bytes, overhead %llu",
+           kind, "resident", hashtb_n(h->content_tab),
+           h->cs_resident_bytes, h->cs_overhead_bytes);
+    if (h->slab != NULL)
+        printf(", slabs %lu KB, %.1f%% used",
+               chunks * 64, chunks ? 100.0 * used / (chunks * 65536.0) : 0.0);
+    printf("\n");
+    free(acc);
+    free(payload);
+    ccn_charbuf_destroy(&name);
+    ccn_charbuf_destroy(&cob);
+    ccn_indexbuf_destroy(&comps);
+    bench_free_handle(&h);
+}
+
+/**
+ * Make a ContentObject with a dummy signature; ccnd does not verify it.
+ */
+static void
+bench_content_object(struct ccn_charbuf *cob, struct ccn_charbuf *name,
+                     const unsigned char *data, size_t size)
+{
+    struct ccn_charbuf *signed_info = ccn_charbuf_create();
+    unsigned char bits[128];
+    unsigned char pub[32];
+    
+    memset(bits, 0x5a, sizeof(bits));
+    memset(pub, 0xa5, sizeof(pub));
+    ccn_signed_info_create(signed_info, pub, sizeof(pub), NULL,
+                           CCN_CONTENT_DATA, -1, NULL, NULL);
+    cob->length = 0;
+    ccn_charbuf_append_tt(cob, CCN_DTAG_ContentObject, CCN_DTAG);
+    ccn_charbuf_append_tt(cob, CCN_DTAG_Signature, CCN_DTAG);
+    ccnb_append_tagged_blob(cob, CCN_DTAG_SignatureBits, bits, sizeof(bits));
+    ccn_charbuf_append_closer(cob);
+    ccn_charbuf_append_charbuf(cob, name);
+    ccn_charbuf_append_charbuf(cob, signed_info);
+    ccnb_append_tagged_blob(cob, CCN_DTAG_Content, data, size);
+    ccn_charbuf_append_closer(cob);
+    ccn_charbuf_destroy(&signed_info);
+}
+
+/**
+ * Time content admission: parse, digest, and store into content_tab.
+ *
+ * The reencode kind is the way process_incoming_content used to do it,
+ * assembling the message with its digest component in a scratch buffer
+ * and parsing it again before the table makes its own copy.
+ * The splice kind uses content_seek.
+ * The defer kind uses content_seek with digests deferred, so no digest
+ * is computed at all; its warm-up round also checks that an interest
+ * naming the digest gets it computed and cached.
+ */
+static void
+bench_admit(const char *kind, int n, size_t size)
+{
+    enum { POOL = 512 };
+    struct ccnd_handle *h;
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_charbuf *cobs[POOL];
+    struct ccn_charbuf *name = ccn_charbuf_create();
+    struct ccn_charbuf *cb = ccn_charbuf_create();
+    struct ccn_indexbuf *comps = ccn_indexbuf_create();
+    struct ccn_parsed_ContentObject obj = {0};
+    unsigned char *data;
+    struct timeval start;
+    double secs = 0;
+    double bytes = 0;
+    size_t round;
+    int splice = (strcmp(kind, "splice") == 0);
+    int defer = (strcmp(kind, "defer") == 0);
+    int done;
+    int res;
+    int i;
+    size_t at;
+    
+    h = bench_handle();
+    h->digest_deferred = defer;
+    data = calloc(1, size);
+    for (i = 0; i < POOL; i++) {
+        cobs[i] = ccn_charbuf_create();
+        bench_name(name, i);
+        data[0] = i;
+        bench_content_object(cobs[i], name, data, size);
+    }
+    /* The first round is a warm-up, and checks the results */
+    for (done = -POOL; done < n; done += POOL) {
+        gettimeofday(&start, NULL);
+        for (i = 0, round = 0; i < POOL; i++) {
+            unsigned char *msg = cobs[i]->buf;
+            size_t msize = cobs[i]->length;
+            
+            memset(&obj, 0, sizeof(obj));
+            if (ccn_parse_ContentObject(msg, msize, &obj, comps) < 0)
+                abort();
+            if (!defer)
+                ccn_digest_ContentObject(msg, &obj);
+            if (splice || defer)
+                res = content_seek(h, e, msg, msize, &obj, comps);
+            else {
+                at = comps->buf[comps->n - 1];
+                cb->length = 0;
+                ccn_charbuf_append(cb, msg, at);
+                ccn_charbuf_append_tt(cb, CCN_DTAG_Component, CCN_DTAG);
+                ccn_charbuf_append_tt(cb, obj.digest_bytes, CCN_BLOB);
+                ccn_charbuf_append(cb, obj.digest, obj.digest_bytes);
+                ccn_charbuf_append_closer(cb);
+                ccn_charbuf_append(cb, msg + at, msize - at);
+                if (ccn_parse_ContentObject(cb->buf, cb->length, &obj, comps) < 0)
+                    abort();
+                hashtb_start(h->content_tab, e);
+                res = hashtb_seek(e, cb->buf, obj.offset[CCN_PCO_B_Content],
+                                  cb->length - obj.offset[CCN_PCO_B_Content]);
+            }
+            if (res != HT_NEW_ENTRY)
+                abort();
+            if (splice && done < 0) {
+                struct ccn_parsed_ContentObject check = {0};
+                struct ccn_indexbuf *ccomps = ccn_indexbuf_create();
+                
+                if (ccn_parse_ContentObject(e->key, e->keysize + e->extsize,
+                                            &check, ccomps) < 0 ||
+                    ccomps->n != comps->n ||
+                    memcmp(ccomps->buf, comps->buf, comps->n * sizeof(comps->buf[0])) != 0 ||
+                    memcmp(check.offset, obj.offset, sizeof(obj.offset)) != 0 ||
+                    check.name_ncomps != obj.name_ncomps)
+                    fprintf(stderr, "%s: bad offsets for %d\n", kind, i);
+                ccn_indexbuf_destroy(&ccomps);
+            }
+            if (defer && done < 0) {
+                struct content_entry *content = e->data;
+                struct ccn_parsed_ContentObject wire = {0};
+                
+                content->key = e->key;
+                content->size = e->keysize + e->extsize;
+                if (content->size != (int)msize ||
+                    memcmp(content->key, msg, msize) != 0 ||
+                    comps->buf[comps->n - 2] != comps->buf[comps->n - 1])
+                    fprintf(stderr, "%s: bad key for %d\n", kind, i);
+                if (ccn_parse_ContentObject(msg, msize, &wire, NULL) < 0)
+                    abort();
+                ccn_digest_ContentObject(msg, &wire);
+                bench_name(name, i);
+                ccn_name_append(name, wire.digest, wire.digest_bytes);
+                cb->length = 0;
+                ccnb_element_begin(cb, CCN_DTAG_Interest);
+                ccn_charbuf_append(cb, name->buf, name->length);
+                ccnb_element_end(cb);
+                if (!stored_content_matches_interest(h, content, NULL,
+                                                     cb->buf, cb->length, NULL) ||
+                    content->digest == NULL ||
+                    memcmp(content->digest, wire.digest, 32) != 0)
+                    fprintf(stderr, "%s: digest not matched for %d\n", kind, i);
+                /* Spoil the last digest byte; the cached digest must refuse it */
+                cb->buf[cb->length - 4] ^= 1;
+                if (stored_content_matches_interest(h, content, NULL,
+                                                    cb->buf, cb->length, NULL))
+                    fprintf(stderr, "%s: wrong digest matched for %d\n", kind, i);
+                ccn_slab_free(h->slab, content->digest, 32);
+                content->digest = NULL;
+            }
+            hashtb_end(e);
+            round += msize;
+        }
+        if (done >= 0) {
+            secs += bench_secs(&start);
+            bytes += round;
+        }
+        /* Empty the table, untimed */
+        hashtb_start(h->content_tab, e);
+        while (e->key != NULL)
+            hashtb_delete(e);
+        hashtb_end(e);
+    }
+    printf("%-8s %6lu B %8d in %10.6f secs %10.1f MB/s\n",
+           kind, (unsigned long)size, done, secs,
+           secs > 0 ? bytes / secs / 1e6 : 0.0);
+    for (i = 0; i < POOL; i++)
+        ccn_charbuf_destroy(&cobs[i]);
+    free(data);
+    ccn_charbuf_destroy(&name);
+    ccn_charbuf_destroy(&cb);
+    ccn_indexbuf_destroy(&comps);
+    bench_free_handle(&h);
+}
+
+/**
+ * Drain whatever has arrived on a socket.
+ */
+static void
+bench_drain(int fd)
+{
+    char buf[65536];
+    
+    while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+        continue;
+}
+
+/**
+ * Fill the store with n ContentObjects of the given payload size,
+ * set up as process_incoming_content would.  They are named by
+ * bench_name, starting at first and counting by stride.
+ */
+static void
+bench_content_pool(struct ccnd_handle *h, struct content_entry **contents,
+                   int n, size_t size, unsigned first, unsigned stride)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_charbuf *cob = ccn_charbuf_create();
+    struct ccn_charbuf *name = ccn_charbuf_create();
+    struct ccn_indexbuf *comps = ccn_indexbuf_create();
+    struct ccn_parsed_ContentObject obj = {0};
+    unsigned char *data;
+    int a;
+    int i;
+    
+    data = calloc(1, size);
+    for (i = 0; i < n; i++) {
+        bench_name(name, first + i * stride);
+        data[0] = i;
+        bench_content_object(cob, name, data, size);
+        memset(&obj, 0, sizeof(obj));
+        if (ccn_parse_ContentObject(cob->buf, cob->length, &obj, comps) < 0)
+            abort();
+        ccn_digest_ContentObject(cob->buf, &obj);
+        if (content_seek(h, e, cob->buf, cob->length, &obj, comps) != HT_NEW_ENTRY)
+            abort();
+        contents[i] = e->data;
+        contents[i]->accession = ++(h->accession);
+        enroll_content(h, contents[i]);
+        contents[i]->ncomps = comps->n;
+        contents[i]->comps = ccn_slab_alloc(h->slab, comps->n * sizeof(contents[i]->comps[0]));
+        for (a = 0; a < (int)comps->n; a++)
+            contents[i]->comps[a] = comps->buf[a];
+        contents[i]->key_size = e->keysize;
+        contents[i]->size = e->keysize + e->extsize;
+        contents[i]->key = e->key;
+        content_index_insert(h, contents[i]);
+        hashtb_end(e);
+    }
+    free(data);
+    ccn_charbuf_destroy(&cob);
+    ccn_charbuf_destroy(&name);
+    ccn_indexbuf_destroy(&comps);
+}
+
+/**
+ * Check the name-ordered index, level by level for the skiplist.
+ *
+ * @returns the number of problems found, which are reported on stderr.
+ */
+static int
+bench_check_index(const char *kind, struct ccnd_handle *h, int expected)
+{
+    struct ccn_charbuf *name = ccn_charbuf_create();
+    struct ccn_indexbuf *links;
+    struct content_entry *content;
+    struct content_entry *prev = NULL;
+    ccn_accession_t a;
+    int problems = 0;
+    int limit = expected + 1; /* a damaged list may have a cycle */
+    int n;
+    int i;
+    int k;
+    
+    ccn_name_init(name);
+    content = content_index_lookup_ge(h, name->buf, name->length);
+    for (n = 0; content != NULL && n < limit; n++) {
+        if (prev != NULL && content->ncomps == prev->ncomps &&
+            memcmp(content->key + content->comps[0], prev->key + prev->comps[0],
+                   content->comps[content->ncomps - 1] - content->comps[0]) == 0 &&
+            content->accession > prev->accession && h->ctree == NULL) {
+            fprintf(stderr, "%s: accession %llu out of order\n", kind,
+                    (unsigned long long)content->accession);
+            problems++;
+        }
+        prev = content;
+        content = content_index_next(h, content);
+    }
+    if (n != expected) {
+        fprintf(stderr, "%s: index has %d entries, not %d\n", kind, n, expected);
+        problems++;
+    }
+    for (i = 0; h->ctree == NULL && i < (int)h->skiplinks->n; i++) {
+        for (k = 0, links = h->skiplinks; (a = links->buf[i]) != 0; k++) {
+            if (k == limit) {
+                fprintf(stderr, "%s: cycle in skiplist level %d\n", kind, i);
+                problems++;
+                break;
+            }
+            content = content_from_accession(h, a);
+            if (content == NULL || content->skiplinks == NULL ||
+                  i >= (int)content->skiplinks->n) {
+                fprintf(stderr, "%s: dangling accession %llu in skiplist\n",
+                        kind, (unsigned long long)a);
+                problems++;
+                break;
+            }
+            links = content->skiplinks;
+        }
+    }
+    ccn_charbuf_destroy(&name);
+    return(problems);
+}
+
+/**
+ * Check that the name-ordered index copes with content entries that
+ * have the same name, as it must when digests are deferred.
+ *
+ * Several ContentObjects that differ only in their signatures are
+ * stored for each name, then removed in random order, checking the
+ * index after every removal.
+ */
+static void
+bench_same_name(const char *kind, int n)
+{
+    enum { COPIES = 4 };
+    struct ccnd_handle *h;
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_charbuf *name = ccn_charbuf_create();
+    struct ccn_charbuf *cob = ccn_charbuf_create();
+    struct ccn_indexbuf *comps = ccn_indexbuf_create();
+    struct ccn_parsed_ContentObject obj = {0};
+    struct content_entry *content;
+    const unsigned char *bits;
+    unsigned char data[8] = {0};
+    size_t bsize;
+    unsigned *order;
+    unsigned t;
+    int problems = 0;
+    int seed;
+    int i;
+    int j;
+    
+    order = calloc(n, sizeof(order[0]));
+    for (seed = 1; seed <= 5 && problems == 0; seed++) {
+        h = bench_handle();
+        h->digest_deferred = 1;
+        h->seed[1] = seed;
+        if (strcmp(kind, "btree") == 0)
+            h->ctree = ccnd_content_tree_create();
+        for (i = 0; i < n; i++) {
+            bench_name(name, i / COPIES);
+            bench_content_object(cob, name, data, sizeof(data));
+            if (ccn_parse_ContentObject(cob->buf, cob->length, &obj, comps) < 0 ||
+                ccn_ref_tagged_BLOB(CCN_DTAG_SignatureBits, cob->buf,
+                                    obj.offset[CCN_PCO_B_SignatureBits],
+                                    obj.offset[CCN_PCO_E_SignatureBits],
+                                    &bits, &bsize) < 0)
+                abort();
+            memcpy((unsigned char *)bits, &i, sizeof(i));
+            if (content_seek(h, e, cob->buf, cob->length, &obj, comps) != HT_NEW_ENTRY)
+                abort();
+            content = e->data;
+            content->accession = ++(h->accession);
+            enroll_content(h, content);
+            content->ncomps = comps->n;
+            content->comps = ccn_slab_alloc(h->slab, comps->n * sizeof(content->comps[0]));
+            for (j = 0; j < (int)comps->n; j++)
+                content->comps[j] = comps->buf[j];
+            content->key_size = e->keysize;
+            content->size = e->keysize + e->extsize;
+            content->key = e->key;
+            content_index_insert(h, content);
+            hashtb_end(e);
+            order[i] = i + 1;
+        }
+        problems += bench_check_index(kind, h, n);
+        for (i = n - 1; i > 0; i--) {
+            j = nrand48(h->seed) % (i + 1);
+            t = order[i]; order[i] = order[j]; order[j] = t;
+        }
+        for (i = 0; i < n && problems == 0; i++) {
+            remove_content(h, content_from_accession(h, order[i]));
+            problems += bench_check_index(kind, h, n - i - 1);
+        }
+        /* Tearing down a damaged skiplist may not terminate */
+        if (problems == 0)
+            bench_free_handle(&h);
+    }
+    printf("%-8s %-8s %8d with %d copies of each name, %d problems\n",
+           kind, "samename", n, COPIES, problems);
+    free(order);
+    ccn_charbuf_destroy(&name);
+    ccn_charbuf_destroy(&cob);
+    ccn_indexbuf_destroy(&comps);
+}
+
+/**
+ * Time sending stored ContentObjects to a face.
+ *
+ * The copy kind is the way send_content used to go, gathering the two
+ * pieces around the digest component into a scratch buffer; the iov kind
+ * is send_content itself.  Stream faces are a unix socketpair; datagram
+ * faces are UDP over the loopback, batched through the sendmmsg ring.
+ */
+static void
+bench_send(const char *kind, int dgram, int n, size_t size)
+{
+    enum { POOL = 64 };
+    struct ccnd_handle *h;
+    struct content_entry *contents[POOL];
+    struct ccn_charbuf *c = ccn_charbuf_create();
+    struct sockaddr_in sin = {0};
+    socklen_t sinlen = sizeof(sin);
+    struct face face = {0};
+    unsigned long long copied = 0;
+    unsigned long long bytes = 0;
+    struct timeval start;
+    double secs;
+    int copy = (strcmp(kind, "copy") == 0);
+    int fds[2];
+    int a, b;
+    int i;
+    
+    h = bench_handle();
+    if (dgram) {
+        fds[0] = socket(AF_INET, SOCK_DGRAM, 0);
+        fds[1] = socket(AF_INET, SOCK_DGRAM, 0);
+        sin.sin_family = AF_INET;
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(fds[1], (struct sockaddr *)&sin, sizeof(sin)) == -1 ||
+            getsockname(fds[1], (struct sockaddr *)&sin, &sinlen) == -1) {
+            perror("bench_send");
+            exit(1);
+        }
+        face.flags = CCN_FACE_DGRAM;
+        face.addr = (struct sockaddr *)&sin;
+        face.addrlen = sinlen;
+        h->dgram_out = dgram_ring_create(32);
+    }
+    else if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+        perror("bench_send");
+        exit(1);
+    }
+    i = 1 << 20;
+    setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &i, sizeof(i));
+    face.recv_fd = fds[0];
+    face.faceid = face.sendface = 1;
+    face.recvcount = 1;
+    bench_content_pool(h, contents, POOL, size, 0, 1);
+    gettimeofday(&start, NULL);
+    for (i = 0; i < n; i++) {
+        struct content_entry *content = contents[i % POOL];
+        
+        if (copy) {
+            a = content->comps[content->ncomps - 2];
+            b = content->comps[content->ncomps - 1];
+            c->length = 0;
+            ccn_charbuf_append(c, content->key, a);
+            ccn_charbuf_append(c, content->key + b, content->size - b);
+            copied += c->length;
+            ccnd_send(h, &face, c->buf, c->length);
+        }
+        else
+            send_content(h, &face, content);
+        bytes += content->size - 36;
+        if (dgram && (i % 32) == 31)
+            ccnd_flush_dgrams(h);
+        if (!dgram || (i % 32) == 31)
+            bench_drain(fds[1]);
+    }
+    ccnd_flush_dgrams(h);
+    bench_drain(fds[1]);
+    secs = bench_secs(&start);
+    copied += h->out_copied_bytes;
+    printf("%-5s %-6s %5lu B %8d in %8.6f secs %8.1f MB/s %6.1f B copied each\n",
+           kind, dgram ? "dgram" : "stream", (unsigned long)size, n, secs,
+           secs > 0 ? bytes / secs / 1e6 : 0.0, (double)copied / n);
+    close(fds[0]);
+    close(fds[1]);
+    ccn_charbuf_destroy(&c);
+    dgram_ring_destroy(&h->dgram_out);
+    bench_free_handle(&h);
+}
+
+/**
+ * Time longest-prefix match of deep names against the nameprefix table,
+ * probing once per prefix length as before, and with the trie.
+ */
+static void
+bench_fib(int n)
+{
+    enum { DEPTH = 12, FANOUT = 8 };
+    struct ccnd_handle *h;
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct hashtb_param param = {0};
+    struct ccn_charbuf **names;
+    struct ccn_indexbuf **comps;
+    struct nameprefix_entry *tnpe;
+    struct timeval start;
+    char buf[24];
+    unsigned long sum = 0;
+    unsigned long tsum = 0;
+    int m = 4096;
+    int i;
+    int j;
+    int k;
+    
+    h = bench_handle();
+    param.finalize_data = h;
+    param.finalize = &finalize_nameprefix;
+    param.hash = &ccn_name_prefix_hash;
+    h->nameprefix_tab = hashtb_create(sizeof(struct nameprefix_entry), &param);
+    h->nameprefix_trie = ccn_nametrie_create();
+    names = calloc(m, sizeof(names[0]));
+    comps = calloc(m, sizeof(comps[0]));
+    for (i = 0; i < m; i++) {
+        names[i] = ccn_charbuf_create();
+        comps[i] = ccn_indexbuf_create();
+        ccn_name_init(names[i]);
+        for (j = 0, k = i; j < DEPTH; j++, k /= FANOUT) {
+            sprintf(buf, "c%d", (j < 4) ? k % FANOUT : (i * 7 + j) % 1000);
+            ccn_name_append_str(names[i], buf);
+        }
+        ccn_name_split(names[i], comps[i]);
+        /* Register a prefix of 2 to 5 components of every other name */
+        if ((i & 1) == 0) {
+            hashtb_start(h->nameprefix_tab, e);
+            nameprefix_seek(h, e, names[i]->buf, comps[i], 2 + (i / 2) % 4);
+            hashtb_end(e);
+        }
+    }
+    gettimeofday(&start, NULL);
+    for (i = 0; i < n; i++) {
+        struct ccn_indexbuf *c = comps[i % m];
+        const unsigned char *msg = names[i % m]->buf;
+        for (j = 0; j <= DEPTH; j++) {
+            tnpe = hashtb_lookup(h->nameprefix_tab, msg + c->buf[0],
+                                 c->buf[j] - c->buf[0]);
+            if (tnpe == NULL)
+                break;
+        }
+        sum += j;
+    }
+    bench_report("probe", "longest", n, &start);
+    gettimeofday(&start, NULL);
+    for (i = 0; i < n; i++) {
+        struct ccn_indexbuf *c = comps[i % m];
+        tnpe = ccn_nametrie_longest(h->nameprefix_trie, names[i % m]->buf,
+                                    c, DEPTH, &k);
+        tsum += k + 1;
+    }
+    bench_report("trie", "longest", n, &start);
+    if (sum != tsum)
+        fprintf(stderr, "fib: probe and trie disagree (%lu, %lu)\n", sum, tsum);
+    for (i = 0; i < m; i++) {
+        ccn_charbuf_destroy(&names[i]);
+        ccn_indexbuf_destroy(&comps[i]);
+    }
+    free(names);
+    free(comps);
+    hashtb_destroy(&h->nameprefix_tab);
+    if (ccn_nametrie_n(h->nameprefix_trie) != 0)
+        fprintf(stderr, "fib: %d prefixes left in trie\n",
+                ccn_nametrie_n(h->nameprefix_trie));
+    ccn_nametrie_destroy(&h->nameprefix_trie);
+    bench_free_handle(&h);
+}
+
+/**
+ * The hash used by hashtb before it went a word at a time.
+ */
+static size_t
+bench_old_hash(const unsigned char *key, size_t key_size)
+{
+    size_t h;
+    size_t i;
+    for (h = key_size + 23, i = 0; i < key_size; i++)
+        h = ((h << 6) ^ (h >> 27)) + key[i];
+    return(h);
+}
+
+/**
+ * Time hashing of every prefix of every name in a corpus.
+ *
+ * The corpus is read from a file of ccnx URIs, one per line, or else
+ * is made up of segmented content names.  The per-prefix rows rehash
+ * each prefix from the start of the name, as probing a hash table
+ * once per prefix length does; the cumulative row uses
+ * ccn_name_prefix_hashes.
+ */
+static int
+bench_hash(const char *file, int n)
+{
+    struct ccn_charbuf **names = NULL;
+    struct ccn_indexbuf **comps = NULL;
+    struct ccn_indexbuf *hashes = ccn_indexbuf_create();
+    struct timeval start;
+    char line[1024];
+    FILE *f = NULL;
+    size_t sink = 0;
+    long prefixes = 0;
+    int m = 0;
+    int i;
+    int j;
+    int k;
+    
+    if (file != NULL) {
+        f = fopen(file, "r");
+        if (f == NULL) {
+            perror(file);
+            return(-1);
+        }
+    }
+    for (m = 0; f != NULL || m < 20000;) {
+        struct ccn_charbuf *name = ccn_charbuf_create();
+        if (f != NULL) {
+            if (fgets(line, sizeof(line), f) == NULL) {
+                ccn_charbuf_destroy(&name);
+                break;
+            }
+            line[strcspn(line, "\r\n")] = 0;
+            if (ccn_name_from_uri(name, line) < 0) {
+                ccn_charbuf_destroy(&name);
+                continue;
+            }
+        }
+        else {
+            bench_name(name, m);
+            sprintf(line, "chunk%d", m % 13);
+            ccn_name_append_str(name, line);
+        }
+        if ((m & (m - 1)) == 0) {
+            names = realloc(names, 2 * (m + 1) * sizeof(names[0]));
+            comps = realloc(comps, 2 * (m + 1) * sizeof(comps[0]));
+        }
+        names[m] = name;
+        comps[m] = ccn_indexbuf_create();
+        ccn_name_split(name, comps[m]);
+        prefixes += comps[m]->n;
+        m++;
+    }
+    if (f != NULL)
+        fclose(f);
+    if (m == 0) {
+        fprintf(stderr, "%s: no names\n", file);
+        return(-1);
+    }
+    printf("%d names, %.1f prefixes per name\n", m, (double)prefixes / m);
+    gettimeofday(&start, NULL);
+    for (i = 0; i < n; i++) {
+        struct ccn_indexbuf *c = comps[i % m];
+        const unsigned char *key = names[i % m]->buf + c->buf[0];
+        for (j = 0; j < (int)c->n; j++)
+            sink += bench_old_hash(key, c->buf[j] - c->buf[0]);
+    }
+    bench_report("old", "prefix", n, &start);
+    gettimeofday(&start, NULL);
+    for (i = 0; i < n; i++) {
+        struct ccn_indexbuf *c = comps[i % m];
+        const unsigned char *key = names[i % m]->buf + c->buf[0];
+        for (j = 0; j < (int)c->n; j++)
+            sink += hashtb_hash(key, c->buf[j] - c->buf[0]);
+    }
+    bench_report("word", "prefix", n, &start);
+    gettimeofday(&start, NULL);
+    for (i = 0; i < n; i++) {
+        struct ccn_indexbuf *c = comps[i % m];
+        ccn_name_prefix_hashes(names[i % m]->buf, c, c->n - 1, hashes);
+        sink += hashes->buf[hashes->n - 1];
+    }
+    bench_report("cumul", "prefix", n, &start);
+    /* Check agreement with the hash table's hash, untimed */
+    for (i = 0, k = 0; i < m; i++) {
+        struct ccn_indexbuf *c = comps[i];
+        ccn_name_prefix_hashes(names[i]->buf, c, c->n - 1, hashes);
+        for (j = 0; j < (int)c->n; j++)
+            if (hashes->buf[j] != ccn_name_prefix_hash(names[i]->buf + c->buf[0],
+                                                       c->buf[j] - c->buf[0]))
+                k++;
+    }
+    if (k != 0)
+        fprintf(stderr, "hash: %d prefix hashes disagree\n", k);
+    if (sink == 1)
+        printf("(unlikely)\n");
+    for (i = 0; i < m; i++) {
+        ccn_charbuf_destroy(&names[i]);
+        ccn_indexbuf_destroy(&comps[i]);
+    }
+    free(names);
+    free(comps);
+    ccn_indexbuf_destroy(&hashes);
+    return(0);
+}
+
+static long long bench_clock_usec;
+
+static void
+bench_gettime(const struct ccn_gettime *self, struct ccn_timeval *result)
+{
+    struct ccnd_handle *h = self->data;
+    
+    result->s = bench_clock_usec / 1000000;
+    result->micros = bench_clock_usec % 1000000;
+    h->sec = result->s;
+    h->usec = result->micros;
+}
+
+/**
+ * The old way: one scheduled event per fresh ContentObject.
+ */
+static int
+bench_expire(struct ccn_schedule *sched,
+             void *clienth,
+             struct ccn_scheduled_event *ev,
+             int flags)
+{
+    struct ccnd_handle *h = clienth;
+    struct content_entry *content;
+    
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0)
+        return(0);
+    content = content_from_accession(h, ev->evint);
+    if (content != NULL)
+        expire_content(h, content);
+    return(0);
+}
+
+/**
+ * Time freshness tracking for n objects admitted over a minute, with
+ * FreshnessSeconds from 1 to 600, run on a simulated clock until all
+ * have gone stale.
+ */
+static void
+bench_fresh(const char *kind, int n)
+{
+    struct ccnd_handle *h;
+    struct content_entry *entries;
+    unsigned short seed[3] = {0, 555, 0};
+    struct timeval start;
+    int wheel = (strcmp(kind, "wheel") == 0);
+    int maxn = 0;
+    int i;
+    
+    h = bench_handle();
+    h->capacity = ~0;
+    h->byte_capacity = ~0ULL;
+    h->min_stale = ~0;
+    h->fresh = calloc(1, sizeof(*h->fresh));
+    bench_clock_usec = 1000000000000LL;
+    h->ticktock.descr[0] = 'B';
+    h->ticktock.micros_per_base = 1000000;
+    h->ticktock.gettime = &bench_gettime;
+    h->ticktock.data = h;
+    h->sched = ccn_schedule_create(h, &h->ticktock);
+    h->starttime = h->sec;
+    h->starttime_usec = h->usec;
+    entries = calloc(n, sizeof(entries[0]));
+    for (i = 0; i < n; i++) {
+        entries[i].accession = ++(h->accession);
+        enroll_content(h, &entries[i]);
+    }
+    gettimeofday(&start, NULL);
+    for (i = 0; i < n; i++) {
+        int usec = (1 + nrand48(seed) % 600) * 1000000;
+        if ((i % 1000) == 0) {
+            bench_clock_usec += 60000000 / (n / 1000 + 1);
+            ccn_schedule_run(h->sched);
+        }
+        if (wheel)
+            fresh_insert(h, &entries[i], usec);
+        else
+            ccn_schedule_event(h->sched, usec, &bench_expire, NULL,
+                               entries[i].accession);
+        if (ccn_schedule_n(h->sched) > maxn)
+            maxn = ccn_schedule_n(h->sched);
+    }
+    bench_report(kind, "admit", n, &start);
+    gettimeofday(&start, NULL);
+    for (i = 0; h->n_stale < (unsigned long)n && i < 700 * 8; i++) {
+        bench_clock_usec += CCND_FRESH_TICK_USEC;
+        ccn_schedule_run(h->sched);
+    }
+    bench_report(kind, "expire", n, &start);
+    printf("%-8s %-8s %8lu stale, %d max scheduled events", kind, "check",
+           h->n_stale, maxn);
+    if (wheel)
+        printf(", %u ms mean lag, %u ms max lag",
+               (unsigned)(h->fresh->lag_usec / (h->fresh->expired + 1) / 1000),
+               h->fresh->lag_max_usec / 1000);
+    printf("\n");
+    ccn_schedule_destroy(&h->sched);
+    fresh_destroy(&h->fresh);
+    free(entries);
+    bench_free_handle(&h);
+}
+
+static unsigned long bench_sched_fired;
+static unsigned long bench_sched_cancelled;
+
+static int
+bench_sched_action(struct ccn_schedule *sched,
+                   void *clienth,
+                   struct ccn_scheduled_event *ev,
+                   int flags)
+{
+    struct ccn_scheduled_event **slot = ev->evdata;
+    
+    if (*slot == ev)
+        *slot = NULL;
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0)
+        bench_sched_cancelled++;
+    else
+        bench_sched_fired++;
+    return(0);
+}
+
+/**
+ * Drive a schedule with n short-lived events, as for interest lifetimes.
+ *
+ * Each simulated millisecond, 1000 events are scheduled 50 ms to 4 s out
+ * into a table of 100000 slots; an event still pending in a slot that
+ * is reused gets cancelled, as when content answers an interest.
+ * Most events are cancelled this way.
+ */
+static void
+bench_sched(const char *kind, int n)
+{
+    enum { SLOTS = 100000, PER_MS = 1000 };
+    struct ccnd_handle *h;
+    struct ccn_scheduled_event **slot;
+    unsigned short seed[3] = {0, 777, 0};
+    struct timeval start;
+    int i;
+    int j;
+    
+    h = bench_handle();
+    bench_clock_usec = 1000000000000LL;
+    h->ticktock.descr[0] = 'B';
+    h->ticktock.micros_per_base = 1000000;
+    h->ticktock.gettime = &bench_gettime;
+    h->ticktock.data = h;
+    h->sched = ccn_schedule_create_flags(h, &h->ticktock,
+                strcmp(kind, "wheel") == 0 ? CCN_SCHEDULE_WHEEL : 0);
+    slot = calloc(SLOTS, sizeof(slot[0]));
+    bench_sched_fired = bench_sched_cancelled = 0;
+    gettimeofday(&start, NULL);
+    for (i = 0; i < n; i++) {
+        if ((i % PER_MS) == 0) {
+            bench_clock_usec += 1000;
+            ccn_schedule_run(h->sched);
+        }
+        j = nrand48(seed) % SLOTS;
+        if (slot[j] != NULL)
+            ccn_schedule_cancel(h->sched, slot[j]);
+        slot[j] = ccn_schedule_event(h->sched, 50000 + nrand48(seed) % 3950000,
+                                     &bench_sched_action, &slot[j], 0);
+    }
+    for (i = 0; ccn_schedule_run(h->sched) >= 0 && i < 5000; i++)
+        bench_clock_usec += 1000;
+    bench_report(kind, "events", n, &start);
+    printf("%-8s %-8s %8lu fired, %lu cancelled (%.1f%%)\n", kind, "check",
+           bench_sched_fired, bench_sched_cancelled,
+           100.0 * bench_sched_cancelled / n);
+    ccn_schedule_destroy(&h->sched);
+    free(slot);
+    bench_free_handle(&h);
+}
+
+/**
+ * Time a consumer on one face that keeps a window of 64 interests
+ * outstanding, so 64 ContentObjects at a time land in its send queue.
+ *
+ * The schedule runs on a simulated clock, so the sim column is the time
+ * the delay classes and bursts would have cost on the wire; wall time
+ * measures ccnd's own work.  The old sender amounted to a burst of 2.
+ */
+static void
+bench_queue(int burst, int n, size_t size)
+{
+    enum { POOL = 64 };
+    struct ccnd_handle *h;
+    struct content_entry *contents[POOL];
+    struct face *faces[2] = {NULL, NULL};
+    struct face face = {0};
+    struct timeval start;
+    long long sim;
+    double secs;
+    unsigned long wakeups = 0;
+    int fds[2];
+    int micros;
+    int i;
+    int k;
+    
+    h = bench_handle();
+    bench_clock_usec = 1000000000000LL;
+    h->ticktock.descr[0] = 'B';
+    h->ticktock.micros_per_base = 1000000;
+    h->ticktock.gettime = &bench_gettime;
+    h->ticktock.data = h;
+    h->sched = ccn_schedule_create(h, &h->ticktock);
+    h->send_burst = burst;
+    h->send_burst_bytes = burst > 2 ? 65536 : 0x7FFFFFFF;
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+        perror("bench_queue");
+        exit(1);
+    }
+    i = 1 << 20;
+    setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &i, sizeof(i));
+    face.recv_fd = fds[0];
+    face.faceid = face.sendface = 1;
+    face.recvcount = 1;
+    faces[1] = &face;
+    h->faces_by_faceid = faces;
+    h->face_limit = 2;
+    bench_content_pool(h, contents, POOL, size, 0, 1);
+    sim = bench_clock_usec;
+    gettimeofday(&start, NULL);
+    for (i = 0; i < n; i += POOL) {
+        for (k = 0; k < POOL; k++)
+            face_send_queue_insert(h, &face, contents[k]);
+        for (;;) {
+            micros = ccn_schedule_run(h->sched);
+            wakeups++;
+            bench_drain(fds[1]);
+            if (micros < 0)
+                break;
+            bench_clock_usec += micros;
+        }
+    }
+    secs = bench_secs(&start);
+    sim = bench_clock_usec - sim;
+    printf("burst %-3d %5lu B %8d in %8.6f secs %9.0f per sec, "
+           "sim %6.1f us and %5.1f wakeups per 64\n",
+           burst, (unsigned long)size, i, secs, secs > 0 ? i / secs : 0.0,
+           (double)sim * POOL / i, (double)wakeups * POOL / i);
+    for (k = 0; k < CCN_CQ_N; k++)
+        content_queue_destroy(h, &face.q[k]);
+    ccn_schedule_destroy(&h->sched);
+    close(fds[0]);
+    close(fds[1]);
+    h->faces_by_faceid = NULL;
+    bench_free_handle(&h);
+}
+
+/**
+ * Is the accession still held by the shaper?
+ */
+static int
+bench_held(struct ccnd_shaper *s, ccn_accession_t accession)
+{
+    struct ccnd_flow *f;
+    
+    for (f = s->head; f != NULL; f = f->next)
+        if (content_queue_member(&f->q, accession) >= 0)
+            return(1);
+    return(0);
+}
+
+/**
+ * A bulk fetch and an interactive one share a face limited to 8 MB/s.
+ *
+ * The bulk consumer keeps the shaper full of 1 KB objects; every 10 ms
+ * the interactive consumer asks for one more.  The schedule runs on a
+ * simulated clock in 100 usec steps, n steps in all.  With the fifo
+ * kind all content is one flow, as with a plain rate limit; with drr
+ * the two prefixes take turns.
+ */
+static void
+bench_shaper(const char *kind, int n)
+{
+    enum { BULK = 512, INTER = 64 };
+    struct ccnd_handle *h;
+    struct content_entry *bulk[BULK];
+    struct content_entry *inter[INTER];
+    struct face *faces[2] = {NULL, NULL};
+    struct face face = {0};
+    struct ccnd_shaper *s;
+    struct timeval start;
+    long long t0 = 0;
+    long long lat = 0;
+    long long lat_max = 0;
+    unsigned long long bytes0;
+    int waiting = -1;
+    int served = 0;
+    int fds[2];
+    int b = 0;
+    int k = 0;
+    int i;
+    
+    h = bench_handle();
+    bench_clock_usec = 1000000000000LL;
+    h->ticktock.descr[0] = 'B';
+    h->ticktock.micros_per_base = 1000000;
+    h->ticktock.gettime = &bench_gettime;
+    h->ticktock.data = h;
+    h->sched = ccn_schedule_create(h, &h->ticktock);
+    h->send_burst = 16;
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+        perror("bench_shaper");
+        exit(1);
+    }
+    i = 1 << 20;
+    setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &i, sizeof(i));
+    face.recv_fd = fds[0];
+    face.faceid = face.sendface = 1;
+    face.recvcount = 1;
+    faces[1] = &face;
+    h->faces_by_faceid = faces;
+    h->face_limit = 2;
+    bench_content_pool(h, bulk, BULK, 1024, 0, 97);
+    bench_content_pool(h, inter, INTER, 1024, 1, 97);
+    ccn_schedule_run(h->sched);
+    face_set_shaper(h, &face, 8000000, -1);
+    s = face.shaper;
+    if (strcmp(kind, "fifo") == 0)
+        s->flowcomps = 0;
+    bytes0 = h->out_direct_bytes;
+    gettimeofday(&start, NULL);
+    for (i = 0; i < n; i++) {
+        bench_clock_usec += 100;
+        while (s->qlen < 200)
+            shaper_enqueue(h, &face, bulk[b++ % BULK]);
+        if ((i % 100) == 0 && waiting < 0) {
+            waiting = k++ % INTER;
+            t0 = bench_clock_usec;
+            shaper_enqueue(h, &face, inter[waiting]);
+        }
+        ccn_schedule_run(h->sched);
+        bench_drain(fds[1]);
+        if (waiting >= 0 && !bench_held(s, inter[waiting]->accession)) {
+            lat += bench_clock_usec - t0;
+            if (bench_clock_usec - t0 > lat_max)
+                lat_max = bench_clock_usec - t0;
+            served++;
+            waiting = -1;
+        }
+    }
+    bench_report(kind, "steps", n, &start);
+    printf("%-8s %-8s %6.2f MB/s sent, %d interactive, "
+           "%.2f ms mean %.2f ms max latency, %llu drops\n",
+           kind, "check",
+           (h->out_direct_bytes - bytes0) / (n * 100e-6) / 1e6, served,
+           served ? lat / 1000.0 / served : 0.0, lat_max / 1000.0,
+           s->drops);
+    shaper_destroy(h, &face.shaper);
+    ccn_schedule_destroy(&h->sched);
+    close(fds[0]);
+    close(fds[1]);
+    h->faces_by_faceid = NULL;
+    bench_free_handle(&h);
+}
+
+/**
+ * Make an Interest for bench_name(i) with the given nonce.
+ */
+static void
+bench_interest(struct ccn_charbuf *c, struct ccn_charbuf *name,
+               unsigned i, unsigned nonce)
+{
+    unsigned char nb[6] = {0};
+    
+    nb[0] = nonce >> 24; nb[1] = nonce >> 16;
+    nb[2] = nonce >> 8; nb[3] = nonce;
+    bench_name(name, i);
+    c->length = 0;
+    ccnb_element_begin(c, CCN_DTAG_Interest);
+    ccn_charbuf_append(c, name->buf, name->length);
+    ccnb_append_tagged_blob(c, CCN_DTAG_Nonce, nb, sizeof(nb));
+    ccnb_element_end(c);
+}
+
+/**
+ * The similar-interest search as it was, walking every pending
+ * interest under the name prefix.
+ */
+static int
+bench_old_similar(struct nameprefix_entry *npe, const unsigned char *msg,
+                  const struct ccn_parsed_interest *pi)
+{
+    struct propagating_entry *head = &npe->pe_head;
+    struct propagating_entry *p;
+    size_t presize = pi->offset[CCN_PI_B_Nonce];
+    size_t postsize = pi->offset[CCN_PI_E] - pi->offset[CCN_PI_E_Nonce];
+    size_t minsize = presize + postsize;
+    const unsigned char *post = msg + pi->offset[CCN_PI_E_Nonce];
+    int k = 0;
+    
+    for (p = head->prev; p != head; p = p->prev) {
+        if (p->size > minsize &&
+            p->interest_msg != NULL &&
+            p->usec > 0 &&
+            0 == memcmp(msg, p->interest_msg, presize) &&
+            0 == memcmp(post, p->interest_msg + p->size - postsize, postsize))
+            k++;
+    }
+    return(k);
+}
+
+/**
+ * Consumers on many faces converge on the same names.
+ *
+ * Every one of CONSUMERS faces has an interest pending for each of
+ * m names under one prefix; then n more arrive, and each looks for
+ * the similar pending interests, by walking the prefix's list as
+ * before or through the pending interest table.
+ */
+static void
+bench_pit(int n)
+{
+    enum { CONSUMERS = 8 };
+    struct ccnd_handle *h;
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct hashtb_param param = {0};
+    struct nameprefix_entry npe = {{0}};
+    struct ccn_parsed_interest pi = {0};
+    struct ccn_charbuf *c = ccn_charbuf_create();
+    struct ccn_charbuf *name = ccn_charbuf_create();
+    struct ccn_charbuf *key = ccn_charbuf_create();
+    struct propagating_entry *pe;
+    struct pit_entry *pit;
+    unsigned short seed[3] = {0, 999, 0};
+    unsigned long sum = 0;
+    unsigned long psum = 0;
+    struct timeval start;
+    unsigned nonce = 1;
+    int m = 1250;
+    int i;
+    int j;
+    
+    h = bench_handle();
+    param.finalize_data = h;
+    param.finalize = &finalize_propagating;
+    h->propagating_tab = hashtb_create(sizeof(struct propagating_entry), &param);
+    h->pit_tab = hashtb_create(sizeof(struct pit_entry), NULL);
+    npe.pe_head.next = npe.pe_head.prev = &npe.pe_head;
+    npe.pe_head.faceid = CCN_NOFACEID;
+    for (j = 0; j < CONSUMERS; j++) {
+        for (i = 0; i < m; i++, nonce++) {
+            bench_interest(c, name, i * 97, nonce);
+            if (ccn_parse_interest(c->buf, c->length, &pi, NULL) < 0)
+                abort();
+            hashtb_start(h->propagating_tab, e);
+            hashtb_seek(e, c->buf + pi.offset[CCN_PI_B_Nonce],
+                        pi.offset[CCN_PI_E_Nonce] - pi.offset[CCN_PI_B_Nonce], 0);
+            pe = e->data;
+            hashtb_end(e);
+            pe->interest_msg = malloc(c->length);
+            memcpy(pe->interest_msg, c->buf, c->length);
+            pe->size = c->length;
+            pe->faceid = j + 1;
+            pe->usec = 4000000;
+            link_propagating_interest_to_nameprefix(h, pe, &npe);
+            pit_key(key, c->buf, &pi);
+            pit_link(h, key, pe);
+        }
+    }
+    gettimeofday(&start, NULL);
+    for (i = 0; i < n; i++) {
+        bench_interest(c, name, (nrand48(seed) % m) * 97, nonce++);
+        ccn_parse_interest(c->buf, c->length, &pi, NULL);
+        sum += bench_old_similar(&npe, c->buf, &pi);
+    }
+    bench_report("list", "similar", n, &start);
+    gettimeofday(&start, NULL);
+    for (i = 0; i < n; i++) {
+        bench_interest(c, name, (nrand48(seed) % m) * 97, nonce++);
+        ccn_parse_interest(c->buf, c->length, &pi, NULL);
+        pit_key(key, c->buf, &pi);
+        pit = hashtb_lookup(h->pit_tab, key->buf, key->length);
+        for (pe = (pit == NULL) ? NULL : pit->newest; pe != NULL; pe = pe->pit_older)
+            if (pe->interest_msg != NULL && pe->usec > 0)
+                psum++;
+    }
+    bench_report("pit", "similar", n, &start);
+    printf("%-8s %-8s %8d pending, %lu and %lu similar found, %d pit entries\n",
+           "pit", "check", CONSUMERS * m, sum, psum, hashtb_n(h->pit_tab));
+    hashtb_destroy(&h->propagating_tab);
+    if (hashtb_n(h->pit_tab) != 0)
+        abort();
+    hashtb_destroy(&h->pit_tab);
+    ccn_charbuf_destroy(&c);
+    ccn_charbuf_destroy(&name);
+    ccn_charbuf_destroy(&key);
+    bench_free_handle(&h);
+}
+
+/**
+ * Match ContentObjects against pending interests with selectors,
+ * parsing each interest again (reparse), as consume_matching_interests
+ * used to, or with the parse kept in the propagating entry (cached).
+ */
+static void
+bench_match(const char *kind, int n)
+{
+    enum { NCOB = 256, NPI = 16 };
+    struct ccn_charbuf *cobs[NCOB];
+    struct ccn_parsed_ContentObject pcs[NCOB];
+    struct ccn_charbuf *interests[NPI];
+    struct ccn_parsed_interest pis[NPI];
+    struct ccn_charbuf *name = ccn_charbuf_create();
+    struct ccn_charbuf *c;
+    const struct ccn_parsed_interest *pi;
+    unsigned char data[64] = {0};
+    unsigned char pub[32];
+    unsigned char seg[2];
+    unsigned long matched = 0;
+    struct timeval start;
+    int cached = (strcmp(kind, "cached") == 0);
+    int i;
+    int j;
+    int k;
+    
+    memset(pub, 0xa5, sizeof(pub));
+    for (i = 0; i < NCOB; i++) {
+        bench_name(name, (i % NPI) + 97 * ((i / NPI) % 16));
+        cobs[i] = ccn_charbuf_create();
+        bench_content_object(cobs[i], name, data, sizeof(data));
+        if (ccn_parse_ContentObject(cobs[i]->buf, cobs[i]->length, &pcs[i], NULL) < 0)
+            abort();
+    }
+    /* Interests for the version, excluding some segments */
+    for (j = 0; j < NPI; j++) {
+        c = interests[j] = ccn_charbuf_create();
+        bench_name(name, j);
+        ccn_name_chop(name, NULL, -1);
+        ccnb_element_begin(c, CCN_DTAG_Interest);
+        ccn_charbuf_append_charbuf(c, name);
+        ccnb_tagged_putf(c, CCN_DTAG_MaxSuffixComponents, "%d", 2);
+        ccnb_append_tagged_blob(c, CCN_DTAG_PublisherPublicKeyDigest,
+                                pub, sizeof(pub));
+        ccnb_element_begin(c, CCN_DTAG_Exclude);
+        for (k = 0; k < 4; k++) {
+            seg[0] = 0;
+            seg[1] = (j + 4 * k + 1) % 16;
+            if (seg[1] > k * 4)
+                ccnb_append_tagged_blob(c, CCN_DTAG_Component, seg, 2);
+        }
+        ccnb_element_end(c);
+        ccnb_tagged_putf(c, CCN_DTAG_Scope, "%d", 2);
+        ccnb_append_tagged_blob(c, CCN_DTAG_Nonce, pub, 6);
+        ccnb_element_end(c);
+        if (ccn_parse_interest(c->buf, c->length, &pis[j], NULL) < 0)
+            abort();
+    }
+    gettimeofday(&start, NULL);
+    for (i = 0; i < n; i++) {
+        k = i % NCOB;
+        for (j = 0; j < NPI; j++) {
+            pi = cached ? &pis[j] : NULL;
+            matched += ccn_content_matches_interest(cobs[k]->buf,
+                                                    cobs[k]->length, 1,
+                                                    &pcs[k],
+                                                    interests[j]->buf,
+                                                    interests[j]->length,
+                                                    pi);
+        }
+    }
+    bench_report(kind, "interest", n * NPI, &start);
+    printf("%-8s %-8s %8lu matched\n", kind, "check", matched);
+    for (i = 0; i < NCOB; i++)
+        ccn_charbuf_destroy(&cobs[i]);
+    for (j = 0; j < NPI; j++)
+        ccn_charbuf_destroy(&interests[j]);
+    ccn_charbuf_destroy(&name);
+}
+
+/**
+ * Interest stuffing as it was, scanning the whole nameprefix table.
+ */
+static int
+bench_old_stuff(struct ccnd_handle *h,
+                struct face *face, struct ccn_charbuf *c, size_t extra)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    int n_stuffed = 0;
+    int remaining_space;
+    
+    remaining_space = h->mtu - (int)(c->length + extra);
+    if (remaining_space < 20 || face == h->face0)
+        return(0);
+    for (hashtb_start(h->nameprefix_tab, e);
+         remaining_space >= 20 && e->data != NULL; hashtb_next(e)) {
+        struct nameprefix_entry *npe = e->data;
+        struct propagating_entry *head = &npe->pe_head;
+        struct propagating_entry *p;
+        for (p = head->next; p != head; p = p->next) {
+            if (p->outbound != NULL &&
+                p->outbound->n > p->sent &&
+                p->size <= remaining_space &&
+                p->interest_msg != NULL &&
+                ((p->flags & (CCN_PR_STUFFED1 | CCN_PR_WAIT1)) == 0) &&
+                ((p->flags & CCN_PR_UNSENT) == 0 ||
+                 p->outbound->buf[p->sent] == face->faceid) &&
+                promote_outbound(p, face->faceid) != -1) {
+                remaining_space -= p->size;
+                p->sent++;
+                n_stuffed++;
+                ccn_charbuf_append(c, p->interest_msg, p->size);
+                break;
+            }
+        }
+    }
+    hashtb_end(e);
+    return(n_stuffed);
+}
+
+/**
+ * Time stuffing of pending interests into the PDUs sent to a face,
+ * with a large nameprefix table.
+ *
+ * The scan kind is the way ccn_stuff_interest used to find candidates;
+ * the queue kind uses the face's stuffing queue.
+ */
+static void
+bench_stuff(const char *kind, int n)
+{
+    struct ccnd_handle *h;
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct hashtb_param param = {0};
+    struct face *faces[2] = {NULL, NULL};
+    struct face face = {0};
+    struct ccn_charbuf *c = ccn_charbuf_create();
+    struct ccn_charbuf *name = ccn_charbuf_create();
+    struct ccn_charbuf *key = ccn_charbuf_create();
+    struct ccn_indexbuf *comps = ccn_indexbuf_create();
+    struct ccn_parsed_interest pi = {0};
+    struct nameprefix_entry *npe;
+    struct propagating_entry *pe;
+    struct timeval start;
+    unsigned long stuffed = 0;
+    int queue = (strcmp(kind, "queue") == 0);
+    int nfib = 50000;
+    int npit = 20000;
+    int i;
+    
+    h = bench_handle();
+    param.finalize_data = h;
+    param.finalize = &finalize_nameprefix;
+    param.hash = &ccn_name_prefix_hash;
+    h->nameprefix_tab = hashtb_create(sizeof(struct nameprefix_entry), &param);
+    h->nameprefix_trie = ccn_nametrie_create();
+    param.hash = NULL;
+    param.finalize = &finalize_propagating;
+    h->propagating_tab = hashtb_create(sizeof(struct propagating_entry), &param);
+    h->pit_tab = hashtb_create(sizeof(struct pit_entry), NULL);
+    face.faceid = face.sendface = 1;
+    face.recvcount = 1;
+    faces[1] = &face;
+    h->faces_by_faceid = faces;
+    h->face_limit = 2;
+    h->mtu = 1400;
+    for (i = 0; i < nfib; i++) {
+        bench_name(name, i);
+        ccn_name_split(name, comps);
+        hashtb_start(h->nameprefix_tab, e);
+        nameprefix_seek(h, e, name->buf, comps, comps->n - 1);
+        npe = e->data;
+        hashtb_end(e);
+        if (i % (nfib / npit) != 0 || i / (nfib / npit) >= npit)
+            continue;
+        bench_interest(c, name, i, i + 1);
+        if (ccn_parse_interest(c->buf, c->length, &pi, NULL) < 0)
+            abort();
+        hashtb_start(h->propagating_tab, e);
+        hashtb_seek(e, c->buf + pi.offset[CCN_PI_B_Nonce],
+                    pi.offset[CCN_PI_E_Nonce] - pi.offset[CCN_PI_B_Nonce], 0);
+        pe = e->data;
+        hashtb_end(e);
+        pe->interest_msg = malloc(c->length);
+        memcpy(pe->interest_msg, c->buf, c->length);
+        pe->size = c->length;
+        pe->faceid = 2;
+        pe->usec = 4000000;
+        pe->outbound = ccn_indexbuf_create();
+        ccn_indexbuf_append_element(pe->outbound, face.faceid);
+        link_propagating_interest_to_nameprefix(h, pe, npe);
+        pit_key(key, c->buf, &pi);
+        pit_link(h, key, pe);
+        stuff_queue_update(h, pe);
+    }
+    gettimeofday(&start, NULL);
+    for (i = 0; i < n; i++) {
+        c->length = 0;
+        if (queue)
+            stuffed += ccn_stuff_interest(h, &face, c, 200);
+        else
+            stuffed += bench_old_stuff(h, &face, c, 200);
+    }
+    bench_report(kind, "send", n, &start);
+    printf("%-8s %-8s %8d prefixes, %d pending, %lu stuffed\n",
+           kind, "check", hashtb_n(h->nameprefix_tab), npit, stuffed);
+    hashtb_destroy(&h->propagating_tab);
+    hashtb_destroy(&h->nameprefix_tab);
+    hashtb_destroy(&h->pit_tab);
+    ccn_nametrie_destroy(&h->nameprefix_trie);
+    h->faces_by_faceid = NULL;
+    ccn_charbuf_destroy(&c);
+    ccn_charbuf_destroy(&name);
+    ccn_charbuf_destroy(&key);
+    ccn_indexbuf_destroy(&comps);
+    bench_free_handle(&h);
+}
+
+/**
+ * Duplicate nonce detection under an interest flood.
+ *
+ * Half of the arrivals repeat a nonce seen recently; the rest are new.
+ * The table kind inserts every nonce into propagating_tab, as
+ * is_duplicate_flooded used to, with the reaper coming around once per
+ * window.  The filter kind uses the nonce filter, aged once per window.
+ */
+static void
+bench_nonce(const char *kind, int n)
+{
+    enum { NONCE = 6 };
+    struct ccnd_handle *h;
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct hashtb_param param = {0};
+    struct ccnd_nonce_filter *f = NULL;
+    unsigned char *recent;
+    unsigned char nonce[NONCE];
+    unsigned short seed[3] = {0, 19, 0};
+    struct timeval start;
+    unsigned long dups = 0;
+    unsigned long found = 0;
+    unsigned long held = 0;
+    unsigned long peak = 0;
+    unsigned long bytes = 0;
+    unsigned long early = 0;
+    unsigned long fp = 0;
+    unsigned long fresh = 0;
+    int table = (strcmp(kind, "table") == 0);
+    int window = n / 8 + 1;
+    int nrecent = window / 2 + 1;
+    int probes = 1000000;
+    int res;
+    int i;
+    int j;
+    
+    h = bench_handle();
+    param.finalize_data = h;
+    param.finalize = &finalize_propagating;
+    h->propagating_tab = hashtb_create(sizeof(struct propagating_entry), &param);
+    f = ccnd_nonce_filter_create();
+    recent = calloc(nrecent, NONCE);
+    gettimeofday(&start, NULL);
+    for (i = 0; i < n; i++) {
+        if (fresh > nrecent && (nrand48(seed) & 1) != 0) {
+            memcpy(nonce, recent + NONCE * (nrand48(seed) % nrecent), NONCE);
+            dups++;
+        }
+        else {
+            for (j = 0; j < NONCE; j++)
+                nonce[j] = nrand48(seed);
+            memcpy(recent + NONCE * (fresh++ % nrecent), nonce, NONCE);
+        }
+        if (table) {
+            hashtb_start(h->propagating_tab, e);
+            res = hashtb_seek(e, nonce, NONCE, 0);
+            hashtb_end(e);
+            found += (res == HT_OLD_ENTRY);
+        }
+        else
+            found += ccnd_nonce_filter_check(f, nonce, NONCE);
+        if ((i + 1) % window == 0) {
+            if (table) {
+                held = hashtb_n(h->propagating_tab);
+                check_propagating(h);
+            }
+            else {
+                ccnd_nonce_filter_stats(f, &held, NULL);
+                ccnd_nonce_filter_age(f);
+            }
+            if (held > peak)
+                peak = held;
+        }
+    }
+    bench_report(kind, "interest", n, &start);
+    if (table) {
+        /* entry, key, hashtb node, and bucket pointer */
+        bytes = peak * (sizeof(struct propagating_entry) + NONCE +
+                        4 * sizeof(size_t) + sizeof(void *));
+    }
+    else {
+        early = ccnd_nonce_filter_stats(f, &held, &bytes);
+        for (i = 0; i < probes; i++) {
+            for (j = 0; j < NONCE; j++)
+                nonce[j] = nrand48(seed);
+            fp += ccnd_nonce_filter_check(f, nonce, NONCE);
+        }
+    }
+    printf("%-8s %-8s %lu dups, %lu found; peak %lu nonces, %.1f bytes each",
+           kind, "check", dups, found, peak, (double)bytes / (peak ? peak : 1));
+    if (table)
+        printf("\n");
+    else
+        printf("; %lu grown; false positives %.5f%%\n", early, 100.0 * fp / probes);
+    free(recent);
+    ccnd_nonce_filter_destroy(&f);
+    hashtb_destroy(&h->propagating_tab);
+    bench_free_handle(&h);
+}
+
+int
+main(int argc, char **argv)
+{
+    int n = 100000;
+    int i;
+    
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s index|cs|slab|admit|send|queue|shaper|fib|pit|match|stuff|nonce|hash|fresh|sched [count]\n"
+                        "       %s slab tracefile\n"
+                        "       %s hash urifile [count]\n",
+                argv[0], argv[0], argv[0]);
+        return(1);
+    }
+    if (strcmp(argv[1], "slab") == 0) {
+        struct bench_event *ev = NULL;
+        int m;
+        
+        if (argc > 2 && (argv[2][0] < '0' || argv[2][0] > '9'))
+            m = bench_slab_trace(argv[2], 0, &ev);
+        else
+            m = bench_slab_trace(NULL, argc > 2 ? atoi(argv[2]) : 200000, &ev);
+        if (m < 0)
+            return(1);
+        bench_slab("malloc", ev, m);
+        bench_slab("slab", ev, m);
+        free(ev);
+        return(0);
+    }
+    if (strcmp(argv[1], "hash") == 0) {
+        const char *file = NULL;
+        int a = 2;
+        
+        if (argc > a && (argv[a][0] < '0' || argv[a][0] > '9'))
+            file = argv[a++];
+        if (argc > a)
+            n = atoi(argv[a]);
+        return(bench_hash(file, n < 1 ? 1 : n) < 0);
+    }
+    if (argc > 2)
+        n = atoi(argv[2]);
+    if (n < 1)
+        n = 1;
+    if (strcmp(argv[1], "index") == 0) {
+        bench_index("skiplist", n);
+        bench_index("btree", n);
+        bench_same_name("skiplist", 2000);
+        bench_same_name("btree", 2000);
+        return(0);
+    }
+    if (strcmp(argv[1], "cs") == 0) {
+        bench_cs_policy("fifo", n);
+        bench_cs_policy("lru", n);
+        bench_cs_policy("clock", n);
+        bench_cs_policy("tinylfu", n);
+        bench_cs_uncapped(n < 20000 ? 20000 : n);
+        return(0);
+    }
+    if (strcmp(argv[1], "fib") == 0) {
+        bench_fib(n);
+        return(0);
+    }
+    if (strcmp(argv[1], "match") == 0) {
+        bench_match("reparse", n);
+        bench_match("cached", n);
+        return(0);
+    }
+    if (strcmp(argv[1], "nonce") == 0) {
+        bench_nonce("table", n);
+        bench_nonce("filter", n);
+        return(0);
+    }
+    if (strcmp(argv[1], "stuff") == 0) {
+        /* The scan kind walks every prefix once the queue runs dry */
+        if (argc <= 2)
+            n = 500;
+        bench_stuff("scan", n);
+        bench_stuff("queue", n);
+        return(0);
+    }
+    if (strcmp(argv[1], "pit") == 0) {
+        bench_pit(n);
+        return(0);
+    }
+    if (strcmp(argv[1], "send") == 0) {
+        static const size_t sizes[] = {1024, 4096, 8192};
+        for (i = 0; i < (int)(sizeof(sizes)/sizeof(sizes[0])); i++) {
+            bench_send("copy", 0, n, sizes[i]);
+            bench_send("iov", 0, n, sizes[i]);
+            bench_send("copy", 1, n, sizes[i]);
+            bench_send("iov", 1, n, sizes[i]);
+        }
+        return(0);
+    }
+    if (strcmp(argv[1], "queue") == 0) {
+        static const size_t sizes[] = {1024, 4096, 8192};
+        for (i = 0; i < (int)(sizeof(sizes)/sizeof(sizes[0])); i++) {
+            bench_queue(2, n, sizes[i]);
+            bench_queue(16, n, sizes[i]);
+            bench_queue(64, n, sizes[i]);
+        }
+        return(0);
+    }
+    if (strcmp(argv[1], "shaper") == 0) {
+        bench_shaper("fifo", n);
+        bench_shaper("drr", n);
+        return(0);
+    }
+    if (strcmp(argv[1], "sched") == 0) {
+        bench_sched("heap", n);
+        bench_sched("wheel", n);
+        return(0);
+    }
+    if (strcmp(argv[1], "fresh") == 0) {
+        bench_fresh("heap", n);
+        bench_fresh("wheel", n);
+        return(0);
+    }
+    if (strcmp(argv[1], "admit") == 0) {
+        static const size_t sizes[] = {256, 1024, 4096, 8192};
+        for (i = 0; i < (int)(sizeof(sizes)/sizeof(sizes[0])); i++) {
+            bench_admit("reencode", n, sizes[i]);
+            bench_admit("splice", n, sizes[i]);
+            bench_admit("defer", n, sizes[i]);
+        }
+        return(0);
+    }
+    fprintf(stderr, "%s: unknown benchmark %s\n", argv[0], argv[1]);
+    return(1);
+}
@@ -21,18 +21,22 @@ DEBRIS = anything.ccnb contentobjecthash.ccnb contentmishash.ccnb \
          contenthash.ccnb
 
 BROKEN_PROGRAMS = 
-CSRC = ccnd_main.c ccnd.c ccnd_msg.c ccnd_stats.c ccnd_internal_client.c ccndsmoketest.c
+BENCH_PROGRAMS = ccndbench
+CSRC = ccnd_main.c ccnd.c ccnd_msg.c ccnd_stats.c ccnd_internal_client.c \
+       ccnd_content_tree.c ccnd_cs_policy.c ccnd_nonce.c ccndsmoketest.c \
+       ccndbench.c
 HSRC = ccnd_private.h
 SCRIPTSRC = testbasics fortunes.ccnb contentobjecthash.ref anything.ref \
             ccnd-init-keystore-helper.sh minsuffix.ref
  
 default: $(PROGRAMS)
 
-all: default $(BROKEN_PROGRAMS)
+all: default $(BROKEN_PROGRAMS) $(BENCH_PROGRAMS)
 
-$(PROGRAMS): $(CCNLIBDIR)/libccn.a
+$(PROGRAMS) $(BENCH_PROGRAMS): $(CCNLIBDIR)/libccn.a
 
-CCND_OBJ = ccnd_main.o ccnd.o ccnd_msg.o ccnd_stats.o ccnd_internal_client.o
+CCND_OBJ = ccnd_main.o ccnd.o ccnd_msg.o ccnd_stats.o ccnd_internal_client.o \
+           ccnd_content_tree.o ccnd_cs_policy.o ccnd_nonce.o
 ccnd: $(CCND_OBJ) ccnd_built.sh
 	$(CC) $(CFLAGS) -o $@ $(CCND_OBJ) $(LDLIBS) $(OPENSSL_LIBS) -lcrypto
 	sh ./ccnd_built.sh
@@ -44,11 +48,17 @@ ccnd-init-keystore-helper: ccnd-init-keystore-helper.sh
 	sed -e 's@/bin/sh@'`which sh`'@g' ccnd-init-keystore-helper.sh > $@
 	chmod +x $@
 
+# Microbenchmarks for ccnd internals
+CCNDBENCH_OBJ = ccndbench.o ccnd_msg.o ccnd_stats.o ccnd_internal_client.o \
+                ccnd_content_tree.o ccnd_cs_policy.o ccnd_nonce.o
+ccndbench: $(CCNDBENCH_OBJ)
+	$(CC) $(CFLAGS) -o $@ $(CCNDBENCH_OBJ) $(LDLIBS) $(OPENSSL_LIBS) -lcrypto
+
 ccndsmoketest: ccndsmoketest.o
 	$(CC) $(CFLAGS) -o $@ ccndsmoketest.o $(LDLIBS)
 
 clean:
-	rm -f *.o *.a $(PROGRAMS) $(BROKEN_PROGRAMS) depend
+	rm -f *.o *.a $(PROGRAMS) $(BROKEN_PROGRAMS) $(BENCH_PROGRAMS) depend
 	rm -rf *.dSYM $(DEBRIS)
 
 check test: ccnd ccndsmoketest $(SCRIPTSRC)
@@ -65,12 +75,14 @@ ccnd_main.o: ccnd_main.c ccnd_private.h ../include/ccn/ccn_private.h \
   ../include/ccn/coding.h ../include/ccn/reg_mgmt.h \
   ../include/ccn/charbuf.h ../include/ccn/schedule.h \
   ../include/ccn/seqwriter.h
-ccnd.o: ccnd.c ../include/ccn/bloom.h ../include/ccn/ccn.h \
+ccnd.o: ccnd.c ../include/ccn/bloom.h ../include/ccn/btree_content.h \
+  ../include/ccn/btree.h ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
   ../include/ccn/indexbuf.h ../include/ccn/ccn_private.h \
   ../include/ccn/ccnd.h ../include/ccn/face_mgmt.h \
   ../include/ccn/sockcreate.h ../include/ccn/hashtb.h \
-  ../include/ccn/schedule.h ../include/ccn/reg_mgmt.h \
+  ../include/ccn/nametrie.h ../include/ccn/schedule.h \
+  ../include/ccn/slab.h ../include/ccn/reg_mgmt.h \
   ../include/ccn/uri.h ccnd_private.h ../include/ccn/seqwriter.h
 ccnd_msg.o: ccnd_msg.c ../include/ccn/ccn.h ../include/ccn/coding.h \
   ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
@@ -79,7 +91,7 @@ ccnd_msg.o: ccnd_msg.c ../include/ccn/ccn.h ../include/ccn/coding.h \
   ../include/ccn/schedule.h ../include/ccn/seqwriter.h
 ccnd_stats.o: ccnd_stats.c ../include/ccn/ccn.h ../include/ccn/coding.h \
   ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
-  ../include/ccn/ccnd.h ../include/ccn/schedule.h \
+  ../include/ccn/ccnd.h ../include/ccn/schedule.h ../include/ccn/slab.h \
   ../include/ccn/sockaddrutil.h ../include/ccn/hashtb.h \
   ../include/ccn/uri.h ccnd_private.h ../include/ccn/ccn_private.h \
   ../include/ccn/reg_mgmt.h ../include/ccn/seqwriter.h
@@ -89,5 +101,26 @@ ccnd_internal_client.o: ccnd_internal_client.c ../include/ccn/ccn.h \
   ../include/ccn/keystore.h ../include/ccn/schedule.h \
   ../include/ccn/sockaddrutil.h ../include/ccn/uri.h ccnd_private.h \
   ../include/ccn/reg_mgmt.h ../include/ccn/seqwriter.h
+ccnd_content_tree.o: ccnd_content_tree.c ccnd_private.h \
+  ../include/ccn/ccn_private.h ../include/ccn/coding.h \
+  ../include/ccn/reg_mgmt.h ../include/ccn/charbuf.h \
+  ../include/ccn/schedule.h ../include/ccn/seqwriter.h
+ccnd_cs_policy.o: ccnd_cs_policy.c ccnd_private.h \
+  ../include/ccn/ccn_private.h ../include/ccn/coding.h \
+  ../include/ccn/reg_mgmt.h ../include/ccn/charbuf.h \
+  ../include/ccn/schedule.h ../include/ccn/seqwriter.h
+ccnd_nonce.o: ccnd_nonce.c ../include/ccn/hashtb.h ccnd_private.h \
+  ../include/ccn/ccn_private.h ../include/ccn/coding.h \
+  ../include/ccn/reg_mgmt.h ../include/ccn/charbuf.h \
+  ../include/ccn/schedule.h ../include/ccn/seqwriter.h
+ccndbench.o: ccndbench.c ccnd.c ../include/ccn/bloom.h \
+  ../include/ccn/btree_content.h ../include/ccn/btree.h \
+  ../include/ccn/ccn.h ../include/ccn/coding.h ../include/ccn/charbuf.h \
+  ../include/ccn/indexbuf.h ../include/ccn/ccn_private.h \
+  ../include/ccn/ccnd.h ../include/ccn/face_mgmt.h \
+  ../include/ccn/sockcreate.h ../include/ccn/hashtb.h \
+  ../include/ccn/nametrie.h ../include/ccn/schedule.h \
+  ../include/ccn/slab.h ../include/ccn/reg_mgmt.h ../include/ccn/uri.h \
+  ccnd_private.h ../include/ccn/seqwriter.h
 ccndsmoketest.o: ccndsmoketest.c ../include/ccn/ccnd.h \
   ../include/ccn/ccn_private.h
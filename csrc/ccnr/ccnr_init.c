@@ -464,6 +464,8 @@ r_init_create(const char *progname, ccnr_logger logger, void *loggerdata)
     struct ccnr_handle *h = NULL;
     struct hashtb_param param = {0};
     struct ccn_charbuf *config = NULL;
+    struct timeval t0;
+    struct timeval t1;
     int res;
     
     h = calloc(1, sizeof(*h));
@@ -529,6 +531,7 @@ r_init_create(const char *progname, ccnr_logger logger, void *loggerdata)
         goto Bail;
     }
     r_util_reseed(h);
+    gettimeofday(&t0, NULL);
     r_store_init(h);
     if (h->running == -1) goto Bail;
     while (h->active_in_fd >= 0) {
@@ -536,7 +539,14 @@ r_init_create(const char *progname, ccnr_logger logger, void *loggerdata)
         r_store_trim(h, h->cob_limit);
         ccn_schedule_run(h->sched);
     }
-    ccnr_msg(h, "Repository file is indexed");
+    gettimeofday(&t1, NULL);
+    if (t1.tv_usec < t0.tv_usec) {
+        t1.tv_sec -= 1;
+        t1.tv_usec += 1000000;
+    }
+    ccnr_msg(h, "Repository file is indexed - %ju bytes in %ld.%03u seconds",
+             (uintmax_t)h->startupbytes, (long)(t1.tv_sec - t0.tv_sec),
+             (unsigned)((t1.tv_usec - t0.tv_usec) / 1000));
     if (h->face0 == NULL) {
         struct fdholder *fdholder;
         fdholder = calloc(1, sizeof(*fdholder));
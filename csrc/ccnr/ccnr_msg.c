@@ -201,8 +201,16 @@ const char *ccnr_usage_message =
     "      1024..8388608 (default 2097152) Maximum node size (bytes).\n"
     "    CCNR_BTREE_NODE_POOL=512\n"
     "      16..2000000 (default 512) Maximum number of btree nodes in memory.\n"
+    "    CCNR_BULK_INDEX_MEMORY=67108864\n"
+    "      0..68719476736 (default 67108864) Memory in bytes for sorting when rebuilding the index; 0 to index one object at a time.\n"
+    "    CCNR_BULK_INDEX_THREADS=0\n"
+    "      0..64 (default 0) Threads for parsing repoFile1 when rebuilding the index in bulk; 0 for one per CPU.\n"
     "    CCNR_CONTENT_CACHE=4201\n"
     "      16..2000000 (default 4201) Maximum number of ContentObjects cached in memory.\n"
+    "    CCNR_CONTENT_CACHE_BYTES=33554432\n"
+    "      65536..68719476736 (default 33554432) Maximum bytes of ContentObjects cached in memory.\n"
+    "    CCNR_INDEX_CHECKPOINT=60\n"
+    "      0..2000 (default 60) Seconds between index checkpoints; 0 for only at shutdown.\n"
     "    CCNR_MIN_SEND_BUFSIZE=16384\n"
     "      Minimum in bytes for output socket buffering.\n"
     "    CCNR_PROTO=unix\n"
@@ -60,6 +60,7 @@ struct content_tree_node;
 struct ccn_forwarding;
 struct enum_state;
 struct ccnr_parsed_policy;
+struct repofile_map;
 
 /* Repository-specific content identifiers */
 
@@ -181,8 +182,11 @@ struct ccnr_handle {
     int active_in_fd;               /**< data currently being indexed */
     int active_out_fd;              /**< repo file we will write to */
     int repofile1_fd;               /**< read-only access to repoFile1 */
-    off_t startupbytes;             /**< repoFile1 size at startup */
+    struct repofile_map *repofile1_map; /**< memory-mapped view of repoFile1 */
+    off_t startupbytes;             /**< repoFile1 bytes to index at startup */
     off_t stable;                   /**< repoFile1 size at shutdown */
+    off_t checkpointed;             /**< repoFile1 size covered by index checkpoint */
+    int checkpoint_secs;            /**< seconds between index checkpoints */
     struct ccn_scheduled_event *reaper;
     struct ccn_scheduled_event *age;
     struct ccn_scheduled_event *clean;
@@ -190,6 +194,7 @@ struct ccnr_handle {
     struct ccn_scheduled_event *reap_enumerations; /**< cleans out old enumeration state */
     struct ccn_scheduled_event *index_cleaner; /**< writes out btree nodes */
     struct ccn_indexbuf *toclean;   /**< for index_cleaner use */
+    struct ccn_scheduled_event *index_checkpointer; /**< makes index durable */
     const char *portstr;            /**< port number for status display */
     nfds_t nfds;                    /**< number of entries in fds array */
     struct pollfd *fds;             /**< used for poll system call */
@@ -208,11 +213,18 @@ struct ccnr_handle {
     ccnr_cookie cookie;      /**< newest used cookie number */
     ccnr_cookie min_stale;      /**< smallest cookie of stale content */
     ccnr_cookie max_stale;      /**< largest cookie of stale content */
-    ccnr_cookie trim_rover;     /**< where we left off trimming */
     unsigned long n_stale;          /**< Number of stale content objects */
     struct ccn_indexbuf *unsol;     /**< unsolicited content */
     unsigned long cob_count;  /**< count of accessioned content objects in memory */
     unsigned long cob_limit;  /**< trim when we get beyond this */
+    uintmax_t cob_bytes;      /**< bytes of accessioned content objects in memory */
+    uintmax_t cob_byte_limit; /**< trim when we get beyond this */
+    struct content_entry *cob_lru[2]; /**< probation and protected, MRU first */
+    uintmax_t cob_lru_bytes[2];     /**< bytes held in each cob_lru list */
+    unsigned long cob_hits;         /**< found already in memory */
+    unsigned long cob_misses;       /**< had to go to the repository file */
+    uintmax_t cob_bytes_read;       /**< bytes read from the repository file */
+    uintmax_t cob_bytes_mapped;     /**< bytes used from its mapped view */
     unsigned long oldformatcontent;
     unsigned long oldformatcontentgrumble;
     unsigned long oldformatinterests;
@@ -393,6 +393,8 @@ collect_stats_html(struct ccnr_handle *h)
         "<p class='header'>%s ccnr[%d] local port %s api %d start %ld.%06u now %ld.%06u</p>" NL
         "<div><b>Content items:</b> %llu accessioned,"
         " %llu cached, %lu stale, %d sparse, %lu duplicate, %lu sent</div>" NL
+        "<div><b>Content cache:</b> %ju bytes,"
+        " %lu hits, %lu misses (%u%% hits), %ju bytes read, %ju bytes mapped</div>" NL
         "<div><b>Interests:</b> %d names,"
         " %ld pending, %ld propagating, %ld noted</div>" NL
         "<div><b>Interest totals:</b> %lu accepted,"
@@ -413,6 +415,10 @@ collect_stats_html(struct ccnr_handle *h)
         hashtb_n(h->content_by_accession_tab),
         h->content_dups_recvd,
         h->content_items_sent,
+        h->cob_bytes,
+        h->cob_hits, h->cob_misses,
+        (unsigned)(h->cob_hits * 100ULL / (h->cob_hits + h->cob_misses + 1)),
+        h->cob_bytes_read, h->cob_bytes_mapped,
         hashtb_n(h->nameprefix_tab), stats.total_interest_counts,
         hashtb_n(h->propagating_tab) - stats.total_flood_control,
         stats.total_flood_control,
@@ -567,6 +573,11 @@ collect_stats_xml(struct ccnr_handle *h)
         "<sparse>%d</sparse>"
         "<duplicate>%lu</duplicate>"
         "<sent>%lu</sent>"
+        "<cachebytes>%ju</cachebytes>"
+        "<hits>%lu</hits>"
+        "<misses>%lu</misses>"
+        "<bytesread>%ju</bytesread>"
+        "<bytesmapped>%ju</bytesmapped>"
         "</cobs>"
         "<interests>"
         "<names>%d</names>"
@@ -584,6 +595,9 @@ collect_stats_xml(struct ccnr_handle *h)
         hashtb_n(h->content_by_accession_tab),
         h->content_dups_recvd,
         h->content_items_sent,
+        h->cob_bytes,
+        h->cob_hits, h->cob_misses,
+        h->cob_bytes_read, h->cob_bytes_mapped,
         hashtb_n(h->nameprefix_tab), stats.total_interest_counts,
         hashtb_n(h->propagating_tab) - stats.total_flood_control,
         stats.total_flood_control,
@@ -25,6 +25,7 @@
 #include <limits.h>
 #include <netdb.h>
 #include <poll.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -34,6 +35,7 @@
 #include <time.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <sys/mman.h>
 #include <sys/time.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -74,6 +76,23 @@ struct content_entry {
     int size;                   /**< size of ContentObject */
     struct ccn_charbuf *flatname; /**< for skiplist, et. al. */
     struct ccn_charbuf *cob;    /**< may contain ContentObject, or be NULL */
+    struct content_entry *lru_prev; /**< cob cache list links */
+    struct content_entry *lru_next;
+    int lru;                    /**< which cob_lru list, plus 1; 0 if none */
+};
+
+/**
+ * A read-only mapping of repoFile1.
+ *
+ * When the file has grown past the mapping, a new mapping of the whole
+ * file replaces it.  The old one stays mapped until the next r_store_trim,
+ * because callers may still be holding addresses from it.
+ */
+struct repofile_map {
+    unsigned char *base;        /**< start of mapping, or NULL */
+    size_t size;                /**< bytes of the file mapped */
+    int failed;                 /**< mmap failed; use pread instead */
+    struct repofile_map *retired; /**< older mappings, still mapped */
 };
 
 static const unsigned char *bogon = NULL;
@@ -86,6 +105,9 @@ r_store_content_btree_insert(struct ccnr_handle *h,
                              struct content_entry *content,
                              struct ccn_parsed_ContentObject *pco,
                              ccnr_accession *accession);
+static int
+r_store_bulk_index(struct ccnr_handle *h, off_t size, size_t limit,
+                   int nthreads);
 
 #define FAILIF(cond) do {} while ((cond) && r_store_fatal(h, __func__, __LINE__))
 #define CHKSYS(res) FAILIF((res) == -1)
@@ -136,10 +158,219 @@ r_store_repofile_from_accession(struct ccnr_handle *h, ccnr_accession a)
 }
 
 
+/*
+ * The in-memory copies of accessioned content objects are managed
+ * as a segmented LRU cache.  Newly buffered objects go on the probation
+ * list; one that is used again moves to the protected list, which may
+ * hold up to 80% of the byte budget.  Objects squeezed off the protected
+ * list get another turn on probation, and eviction takes the least
+ * recently used object on probation first.
+ */
+
+static void
+cob_lru_unlink(struct ccnr_handle *h, struct content_entry *content)
+{
+    struct content_entry **head = &h->cob_lru[content->lru - 1];
+    
+    if (content->lru_next == content)
+        *head = NULL;
+    else {
+        content->lru_prev->lru_next = content->lru_next;
+        content->lru_next->lru_prev = content->lru_prev;
+        if (*head == content)
+            *head = content->lru_next;
+    }
+    h->cob_lru_bytes[content->lru - 1] -= content->cob->length;
+    content->lru_prev = content->lru_next = NULL;
+    content->lru = 0;
+}
+
+static void
+cob_lru_push(struct ccnr_handle *h, struct content_entry *content, int which)
+{
+    struct content_entry **head = &h->cob_lru[which];
+    
+    if (*head == NULL)
+        content->lru_prev = content->lru_next = content;
+    else {
+        content->lru_next = *head;
+        content->lru_prev = (*head)->lru_prev;
+        content->lru_prev->lru_next = content;
+        (*head)->lru_prev = content;
+    }
+    *head = content;
+    h->cob_lru_bytes[which] += content->cob->length;
+    content->lru = which + 1;
+}
+
+/**
+ * Put a newly buffered copy under management of the cob cache,
+ * if it may be evicted (that is, if it is already in the repository).
+ */
+static void
+r_store_cache_insert(struct ccnr_handle *h, struct content_entry *content)
+{
+    if (content->lru != 0 || content->cob == NULL ||
+        content->accession == CCNR_NULL_ACCESSION)
+        return;
+    h->cob_count++;
+    h->cob_bytes += content->cob->length;
+    cob_lru_push(h, content, 0);
+}
+
+static void
+r_store_cache_remove(struct ccnr_handle *h, struct content_entry *content)
+{
+    if (content->lru == 0)
+        return;
+    h->cob_count--;
+    h->cob_bytes -= content->cob->length;
+    cob_lru_unlink(h, content);
+}
+
+static void
+r_store_cache_hit(struct ccnr_handle *h, struct content_entry *content)
+{
+    struct content_entry *old;
+    
+    if (content->lru == 0)
+        return;
+    cob_lru_unlink(h, content);
+    cob_lru_push(h, content, 1);
+    while (h->cob_lru_bytes[1] > h->cob_byte_limit / 5 * 4 &&
+           (old = h->cob_lru[1]->lru_prev) != content) {
+        cob_lru_unlink(h, old);
+        cob_lru_push(h, old, 0);
+    }
+}
+
+/**
+ * Make sure the mapping of repoFile1 covers at least the first need bytes.
+ * @returns 0 for success, -1 if it does not.
+ */
+static int
+r_store_map_repofile(struct ccnr_handle *h, int fd, off_t need)
+{
+    struct repofile_map *map = h->repofile1_map;
+    struct repofile_map *old = NULL;
+    struct stat statbuf;
+    void *base;
+    
+    if (map == NULL) {
+        map = calloc(1, sizeof(*map));
+        if (map == NULL)
+            return(-1);
+        h->repofile1_map = map;
+    }
+    if (map->failed)
+        return(-1);
+    if (need <= (off_t)map->size)
+        return(0);
+    if (fstat(fd, &statbuf) != 0 || statbuf.st_size < need)
+        return(-1);
+    if ((uintmax_t)statbuf.st_size > (uintmax_t)SIZE_MAX)
+        return(-1);
+    base = mmap(NULL, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        ccnr_msg(h, "mmap of repoFile1 (%ju bytes) failed - %s (errno = %d)",
+                 (uintmax_t)statbuf.st_size, strerror(errno), errno);
+        map->failed = 1;
+        return(-1);
+    }
+    /*
+     * Readahead is left on; the kernel backs off by itself when faults
+     * are scattered, and MADV_RANDOM makes objects that cross a page
+     * boundary cost two reads.  The repository need not be in a core dump.
+     */
+#ifdef MADV_DONTDUMP
+    madvise(base, statbuf.st_size, MADV_DONTDUMP);
+#endif
+    if (map->base != NULL) {
+        old = calloc(1, sizeof(*old));
+        if (old == NULL) {
+            munmap(base, statbuf.st_size);
+            return(-1);
+        }
+        old->base = map->base;
+        old->size = map->size;
+        old->retired = map->retired;
+        map->retired = old;
+    }
+    map->base = base;
+    map->size = statbuf.st_size;
+    if (CCNSHOULDLOG(h, sdf, CCNL_FINE))
+        ccnr_msg(h, "mapped %ju bytes of repoFile1", (uintmax_t)map->size);
+    return(0);
+}
+
+/**
+ * Unmap superseded mappings of repoFile1, or all of them if all is nonzero.
+ *
+ * This may only be called when nobody holds an address returned by
+ * r_store_content_base.
+ */
+static void
+r_store_unmap_repofile(struct ccnr_handle *h, int all)
+{
+    struct repofile_map *map = h->repofile1_map;
+    struct repofile_map *old;
+    
+    if (map == NULL)
+        return;
+    while ((old = map->retired) != NULL) {
+        map->retired = old->retired;
+        munmap(old->base, old->size);
+        free(old);
+    }
+    if (all) {
+        if (map->base != NULL)
+            munmap(map->base, map->size);
+        free(map);
+        h->repofile1_map = NULL;
+    }
+}
+
+/**
+ * Find the content object in the mapped view of the repository file.
+ *
+ * This avoids allocating and copying into a buffer, and leaves
+ * the caching to the page cache.
+ */
 static const unsigned char *
 r_store_content_mapped(struct ccnr_handle *h, struct content_entry *content)
 {
-    return(NULL);
+    unsigned repofile;
+    off_t offset;
+    int fd;
+    struct ccn_skeleton_decoder decoder = {0};
+    struct ccn_skeleton_decoder *d = &decoder;
+    const unsigned char *base;
+    size_t avail;
+    ssize_t dres;
+    
+    repofile = r_store_repofile_from_accession(h, content->accession);
+    offset = r_store_offset_from_accession(h, content->accession);
+    if (repofile != 1)
+        return(NULL);
+    fd = r_io_repo_data_file_fd(h, repofile, 0);
+    if (fd == -1)
+        return(NULL);
+    if (r_store_map_repofile(h, fd, offset + (content->size > 0 ? content->size : 1)) < 0)
+        return(NULL);
+    base = h->repofile1_map->base + offset;
+    if (content->size > 0)
+        return(base);
+    /* Size not yet known, so find the end of the object */
+    avail = h->repofile1_map->size - offset;
+    dres = ccn_skeleton_decode(d, base, avail);
+    if (d->state < 0) {
+        ccnr_msg(h, "r_store_content_mapped %u : error parsing cob", fd);
+        return(NULL);
+    }
+    if (d->state != 0 || dres <= 0)
+        return(NULL); /* runs past the mapping, let the read path try */
+    content->size = dres;
+    return(base);
 }
 
 static const unsigned char *
@@ -174,7 +405,7 @@ r_store_content_read(struct ccnr_handle *h, struct content_entry *content)
         if (rres == content->size) {
             cob->length = content->size;
             content->cob = cob;
-            h->cob_count++;
+            r_store_cache_insert(h, content);
             return(cob->buf);
         }
         if (rres == -1)
@@ -199,8 +430,8 @@ r_store_content_read(struct ccnr_handle *h, struct content_entry *content)
         if (ccn_charbuf_append(cob, buf, dres) < 0)
             goto Bail;
         content->cob = cob;
-        h->cob_count++;
-        return(cob->buf);        
+        r_store_cache_insert(h, content);
+        return(cob->buf);
     }
 Bail:
     ccn_charbuf_destroy(&cob);
@@ -216,8 +447,8 @@ PUBLIC int
 r_store_content_trim(struct ccnr_handle *h, struct content_entry *content)
 {
     if (content->accession != CCNR_NULL_ACCESSION && content->cob != NULL) {
+        r_store_cache_remove(h, content);
         ccn_charbuf_destroy(&content->cob);
-        h->cob_count--;
         return(0);
     }
     return(-1);
@@ -225,38 +456,37 @@ r_store_content_trim(struct ccnr_handle *h, struct content_entry *content)
 
 /**
  *  Evict recoverable content from in-memory buffers
+ *
+ * Trims until there are no more than limit objects, and no more
+ * than cob_byte_limit bytes, in the cache.
  */
 PUBLIC void
 r_store_trim(struct ccnr_handle *h, unsigned long limit)
 {
     struct content_entry *content = NULL;
-    int checklimit;
     unsigned before;
-    unsigned rover;
-    unsigned mask;
     
     r_store_index_needs_cleaning(h);
+    r_store_unmap_repofile(h, 0);
     before = h->cob_count;
-    if (before <= limit)
-        return;
-    checklimit = h->cookie_limit;
-    mask = h->cookie_limit - 1;
-    for (rover = (h->trim_rover & mask);
-         checklimit > 0 && h->cob_count > limit;
-         checklimit--, rover = (rover + 1) & mask) {
-        content = h->content_by_cookie[rover];
-        if (content != NULL)
-            r_store_content_trim(h, content);
+    while (h->cob_count > limit || h->cob_bytes > h->cob_byte_limit) {
+        content = h->cob_lru[0];
+        if (content == NULL)
+            content = h->cob_lru[1];
+        if (content == NULL)
+            break;
+        if (r_store_content_trim(h, content->lru_prev) < 0)
+            break;
     }
-    h->trim_rover = rover;
-    if (CCNSHOULDLOG(h, sdf, CCNL_FINER))
-        ccnr_msg(h, "trimmed %u cobs", before - h->cob_count);
+    if (before != h->cob_count && CCNSHOULDLOG(h, sdf, CCNL_FINER))
+        ccnr_msg(h, "trimmed %u cobs", before - (unsigned)h->cob_count);
 }
 
 /**
  *  Get the base address of the content object
  *
- * This may involve reading the object in.  Caller should not assume that
+ * This may involve reading the object in, but usually the address is
+ * in the mapped view of the repository file.  Caller should not assume that
  * the address will stay valid after it relinquishes control, either by
  * returning or by calling routines that might invalidate objects.
  *
@@ -268,14 +498,21 @@ r_store_content_base(struct ccnr_handle *h, struct content_entry *content)
     
     if (content->cob != NULL && content->cob->length == content->size) {
         ans = content->cob->buf;
+        h->cob_hits++;
+        r_store_cache_hit(h, content);
         goto Finish;
     }
     if (content->accession == CCNR_NULL_ACCESSION)
         goto Finish;
+    h->cob_misses++;
     ans = r_store_content_mapped(h, content);
-    if (ans != NULL)
+    if (ans != NULL) {
+        h->cob_bytes_mapped += content->size;
         goto Finish;
+    }
     ans = r_store_content_read(h, content);
+    if (ans != NULL)
+        h->cob_bytes_read += content->size;
 Finish:
     if (ans != NULL) {
         /* Sanity check - make sure first 2 and last 2 bytes are good */
@@ -429,6 +666,100 @@ r_store_reindexing(struct ccn_schedule *sched,
     return(2000000);
 }
 
+/**
+ * Make the index durable, as covering repoFile1 up to the point indexed.
+ *
+ * repoFile1 is flushed first, so that the checkpoint never covers data
+ * that could be lost.
+ * @returns 0 for success, -1 for error.
+ */
+static int
+r_store_checkpoint(struct ccnr_handle *h)
+{
+    struct fdholder *in = NULL;
+    struct ccn_charbuf *path = NULL;
+    off_t covered;
+    int fd;
+    int res = -1;
+    
+    if (h->btree == NULL || h->btree->io == NULL)
+        return(-1);
+    if (h->active_in_fd >= 0) {
+        in = r_io_fdholder_from_fd(h, h->active_in_fd);
+        if (in == NULL)
+            return(-1);
+        covered = in->bufoffset;
+    }
+    else
+        covered = h->stable;
+    if (covered == h->checkpointed)
+        return(0);
+    path = ccn_charbuf_create();
+    ccn_charbuf_putf(path, "%s/repoFile1", h->directory);
+    fd = open(ccn_charbuf_as_string(path), O_RDONLY);
+    if (fd != -1) {
+        res = fsync(fd);
+        close(fd);
+    }
+    if (res < 0 && errno != ENOENT)
+        ccnr_msg(h, "cannot sync %s: %s",
+                 ccn_charbuf_as_string(path), strerror(errno));
+    else {
+        path->length = 0;
+        ccn_charbuf_putf(path, "%ju", (uintmax_t)covered);
+        res = ccn_btree_checkpoint(h->btree, ccn_charbuf_as_string(path));
+        if (res < 0)
+            ccnr_msg(h, "index checkpoint failed");
+        else {
+            h->checkpointed = covered;
+            if (CCNSHOULDLOG(h, sdfsdffd, CCNL_FINE))
+                ccnr_msg(h, "index checkpoint at %ju", (uintmax_t)covered);
+        }
+    }
+    ccn_charbuf_destroy(&path);
+    return(res);
+}
+
+static int
+r_store_index_checkpointer(struct ccn_schedule *sched,
+                           void *clienth,
+                           struct ccn_scheduled_event *ev,
+                           int flags)
+{
+    struct ccnr_handle *h = clienth;
+    
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0) {
+        h->index_checkpointer = NULL;
+        return(0);
+    }
+    r_store_checkpoint(h);
+    return(h->checkpoint_secs * 1000000);
+}
+
+/**
+ * Read the repoFile1 size covered by the last index checkpoint.
+ * @returns the size, or -1 if there is no usable checkpoint.
+ */
+static off_t
+r_store_checkpoint_offset(struct ccnr_handle *h)
+{
+    struct ccn_charbuf *cb = NULL;
+    uintmax_t val;
+    size_t i;
+    
+    if (h->btree == NULL || h->btree->io == NULL)
+        return(-1);
+    cb = h->btree->io->checkpoint;
+    if (cb == NULL || cb->length == 0)
+        return(-1);
+    for (val = 0, i = 0; i < cb->length; i++) {
+        if (cb->buf[i] < '0' || cb->buf[i] > '9')
+            return(-1);
+        val = val * 10 + (cb->buf[i] - '0');
+    }
+    return(val);
+}
+
 /**
  * Select power of 2 between l and m + 1 (if possible).
  */
@@ -456,12 +787,18 @@ r_store_init(struct ccnr_handle *h)
     struct ccn_charbuf *path = NULL;
     struct ccn_charbuf *msgs = NULL;
     off_t offset;
+    off_t ckpt;
+    intmax_t bulk;
+    int bulkthreads;
+    int reindex = 0;
     
     path = ccn_charbuf_create();
     param.finalize_data = h;
     param.finalize = 0;
     
     h->cob_limit = r_init_confval(h, "CCNR_CONTENT_CACHE", 16, 2000000, 4201);
+    h->cob_byte_limit = r_init_confval(h, "CCNR_CONTENT_CACHE_BYTES", 65536,
+                                       ((intmax_t)1) << 36, 33554432);
     h->cookie_limit = choose_limit(h->cob_limit, (ccnr_cookie)(~0U));
     h->content_by_cookie = calloc(h->cookie_limit, sizeof(h->content_by_cookie[0]));
     CHKPTR(h->content_by_cookie);
@@ -503,8 +840,25 @@ r_store_init(struct ccnr_handle *h)
     h->active_in_fd = -1;
     h->active_out_fd = r_io_open_repo_data_file(h, "repoFile1", 1); /* output */
     offset = lseek(h->active_out_fd, 0, SEEK_END);
-    h->startupbytes = offset;
-    if (offset != h->stable || node->corrupt != 0) {
+    h->startupbytes = 0;
+    h->checkpointed = ckpt = r_store_checkpoint_offset(h);
+    if (offset != h->stable && node->corrupt == 0 &&
+          ckpt >= 0 && ckpt <= offset) {
+        /* Index only what came after the checkpoint */
+        ccnr_msg(h, "Index not current - resuming from checkpoint at %ju",
+                 (uintmax_t)ckpt);
+        h->stable = 0;
+        h->startupbytes = offset - ckpt;
+        h->active_in_fd = r_io_open_repo_data_file(h, "repoFile1", 0); /* input */
+        if (h->active_in_fd >= 0) {
+            r_io_fdholder_from_fd(h, h->active_in_fd)->bufoffset = ckpt;
+            if (lseek(h->active_in_fd, ckpt, SEEK_SET) != ckpt)
+                r_init_fail(h, __LINE__, "repoFile1", errno);
+        }
+        if (CCNSHOULDLOG(h, dfds, CCNL_INFO))
+            ccn_schedule_event(h->sched, 50000, r_store_reindexing, NULL, 0);
+    }
+    else if (offset != h->stable || node->corrupt != 0) {
         ccnr_msg(h, "Index not current - resetting");
         ccn_btree_init_node(node, 0, 'R', 0);
         node = NULL;
@@ -519,6 +873,10 @@ r_store_init(struct ccnr_handle *h)
             if (res < 0)
                 j++;
         }
+        path->length = 0;
+        ccn_charbuf_putf(path, "%s/index/checkpoint", h->directory);
+        unlink(ccn_charbuf_as_string(path));
+        h->checkpointed = -1;
         h->btree = btree = ccn_btree_create();
         path->length = 0;
         ccn_charbuf_putf(path, "%s/index", h->directory);
@@ -530,10 +888,9 @@ r_store_init(struct ccnr_handle *h)
         btree->nextnodeid = btree->io->maxnodeid + 1;
         ccn_btree_init_node(node, 0, 'R', 0);
         h->stable = 0;
-        h->active_in_fd = r_io_open_repo_data_file(h, "repoFile1", 0); /* input */
+        h->startupbytes = offset;
+        reindex = 1;
         ccn_charbuf_destroy(&path);
-        if (CCNSHOULDLOG(h, dfds, CCNL_INFO))
-            ccn_schedule_event(h->sched, 50000, r_store_reindexing, NULL, 0);
     }
     if (CCNSHOULDLOG(h, weuyg, CCNL_FINEST)) {
         FILE *dumpfile = NULL;
@@ -558,6 +915,27 @@ r_store_init(struct ccnr_handle *h)
     btree->full0 = r_init_confval(h, "CCNR_BTREE_MAX_LEAF_ENTRIES", 4, 9999, 1999);
     btree->nodebytes = r_init_confval(h, "CCNR_BTREE_MAX_NODE_BYTES", 1024, 8388608, 2097152);
     btree->nodepool = r_init_confval(h, "CCNR_BTREE_NODE_POOL", 16, 2000000, 512);
+    h->checkpoint_secs = r_init_confval(h, "CCNR_INDEX_CHECKPOINT", 0, 2000, 60);
+    bulk = r_init_confval(h, "CCNR_BULK_INDEX_MEMORY", 0,
+                          ((intmax_t)1) << 36, 67108864);
+    bulkthreads = r_init_confval(h, "CCNR_BULK_INDEX_THREADS", 0, 64, 0);
+    if (reindex) {
+        if (bulk > 0 &&
+              r_store_bulk_index(h, offset, bulk, bulkthreads) == 0) {
+            h->stable = offset;
+            r_store_checkpoint(h);
+        }
+        else {
+            h->active_in_fd = r_io_open_repo_data_file(h, "repoFile1", 0); /* input */
+            if (CCNSHOULDLOG(h, dfds, CCNL_INFO))
+                ccn_schedule_event(h->sched, 50000, r_store_reindexing, NULL, 0);
+        }
+    }
+    if (h->checkpoint_secs > 0 && h->running != -1)
+        h->index_checkpointer = ccn_schedule_event(h->sched,
+                                                   h->checkpoint_secs * 1000000,
+                                                   r_store_index_checkpointer,
+                                                   NULL, 0);
     if (h->running != -1)
         r_store_index_needs_cleaning(h);
 }
@@ -566,6 +944,10 @@ PUBLIC int
 r_store_final(struct ccnr_handle *h, int stable) {
     int res;
     
+    r_store_unmap_repofile(h, 1);
+    /* Without a checkpoint, the index would roll back on restart */
+    if (stable && r_store_checkpoint(h) < 0)
+        stable = 0;
     res = ccn_btree_destroy(&h->btree);
     if (res < 0)
         ccnr_msg(h, "r_store_final.%d-%d Errors while closing index", __LINE__, res);
@@ -662,6 +1044,33 @@ r_store_enroll_content(struct ccnr_handle *h, struct content_entry *content)
     return(cookie);
 }
 
+/**
+ * Split a leaf that has grown too big, and any nodes above it that
+ * become too big as a result.
+ * @returns -1 if a node could not be fetched, otherwise 0.
+ */
+static int
+r_store_btree_split_as_needed(struct ccnr_handle *h,
+                              struct ccn_btree_node *leaf)
+{
+    struct ccn_btree *btree = h->btree;
+    struct ccn_btree_node *node = NULL;
+    int limit;
+    int res;
+    
+    if (ccn_btree_oversize(btree, leaf)) {
+        res = ccn_btree_split(btree, leaf);
+        for (limit = 100; res >= 0 && btree->nextsplit != 0; limit--) {
+            if (limit == 0) abort();
+            node = ccn_btree_getnode(btree, btree->nextsplit, 0);
+            if (node == NULL)
+                return(-1);
+            res = ccn_btree_split(btree, node);
+        }
+    }
+    return(0);
+}
+
 /** @returns 2 if content was added to index, 1 if it was there but had no accession, 0 if it was already there, -1 for error */
 static int
 r_store_content_btree_insert(struct ccnr_handle *h,
@@ -672,10 +1081,8 @@ r_store_content_btree_insert(struct ccnr_handle *h,
     const unsigned char *content_base = NULL;
     struct ccn_btree *btree = NULL;
     struct ccn_btree_node *leaf = NULL;
-    struct ccn_btree_node *node = NULL;
     struct ccn_charbuf *flat = NULL;
     int i;
-    int limit;
     int res;
 
     btree = h->btree;
@@ -706,16 +1113,9 @@ r_store_content_btree_insert(struct ccnr_handle *h,
                                        content->flatname);
         if (res < 0)
             return(-1);
-        if (ccn_btree_oversize(btree, leaf)) {
-            res = ccn_btree_split(btree, leaf);
-            for (limit = 100; res >= 0 && btree->nextsplit != 0; limit--) {
-                if (limit == 0) abort();
-                node = ccn_btree_getnode(btree, btree->nextsplit, 0);
-                if (node == NULL)
-                    return(-1);
-                res = ccn_btree_split(btree, node);
-            }
-        }
+        res = r_store_btree_split_as_needed(h, leaf);
+        if (res < 0)
+            return(-1);
         r_store_index_needs_cleaning(h);
         
         *accp = content->accession;
@@ -763,10 +1163,8 @@ r_store_forget_content(struct ccnr_handle *h, struct content_entry **pentry)
     }
     /* Clean up allocated subfields */
     ccn_charbuf_destroy(&entry->flatname);
-    if (entry->cob != NULL) {
-        h->cob_count--;
-        ccn_charbuf_destroy(&entry->cob);
-    }
+    r_store_cache_remove(h, entry);
+    ccn_charbuf_destroy(&entry->cob);
     free(entry);
 }
 
@@ -1270,8 +1668,7 @@ r_store_set_accession_from_offset(struct ccnr_handle *h,
         entry = e->data;
         if (entry != NULL) {
             entry->content = content;
-            if (content->cob != NULL)
-                h->cob_count++;
+            r_store_cache_insert(h, content);
         }
         hashtb_end(e);
         if (content->flatname != NULL) {
@@ -1347,6 +1744,841 @@ ccnr_debug_content(struct ccnr_handle *h,
     ccn_charbuf_destroy(&c);
 }
 
+/**
+ * Bulk indexing of repoFile1
+ *
+ * When the index has to be rebuilt from nothing, it is much quicker to
+ * make one sequential pass over repoFile1 and then build the index
+ * bottom-up in key order than to insert the objects one at a time as
+ * they are read.
+ *
+ * The pass collects a record for each ContentObject - its flatname,
+ * offset, and index entry payload - into a run that is sorted when it
+ * reaches the memory budget.  Sorted runs are spilled to temporary files
+ * in the index directory, and merged with those still in memory when
+ * the pass is done.
+ *
+ * Finding where each message ends is cheap, so repoFile1 is read on one
+ * thread.  Parsing the messages, digesting them, and making their
+ * flatnames is not, so when there are scan workers the complete messages
+ * are handed out to them in batches.  Each worker collects, sorts, and
+ * spills runs of its own, with its share of the memory budget.
+ */
+
+/** Bytes of repoFile1 read at a time */
+#define BULK_READ_CHUNK (1 << 20)
+/**
+ * A bulk record is a 2-byte key size, an 8-byte repoFile1 offset,
+ * and the entry payload, followed by the key.  Multi-byte values are
+ * big-endian.
+ */
+#define BULK_HDR 10
+#define BULK_PAYLOAD (sizeof(struct ccn_btree_content_payload))
+#define BULK_KEY (BULK_HDR + BULK_PAYLOAD)
+#define BULK_KEYSIZE(r) (((r)[0] << 8) + (r)[1])
+/** Smallest memory budget that is worth the trouble */
+#define BULK_MIN_MEMORY (1 << 20)
+/** Percentage of each index node to fill, leaving room for later inserts */
+#define BULK_FILL 90
+/** Most scan workers */
+#define BULK_MAX_THREADS 64
+
+struct bulk_index {
+    struct ccn_charbuf *recs;   /**< records of the run being collected */
+    struct ccn_indexbuf *starts; /**< where each record starts in recs */
+    struct ccn_charbuf *flat;   /**< scratch for flatnames */
+    struct ccn_charbuf *last;   /**< key of the last entry loaded */
+    struct ccn_btree_loader *loader; /**< builds the index */
+    struct bulk_index *top;     /**< where spilled runs are counted */
+    pthread_mutex_t *lock;      /**< guards top->nruns, if threaded */
+    const unsigned char **v;    /**< the last run, once sorted */
+    size_t limit;               /**< memory budget for a run */
+    int nruns;                  /**< runs spilled to files */
+    int failed;                 /**< run that could not be written */
+    int err;                    /**< errno for that, or 0 */
+    uintmax_t objects;          /**< ContentObjects found */
+    uintmax_t skipped;          /**< messages that could not be indexed */
+    uintmax_t entries;          /**< entries loaded into the index */
+};
+
+struct bulk_pool;
+
+/**
+ * A scan worker parses the batches of messages handed to it.
+ */
+struct bulk_worker {
+    struct bulk_pool *pool;     /**< the workers this is one of */
+    struct bulk_index run;      /**< records collected by this worker */
+    struct ccn_charbuf *batch;  /**< complete messages to parse */
+    struct ccn_indexbuf *ends;  /**< where each message ends in batch */
+    off_t pos;                  /**< repoFile1 offset of batch */
+    int busy;                   /**< batch is not yet parsed */
+    int res;                    /**< -1 once anything has failed */
+    int started;                /**< thread was created */
+    pthread_t thread;
+};
+
+struct bulk_pool {
+    struct ccnr_handle *h;
+    pthread_mutex_t lock;       /**< guards busy, res, quit, and nruns */
+    pthread_cond_t cond;        /**< signalled when busy or quit changes */
+    int quit;                   /**< no more batches are coming */
+    int n;                      /**< number of workers, maybe 0 */
+    struct bulk_worker *w;
+};
+
+struct bulk_source {
+    FILE *f;                    /**< a spilled run, or NULL */
+    struct ccn_charbuf *rec;    /**< current record read from f */
+    int k;                      /**< run number of f */
+    const unsigned char **v;    /**< else a sorted run in memory */
+    size_t i;                   /**< next record of v */
+    const unsigned char *cur;   /**< current record */
+};
+
+/**
+ * Order bulk records by key, and by offset for equal keys.
+ */
+static int
+bulk_compare(const unsigned char *a, const unsigned char *b)
+{
+    size_t as = BULK_KEYSIZE(a);
+    size_t bs = BULK_KEYSIZE(b);
+    int res;
+    
+    res = memcmp(a + BULK_KEY, b + BULK_KEY, as < bs ? as : bs);
+    if (res != 0)
+        return(res);
+    if (as != bs)
+        return(as < bs ? -1 : 1);
+    return(memcmp(a + 2, b + 2, 8));
+}
+
+static int
+bulk_qsort_compare(const void *a, const void *b)
+{
+    return(bulk_compare(*(const unsigned char * const *)a,
+                        *(const unsigned char * const *)b));
+}
+
+static void
+bulk_run_path(struct ccnr_handle *h, struct ccn_charbuf *path, int k)
+{
+    path->length = 0;
+    ccn_charbuf_putf(path, "%s/index/bulk.%d", h->directory, k);
+}
+
+/**
+ * Set up to collect runs, counting the spilled ones in top.
+ * @returns 0 for success, -1 for error.
+ */
+static int
+bulk_run_init(struct bulk_index *bi, struct bulk_index *top, size_t limit)
+{
+    bi->recs = ccn_charbuf_create();
+    bi->starts = ccn_indexbuf_create();
+    bi->flat = ccn_charbuf_create();
+    bi->top = top;
+    bi->limit = limit;
+    if (bi->recs == NULL || bi->starts == NULL || bi->flat == NULL)
+        return(-1);
+    return(0);
+}
+
+static void
+bulk_run_destroy(struct bulk_index *bi)
+{
+    ccn_charbuf_destroy(&bi->recs);
+    ccn_indexbuf_destroy(&bi->starts);
+    ccn_charbuf_destroy(&bi->flat);
+    free(bi->v);
+    bi->v = NULL;
+}
+
+/**
+ * Sort the records of the current run.
+ * @returns a malloc'ed array of record pointers, ending with NULL, or NULL.
+ */
+static const unsigned char **
+bulk_sort_run(struct bulk_index *bi)
+{
+    const unsigned char **v = NULL;
+    size_t i;
+    
+    v = calloc(bi->starts->n + 1, sizeof(v[0]));
+    if (v == NULL)
+        return(NULL);
+    for (i = 0; i < bi->starts->n; i++)
+        v[i] = bi->recs->buf + bi->starts->buf[i];
+    qsort(v, bi->starts->n, sizeof(v[0]), bulk_qsort_compare);
+    return(v);
+}
+
+/**
+ * Sort the current run and write it to a temporary file.
+ *
+ * This may run on a scan worker, where logging is not safe, so a
+ * failure is noted for bulk_report.
+ * @returns 0 for success, -1 for error.
+ */
+static int
+bulk_spill(struct ccnr_handle *h, struct bulk_index *bi)
+{
+    const unsigned char **v = NULL;
+    struct ccn_charbuf *path = NULL;
+    FILE *f = NULL;
+    size_t i;
+    int k;
+    int res = -1;
+    
+    v = bulk_sort_run(bi);
+    if (v == NULL)
+        return(-1);
+    if (bi->lock != NULL)
+        pthread_mutex_lock(bi->lock);
+    k = bi->top->nruns++;
+    if (bi->lock != NULL)
+        pthread_mutex_unlock(bi->lock);
+    path = ccn_charbuf_create();
+    bulk_run_path(h, path, k);
+    f = fopen(ccn_charbuf_as_string(path), "w");
+    if (f != NULL) {
+        for (i = 0; i < bi->starts->n; i++)
+            if (fwrite(v[i], BULK_KEY + BULK_KEYSIZE(v[i]), 1, f) != 1)
+                break;
+        res = (i == bi->starts->n) ? 0 : -1;
+        if (fclose(f) != 0)
+            res = -1;
+    }
+    if (res < 0 && bi->err == 0) {
+        bi->failed = k;
+        bi->err = errno != 0 ? errno : EIO;
+    }
+    bi->recs->length = 0;
+    bi->starts->n = 0;
+    ccn_charbuf_destroy(&path);
+    free(v);
+    return(res);
+}
+
+/**
+ * Log the run that could not be written, if any.
+ */
+static void
+bulk_report(struct ccnr_handle *h, struct bulk_index *bi)
+{
+    struct ccn_charbuf *path = NULL;
+    
+    if (bi->err == 0)
+        return;
+    path = ccn_charbuf_create();
+    bulk_run_path(h, path, bi->failed);
+    ccnr_msg(h, "cannot write %s: %s",
+             ccn_charbuf_as_string(path), strerror(bi->err));
+    ccn_charbuf_destroy(&path);
+}
+
+/**
+ * Collect the index record for one message of repoFile1.
+ * @returns 0 for success, -1 for error.
+ */
+static int
+bulk_add_message(struct ccnr_handle *h, struct bulk_index *bi,
+                 const unsigned char *msg, size_t size, off_t offset)
+{
+    struct ccn_parsed_ContentObject pco = {0};
+    struct ccn_btree_content_payload payload;
+    struct ccn_charbuf *flat = bi->flat;
+    unsigned char hdr[BULK_HDR];
+    uint_least64_t cobid;
+    size_t start;
+    int res;
+    int i;
+    
+    res = ccn_parse_ContentObject(msg, size, &pco, NULL);
+    if (res < 0)
+        goto Skip;
+    bi->objects++;
+    ccn_digest_ContentObject(msg, &pco);
+    if (pco.digest_bytes != 32)
+        goto Skip;
+    flat->length = 0;
+    res = ccn_flatname_from_ccnb(flat, msg, size);
+    if (res >= 0)
+        res = ccn_flatname_append_component(flat, pco.digest, pco.digest_bytes);
+    if (res < 0 || flat->length > 0xFFFF)
+        goto Skip;
+    cobid = ccnr_accession_encode(h, ((ccnr_accession)offset) |
+                                     r_store_mark_repoFile1);
+    res = ccn_btree_content_payload_init(&payload, cobid, msg, &pco, flat);
+    if (res < 0)
+        goto Skip;
+    hdr[0] = flat->length >> 8;
+    hdr[1] = flat->length;
+    for (i = 0; i < 8; i++)
+        hdr[2 + i] = ((uintmax_t)offset) >> (8 * (7 - i));
+    start = bi->recs->length;
+    if (ccn_indexbuf_append_element(bi->starts, start) < 0 ||
+        ccn_charbuf_append(bi->recs, hdr, sizeof(hdr)) < 0 ||
+        ccn_charbuf_append(bi->recs, &payload, sizeof(payload)) < 0 ||
+        ccn_charbuf_append_charbuf(bi->recs, flat) < 0)
+        return(-1);
+    if (bi->recs->length + bi->starts->n * sizeof(bi->starts->buf[0]) >=
+          bi->limit)
+        return(bulk_spill(h, bi));
+    return(0);
+Skip:
+    bi->skipped++;
+    return(0);
+}
+
+/**
+ * Collect the records for a batch of complete messages.
+ * @param ends holds where each message ends in batch.
+ * @returns 0 for success, -1 for error.
+ */
+static int
+bulk_parse_batch(struct ccnr_handle *h, struct bulk_index *bi,
+                 const unsigned char *batch, struct ccn_indexbuf *ends,
+                 off_t pos)
+{
+    size_t start = 0;
+    size_t i;
+    
+    for (i = 0; i < ends->n; start = ends->buf[i++]) {
+        if (bulk_add_message(h, bi, batch + start, ends->buf[i] - start,
+                             pos + start) < 0)
+            return(-1);
+    }
+    return(0);
+}
+
+static void *
+bulk_worker_main(void *arg)
+{
+    struct bulk_worker *w = arg;
+    struct bulk_pool *pool = w->pool;
+    int res;
+    
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!w->busy && !pool->quit)
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        if (!w->busy)
+            break;
+        pthread_mutex_unlock(&pool->lock);
+        res = bulk_parse_batch(pool->h, &w->run, w->batch->buf, w->ends,
+                               w->pos);
+        pthread_mutex_lock(&pool->lock);
+        if (res < 0)
+            w->res = -1;
+        w->busy = 0;
+        pthread_cond_broadcast(&pool->cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    /* What is left gets merged from memory */
+    if (w->res == 0 && w->run.starts->n > 0) {
+        w->run.v = bulk_sort_run(&w->run);
+        if (w->run.v == NULL)
+            w->res = -1;
+    }
+    return(NULL);
+}
+
+/**
+ * Start n scan workers, sharing the memory budget of bi among them.
+ * @returns 0 for success, -1 for error.
+ */
+static int
+bulk_pool_start(struct bulk_pool *pool, struct bulk_index *bi, int n)
+{
+    struct bulk_worker *w = NULL;
+    size_t limit;
+    int i;
+    
+    pool->w = calloc(n, sizeof(pool->w[0]));
+    if (pool->w == NULL)
+        return(-1);
+    pool->n = n;
+    limit = bi->limit / n;
+    if (limit < BULK_MIN_MEMORY)
+        limit = BULK_MIN_MEMORY;
+    for (i = 0; i < n; i++) {
+        w = &pool->w[i];
+        w->pool = pool;
+        w->batch = ccn_charbuf_create();
+        w->ends = ccn_indexbuf_create();
+        if (bulk_run_init(&w->run, bi, limit) < 0 ||
+              w->batch == NULL || w->ends == NULL)
+            return(-1);
+        w->run.lock = &pool->lock;
+        if (pthread_create(&w->thread, NULL, bulk_worker_main, w) != 0)
+            return(-1);
+        w->started = 1;
+    }
+    return(0);
+}
+
+/**
+ * Tell the scan workers that no more batches are coming, and wait
+ * for them to finish.
+ * @returns 0 for success, -1 if any of them failed.
+ */
+static int
+bulk_pool_finish(struct bulk_pool *pool, struct bulk_index *bi)
+{
+    struct bulk_worker *w = NULL;
+    int res = 0;
+    int i;
+    
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (i = 0; i < pool->n; i++) {
+        w = &pool->w[i];
+        if (w->started)
+            pthread_join(w->thread, NULL);
+        w->started = 0;
+        bulk_report(pool->h, &w->run);
+        if (w->res < 0)
+            res = -1;
+        bi->objects += w->run.objects;
+        bi->skipped += w->run.skipped;
+    }
+    return(res);
+}
+
+static void
+bulk_pool_destroy(struct bulk_pool *pool)
+{
+    int i;
+    
+    for (i = 0; pool->w != NULL && i < pool->n; i++) {
+        bulk_run_destroy(&pool->w[i].run);
+        ccn_charbuf_destroy(&pool->w[i].batch);
+        ccn_indexbuf_destroy(&pool->w[i].ends);
+    }
+    free(pool->w);
+    pool->w = NULL;
+    pool->n = 0;
+}
+
+/**
+ * Parse the complete messages at the front of *pbuf, leaving the rest.
+ *
+ * With scan workers, the buffer goes to the first idle one, and *pbuf
+ * is replaced by the one it finished with.  Likewise for *pends.
+ * @param used is where the last complete message ends.
+ * @returns 0 for success, -1 for error.
+ */
+static int
+bulk_dispatch(struct bulk_pool *pool, struct bulk_index *bi,
+              struct ccn_charbuf **pbuf, struct ccn_indexbuf **pends,
+              off_t pos, size_t used)
+{
+    struct ccn_charbuf *buf = *pbuf;
+    struct ccn_indexbuf *ends = *pends;
+    struct bulk_worker *w = NULL;
+    int res = 0;
+    int i;
+    
+    if (pool->n == 0) {
+        res = bulk_parse_batch(pool->h, bi, buf->buf, ends, pos);
+        memmove(buf->buf, buf->buf + used, buf->length - used);
+        buf->length -= used;
+        return(res);
+    }
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        for (i = 0; i < pool->n; i++) {
+            if (pool->w[i].res < 0)
+                res = -1;
+            else if (!pool->w[i].busy && w == NULL)
+                w = &pool->w[i];
+        }
+        if (res < 0 || w != NULL)
+            break;
+        pthread_cond_wait(&pool->cond, &pool->lock);
+    }
+    if (res == 0) {
+        *pbuf = w->batch;
+        *pends = w->ends;
+        w->batch = buf;
+        w->ends = ends;
+        w->pos = pos;
+        (*pbuf)->length = 0;
+        res = ccn_charbuf_append(*pbuf, buf->buf + used, buf->length - used);
+        buf->length = used;
+        w->busy = 1;
+        pthread_cond_broadcast(&pool->cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return(res);
+}
+
+/**
+ * Read through repoFile1, collecting records for the index.
+ * @returns 0 for success, -1 for error.
+ */
+static int
+bulk_scan(struct bulk_pool *pool, struct bulk_index *bi, int fd, off_t size)
+{
+    struct ccnr_handle *h = pool->h;
+    struct ccn_skeleton_decoder decoder;
+    struct ccn_skeleton_decoder *d = &decoder;
+    struct ccn_charbuf *buf = NULL;
+    struct ccn_indexbuf *ends = NULL;
+    unsigned char *p = NULL;
+    off_t pos = 0;
+    size_t start;
+    ssize_t res;
+    int ans = -1;
+    
+    buf = ccn_charbuf_create();
+    ends = ccn_indexbuf_create();
+    if (buf == NULL || ends == NULL)
+        goto Bail;
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, size, POSIX_FADV_SEQUENTIAL);
+#endif
+    while (pos + (off_t)buf->length < size) {
+        p = ccn_charbuf_reserve(buf, BULK_READ_CHUNK);
+        if (p == NULL)
+            goto Bail;
+        res = pread(fd, p, BULK_READ_CHUNK, pos + buf->length);
+        if (res < 0) {
+            ccnr_msg(h, "cannot read repoFile1: %s", strerror(errno));
+            goto Bail;
+        }
+        if (res == 0)
+            break;
+        buf->length += res;
+        ends->n = 0;
+        for (start = 0; start < buf->length; start += d->index) {
+            memset(d, 0, sizeof(*d));
+            ccn_skeleton_decode(d, buf->buf + start, buf->length - start);
+            if (d->state != 0)
+                break;
+            if (ccn_indexbuf_append_element(ends, start + d->index) < 0)
+                goto Bail;
+        }
+        if (d->state < 0) {
+            ccnr_msg(h, "repoFile1 is not valid ccnb after %ju",
+                     (uintmax_t)(pos + start));
+            goto Bail;
+        }
+        if (start > 0 && bulk_dispatch(pool, bi, &buf, &ends, pos, start) < 0)
+            goto Bail;
+        pos += start;
+    }
+    ans = 0;
+Bail:
+    ccn_charbuf_destroy(&buf);
+    ccn_indexbuf_destroy(&ends);
+    return(ans);
+}
+
+/**
+ * Hand one record to the btree loader, unless it repeats the key of
+ * the one before.
+ *
+ * Records arrive in key order, so of duplicates the one earliest in
+ * repoFile1 wins.
+ * @returns 0 for success, -1 for error.
+ */
+static int
+bulk_load_record(struct ccnr_handle *h, struct bulk_index *bi,
+                 const unsigned char *rec)
+{
+    struct ccn_charbuf *last = bi->last;
+    const unsigned char *key = rec + BULK_KEY;
+    size_t keysize = BULK_KEYSIZE(rec);
+    int res;
+    
+    if (bi->entries != 0 && keysize == last->length &&
+          memcmp(key, last->buf, keysize) == 0)
+        return(0);
+    res = ccn_btree_loader_add(bi->loader, key, keysize,
+                               (void *)(rec + BULK_HDR), BULK_PAYLOAD);
+    if (res < 0)
+        return(-1);
+    bi->entries++;
+    last->length = 0;
+    return(ccn_charbuf_append(last, key, keysize));
+}
+
+/**
+ * Read the next record of a spilled run.
+ * @returns 1 if there is one, 0 at the end of the run, or -1 if the
+ *          run cannot be read or is cut short.
+ */
+static int
+bulk_read_record(FILE *f, struct ccn_charbuf *rec)
+{
+    unsigned char *p;
+    size_t n;
+    
+    rec->length = 0;
+    p = ccn_charbuf_reserve(rec, BULK_KEY);
+    if (p == NULL)
+        return(-1);
+    n = fread(p, 1, BULK_HDR, f);
+    if (n == 0 && feof(f) && !ferror(f))
+        return(0);
+    if (n != BULK_HDR)
+        return(-1);
+    n = BULK_PAYLOAD + BULK_KEYSIZE(p);
+    rec->length = BULK_HDR;
+    p = ccn_charbuf_reserve(rec, n);
+    if (p == NULL || fread(p, 1, n, f) != n)
+        return(-1);
+    rec->length += n;
+    return(1);
+}
+
+/**
+ * Step a merge source to its next record.
+ * @returns 1 if there is one, 0 at the end, or -1 for error.
+ */
+static int
+bulk_source_next(struct ccnr_handle *h, struct bulk_source *s)
+{
+    struct ccn_charbuf *path = NULL;
+    int res;
+    
+    if (s->f == NULL) {
+        s->cur = s->v[s->i];
+        if (s->cur == NULL)
+            return(0);
+        s->i++;
+        return(1);
+    }
+    res = bulk_read_record(s->f, s->rec);
+    s->cur = s->rec->buf;
+    if (res < 0) {
+        path = ccn_charbuf_create();
+        bulk_run_path(h, path, s->k);
+        ccnr_msg(h, "cannot read %s: %s", ccn_charbuf_as_string(path),
+                 ferror(s->f) ? strerror(errno) : "truncated");
+        ccn_charbuf_destroy(&path);
+    }
+    return(res);
+}
+
+static int
+bulk_heap_less(struct bulk_source *s, int a, int b)
+{
+    return(bulk_compare(s[a].cur, s[b].cur) < 0);
+}
+
+static void
+bulk_heap_down(struct bulk_source *s, int *heap, int n, int i)
+{
+    int c;
+    int t;
+    
+    for (c = 2 * i + 1; c < n; i = c, c = 2 * i + 1) {
+        if (c + 1 < n && bulk_heap_less(s, heap[c + 1], heap[c]))
+            c++;
+        if (!bulk_heap_less(s, heap[c], heap[i]))
+            break;
+        t = heap[i]; heap[i] = heap[c]; heap[c] = t;
+    }
+}
+
+/**
+ * Merge the spilled runs, and the sorted runs still in memory, into
+ * the index.
+ * @returns 0 for success, -1 for error.
+ */
+static int
+bulk_merge(struct ccnr_handle *h, struct bulk_index *bi,
+           struct bulk_index **mem, int nmem)
+{
+    struct bulk_source *s = NULL;
+    struct ccn_charbuf *path = NULL;
+    int *heap = NULL;
+    int ns = bi->nruns + nmem;
+    int n = 0;
+    int i;
+    int res = -1;
+    
+    s = calloc(ns + 1, sizeof(*s));
+    heap = calloc(ns + 1, sizeof(*heap));
+    path = ccn_charbuf_create();
+    if (s == NULL || heap == NULL || path == NULL)
+        goto Bail;
+    for (i = 0; i < ns; i++) {
+        if (i < bi->nruns) {
+            bulk_run_path(h, path, i);
+            s[i].f = fopen(ccn_charbuf_as_string(path), "r");
+            s[i].rec = ccn_charbuf_create();
+            s[i].k = i;
+            if (s[i].f == NULL || s[i].rec == NULL) {
+                ccnr_msg(h, "cannot read %s: %s",
+                         ccn_charbuf_as_string(path), strerror(errno));
+                goto Bail;
+            }
+        }
+        else
+            s[i].v = mem[i - bi->nruns]->v;
+        switch (bulk_source_next(h, &s[i])) {
+            case 1:
+                heap[n++] = i;
+                break;
+            case 0:
+                break;
+            default:
+                goto Bail;
+        }
+    }
+    for (i = n / 2 - 1; i >= 0; i--)
+        bulk_heap_down(s, heap, n, i);
+    while (n > 0) {
+        i = heap[0];
+        if (bulk_load_record(h, bi, s[i].cur) < 0)
+            goto Bail;
+        switch (bulk_source_next(h, &s[i])) {
+            case 1:
+                break;
+            case 0:
+                heap[0] = heap[--n];
+                break;
+            default:
+                goto Bail;
+        }
+        bulk_heap_down(s, heap, n, 0);
+    }
+    res = 0;
+Bail:
+    for (i = 0; s != NULL && i < ns; i++) {
+        if (s[i].f != NULL)
+            fclose(s[i].f);
+        ccn_charbuf_destroy(&s[i].rec);
+    }
+    free(s);
+    free(heap);
+    ccn_charbuf_destroy(&path);
+    return(res);
+}
+
+/**
+ * Index all of repoFile1 in bulk, as of when it held size bytes.
+ *
+ * The index should be empty to start with.  Afterwards, the nodes are
+ * written out but not yet made durable.
+ * @param limit is the memory budget for sorting.
+ * @param nthreads is the number of scan workers, or 0 for one per CPU.
+ * @returns 0 for success, -1 if the repository should be indexed in
+ *          the usual way instead.
+ */
+static int
+r_store_bulk_index(struct ccnr_handle *h, off_t size, size_t limit,
+                   int nthreads)
+{
+    struct bulk_index bi = {0};
+    struct bulk_pool pool = {0};
+    struct bulk_index **mem = NULL;
+    struct ccn_charbuf *path = NULL;
+    struct timeval t0;
+    struct timeval t1;
+    struct timeval t2;
+    double secs;
+    double loadsecs;
+    long ncpu;
+    int nmem = 0;
+    int i;
+    int fd;
+    int res = -1;
+    
+    if (nthreads <= 0) {
+        ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = ncpu > 0 ? ncpu : 1;
+    }
+    if (nthreads > BULK_MAX_THREADS)
+        nthreads = BULK_MAX_THREADS;
+    pool.h = h;
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.cond, NULL);
+    if (limit < BULK_MIN_MEMORY)
+        limit = BULK_MIN_MEMORY;
+    res = bulk_run_init(&bi, &bi, limit);
+    bi.last = ccn_charbuf_create();
+    path = ccn_charbuf_create();
+    mem = calloc(nthreads + 1, sizeof(mem[0]));
+    if (res < 0 || bi.last == NULL || path == NULL || mem == NULL) {
+        res = -1;
+        goto Bail;
+    }
+    ccn_charbuf_putf(path, "%s/repoFile1", h->directory);
+    fd = open(ccn_charbuf_as_string(path), O_RDONLY);
+    if (fd == -1) {
+        res = -1;
+        goto Bail;
+    }
+    gettimeofday(&t0, NULL);
+    /* With a single thread, the reading thread does the parsing too */
+    if (nthreads > 1)
+        res = bulk_pool_start(&pool, &bi, nthreads);
+    if (res == 0)
+        res = bulk_scan(&pool, &bi, fd, size);
+    close(fd);
+    if (bulk_pool_finish(&pool, &bi) < 0)
+        res = -1;
+    bulk_report(h, &bi);
+    gettimeofday(&t1, NULL);
+    if (res == 0 && pool.n == 0) {
+        bi.v = bulk_sort_run(&bi);
+        if (bi.v == NULL)
+            res = -1;
+        mem[nmem++] = &bi;
+    }
+    for (i = 0; i < pool.n; i++)
+        if (pool.w[i].run.v != NULL)
+            mem[nmem++] = &pool.w[i].run;
+    if (res == 0) {
+        bi.loader = ccn_btree_loader_create(h->btree, BULK_FILL);
+        if (bi.loader == NULL)
+            res = -1;
+    }
+    if (res == 0)
+        res = bulk_merge(h, &bi, mem, nmem);
+    if (bi.loader != NULL && ccn_btree_loader_finish(&bi.loader) < 0)
+        res = -1;
+    gettimeofday(&t2, NULL);
+    if (res == 0) {
+        secs = (t2.tv_sec - t0.tv_sec) + (t2.tv_usec - t0.tv_usec) / 1e6;
+        loadsecs = (t2.tv_sec - t1.tv_sec) + (t2.tv_usec - t1.tv_usec) / 1e6;
+        if (secs <= 0)
+            secs = 1e-6;
+        ccnr_msg(h, "bulk indexed %ju objects, %ju bytes in %.3f seconds "
+                 "(%.1f MB/s, %.0f objects/s); sort and load %.3f seconds, "
+                 "%d runs, %d scan threads",
+                 bi.objects, (uintmax_t)size, secs,
+                 size / secs / 1e6, bi.objects / secs, loadsecs, bi.nruns,
+                 pool.n > 0 ? pool.n : 1);
+        if (bi.skipped != 0 || bi.entries != bi.objects)
+            ccnr_msg(h, "bulk index has %ju entries; %ju messages skipped",
+                     bi.entries, bi.skipped);
+    }
+    else
+        ccnr_msg(h, "bulk index failed - indexing one object at a time");
+Bail:
+    for (i = 0; path != NULL && i < bi.nruns; i++) {
+        bulk_run_path(h, path, i);
+        unlink(ccn_charbuf_as_string(path));
+    }
+    bulk_pool_destroy(&pool);
+    bulk_run_destroy(&bi);
+    ccn_charbuf_destroy(&bi.last);
+    ccn_charbuf_destroy(&path);
+    free(mem);
+    pthread_cond_destroy(&pool.cond);
+    pthread_mutex_destroy(&pool.lock);
+    return(res);
+}
+
 /** Number of btree index writes to do in a batch */
 #define CCN_BT_CLEAN_BATCH 3
 /** Approximate delay between batches of btree index writes */
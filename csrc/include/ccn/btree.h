@@ -58,6 +58,11 @@ struct ccn_btree_node;
  * set iodata to NULL, updating openfds as appropriate.  It should not change
  * the other parts of the node.
  *
+ * Checkpoint, if provided, makes everything written so far durable as a
+ * unit, along with a client-supplied info string.  After a crash, the
+ * storage should come back as of the last checkpoint, with the info
+ * string in the checkpoint slot.
+ *
  * Negative return values indicate errors.
  */
 typedef int (*ccn_btree_io_openfn)
@@ -70,6 +75,8 @@ typedef int (*ccn_btree_io_closefn)
     (struct ccn_btree_io *, struct ccn_btree_node *);
 typedef int (*ccn_btree_io_destroyfn)
     (struct ccn_btree_io **);
+typedef int (*ccn_btree_io_checkpointfn)
+    (struct ccn_btree_io *, const char *);
 
 /* This serves as the external name of a btree node. */
 typedef unsigned ccn_btnodeid;
@@ -84,8 +91,10 @@ struct ccn_btree_io {
     ccn_btree_io_writefn btwrite;
     ccn_btree_io_closefn btclose;
     ccn_btree_io_destroyfn btdestroy;
+    ccn_btree_io_checkpointfn btcheckpoint; /**< may be NULL */
     ccn_btnodeid maxnodeid;    /**< Largest assigned nodeid */
     int openfds;               /**< Number of open files */
+    struct ccn_charbuf *checkpoint; /**< info from last checkpoint, or NULL */
     void *data;
 };
 /**
@@ -317,6 +326,18 @@ int ccn_btree_prepare_for_update(struct ccn_btree *bt,
 /* Check the whole btree carefully */
 int ccn_btree_check(struct ccn_btree *btree, FILE *outfp);
 
+/* Write out all changes and make them durable */
+int ccn_btree_checkpoint(struct ccn_btree *btree, const char *info);
+
+/* Build an empty btree bottom-up from entries in key order */
+struct ccn_btree_loader;
+struct ccn_btree_loader *ccn_btree_loader_create(struct ccn_btree *btree,
+                                                 int fill);
+int ccn_btree_loader_add(struct ccn_btree_loader *l,
+                         const unsigned char *key, size_t keysize,
+                         void *payload, size_t payload_bytes);
+int ccn_btree_loader_finish(struct ccn_btree_loader **pl);
+
 /*
  * Storage layer - client can provide other options
  */
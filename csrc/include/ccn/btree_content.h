@@ -62,6 +62,13 @@ int ccn_btree_match_interest(struct ccn_btree_node *node, int ndx,
                              const struct ccn_parsed_interest *pi,
                              struct ccn_charbuf *scratch);
 
+/* Fill in the entry payload for a ContentObject */
+int ccn_btree_content_payload_init(struct ccn_btree_content_payload *e,
+                                   uint_least64_t cobid,
+                                   const unsigned char *content_object,
+                                   struct ccn_parsed_ContentObject *pc,
+                                   struct ccn_charbuf *flatname);
+
 /* Insert a ContentObject into a btree node */
 int ccn_btree_insert_content(struct ccn_btree_node *node, int ndx,
                              uint_least64_t cobid,
@@ -266,6 +266,23 @@ int ccn_name_split(const struct ccn_charbuf *c,
 int ccn_name_chop(struct ccn_charbuf *c,
                   struct ccn_indexbuf* components, int n);
 
+/*
+ * ccn_name_prefix_hash: hash a sequence of ccnb-encoded Components
+ * Use as the hash parameter of hash tables keyed by name prefix
+ * components, so that the hashes from ccn_name_prefix_hashes apply.
+ */
+size_t ccn_name_prefix_hash(const unsigned char *key, size_t keysize);
+
+/*
+ * ccn_name_prefix_hashes: hashes of each prefix of a parsed name
+ * On success hashes->buf[i] is the ccn_name_prefix_hash of the first
+ * i of ncomps components, computed in one pass.
+ * returns -1 for error, otherwise 0.
+ */
+int ccn_name_prefix_hashes(const unsigned char *msg,
+                           const struct ccn_indexbuf *comps, int ncomps,
+                           struct ccn_indexbuf *hashes);
+
 
 /***********************************
  * Authenticators and signatures for content are constructed in charbufs
@@ -34,8 +34,18 @@ struct ccn_face_instance {
     struct ccn_sockdescr descr;
     int lifetime;
     struct ccn_charbuf *store;
+    int rate;           /**< output limit, bytes per second */
+    int burst;          /**< output burst size, bytes */
+    unsigned limits;    /**< which of rate and burst are present */
 };
 
+/*
+ * Bits for limits.  Zero (the default) leaves the limits alone;
+ * a rate that is present but 0 removes the limit.
+ */
+#define CCN_FACE_RATE_LIMIT     1
+#define CCN_FACE_BURST_LIMIT    2
+
 struct ccn_face_instance *ccn_face_instance_parse(const unsigned char *p,
                                                   size_t size);
 
@@ -27,12 +27,24 @@
 struct hashtb; /* details are private to the implementation */
 struct hashtb_enumerator; /* more about this below */
 typedef void (*hashtb_finalize_proc)(struct hashtb_enumerator *);
+typedef size_t (*hashtb_hash_proc)(const unsigned char *key, size_t keysize);
+struct ccn_slab; /* see ccn/slab.h */
 struct hashtb_param {
     hashtb_finalize_proc finalize; /* default is NULL */
     void *finalize_data;           /* default is NULL */
     int orders;                    /* default is 0 */
+    struct ccn_slab *slab;         /* node storage; default NULL is malloc */
+    hashtb_hash_proc hash;         /* default NULL is hashtb_hash */
 }; 
 
+/*
+ * hashtb_hash: The default hash function.
+ * Tables whose keys have some structure may supply their own in
+ * the hash parameter; see for example ccn_name_prefix_hash.
+ */
+size_t
+hashtb_hash(const unsigned char *key, size_t keysize);
+
 /*
  * hashtb_create: Create a new hash table.
  * The param may be NULL to use the defaults, otherwise
@@ -69,6 +81,16 @@ hashtb_n(struct hashtb *ht);
 void *
 hashtb_lookup(struct hashtb *ht, const void *key, size_t keysize);
 
+/*
+ * hashtb_lookup_hashed: Find an item, given the hash of its key
+ * The hash must be what the table's hash function gives for the key;
+ * this lets a caller that already has it (perhaps computed along with
+ * those of related keys) avoid computing it again.
+ */
+void *
+hashtb_lookup_hashed(struct hashtb *ht, const void *key, size_t keysize,
+                     size_t hash);
+
 /* The client owns the memory for an enumerator, normally in a local. */ 
 struct hashtb_enumerator {
     struct hashtb *ht;
@@ -111,6 +133,31 @@ hashtb_seek(struct hashtb_enumerator *hte,
 #define HT_OLD_ENTRY 0
 #define HT_NEW_ENTRY 1
 
+/*
+ * hashtb_seek_hashed: Find or add an item, given the hash of its key
+ * As for hashtb_lookup_hashed, the hash must agree with the table's
+ * hash function.
+ */
+int
+hashtb_seek_hashed(struct hashtb_enumerator *hte, const void *key,
+                   size_t keysize, size_t extsize, size_t hash);
+
+/*
+ * hashtb_seek_spliced: Find or add an item, splicing into the key
+ * The key is taken to be the first splice_at bytes at key, then the
+ * splicesize bytes at splice, then the remaining bytes at key + splice_at.
+ * keysize and extsize describe the spliced result, so the splice must
+ * fall within the key proper.  A new item's key is assembled directly
+ * in the hash table's data, avoiding a scratch copy.
+ *
+ * Returns as for hashtb_seek.
+ */
+int
+hashtb_seek_spliced(struct hashtb_enumerator *hte,
+                    const void *key, size_t splice_at,
+                    const void *splice, size_t splicesize,
+                    size_t keysize, size_t extsize);
+
 /*
  * hashtb_delete: Delete an item
  * The item will be unlinked from the table, and will
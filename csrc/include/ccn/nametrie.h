@@ -0,0 +1,93 @@
+/**
+ * @file ccn/nametrie.h
+ *
+ * Name-component trie for longest-prefix matching.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CCN_NAMETRIE_DEFINED
+#define CCN_NAMETRIE_DEFINED
+
+#include <stddef.h>
+#include <ccn/indexbuf.h>
+
+/**
+ * A name trie maps name prefixes to client data, with one node per
+ * name component.  Finding every registered prefix of a name takes a
+ * single walk from the root, hashing each component just once, instead
+ * of one hash table probe for each prefix length.
+ *
+ * Names are given as a ccnb message together with the component
+ * boundaries, as produced by ccn_parse_interest, ccn_parse_ContentObject,
+ * or ccn_name_split; ncomps says how many leading components to use.
+ *
+ * The trie does not own the client data; only non-NULL data marks
+ * a node as present.
+ */
+struct ccn_nametrie;
+struct ccn_nametrie_node;
+
+struct ccn_nametrie *ccn_nametrie_create(void);
+void ccn_nametrie_destroy(struct ccn_nametrie **);
+
+/*
+ * ccn_nametrie_insert: Attach data to a prefix, creating nodes as needed.
+ * Any data already there is replaced.
+ * Returns the node, which may be used for later removal, or NULL for
+ * an error (ENOMEM, bad arguments, or data == NULL).
+ */
+struct ccn_nametrie_node *
+ccn_nametrie_insert(struct ccn_nametrie *t, const unsigned char *msg,
+                    const struct ccn_indexbuf *comps, int ncomps, void *data);
+
+/*
+ * ccn_nametrie_remove: Detach the data from a node.
+ * Nodes that no longer lead to any data are freed.
+ */
+void ccn_nametrie_remove(struct ccn_nametrie *t, struct ccn_nametrie_node *);
+
+/*
+ * ccn_nametrie_lookup: Find the data for exactly this prefix, or NULL.
+ */
+void *ccn_nametrie_lookup(struct ccn_nametrie *t, const unsigned char *msg,
+                          const struct ccn_indexbuf *comps, int ncomps);
+
+/*
+ * ccn_nametrie_longest: Find the data for the longest present prefix.
+ * If matched is not NULL, the number of components in that prefix
+ * is stored there (-1 if none is present).
+ */
+void *ccn_nametrie_longest(struct ccn_nametrie *t, const unsigned char *msg,
+                           const struct ccn_indexbuf *comps, int ncomps,
+                           int *matched);
+
+/*
+ * ccn_nametrie_match: Find every present prefix.
+ * The component counts of the present prefixes, shortest first, are
+ * appended to matches, if it is not NULL.
+ * Returns the length of the longest present prefix, or -1 if none.
+ */
+int ccn_nametrie_match(struct ccn_nametrie *t, const unsigned char *msg,
+                       const struct ccn_indexbuf *comps, int ncomps,
+                       struct ccn_indexbuf *matches);
+
+/*
+ * ccn_nametrie_n: Number of prefixes that have data.
+ */
+int ccn_nametrie_n(struct ccn_nametrie *t);
+
+#endif
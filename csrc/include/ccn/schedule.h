@@ -76,11 +76,29 @@ struct ccn_schedule *ccn_schedule_create(void *clienth,
                                          const struct ccn_gettime *ccnclock);
 void ccn_schedule_destroy(struct ccn_schedule **schedp);
 
+/*
+ * ccn_schedule_create_flags: create, choosing the implementation
+ * The default is a heap.  CCN_SCHEDULE_WHEEL selects a hierarchical
+ * timer wheel, which schedules and cancels in constant time but runs
+ * events up to about a millisecond late.  Cancelled events are freed
+ * at the next ccn_schedule_run rather than when they would have come due.
+ */
+#define CCN_SCHEDULE_WHEEL 1
+struct ccn_schedule *ccn_schedule_create_flags(void *clienth,
+                                               const struct ccn_gettime *ccnclock,
+                                               int flags);
+
 /*
  * Accessor for the clock passed into create
  */
 const struct ccn_gettime *ccn_schedule_get_gettime(struct ccn_schedule *);
 
+/*
+ * Number of events waiting in the schedule, including cancelled ones
+ * that have not yet come due
+ */
+int ccn_schedule_n(struct ccn_schedule *);
+
 /*
  * ccn_schedule_event: schedule a new event
  */
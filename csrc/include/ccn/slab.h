@@ -0,0 +1,78 @@
+/**
+ * @file ccn/slab.h
+ *
+ * Size-class memory allocator for many small, similar objects.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CCN_SLAB_DEFINED
+#define CCN_SLAB_DEFINED
+
+#include <stddef.h>
+
+/**
+ * A slab allocator carves large chunks of memory into objects of a
+ * fixed set of sizes.  Freed objects are kept for reuse by later
+ * allocations of the same size class; they are not returned to the
+ * system until the allocator is destroyed.
+ *
+ * The caller supplies the size when freeing, so there is no
+ * per-object header.  Requests larger than the largest size class go
+ * to malloc.
+ *
+ * Wherever a struct ccn_slab * is called for, NULL may be used to get
+ * plain malloc and free.
+ */
+struct ccn_slab;
+
+/**
+ * Occupancy of one size class.
+ */
+struct ccn_slab_stats {
+    size_t size;            /**< object size, or 0 for the malloc class */
+    unsigned long slabs;    /**< chunks obtained from the system */
+    unsigned long in_use;   /**< objects currently allocated */
+    unsigned long free;     /**< objects available without a new chunk */
+};
+
+struct ccn_slab *ccn_slab_create(void);
+void ccn_slab_destroy(struct ccn_slab **);
+
+/*
+ * ccn_slab_alloc: Allocate size bytes, uninitialized.
+ * ccn_slab_calloc: Allocate size bytes, zeroed.
+ */
+void *ccn_slab_alloc(struct ccn_slab *, size_t size);
+void *ccn_slab_calloc(struct ccn_slab *, size_t size);
+
+/*
+ * ccn_slab_free: Free an object; size must match the allocation.
+ */
+void ccn_slab_free(struct ccn_slab *, void *p, size_t size);
+
+/*
+ * ccn_slab_size: Number of bytes actually used for an allocation of size.
+ */
+size_t ccn_slab_size(struct ccn_slab *, size_t size);
+
+/*
+ * ccn_slab_stats: Get the occupancy for size class i.
+ * Returns -1 if there is no such class.
+ */
+int ccn_slab_stats(struct ccn_slab *, int i, struct ccn_slab_stats *ans);
+
+#endif
@@ -942,6 +942,381 @@ ccn_btree_close_node(struct ccn_btree *btree, struct ccn_btree_node *node)
     return(res);
 }
 
+/**
+ *  Write out all pending changes, and ask the storage layer to make
+ *  them durable along with the info string.
+ *
+ * Nodes stay open and resident.  The info string is what the storage
+ * layer will present in io->checkpoint if it has to recover from a crash.
+ *
+ * @returns 0 for success or -1 for error, including when the storage
+ *          layer does not do checkpoints.
+ */
+int
+ccn_btree_checkpoint(struct ccn_btree *btree, const char *info)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_btree_io *io = btree->io;
+    struct ccn_btree_node *node = NULL;
+    int res = 0;
+
+    if (io == NULL || io->btcheckpoint == NULL)
+        return(-1);
+    hashtb_start(btree->resident, e);
+    for (node = e->data; node != NULL && res >= 0; node = e->data) {
+        if (node->clean != node->buf->length) {
+            if (node->corrupt || node->iodata == NULL)
+                res = -1;
+            else
+                res = io->btwrite(io, node);
+            if (res < 0)
+                ccn_btree_note_error(btree, __LINE__);
+            else
+                node->clean = node->buf->length;
+        }
+        hashtb_next(e);
+    }
+    hashtb_end(e);
+    if (res >= 0)
+        res = io->btcheckpoint(io, info);
+    return(res < 0 ? -1 : 0);
+}
+
+/**
+ * State for one level of a btree being loaded in bulk
+ */
+struct ccn_btree_loader_level {
+    struct ccn_charbuf *keys;   /**< key bytes of the node being filled */
+    struct ccn_charbuf *ents;   /**< its entries, payloads and trailers */
+    struct ccn_charbuf *first;  /**< first key of the subtree under it */
+    int n;                      /**< entries in the node being filled */
+    size_t k;                   /**< entry size */
+    unsigned long emitted;      /**< nodes already written at this level */
+};
+
+#define CCN_BT_LOADER_MAX_LEVELS 40
+
+/**
+ * State for building a btree bottom-up from entries in key order
+ */
+struct ccn_btree_loader {
+    struct ccn_btree *btree;
+    int fill;                   /**< percent of node capacity to use */
+    int nlevels;                /**< levels started so far */
+    struct ccn_charbuf *last;   /**< last key added */
+    struct ccn_charbuf *scratch; /**< for assembling nodes */
+    struct ccn_btree_loader_level level[CCN_BT_LOADER_MAX_LEVELS];
+};
+
+/**
+ * Start loading an empty btree in bulk.
+ *
+ * The btree must consist of just an empty root leaf.  Its tunables
+ * (full, full0, nodebytes) should already be set, since the nodes are
+ * filled to fill percent of what they allow.
+ *
+ * @returns the loader, or NULL if the btree is not empty or the fill
+ *          is not between 1 and 100.
+ */
+struct ccn_btree_loader *
+ccn_btree_loader_create(struct ccn_btree *btree, int fill)
+{
+    struct ccn_btree_loader *l = NULL;
+    struct ccn_btree_node *root = NULL;
+    
+    if (fill < 1 || fill > 100)
+        return(NULL);
+    root = ccn_btree_getnode(btree, 1, 0);
+    if (root == NULL || root->corrupt ||
+        ccn_btree_node_nent(root) != 0 || btree->nextnodeid < 2)
+        return(NULL);
+    l = calloc(1, sizeof(*l));
+    if (l == NULL)
+        return(NULL);
+    l->btree = btree;
+    l->fill = fill;
+    l->last = ccn_charbuf_create();
+    l->scratch = ccn_charbuf_create();
+    if (l->last == NULL || l->scratch == NULL)
+        ccn_btree_loader_finish(&l);
+    return(l);
+}
+
+/**
+ * Decide whether the node being filled at lev has room for another entry
+ */
+static int
+loader_has_room(struct ccn_btree_loader *l, int lev, size_t keysize)
+{
+    struct ccn_btree *btree = l->btree;
+    struct ccn_btree_loader_level *lv = &l->level[lev];
+    size_t bytes;
+    int limit;
+    
+    limit = (lev == 0 && btree->full0 > 0) ? btree->full0 : btree->full;
+    limit = (long)limit * l->fill / 100;
+    if (limit < 2)
+        limit = 2;
+    if (lv->n >= limit)
+        return(0);
+    if (lv->n >= 4 && btree->nodebytes != 0) {
+        bytes = sizeof(struct ccn_btree_node_header) + lv->keys->length +
+                keysize + (lv->n + 1) * lv->k + CCN_BT_SIZE_UNITS;
+        if (bytes > (unsigned long)btree->nodebytes / 100 * l->fill)
+            return(0);
+    }
+    return(1);
+}
+
+/**
+ * Remove a node from the resident cache.
+ */
+static void
+loader_evict(struct ccn_btree *btree, ccn_btnodeid nodeid)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    
+    hashtb_start(btree->resident, e);
+    if (hashtb_seek(e, &nodeid, sizeof(nodeid), 0) == HT_OLD_ENTRY)
+        hashtb_delete(e);
+    hashtb_end(e);
+}
+
+static int loader_add(struct ccn_btree_loader *l, int lev,
+                      const unsigned char *key, size_t keysize,
+                      void *payload, size_t payload_bytes);
+
+/**
+ * Finish the node being filled at lev, and link it into the level above.
+ *
+ * The node gets the next available nodeid, or 1 if it is the root.
+ * When the btree has storage, the node is written out and dropped from
+ * the resident cache, so only the nodes being filled stay in memory.
+ *
+ * @returns 0 for success, -1 for error.
+ */
+static int
+loader_close_node(struct ccn_btree_loader *l, int lev, int isroot)
+{
+    struct ccn_btree *btree = l->btree;
+    struct ccn_btree_loader_level *lv = &l->level[lev];
+    struct ccn_btree_internal_payload link = {{CCN_BT_INTERNAL_MAGIC}};
+    struct ccn_btree_internal_payload *e = NULL;
+    struct ccn_btree_node *node = NULL;
+    struct ccn_btree_node *chld = NULL;
+    struct ccn_btree_node tmp = {0};
+    struct ccn_charbuf *t = NULL;
+    ccn_btnodeid nodeid;
+    size_t org;
+    int i;
+    int res;
+    
+    /* Lay out header, keys, free space, and entries */
+    tmp.buf = l->scratch;
+    res = ccn_btree_init_node(&tmp, lev, isroot ? 'R' : 0, 0);
+    if (res < 0)
+        return(-1);
+    if (ccn_charbuf_append_charbuf(tmp.buf, lv->keys) < 0)
+        return(-1);
+    org = tmp.buf->length + lv->ents->length;
+    org = (org + CCN_BT_SIZE_UNITS - 1) / CCN_BT_SIZE_UNITS * CCN_BT_SIZE_UNITS;
+    org -= lv->ents->length;
+    if (ccn_charbuf_reserve(tmp.buf, org - tmp.buf->length) == NULL)
+        return(-1);
+    memset(tmp.buf->buf + tmp.buf->length, 0, org - tmp.buf->length);
+    tmp.buf->length = org;
+    if (ccn_charbuf_append_charbuf(tmp.buf, lv->ents) < 0)
+        return(-1);
+    nodeid = isroot ? 1 : btree->nextnodeid++;
+    node = ccn_btree_getnode(btree, nodeid, 0);
+    if (node == NULL)
+        return(-1);
+    t = node->buf;
+    node->buf = tmp.buf;
+    l->scratch = t;
+    node->clean = 0;
+    node->corrupt = 0;
+    if (ccn_btree_chknode(node) < 0 || node->buf->length != org + lv->ents->length) {
+        ccn_btree_note_error(btree, __LINE__);
+        return(-1);
+    }
+    /* Fix up the cached parent pointers of any resident children */
+    for (i = 0; lev > 0 && i < lv->n; i++) {
+        e = ccn_btree_node_getentry(sizeof(*e), node, i);
+        if (e != NULL && (chld = ccn_btree_rnode(btree, MYFETCH(e, child))) != NULL)
+            chld->parent = nodeid;
+    }
+    if (btree->io != NULL) {
+        res = ccn_btree_prepare_for_update(btree, node);
+        if (res >= 0)
+            res = ccn_btree_close_node(btree, node);
+        if (res < 0)
+            return(-1);
+        if (!isroot)
+            loader_evict(btree, nodeid);
+    }
+    lv->n = 0;
+    lv->keys->length = 0;
+    lv->ents->length = 0;
+    lv->emitted++;
+    if (isroot)
+        return(0);
+    MYSTORE(&link, child, nodeid);
+    return(loader_add(l, lev + 1, lv->first->buf, lv->first->length,
+                      &link, sizeof(link)));
+}
+
+/**
+ * Append an entry to the node being filled at lev, finishing that node
+ * first if it is full.
+ *
+ * The first entry of an internal node has an empty key; its key
+ * is remembered as the first key of the subtree instead.
+ *
+ * @returns 0 for success, -1 for error.
+ */
+static int
+loader_add(struct ccn_btree_loader *l, int lev,
+           const unsigned char *key, size_t keysize,
+           void *payload, size_t payload_bytes)
+{
+    struct ccn_btree_loader_level *lv = NULL;
+    struct ccn_btree_entry_trailer *t = NULL;
+    unsigned char *to = NULL;
+    size_t pb;
+    size_t k;
+    
+    if (lev >= CCN_BT_LOADER_MAX_LEVELS)
+        return(-1);
+    lv = &l->level[lev];
+    if (lev == l->nlevels) {
+        lv->keys = ccn_charbuf_create();
+        lv->ents = ccn_charbuf_create();
+        lv->first = ccn_charbuf_create();
+        if (lv->keys == NULL || lv->ents == NULL || lv->first == NULL)
+            return(-1);
+        l->nlevels++;
+    }
+    pb = (payload_bytes + CCN_BT_SIZE_UNITS - 1)
+         / CCN_BT_SIZE_UNITS
+         * CCN_BT_SIZE_UNITS;
+    k = pb + sizeof(struct ccn_btree_entry_trailer);
+    if (lv->n > 0 && k != lv->k)
+        return(-1);
+    if (lv->n > 0 && !loader_has_room(l, lev, keysize)) {
+        if (loader_close_node(l, lev, 0) < 0)
+            return(-1);
+    }
+    if (lv->n == 0) {
+        lv->k = k;
+        lv->first->length = 0;
+        if (ccn_charbuf_append(lv->first, key, keysize) < 0)
+            return(-1);
+        if (lev > 0)
+            keysize = 0;
+    }
+    to = ccn_charbuf_reserve(lv->ents, k);
+    if (to == NULL)
+        return(-1);
+    memset(to, 0, k);
+    memcpy(to, payload, payload_bytes);
+    t = (struct ccn_btree_entry_trailer *)(to + pb);
+    MYSTORE(t, koff0, sizeof(struct ccn_btree_node_header) + lv->keys->length);
+    MYSTORE(t, ksiz0, keysize);
+    MYSTORE(t, entdx, lv->n);
+    MYSTORE(t, level, lev);
+    MYSTORE(t, entsz, k / CCN_BT_SIZE_UNITS);
+    lv->ents->length += k;
+    if (keysize > 0 && ccn_charbuf_append(lv->keys, key, keysize) < 0)
+        return(-1);
+    lv->n++;
+    return(0);
+}
+
+/**
+ * Add an entry to a btree being loaded in bulk.
+ *
+ * Keys must be presented in strictly increasing order, and all of the
+ * payloads must be the same size.
+ *
+ * @returns 0 for success, -1 for error, including a key out of order.
+ */
+int
+ccn_btree_loader_add(struct ccn_btree_loader *l,
+                     const unsigned char *key, size_t keysize,
+                     void *payload, size_t payload_bytes)
+{
+    struct ccn_charbuf *last = l->last;
+    size_t n;
+    int res;
+    
+    if (keysize > CCN_BT_MAX_KEY_SIZE)
+        return(-1);
+    if (l->level[0].n + l->level[0].emitted != 0) {
+        n = keysize < last->length ? keysize : last->length;
+        res = memcmp(key, last->buf, n);
+        if (res < 0 || (res == 0 && keysize <= last->length))
+            return(-1);
+    }
+    res = loader_add(l, 0, key, keysize, payload, payload_bytes);
+    if (res < 0)
+        return(-1);
+    last->length = 0;
+    return(ccn_charbuf_append(last, key, keysize));
+}
+
+/**
+ * Finish loading a btree in bulk, and free the loader.
+ *
+ * The partly filled nodes are finished from the bottom up, and the
+ * one that ends up alone at the top becomes the root.  The nodes are
+ * written out but not made durable; use ccn_btree_checkpoint for that.
+ *
+ * @returns 0 for success, -1 for error (including earlier ones).
+ */
+int
+ccn_btree_loader_finish(struct ccn_btree_loader **pl)
+{
+    struct ccn_btree_loader *l = *pl;
+    struct ccn_btree_loader_level *lv = NULL;
+    int lev;
+    int res = 0;
+    
+    if (l == NULL)
+        return(-1);
+    *pl = NULL;
+    if (l->last == NULL || l->scratch == NULL)
+        res = -1;
+    for (lev = 0; res >= 0 && lev < CCN_BT_LOADER_MAX_LEVELS; lev++) {
+        if (lev == l->nlevels) {
+            /* Nothing was added; the root stays an empty leaf */
+            if (lev == 0)
+                break;
+            res = -1;
+            break;
+        }
+        lv = &l->level[lev];
+        if (lev == l->nlevels - 1 && lv->emitted == 0) {
+            res = loader_close_node(l, lev, 1);
+            break;
+        }
+        if (lv->n > 0)
+            res = loader_close_node(l, lev, 0);
+    }
+    for (lev = 0; lev < l->nlevels; lev++) {
+        lv = &l->level[lev];
+        ccn_charbuf_destroy(&lv->keys);
+        ccn_charbuf_destroy(&lv->ents);
+        ccn_charbuf_destroy(&lv->first);
+    }
+    ccn_charbuf_destroy(&l->last);
+    ccn_charbuf_destroy(&l->scratch);
+    free(l);
+    return(res < 0 ? -1 : 0);
+}
+
 static void
 finalize_node(struct hashtb_enumerator *e)
 {
@@ -60,27 +60,22 @@ ccn_btree_storeval64(unsigned char *p, int size, uint_least64_t v)
 }
 
 /**
- * Insert a ContentObject into a btree node
- *
- * The caller has presumably already done a lookup and found that the
- * object is not there.
+ * Fill in the index entry payload for a ContentObject
  *
  * The caller is responsible for provinding a valid content parse (pc).
  *
  * The flatname buffer should hold the correct full name, including the
  * digest.
  *
- * @returns the new entry count or, -1 for error.
+ * @returns 0, or -1 for error.
  */
 int
-ccn_btree_insert_content(struct ccn_btree_node *node, int ndx,
-                         uint_least64_t cobid,
-                         const unsigned char *content_object,
-                         struct ccn_parsed_ContentObject *pc,
-                         struct ccn_charbuf *flatname)
+ccn_btree_content_payload_init(struct ccn_btree_content_payload *e,
+                               uint_least64_t cobid,
+                               const unsigned char *content_object,
+                               struct ccn_parsed_ContentObject *pc,
+                               struct ccn_charbuf *flatname)
 {
-    struct ccn_btree_content_payload payload;
-    struct ccn_btree_content_payload *e = &payload;
     int ncomp;
     int res;
     unsigned size;
@@ -116,10 +111,39 @@ ccn_btree_insert_content(struct ccn_btree_node *node, int ndx,
     if (res < 0 || blob_size != sizeof(e->ppkdg))
         return(-1);
     memcpy(e->ppkdg, blob, sizeof(e->ppkdg));
-    /* Now actually do the insert */
+    return(0);
+}
+
+/**
+ * Insert a ContentObject into a btree node
+ *
+ * The caller has presumably already done a lookup and found that the
+ * object is not there.
+ *
+ * The caller is responsible for provinding a valid content parse (pc).
+ *
+ * The flatname buffer should hold the correct full name, including the
+ * digest.
+ *
+ * @returns the new entry count or, -1 for error.
+ */
+int
+ccn_btree_insert_content(struct ccn_btree_node *node, int ndx,
+                         uint_least64_t cobid,
+                         const unsigned char *content_object,
+                         struct ccn_parsed_ContentObject *pc,
+                         struct ccn_charbuf *flatname)
+{
+    struct ccn_btree_content_payload payload;
+    int res;
+    
+    res = ccn_btree_content_payload_init(&payload, cobid, content_object,
+                                         pc, flatname);
+    if (res < 0)
+        return(-1);
     res = ccn_btree_insert_entry(node, ndx,
                                  flatname->buf, flatname->length,
-                                 e, sizeof(*e));
+                                 &payload, sizeof(payload));
     return(res);
 }
 
@@ -28,19 +28,30 @@
 
 #include <ccn/btree.h>
 #include <ccn/charbuf.h>
+#include <ccn/indexbuf.h>
 
 static int bts_open(struct ccn_btree_io *, struct ccn_btree_node *);
 static int bts_read(struct ccn_btree_io *, struct ccn_btree_node *, unsigned);
 static int bts_write(struct ccn_btree_io *, struct ccn_btree_node *);
 static int bts_close(struct ccn_btree_io *, struct ccn_btree_node *);
 static int bts_destroy(struct ccn_btree_io **);
+static int bts_checkpoint(struct ccn_btree_io *, const char *);
 
 struct bts_data {
     struct ccn_btree_io *io;
     struct ccn_charbuf *dirpath;
     int lfd;
+    unsigned committed;             /**< last checkpoint generation, or 0 */
+    unsigned gen;                   /**< generation being written */
+    struct ccn_indexbuf *shadowed;  /**< nodes with a shadow file in gen */
 };
 
+/** Limit on the size of the checkpoint file */
+#define BTS_CHECKPOINT_MAX 4096
+
+static int bts_recover(struct bts_data *, struct ccn_btree_io *,
+                       ccn_btnodeid *, struct ccn_charbuf *);
+
 /**
  * Create a btree storage layer from a directory.
  * 
@@ -48,6 +59,13 @@ struct bts_data {
  * as a separate file.
  * The files are named using the decimal representation of the nodeid.
  *
+ * Once a checkpoint has been made, nodes are no longer written in place.
+ * The first write of a node after a checkpoint goes to a shadow file
+ * named nodeid.gen, and the next checkpoint renames the shadow files
+ * into place after recording the new generation in the checkpoint file.
+ * When the directory is opened, leftover shadow files of the recorded
+ * generation are renamed into place, and any others are removed.
+ *
  * If msgs is not NULL, diagnostics may be recorded there.
  *
  * @param path is the name of the directory, which must exist.
@@ -66,6 +84,7 @@ ccn_btree_io_from_directory(const char *path, struct ccn_charbuf *msgs)
     struct flock flk = {0};
     int pid, res;
     int maxnodeid = 0;
+    ccn_btnodeid ckmaxnodeid = 0;
     
     /* Make sure we were handed a directory */
     d = opendir(path);
@@ -83,6 +102,8 @@ ccn_btree_io_from_directory(const char *path, struct ccn_charbuf *msgs)
     if (md->dirpath == NULL) goto Bail; /* errno per calloc */
     res = ccn_charbuf_putf(md->dirpath, "%s", path);
     if (res < 0) goto Bail; /* errno per calloc or snprintf */
+    md->shadowed = ccn_indexbuf_create();
+    if (md->shadowed == NULL) goto Bail; /* errno per calloc */
     tans = calloc(1, sizeof(*tans));
     if (tans == NULL) goto Bail; /* errno per calloc */
     
@@ -148,6 +169,9 @@ ccn_btree_io_from_directory(const char *path, struct ccn_charbuf *msgs)
         goto Bail;
     }
     /* leave the lock file descriptor open, otherwise the lock is released */
+    /* Roll forward or back to the last checkpoint, if there is one */
+    res = bts_recover(md, tans, &ckmaxnodeid, msgs);
+    if (res < 0) goto Bail;
     /* Read maxnodeid */
     temp->length = 0;
     ccn_charbuf_append_charbuf(temp, md->dirpath);
@@ -158,9 +182,11 @@ ccn_btree_io_from_directory(const char *path, struct ccn_charbuf *msgs)
         read(fd, tbuf, sizeof(tbuf) - 1);
         errno = EINVAL;
         maxnodeid = strtoul(tbuf, NULL, 10);
-        if (maxnodeid == 0)
+        if (maxnodeid == 0 && ckmaxnodeid == 0)
             goto Bail;
     }
+    if (maxnodeid < ckmaxnodeid)
+        maxnodeid = ckmaxnodeid;
     /* Everything looks good. */
     ans = tans;
     tans = NULL;
@@ -173,6 +199,7 @@ ccn_btree_io_from_directory(const char *path, struct ccn_charbuf *msgs)
     ans->btwrite = &bts_write;
     ans->btclose = &bts_close;
     ans->btdestroy = &bts_destroy;
+    ans->btcheckpoint = &bts_checkpoint;
     ans->maxnodeid = maxnodeid;
     ans->openfds = 0;
     ans->data = md;
@@ -180,9 +207,13 @@ ccn_btree_io_from_directory(const char *path, struct ccn_charbuf *msgs)
     md = NULL;
 Bail:
     if (fd != -1) close(fd);
-    if (tans != NULL) free(tans);
+    if (tans != NULL) {
+        ccn_charbuf_destroy(&tans->checkpoint);
+        free(tans);
+    }
     if (md != NULL) {
         ccn_charbuf_destroy(&md->dirpath);
+        ccn_indexbuf_destroy(&md->shadowed);
         free(md);
     }
     ccn_charbuf_destroy(&temp);
@@ -192,8 +223,46 @@ Bail:
 struct bts_node_state {
     struct ccn_btree_node *node;
     int fd;
+    unsigned gen;       /**< generation of the shadow file open, or 0 */
 };
 
+/**
+ * Set temp to the name of the file for a node.
+ *
+ * If gen is nonzero, this is the name of the shadow file for that generation.
+ */
+static int
+bts_node_path(struct bts_data *md, struct ccn_charbuf *temp,
+              ccn_btnodeid nodeid, unsigned gen)
+{
+    int res;
+    
+    temp->length = 0;
+    res = ccn_charbuf_append_charbuf(temp, md->dirpath);
+    if (gen == 0)
+        res |= ccn_charbuf_putf(temp, "/%u", (unsigned)nodeid);
+    else
+        res |= ccn_charbuf_putf(temp, "/%u.%u", (unsigned)nodeid, gen);
+    return(res);
+}
+
+/**
+ * Flush a file or directory to stable storage, by name.
+ */
+static int
+bts_fsync_path(struct ccn_charbuf *path)
+{
+    int fd;
+    int res;
+    
+    fd = open(ccn_charbuf_as_string(path), O_RDONLY);
+    if (fd == -1)
+        return(-1);
+    res = fsync(fd);
+    close(fd);
+    return(res);
+}
+
 static int
 bts_open(struct ccn_btree_io *io, struct ccn_btree_node *node)
 {
@@ -209,16 +278,27 @@ bts_open(struct ccn_btree_io *io, struct ccn_btree_node *node)
     temp = ccn_charbuf_create();
     if (temp == NULL)
         return(-1);
-    res = ccn_charbuf_append_charbuf(temp, md->dirpath);
-    res |= ccn_charbuf_putf(temp, "/%u", (unsigned)node->nodeid);
+    nd->fd = -1;
+    if (md->committed != 0) {
+        /* Use the shadow file if the node has been written since checkpoint */
+        res = bts_node_path(md, temp, node->nodeid, md->gen);
+        if (res >= 0)
+            nd->fd = open(ccn_charbuf_as_string(temp), O_RDWR);
+        if (nd->fd != -1)
+            nd->gen = md->gen;
+    }
+    res = bts_node_path(md, temp, node->nodeid, 0);
     if (res < 0) {
+        if (nd->fd != -1)
+            close(nd->fd);
         ccn_charbuf_destroy(&temp);
         free(nd);
         return(-1);
     }
-    nd->fd = open(ccn_charbuf_as_string(temp),
-               (O_RDWR | O_CREAT),
-               0640);
+    if (nd->fd == -1)
+        nd->fd = open(ccn_charbuf_as_string(temp),
+                   (O_RDWR | O_CREAT),
+                   0640);
     if (nd->fd != -1 && node->nodeid > io->maxnodeid) {
         /* Record maxnodeid in a file */
         io->maxnodeid = node->nodeid;
@@ -281,15 +361,65 @@ bts_read(struct ccn_btree_io *io, struct ccn_btree_node *node, unsigned limit)
     return(0);
 }
 
+/**
+ * Write the whole node to a new shadow file, and switch to using that.
+ */
+static int
+bts_write_shadow(struct ccn_btree_io *io, struct ccn_btree_node *node)
+{
+    struct bts_node_state *nd = node->iodata;
+    struct bts_data *md = io->data;
+    struct ccn_charbuf *temp = NULL;
+    ssize_t sres;
+    int fd = -1;
+    int res;
+    
+    temp = ccn_charbuf_create();
+    if (temp == NULL)
+        return(-1);
+    res = bts_node_path(md, temp, node->nodeid, md->gen);
+    if (res >= 0)
+        fd = open(ccn_charbuf_as_string(temp),
+                  (O_RDWR | O_CREAT | O_TRUNC),
+                  0640);
+    if (fd == -1) {
+        ccn_charbuf_destroy(&temp);
+        return(-1);
+    }
+    sres = write(fd, node->buf->buf, node->buf->length);
+    res = (sres == node->buf->length) ? 0 : -1;
+    if (res >= 0)
+        res = ccn_indexbuf_append_element(md->shadowed, node->nodeid);
+    if (res < 0) {
+        close(fd);
+        unlink(ccn_charbuf_as_string(temp));
+    }
+    else {
+        close(nd->fd);
+        nd->fd = fd;
+        nd->gen = md->gen;
+    }
+    ccn_charbuf_destroy(&temp);
+    return(res);
+}
+
 static int
 bts_write(struct ccn_btree_io *io, struct ccn_btree_node *node)
 {
     struct bts_node_state *nd = node->iodata;
+    struct bts_data *md = io->data;
     ssize_t sres;
     off_t offset;
     size_t clean = 0;
     
     if (nd == NULL || nd->node != node) abort();
+    if (md->committed != 0 && nd->gen != md->gen) {
+        /* A node that matches its file needs no shadow */
+        if (node->clean == node->buf->length &&
+              lseek(nd->fd, 0, SEEK_END) == (off_t)node->buf->length)
+            return(0);
+        return(bts_write_shadow(io, node));
+    }
     if (node->clean > 0 && node->clean <= node->buf->length)
         clean = node->clean;
     offset = lseek(nd->fd, clean, SEEK_SET);
@@ -367,9 +497,195 @@ bts_destroy(struct ccn_btree_io **pio)
     md = (*pio)->data;
     if (md->io != *pio) abort();
     ccn_charbuf_destroy(&md->dirpath);
+    ccn_indexbuf_destroy(&md->shadowed);
     free(md);
+    ccn_charbuf_destroy(&(*pio)->checkpoint);
     (*pio)->data = NULL;
     free(*pio);
     *pio = NULL;
     return(res);
 }
+
+/**
+ *  Make everything written so far durable, along with info.
+ *
+ * The node files are flushed, and then the checkpoint file is replaced
+ * to commit the generation.  Only then are the shadow files renamed
+ * into place; if that is interrupted, it is finished when the directory
+ * is next opened.
+ *
+ * info should be a single line of text.
+ * @returns -1 if there were errors.
+ */
+static int
+bts_checkpoint(struct ccn_btree_io *io, const char *info)
+{
+    struct bts_data *md = io->data;
+    struct ccn_charbuf *temp = NULL;
+    struct ccn_charbuf *temp2 = NULL;
+    ccn_btnodeid nodeid;
+    size_t i;
+    ssize_t sres;
+    int fd;
+    int res = 0;
+    
+    temp = ccn_charbuf_create();
+    temp2 = ccn_charbuf_create();
+    if (temp == NULL || temp2 == NULL || strchr(info, '\n') != NULL) {
+        res = -1;
+        goto Bail;
+    }
+    if (md->committed == 0) {
+        /* Nodes were written in place, so flush all of them */
+        for (nodeid = 1; nodeid <= io->maxnodeid && res >= 0; nodeid++) {
+            res = bts_node_path(md, temp, nodeid, 0);
+            if (res >= 0 && bts_fsync_path(temp) < 0 && errno != ENOENT)
+                res = -1;
+        }
+    }
+    for (i = 0; i < md->shadowed->n && res >= 0; i++) {
+        res = bts_node_path(md, temp, md->shadowed->buf[i], md->gen);
+        if (res >= 0)
+            res = bts_fsync_path(temp);
+    }
+    if (res < 0)
+        goto Bail;
+    /* Commit this generation */
+    temp->length = 0;
+    ccn_charbuf_append_charbuf(temp, md->dirpath);
+    ccn_charbuf_putf(temp, "/checkpoint.new");
+    fd = open(ccn_charbuf_as_string(temp), (O_WRONLY | O_CREAT | O_TRUNC), 0640);
+    if (fd == -1) {
+        res = -1;
+        goto Bail;
+    }
+    ccn_charbuf_putf(temp2, "%u %u %s\n", md->gen, (unsigned)io->maxnodeid, info);
+    sres = write(fd, temp2->buf, temp2->length);
+    if (sres != temp2->length || fsync(fd) == -1)
+        res = -1;
+    close(fd);
+    if (res >= 0) {
+        temp2->length = 0;
+        ccn_charbuf_append_charbuf(temp2, md->dirpath);
+        ccn_charbuf_putf(temp2, "/checkpoint");
+        res = rename(ccn_charbuf_as_string(temp), ccn_charbuf_as_string(temp2));
+    }
+    if (res >= 0)
+        res = bts_fsync_path(md->dirpath);
+    if (res < 0)
+        goto Bail;
+    md->committed = md->gen;
+    if (io->checkpoint == NULL)
+        io->checkpoint = ccn_charbuf_create();
+    if (io->checkpoint != NULL) {
+        io->checkpoint->length = 0;
+        ccn_charbuf_append_string(io->checkpoint, info);
+    }
+    /* Now the shadow files may replace the originals */
+    for (i = 0; i < md->shadowed->n; i++) {
+        nodeid = md->shadowed->buf[i];
+        if (bts_node_path(md, temp, nodeid, md->gen) < 0 ||
+            bts_node_path(md, temp2, nodeid, 0) < 0 ||
+            rename(ccn_charbuf_as_string(temp), ccn_charbuf_as_string(temp2)) < 0)
+            res = -1;
+    }
+    if (md->shadowed->n > 0 && bts_fsync_path(md->dirpath) < 0)
+        res = -1;
+    md->shadowed->n = 0;
+    md->gen = md->committed + 1;
+Bail:
+    ccn_charbuf_destroy(&temp);
+    ccn_charbuf_destroy(&temp2);
+    return(res);
+}
+
+/**
+ *  Bring the directory to the state of the last checkpoint.
+ *
+ * Reads the checkpoint file, if any, and deals with the shadow files.
+ * @returns -1 for error.
+ */
+static int
+bts_recover(struct bts_data *md, struct ccn_btree_io *io,
+            ccn_btnodeid *maxnodeidp, struct ccn_charbuf *msgs)
+{
+    struct ccn_charbuf *temp = NULL;
+    struct ccn_charbuf *temp2 = NULL;
+    DIR *d = NULL;
+    struct dirent *de = NULL;
+    unsigned long nodeid;
+    unsigned long gen;
+    unsigned long ckmax;
+    char *p = NULL;
+    ssize_t rres;
+    int fd;
+    int n = 0;
+    int res = -1;
+    
+    temp = ccn_charbuf_create();
+    temp2 = ccn_charbuf_create();
+    if (temp == NULL || temp2 == NULL)
+        goto Bail;
+    ccn_charbuf_append_charbuf(temp2, md->dirpath);
+    ccn_charbuf_putf(temp2, "/checkpoint");
+    fd = open(ccn_charbuf_as_string(temp2), O_RDONLY);
+    if (fd != -1) {
+        rres = read(fd, ccn_charbuf_reserve(temp, BTS_CHECKPOINT_MAX),
+                    BTS_CHECKPOINT_MAX);
+        close(fd);
+        if (rres > 0)
+            temp->length = rres;
+        gen = strtoul(ccn_charbuf_as_string(temp), &p, 10);
+        ckmax = strtoul(p, &p, 10);
+        if (gen == 0 || gen > ~0U - 1 || *p != ' ' ||
+              temp->buf[temp->length - 1] != '\n') {
+            if (msgs != NULL)
+                ccn_charbuf_append_string(msgs, "Ignoring bad checkpoint file. ");
+        }
+        else {
+            io->checkpoint = ccn_charbuf_create();
+            if (io->checkpoint == NULL)
+                goto Bail;
+            ccn_charbuf_append(io->checkpoint, p + 1,
+                               temp->length - 2 - (p - (char *)temp->buf));
+            md->committed = gen;
+            *maxnodeidp = ckmax;
+        }
+    }
+    md->gen = md->committed + 1;
+    d = opendir(ccn_charbuf_as_string(md->dirpath));
+    if (d == NULL)
+        goto Bail;
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_name[0] < '0' || de->d_name[0] > '9')
+            continue;
+        nodeid = strtoul(de->d_name, &p, 10);
+        if (p[0] != '.' || p[1] < '0' || p[1] > '9')
+            continue;
+        gen = strtoul(p + 1, &p, 10);
+        if (p[0] != 0)
+            continue;
+        temp->length = 0;
+        ccn_charbuf_append_charbuf(temp, md->dirpath);
+        ccn_charbuf_putf(temp, "/%s", de->d_name);
+        if (gen == md->committed && nodeid != 0) {
+            bts_node_path(md, temp2, nodeid, 0);
+            rename(ccn_charbuf_as_string(temp), ccn_charbuf_as_string(temp2));
+        }
+        else
+            unlink(ccn_charbuf_as_string(temp));
+        n++;
+    }
+    closedir(d);
+    if (n > 0) {
+        bts_fsync_path(md->dirpath);
+        if (msgs != NULL)
+            ccn_charbuf_putf(msgs, "Resolved %d shadow files for checkpoint %u. ",
+                             n, md->committed);
+    }
+    res = 0;
+Bail:
+    ccn_charbuf_destroy(&temp);
+    ccn_charbuf_destroy(&temp2);
+    return(res);
+}
@@ -40,6 +40,7 @@
 #include <ccn/coding.h>
 #include <ccn/digest.h>
 #include <ccn/hashtb.h>
+#include <ccn/nametrie.h>
 #include <ccn/reg_mgmt.h>
 #include <ccn/signing.h>
 #include <ccn/keystore.h>
@@ -54,6 +55,8 @@ struct ccn {
     struct ccn_charbuf *ccndid;
     struct hashtb *interests_by_prefix;
     struct hashtb *interest_filters;
+    struct ccn_nametrie *interests_by_prefix_trie; /* same prefixes */
+    struct ccn_nametrie *interest_filters_trie; /* same prefixes */
     struct ccn_skeleton_decoder decoder;
     struct ccn_indexbuf *scratch_indexbuf;
     struct hashtb *keys;    /* public keys, by pubid */
@@ -75,6 +78,7 @@ struct ccn_reg_closure;
 
 struct interests_by_prefix { /* keyed by components of name prefix */
     struct expressed_interest *list;
+    struct ccn_nametrie_node *trie_node;
 };
 
 struct expressed_interest {
@@ -95,6 +99,7 @@ struct interest_filter { /* keyed by components of name */
     struct ccn_reg_closure *ccn_reg_closure;
     struct timeval expiry;       /* Expiration time */
     int flags;
+    struct ccn_nametrie_node *trie_node;
 };
 #define CCN_FORW_WAITING_CCNDID (1<<30)
 
@@ -466,6 +471,7 @@ ccn_destroy(struct ccn **hp)
         hashtb_end(e);
         hashtb_destroy(&(h->interests_by_prefix));
     }
+    ccn_nametrie_destroy(&h->interests_by_prefix_trie);
     if (h->interest_filters != NULL) {
         for (hashtb_start(h->interest_filters, e); e->data != NULL; hashtb_next(e)) {
             struct interest_filter *i = e->data;
@@ -474,6 +480,7 @@ ccn_destroy(struct ccn **hp)
         hashtb_end(e);
         hashtb_destroy(&(h->interest_filters));
     }
+    ccn_nametrie_destroy(&h->interest_filters_trie);
     hashtb_destroy(&(h->keys));
     hashtb_destroy(&(h->keystores));
     ccn_charbuf_destroy(&h->interestbuf);
@@ -570,6 +577,40 @@ ccn_construct_interest(struct ccn *h,
     replace_interest_msg(dest, (res >= 0 ? c : NULL));
 }
 
+/**
+ * Enter a name prefix into one of our name tries.
+ * @param prefixend is the offset in namebuf of the end of the prefix.
+ * @returns the trie node, or NULL for an error.
+ */
+static struct ccn_nametrie_node *
+ccn_enter_prefix(struct ccn *h, struct ccn_nametrie *t,
+                 struct ccn_charbuf *namebuf, size_t prefixend, void *data)
+{
+    struct ccn_nametrie_node *ans = NULL;
+    struct ccn_indexbuf *comps = ccn_indexbuf_obtain(h);
+    int i;
+    if (ccn_name_split(namebuf, comps) >= 0) {
+        for (i = 0; i < comps->n; i++) {
+            if (comps->buf[i] == prefixend) {
+                ans = ccn_nametrie_insert(t, namebuf->buf, comps, i, data);
+                break;
+            }
+        }
+    }
+    ccn_indexbuf_release(h, comps);
+    return(ans);
+}
+
+static void
+finalize_interests_by_prefix(struct hashtb_enumerator *e)
+{
+    struct ccn *h = hashtb_get_param(e->ht, NULL);
+    struct interests_by_prefix *entry = e->data;
+    if (h->interests_by_prefix_trie != NULL)
+        ccn_nametrie_remove(h->interests_by_prefix_trie, entry->trie_node);
+    entry->trie_node = NULL;
+}
+
 int
 ccn_express_interest(struct ccn *h,
                      struct ccn_charbuf *namebuf,
@@ -583,8 +624,13 @@ ccn_express_interest(struct ccn *h,
     struct expressed_interest *interest = NULL;
     struct interests_by_prefix *entry = NULL;
     if (h->interests_by_prefix == NULL) {
-        h->interests_by_prefix = hashtb_create(sizeof(struct interests_by_prefix), NULL);
-        if (h->interests_by_prefix == NULL)
+        struct hashtb_param param = {0};
+        param.finalize = &finalize_interests_by_prefix;
+        param.finalize_data = h;
+        param.hash = &ccn_name_prefix_hash;
+        h->interests_by_prefix = hashtb_create(sizeof(struct interests_by_prefix), &param);
+        h->interests_by_prefix_trie = ccn_nametrie_create();
+        if (h->interests_by_prefix == NULL || h->interests_by_prefix_trie == NULL)
             return(NOTE_ERRNO(h));
     }
     prefixend = ccn_check_namebuf(h, namebuf, -1, 1);
@@ -602,8 +648,16 @@ ccn_express_interest(struct ccn *h,
         hashtb_end(e);
         return(res);
     }
-    if (res == HT_NEW_ENTRY)
+    if (res == HT_NEW_ENTRY) {
         entry->list = NULL;
+        entry->trie_node = ccn_enter_prefix(h, h->interests_by_prefix_trie,
+                                            namebuf, prefixend, entry);
+        if (entry->trie_node == NULL) {
+            hashtb_delete(e);
+            hashtb_end(e);
+            return(NOTE_ERRNO(h));
+        }
+    }
     interest = calloc(1, sizeof(*interest));
     if (interest == NULL) {
         NOTE_ERRNO(h);
@@ -630,11 +684,15 @@ ccn_express_interest(struct ccn *h,
 static void
 finalize_interest_filter(struct hashtb_enumerator *e)
 {
+    struct ccn *h = hashtb_get_param(e->ht, NULL);
     struct interest_filter *i = e->data;
     if (i->ccn_reg_closure != NULL) {
         i->ccn_reg_closure->interest_filter = NULL;
         i->ccn_reg_closure = NULL;
     }
+    if (h != NULL && h->interest_filters_trie != NULL)
+        ccn_nametrie_remove(h->interest_filters_trie, i->trie_node);
+    i->trie_node = NULL;
 }
 
 int
@@ -648,8 +706,11 @@ ccn_set_interest_filter_with_flags(struct ccn *h, struct ccn_charbuf *namebuf,
     if (h->interest_filters == NULL) {
         struct hashtb_param param = {0};
         param.finalize = &finalize_interest_filter;
+        param.finalize_data = h;
+        param.hash = &ccn_name_prefix_hash;
         h->interest_filters = hashtb_create(sizeof(struct interest_filter), &param);
-        if (h->interest_filters == NULL)
+        h->interest_filters_trie = ccn_nametrie_create();
+        if (h->interest_filters == NULL || h->interest_filters_trie == NULL)
             return(NOTE_ERRNO(h));
     }
     res = ccn_check_namebuf(h, namebuf, -1, 0);
@@ -657,6 +718,16 @@ ccn_set_interest_filter_with_flags(struct ccn *h, struct ccn_charbuf *namebuf,
         return(res);
     hashtb_start(h->interest_filters, e);
     res = hashtb_seek(e, namebuf->buf + 1, namebuf->length - 2, 0);
+    if (res == HT_NEW_ENTRY && action != NULL) {
+        entry = e->data;
+        entry->trie_node = ccn_enter_prefix(h, h->interest_filters_trie,
+                                            namebuf, namebuf->length - 1,
+                                            entry);
+        if (entry->trie_node == NULL) {
+            hashtb_delete(e);
+            res = NOTE_ERRNO(h);
+        }
+    }
     if (res >= 0) {
         entry = e->data;
         entry->flags = forw_flags;
@@ -1210,8 +1281,21 @@ ccn_dispatch_message(struct ccn *h, unsigned char *msg, size_t size)
             size_t keystart = comps->buf[0];
             unsigned char *key = msg + keystart;
             struct interest_filter *entry;
-            for (i = comps->n - 1; i >= 0; i--) {
-                entry = hashtb_lookup(h->interest_filters, key, comps->buf[i] - keystart);
+            struct ccn_indexbuf *matches = ccn_indexbuf_obtain(h);
+            struct ccn_indexbuf *hashes = ccn_indexbuf_obtain(h);
+            /* Find the candidate prefixes in one pass, longest used first */
+            ccn_nametrie_match(h->interest_filters_trie, msg, comps,
+                               comps->n - 1, matches);
+            if (matches->n > 0)
+                ccn_name_prefix_hashes(msg, comps, comps->n - 1, hashes);
+            while (matches->n > 0) {
+                i = matches->buf[--matches->n];
+                if (i < hashes->n)
+                    entry = hashtb_lookup_hashed(h->interest_filters, key,
+                                                 comps->buf[i] - keystart,
+                                                 hashes->buf[i]);
+                else
+                    entry = hashtb_lookup(h->interest_filters, key, comps->buf[i] - keystart);
                 if (entry != NULL) {
                     info.matched_comps = i;
                     ures = (entry->action->p)(entry->action, upcall_kind, &info);
@@ -1219,6 +1303,8 @@ ccn_dispatch_message(struct ccn *h, unsigned char *msg, size_t size)
                         upcall_kind = CCN_UPCALL_CONSUMED_INTEREST;
                 }
             }
+            ccn_indexbuf_release(h, matches);
+            ccn_indexbuf_release(h, hashes);
         }
     }
     else {
@@ -1235,8 +1321,20 @@ ccn_dispatch_message(struct ccn *h, unsigned char *msg, size_t size)
                 unsigned char *key = msg + keystart;
                 struct expressed_interest *interest = NULL;
                 struct interests_by_prefix *entry = NULL;
-                for (i = comps->n - 1; i >= 0; i--) {
-                    entry = hashtb_lookup(h->interests_by_prefix, key, comps->buf[i] - keystart);
+                struct ccn_indexbuf *matches = ccn_indexbuf_obtain(h);
+                struct ccn_indexbuf *hashes = ccn_indexbuf_obtain(h);
+                ccn_nametrie_match(h->interests_by_prefix_trie, msg, comps,
+                                   comps->n - 1, matches);
+                if (matches->n > 0)
+                    ccn_name_prefix_hashes(msg, comps, comps->n - 1, hashes);
+                while (matches->n > 0) {
+                    i = matches->buf[--matches->n];
+                    if (i < hashes->n)
+                        entry = hashtb_lookup_hashed(h->interests_by_prefix, key,
+                                                     comps->buf[i] - keystart,
+                                                     hashes->buf[i]);
+                    else
+                        entry = hashtb_lookup(h->interests_by_prefix, key, comps->buf[i] - keystart);
                     if (entry != NULL) {
                         for (interest = entry->list; interest != NULL; interest = interest->next) {
                             if (interest->magic != 0x7059e5f4) {
@@ -1302,6 +1400,8 @@ ccn_dispatch_message(struct ccn *h, unsigned char *msg, size_t size)
                         }
                     }
                 }
+                ccn_indexbuf_release(h, matches);
+                ccn_indexbuf_release(h, hashes);
             }
         }
     } // XXX whew, what a lot of right braces!
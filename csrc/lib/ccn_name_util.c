@@ -22,6 +22,7 @@
 #include <ccn/ccn.h>
 #include <ccn/charbuf.h>
 #include <ccn/coding.h>
+#include <ccn/hashtb.h>
 #include <ccn/indexbuf.h>
 #include <ccn/random.h>
 
@@ -212,6 +213,85 @@ ccn_name_split(const struct ccn_charbuf *c, struct ccn_indexbuf *components)
     return(ccn_parse_Name(d, components));
 }
 
+/*
+ * Hashes of name prefixes are built up one component at a time, so
+ * that the hash of each prefix of a name follows from the one before.
+ */
+#define NAME_HASH_SEED 0x2545F4914F6CDD1DULL
+
+static size_t
+name_hash_step(size_t h, const unsigned char *comp, size_t size)
+{
+    unsigned long long x = h;
+    x ^= hashtb_hash(comp, size);
+    x *= 0x9E3779B97F4A7C15ULL;
+    x ^= x >> 32;
+    return((size_t)x);
+}
+
+/**
+ * Hash a sequence of ccnb-encoded Components, as a name prefix.
+ *
+ * This is suitable for use as the hash function of a hash table keyed
+ * by name prefix components, and agrees with ccn_name_prefix_hashes.
+ * Anything in the key that does not parse as a sequence of complete
+ * elements is hashed as if it were one more component.
+ */
+size_t
+ccn_name_prefix_hash(const unsigned char *key, size_t keysize)
+{
+    struct ccn_skeleton_decoder decoder = {0};
+    struct ccn_skeleton_decoder *d = &decoder;
+    size_t h = (size_t)NAME_HASH_SEED;
+    size_t start = 0;
+    ssize_t dres;
+
+    while (d->index < keysize) {
+        dres = ccn_skeleton_decode(d, key + d->index, keysize - d->index);
+        if (d->state != 0 || dres <= 0)
+            break;
+        h = name_hash_step(h, key + start, d->index - start);
+        start = d->index;
+    }
+    if (start < keysize)
+        h = name_hash_step(h, key + start, keysize - start);
+    return(h);
+}
+
+/**
+ * Compute the hashes of all the prefixes of a parsed name at once.
+ *
+ * @param msg is the ccnb-encoded message containing the name.
+ * @param comps holds the component boundaries, as produced by
+ *        ccn_parse_interest, ccn_parse_ContentObject, or ccn_name_split.
+ * @param ncomps is the number of leading components to use.
+ * @param hashes is replaced by ncomps + 1 hashes; the ith is
+ *        ccn_name_prefix_hash of the first i components.
+ * @returns 0, or -1 for error.
+ */
+int
+ccn_name_prefix_hashes(const unsigned char *msg,
+                       const struct ccn_indexbuf *comps, int ncomps,
+                       struct ccn_indexbuf *hashes)
+{
+    size_t h = (size_t)NAME_HASH_SEED;
+    int i;
+
+    if (ncomps < 0 || ncomps + 1 > (int)comps->n)
+        return(-1);
+    hashes->n = 0;
+    if (ccn_indexbuf_reserve(hashes, ncomps + 1) == NULL)
+        return(-1);
+    hashes->buf[0] = h;
+    for (i = 0; i < ncomps; i++) {
+        h = name_hash_step(h, msg + comps->buf[i],
+                           comps->buf[i + 1] - comps->buf[i]);
+        hashes->buf[i + 1] = h;
+    }
+    hashes->n = ncomps + 1;
+    return(0);
+}
+
 /**
  * Chop the name down to n components.
  * @param c contains a ccnb-encoded Name
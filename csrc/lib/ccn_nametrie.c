@@ -0,0 +1,304 @@
+/**
+ * @file ccn_nametrie.c
+ * @brief Name-component trie for longest-prefix matching.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ccn/hashtb.h>
+#include <ccn/indexbuf.h>
+#include <ccn/nametrie.h>
+
+/**
+ * Each node holds the encoded component that leads to it from its
+ * parent.  Children are kept in a small chained hash table that grows
+ * with the number of children.
+ */
+struct ccn_nametrie_node {
+    struct ccn_nametrie_node *parent;
+    struct ccn_nametrie_node *link;     /**< next in parent's bucket */
+    struct ccn_nametrie_node **bucket;  /**< children */
+    unsigned n_buckets;
+    unsigned n_children;
+    size_t hash;                        /**< hash of the component */
+    void *data;                         /**< client data, or NULL */
+    size_t size;                        /**< size of the component */
+    /* component follows immediately */
+};
+#define COMP(p) ((unsigned char *)((p) + 1))
+
+struct ccn_nametrie {
+    struct ccn_nametrie_node root;      /**< the empty prefix */
+    int n;                              /**< number of nodes with data */
+};
+
+struct ccn_nametrie *
+ccn_nametrie_create(void)
+{
+    return(calloc(1, sizeof(struct ccn_nametrie)));
+}
+
+static void
+free_children(struct ccn_nametrie_node *p)
+{
+    struct ccn_nametrie_node *c;
+    struct ccn_nametrie_node *next;
+    unsigned b;
+
+    for (b = 0; b < p->n_buckets; b++) {
+        for (c = p->bucket[b]; c != NULL; c = next) {
+            next = c->link;
+            free_children(c);
+            free(c);
+        }
+    }
+    free(p->bucket);
+    p->bucket = NULL;
+    p->n_buckets = p->n_children = 0;
+}
+
+void
+ccn_nametrie_destroy(struct ccn_nametrie **tp)
+{
+    struct ccn_nametrie *t = *tp;
+
+    if (t != NULL) {
+        free_children(&t->root);
+        free(t);
+        *tp = NULL;
+    }
+}
+
+static struct ccn_nametrie_node *
+find_child(struct ccn_nametrie_node *p,
+           const unsigned char *comp, size_t size, size_t h)
+{
+    struct ccn_nametrie_node *c;
+
+    if (p->n_buckets == 0)
+        return(NULL);
+    for (c = p->bucket[h % p->n_buckets]; c != NULL; c = c->link)
+        if (c->hash == h && c->size == size && 0 == memcmp(COMP(c), comp, size))
+            return(c);
+    return(NULL);
+}
+
+static int
+grow_buckets(struct ccn_nametrie_node *p)
+{
+    struct ccn_nametrie_node **bucket;
+    struct ccn_nametrie_node *c;
+    struct ccn_nametrie_node *next;
+    unsigned n = 2 * p->n_buckets + 3;
+    unsigned b;
+
+    bucket = calloc(n, sizeof(bucket[0]));
+    if (bucket == NULL)
+        return(-1);
+    for (b = 0; b < p->n_buckets; b++) {
+        for (c = p->bucket[b]; c != NULL; c = next) {
+            next = c->link;
+            c->link = bucket[c->hash % n];
+            bucket[c->hash % n] = c;
+        }
+    }
+    free(p->bucket);
+    p->bucket = bucket;
+    p->n_buckets = n;
+    return(0);
+}
+
+static struct ccn_nametrie_node *
+add_child(struct ccn_nametrie_node *p,
+          const unsigned char *comp, size_t size, size_t h)
+{
+    struct ccn_nametrie_node *c;
+
+    if (p->n_children >= p->n_buckets && grow_buckets(p) < 0)
+        return(NULL);
+    c = calloc(1, sizeof(*c) + size);
+    if (c == NULL)
+        return(NULL);
+    memcpy(COMP(c), comp, size);
+    c->size = size;
+    c->hash = h;
+    c->parent = p;
+    c->link = p->bucket[h % p->n_buckets];
+    p->bucket[h % p->n_buckets] = c;
+    p->n_children++;
+    return(c);
+}
+
+static void
+remove_child(struct ccn_nametrie_node *p, struct ccn_nametrie_node *c)
+{
+    struct ccn_nametrie_node **pp;
+
+    for (pp = &p->bucket[c->hash % p->n_buckets]; *pp != NULL; pp = &(*pp)->link) {
+        if (*pp == c) {
+            *pp = c->link;
+            p->n_children--;
+            break;
+        }
+    }
+    free(c->bucket);
+    free(c);
+}
+
+/**
+ * Free p and its ancestors, as long as they lead to no data.
+ */
+static void
+prune(struct ccn_nametrie *t, struct ccn_nametrie_node *p)
+{
+    struct ccn_nametrie_node *parent;
+
+    while (p != &t->root && p->data == NULL && p->n_children == 0) {
+        parent = p->parent;
+        remove_child(parent, p);
+        p = parent;
+    }
+}
+
+/**
+ * Step from p to the child for component i, or NULL if there is none.
+ */
+static struct ccn_nametrie_node *
+step(struct ccn_nametrie_node *p, const unsigned char *msg,
+     const struct ccn_indexbuf *comps, int i)
+{
+    const unsigned char *comp = msg + comps->buf[i];
+    size_t size = comps->buf[i + 1] - comps->buf[i];
+
+    return(find_child(p, comp, size, hashtb_hash(comp, size)));
+}
+
+struct ccn_nametrie_node *
+ccn_nametrie_insert(struct ccn_nametrie *t, const unsigned char *msg,
+                    const struct ccn_indexbuf *comps, int ncomps, void *data)
+{
+    struct ccn_nametrie_node *p;
+    struct ccn_nametrie_node *c;
+    const unsigned char *comp;
+    size_t size;
+    size_t h;
+    int i;
+
+    if (data == NULL || ncomps < 0 || ncomps + 1 > (int)comps->n)
+        return(NULL);
+    p = &t->root;
+    for (i = 0; i < ncomps; i++, p = c) {
+        comp = msg + comps->buf[i];
+        size = comps->buf[i + 1] - comps->buf[i];
+        h = hashtb_hash(comp, size);
+        c = find_child(p, comp, size, h);
+        if (c == NULL) {
+            c = add_child(p, comp, size, h);
+            if (c == NULL) {
+                prune(t, p);
+                return(NULL);
+            }
+        }
+    }
+    if (p->data == NULL)
+        t->n++;
+    p->data = data;
+    return(p);
+}
+
+void
+ccn_nametrie_remove(struct ccn_nametrie *t, struct ccn_nametrie_node *p)
+{
+    if (p == NULL || p->data == NULL)
+        return;
+    p->data = NULL;
+    t->n--;
+    prune(t, p);
+}
+
+void *
+ccn_nametrie_lookup(struct ccn_nametrie *t, const unsigned char *msg,
+                    const struct ccn_indexbuf *comps, int ncomps)
+{
+    struct ccn_nametrie_node *p = &t->root;
+    int i;
+
+    if (ncomps < 0 || ncomps + 1 > (int)comps->n)
+        return(NULL);
+    for (i = 0; i < ncomps && p != NULL; i++)
+        p = step(p, msg, comps, i);
+    return(p == NULL ? NULL : p->data);
+}
+
+void *
+ccn_nametrie_longest(struct ccn_nametrie *t, const unsigned char *msg,
+                     const struct ccn_indexbuf *comps, int ncomps,
+                     int *matched)
+{
+    struct ccn_nametrie_node *p = &t->root;
+    void *ans = NULL;
+    int m = -1;
+    int i;
+
+    if (ncomps < 0 || ncomps + 1 > (int)comps->n)
+        ncomps = -1;
+    for (i = 0; i <= ncomps; i++) {
+        if (p->data != NULL) {
+            ans = p->data;
+            m = i;
+        }
+        if (i == ncomps || p->n_children == 0)
+            break;
+        p = step(p, msg, comps, i);
+        if (p == NULL)
+            break;
+    }
+    if (matched != NULL)
+        *matched = m;
+    return(ans);
+}
+
+int
+ccn_nametrie_match(struct ccn_nametrie *t, const unsigned char *msg,
+                   const struct ccn_indexbuf *comps, int ncomps,
+                   struct ccn_indexbuf *matches)
+{
+    struct ccn_nametrie_node *p = &t->root;
+    int m = -1;
+    int i;
+
+    if (ncomps < 0 || ncomps + 1 > (int)comps->n)
+        return(-1);
+    for (i = 0; p != NULL; i++) {
+        if (p->data != NULL) {
+            m = i;
+            if (matches != NULL)
+                ccn_indexbuf_append_element(matches, i);
+        }
+        if (i == ncomps || p->n_children == 0)
+            break;
+        p = step(p, msg, comps, i);
+    }
+    return(m);
+}
+
+int
+ccn_nametrie_n(struct ccn_nametrie *t)
+{
+    return(t->n);
+}
@@ -43,6 +43,46 @@ struct ccn_schedule {
     int now;         /* internal micros corresponding to lasttime  */
     struct ccn_timeval lasttime; /* actual time when we last checked  */
     int time_has_passed; /* to prevent too-frequent time syscalls */
+    struct ccn_schedule_wheel *wheel; /* non-NULL if not using the heap */
+};
+
+/**
+ * The timer wheel alternative keeps each event in a doubly-linked
+ * bucket, so that scheduling and cancelling take constant time.
+ * Level 0 has a bucket for each tick of (1 << WHEEL_TICK_BITS) micros;
+ * each bucket of a higher level covers a full turn of the level below,
+ * and is cascaded down when the lower level wraps.  Events too far out
+ * for the top level wait in its farthest bucket and are placed again
+ * when it comes around.
+ *
+ * Times are kept in a 64-bit count of micros, so no epoch updates
+ * are needed.  Events may run up to a tick late, never early.
+ */
+#define WHEEL_TICK_BITS 10
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+
+enum wheel_state {
+    WHEEL_LINKED,       /* in a bucket */
+    WHEEL_RUNNING,      /* action is being called */
+    WHEEL_DEAD          /* cancelled, awaiting free */
+};
+
+struct wheel_event {
+    struct ccn_scheduled_event ev; /* must be first */
+    struct wheel_event *next;
+    struct wheel_event **pprev;
+    long long event_time;
+    enum wheel_state state;
+};
+
+struct ccn_schedule_wheel {
+    long long now;      /* micros since the schedule was created */
+    long long tick;     /* next tick to run */
+    int n;              /* number of events in buckets */
+    struct wheel_event *dead; /* cancelled events */
+    struct wheel_event *slot[WHEEL_LEVELS][WHEEL_SLOTS];
 };
 
 /*
@@ -81,11 +121,20 @@ update_time(struct ccn_schedule *sched)
     if (elapsed + sched->now < elapsed)
         update_epoch(sched);
     sched->now += elapsed;
+    if (sched->wheel != NULL)
+        sched->wheel->now += elapsed;
     sched->lasttime = now;
 }
 
 struct ccn_schedule *
 ccn_schedule_create(void *clienth, const struct ccn_gettime *ccnclock)
+{
+    return(ccn_schedule_create_flags(clienth, ccnclock, 0));
+}
+
+struct ccn_schedule *
+ccn_schedule_create_flags(void *clienth, const struct ccn_gettime *ccnclock,
+                          int flags)
 {
     struct ccn_schedule *sched;
     if (ccnclock == NULL)
@@ -94,11 +143,20 @@ ccn_schedule_create(void *clienth, const struct ccn_gettime *ccnclock)
     if (sched != NULL) {
         sched->clienth = clienth;
         sched->clock = ccnclock;
+        if ((flags & CCN_SCHEDULE_WHEEL) != 0) {
+            sched->wheel = calloc(1, sizeof(*sched->wheel));
+            if (sched->wheel == NULL) {
+                free(sched);
+                return(NULL);
+            }
+        }
         update_time(sched);
     }
     return(sched);
 }
 
+static void wheel_destroy(struct ccn_schedule *sched);
+
 void
 ccn_schedule_destroy(struct ccn_schedule **schedp)
 {
@@ -111,6 +169,8 @@ ccn_schedule_destroy(struct ccn_schedule **schedp)
     if (sched == NULL)
         return;
     *schedp = NULL;
+    if (sched->wheel != NULL)
+        wheel_destroy(sched);
     heap = sched->heap;
     if (heap != NULL) {
         n = sched->heap_n;
@@ -130,6 +190,14 @@ ccn_schedule_get_gettime(struct ccn_schedule *schedp) {
     return(schedp->clock);
 }
 
+int
+ccn_schedule_n(struct ccn_schedule *sched)
+{
+    if (sched->wheel != NULL)
+        return(sched->wheel->n);
+    return(sched->heap_n);
+}
+
 /*
  * heap_insert: insert a new item
  * n is the total heap size, counting the new item
@@ -215,6 +283,209 @@ reschedule_event(
     return(ev);
 }
 
+/* Use a dummy action in cancelled events */ 
+static int
+ccn_schedule_cancelled_event(struct ccn_schedule *sched, void *clienth,
+                             struct ccn_scheduled_event *ev, int flags)
+{
+    return(0);
+}
+
+static void
+wheel_link(struct wheel_event **head, struct wheel_event *we)
+{
+    we->next = *head;
+    if (we->next != NULL)
+        we->next->pprev = &we->next;
+    we->pprev = head;
+    *head = we;
+}
+
+static void
+wheel_unlink(struct wheel_event *we)
+{
+    *(we->pprev) = we->next;
+    if (we->next != NULL)
+        we->next->pprev = we->pprev;
+    we->next = NULL;
+    we->pprev = NULL;
+}
+
+/*
+ * wheel_place: put an event into the bucket for its time
+ * Anything already due goes into the next tick to be run.
+ */
+static void
+wheel_place(struct ccn_schedule_wheel *w, struct wheel_event *we)
+{
+    long long t;
+    long long delta;
+    int level;
+    
+    t = (we->event_time + (1 << WHEEL_TICK_BITS) - 1) >> WHEEL_TICK_BITS;
+    if (t < w->tick)
+        t = w->tick;
+    delta = t - w->tick;
+    for (level = 0; level < WHEEL_LEVELS - 1; level++)
+        if (delta < (1LL << (WHEEL_BITS * (level + 1))))
+            break;
+    if (delta >= (1LL << (WHEEL_BITS * WHEEL_LEVELS)))
+        t = w->tick + (1LL << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+    t = (t >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+    wheel_link(&w->slot[level][t], we);
+    we->state = WHEEL_LINKED;
+    w->n++;
+}
+
+/*
+ * wheel_cascade: spread the current bucket of a level over the levels below
+ */
+static void
+wheel_cascade(struct ccn_schedule_wheel *w, int level)
+{
+    struct wheel_event *list;
+    struct wheel_event *we;
+    int i = (w->tick >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+    
+    list = w->slot[level][i];
+    w->slot[level][i] = NULL;
+    while ((we = list) != NULL) {
+        list = we->next;
+        w->n--;
+        wheel_place(w, we);
+    }
+}
+
+/*
+ * wheel_bury: free the events that have been cancelled
+ */
+static void
+wheel_bury(struct ccn_schedule_wheel *w)
+{
+    struct wheel_event *we;
+    
+    while ((we = w->dead) != NULL) {
+        w->dead = we->next;
+        free(we);
+    }
+}
+
+static void
+wheel_destroy(struct ccn_schedule *sched)
+{
+    struct ccn_schedule_wheel *w = sched->wheel;
+    struct wheel_event *we;
+    int level;
+    int i;
+    
+    sched->wheel = NULL;
+    for (level = 0; level < WHEEL_LEVELS; level++) {
+        for (i = 0; i < WHEEL_SLOTS; i++) {
+            while ((we = w->slot[level][i]) != NULL) {
+                wheel_unlink(we);
+                (we->ev.action)(sched, sched->clienth, &we->ev,
+                                CCN_SCHEDULE_CANCEL);
+                free(we);
+            }
+        }
+    }
+    wheel_bury(w);
+    free(w);
+}
+
+static struct ccn_scheduled_event *
+wheel_event(struct ccn_schedule *sched, int micros,
+            ccn_scheduled_action action, void *evdata, intptr_t evint)
+{
+    struct wheel_event *we;
+    
+    we = calloc(1, sizeof(*we));
+    if (we == NULL)
+        return(NULL);
+    we->ev.action = action;
+    we->ev.evdata = evdata;
+    we->ev.evint = evint;
+    update_time(sched);
+    we->event_time = sched->wheel->now + micros;
+    wheel_place(sched->wheel, we);
+    return(&we->ev);
+}
+
+/*
+ * wheel_next: micros until the wheel needs to run again, or -1 if idle
+ */
+static int
+wheel_next(struct ccn_schedule_wheel *w)
+{
+    long long t;
+    
+    if (w->n == 0)
+        return(-1);
+    /* Stop at the first bucket with events, or where a cascade is due */
+    for (t = w->tick; w->slot[0][t & (WHEEL_SLOTS - 1)] == NULL; t++)
+        if ((t & (WHEEL_SLOTS - 1)) == 0)
+            break;
+    t = (t << WHEEL_TICK_BITS) - w->now;
+    if (t < 0)
+        return(0);
+    if (t > INT_MAX)
+        return(INT_MAX);
+    return(t);
+}
+
+static int
+wheel_run(struct ccn_schedule *sched)
+{
+    struct ccn_schedule_wheel *w = sched->wheel;
+    struct wheel_event *batch;
+    struct wheel_event *we;
+    long long target;
+    int level;
+    int res;
+    
+    wheel_bury(w);
+    update_time(sched);
+    target = w->now >> WHEEL_TICK_BITS;
+    while (w->tick <= target) {
+        if (w->n == 0) {
+            w->tick = target + 1;
+            break;
+        }
+        for (level = 1; level < WHEEL_LEVELS; level++) {
+            if (((w->tick >> (WHEEL_BITS * (level - 1))) & (WHEEL_SLOTS - 1)) != 0)
+                break;
+            wheel_cascade(w, level);
+        }
+        /* Take the whole bucket, so that new events land in later ones */
+        batch = w->slot[0][w->tick & (WHEEL_SLOTS - 1)];
+        w->slot[0][w->tick & (WHEEL_SLOTS - 1)] = NULL;
+        if (batch != NULL)
+            batch->pprev = &batch;
+        w->tick++;
+        while ((we = batch) != NULL) {
+            wheel_unlink(we);
+            w->n--;
+            we->state = WHEEL_RUNNING;
+            sched->time_has_passed = 0;
+            res = (we->ev.action)(sched, sched->clienth, &we->ev, 0);
+            if (res <= 0 || we->ev.action == &ccn_schedule_cancelled_event)
+                free(we);
+            else {
+                /* As with the heap, stay on the original beat if we can */
+                if (w->now - we->event_time > sched->clock->micros_per_base)
+                    we->event_time = w->now;
+                we->event_time += res;
+                wheel_place(w, we);
+            }
+            if (sched->time_has_passed) {
+                update_time(sched);
+                target = w->now >> WHEEL_TICK_BITS;
+            }
+        }
+    }
+    return(wheel_next(w));
+}
+
 /*
  * ccn_schedule_event: schedule a new event
  */
@@ -227,6 +498,8 @@ ccn_schedule_event(
     intptr_t evint)
 {
     struct ccn_scheduled_event *ev;
+    if (sched->wheel != NULL)
+        return(wheel_event(sched, micros, action, evdata, evint));
     ev = calloc(1, sizeof(*ev));
     if (ev == NULL) return(NULL);
     ev->action = action;
@@ -236,14 +509,6 @@ ccn_schedule_event(
     return(reschedule_event(sched, micros, ev));
 }
 
-/* Use a dummy action in cancelled events */ 
-static int
-ccn_schedule_cancelled_event(struct ccn_schedule *sched, void *clienth,
-                             struct ccn_scheduled_event *ev, int flags)
-{
-    return(0);
-}
-
 /**
  * Cancel a scheduled event.
  *
@@ -262,6 +527,17 @@ ccn_schedule_cancel(struct ccn_schedule *sched, struct ccn_scheduled_event *ev)
     ev->action = &ccn_schedule_cancelled_event;
     ev->evdata = NULL;
     ev->evint = 0;
+    if (sched->wheel != NULL) {
+        struct wheel_event *we = (struct wheel_event *)ev;
+        if (we->state == WHEEL_LINKED) {
+            /* Freed on the next run, in case of a repeated cancel */
+            wheel_unlink(we);
+            sched->wheel->n--;
+            we->state = WHEEL_DEAD;
+            we->next = sched->wheel->dead;
+            sched->wheel->dead = we;
+        }
+    }
     return(0);
 }
 
@@ -300,6 +576,8 @@ ccn_schedule_run_next(struct ccn_schedule *sched)
 int
 ccn_schedule_run(struct ccn_schedule *sched)
 {
+    if (sched->wheel != NULL)
+        return(wheel_run(sched));
     update_time(sched);
     while (sched->heap_n > 0 && sched->heap[0].event_time <= sched->now) {
         sched->time_has_passed = 0;
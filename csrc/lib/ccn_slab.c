@@ -0,0 +1,263 @@
+/**
+ * @file ccn_slab.c
+ * @brief Size-class memory allocator.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ccn/slab.h>
+
+/*
+ * Size classes are multiples of 16 up to 128, and beyond that there
+ * are eight classes for each power of 2, up to CCN_SLAB_MAX.  So no more
+ * than 12.5% is wasted by rounding up.
+ */
+#define CCN_SLAB_ALIGN 16
+#define CCN_SLAB_MAX 16384
+#define CCN_SLAB_NCLASS (8 + 8 * 7)
+#define CCN_SLAB_CHUNK 65536
+
+/** Chunk header; objects follow, suitably aligned */
+struct slab_chunk {
+    struct slab_chunk *next;
+};
+#define CHUNK_HDR ((sizeof(struct slab_chunk) + CCN_SLAB_ALIGN - 1) & \
+                   ~(size_t)(CCN_SLAB_ALIGN - 1))
+
+struct slab_free {
+    struct slab_free *next;
+};
+
+struct slab_class {
+    size_t size;                /**< object size */
+    unsigned per_chunk;         /**< objects per chunk */
+    struct slab_chunk *chunks;  /**< all of our chunks, for destroy */
+    struct slab_free *free;     /**< freed objects */
+    unsigned char *bump;        /**< never-used part of newest chunk */
+    unsigned bump_left;         /**< objects left at bump */
+    unsigned long slabs;
+    unsigned long in_use;
+};
+
+struct ccn_slab {
+    struct slab_class class[CCN_SLAB_NCLASS];
+    unsigned long large_in_use; /**< allocations passed on to malloc */
+};
+
+/**
+ * Map a size to its class number, or -1 if too big.
+ */
+static int
+size_class(size_t size)
+{
+    int i;
+    size_t base;
+
+    if (size <= 128)
+        return(size == 0 ? 0 : (size - 1) / 16);
+    if (size > CCN_SLAB_MAX)
+        return(-1);
+    for (i = 8, base = 128; size > 2 * base; i += 8)
+        base *= 2;
+    /* base < size <= 2 * base, in steps of base / 8 */
+    return(i + (size - base - 1) / (base / 8));
+}
+
+/**
+ * Create a slab allocator.
+ */
+struct ccn_slab *
+ccn_slab_create(void)
+{
+    struct ccn_slab *s;
+    size_t base;
+    int i;
+    int j;
+
+    s = calloc(1, sizeof(*s));
+    if (s == NULL)
+        return(NULL);
+    for (i = 0; i < 8; i++)
+        s->class[i].size = 16 * (i + 1);
+    for (base = 128; i < CCN_SLAB_NCLASS; base *= 2)
+        for (j = 1; j <= 8; j++, i++)
+            s->class[i].size = base + j * (base / 8);
+    for (i = 0; i < CCN_SLAB_NCLASS; i++)
+        s->class[i].per_chunk = (CCN_SLAB_CHUNK - CHUNK_HDR) / s->class[i].size;
+    return(s);
+}
+
+/**
+ * Destroy a slab allocator, releasing all of its memory.
+ *
+ * Any objects still allocated from it become invalid.
+ * Large objects are not tracked, so the caller must free those.
+ */
+void
+ccn_slab_destroy(struct ccn_slab **ps)
+{
+    struct ccn_slab *s = *ps;
+    struct slab_chunk *c;
+    int i;
+
+    if (s == NULL)
+        return;
+    for (i = 0; i < CCN_SLAB_NCLASS; i++) {
+        while (s->class[i].chunks != NULL) {
+            c = s->class[i].chunks;
+            s->class[i].chunks = c->next;
+            free(c);
+        }
+    }
+    free(s);
+    *ps = NULL;
+}
+
+/**
+ * Allocate an object of the given size.
+ * @returns a pointer to uninitialized memory, or NULL if none is available.
+ */
+void *
+ccn_slab_alloc(struct ccn_slab *s, size_t size)
+{
+    struct slab_class *k;
+    struct slab_chunk *c;
+    struct slab_free *f;
+    int i;
+
+    if (s == NULL)
+        return(malloc(size));
+    i = size_class(size);
+    if (i < 0) {
+        f = malloc(size);
+        if (f != NULL)
+            s->large_in_use++;
+        return(f);
+    }
+    k = &s->class[i];
+    if (k->free != NULL) {
+        f = k->free;
+        k->free = f->next;
+        k->in_use++;
+        return(f);
+    }
+    if (k->bump_left == 0) {
+        c = malloc(CCN_SLAB_CHUNK);
+        if (c == NULL)
+            return(NULL);
+        c->next = k->chunks;
+        k->chunks = c;
+        k->slabs++;
+        k->bump = (unsigned char *)c + CHUNK_HDR;
+        k->bump_left = k->per_chunk;
+    }
+    f = (void *)k->bump;
+    k->bump += k->size;
+    k->bump_left--;
+    k->in_use++;
+    return(f);
+}
+
+/**
+ * Allocate a zeroed object of the given size.
+ */
+void *
+ccn_slab_calloc(struct ccn_slab *s, size_t size)
+{
+    void *p;
+
+    if (s == NULL)
+        return(calloc(1, size));
+    p = ccn_slab_alloc(s, size);
+    if (p != NULL)
+        memset(p, 0, size);
+    return(p);
+}
+
+/**
+ * Free an object.
+ *
+ * The size must be the same as was used to allocate it.
+ */
+void
+ccn_slab_free(struct ccn_slab *s, void *p, size_t size)
+{
+    struct slab_class *k;
+    struct slab_free *f = p;
+    int i;
+
+    if (p == NULL)
+        return;
+    if (s == NULL) {
+        free(p);
+        return;
+    }
+    i = size_class(size);
+    if (i < 0) {
+        s->large_in_use--;
+        free(p);
+        return;
+    }
+    k = &s->class[i];
+    f->next = k->free;
+    k->free = f;
+    k->in_use--;
+}
+
+/**
+ * Get the number of bytes actually used for an allocation.
+ */
+size_t
+ccn_slab_size(struct ccn_slab *s, size_t size)
+{
+    int i;
+
+    if (s == NULL)
+        return(size);
+    i = size_class(size);
+    if (i < 0)
+        return(size);
+    return(s->class[i].size);
+}
+
+/**
+ * Get occupancy statistics.
+ *
+ * Class numbers run from 0; the last one describes the allocations
+ * that were too large for the size classes.
+ * @returns 0 for success, or -1 if there is no class i.
+ */
+int
+ccn_slab_stats(struct ccn_slab *s, int i, struct ccn_slab_stats *ans)
+{
+    struct slab_class *k;
+
+    memset(ans, 0, sizeof(*ans));
+    if (s == NULL || i < 0 || i > CCN_SLAB_NCLASS)
+        return(-1);
+    if (i == CCN_SLAB_NCLASS) {
+        ans->in_use = s->large_in_use;
+        return(0);
+    }
+    k = &s->class[i];
+    ans->size = k->size;
+    ans->slabs = k->slabs;
+    ans->in_use = k->in_use;
+    ans->free = k->slabs * k->per_chunk - k->in_use;
+    return(0);
+}
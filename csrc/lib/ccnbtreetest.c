@@ -20,6 +20,7 @@
  * Boston, MA 02110-1301, USA.
  */
  
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -27,6 +28,7 @@
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -192,6 +194,151 @@ test_btree_lockfile(void)
     return(res);
 }
 
+/**
+ * Helper for test_btree_checkpoint()
+ *
+ * Sets the contents of a node and writes it out.
+ */
+static void
+put_node(struct ccn_btree_io *io, struct ccn_btree_node *node, const char *s)
+{
+    int res;
+    
+    if (node->iodata == NULL) {
+        res = io->btopen(io, node);
+        CHKSYS(res);
+    }
+    node->buf->length = 0;
+    ccn_charbuf_putf(node->buf, "%s", s);
+    node->clean = 0;
+    res = io->btwrite(io, node);
+    CHKSYS(res);
+}
+
+/**
+ * Helper for test_btree_checkpoint()
+ *
+ * Reads a node and checks its contents.
+ */
+static void
+check_node(struct ccn_btree_io *io, struct ccn_btree_node *node, const char *s)
+{
+    int res;
+    
+    if (node->iodata != NULL) {
+        res = io->btclose(io, node);
+        CHKSYS(res);
+    }
+    res = io->btopen(io, node);
+    CHKSYS(res);
+    node->buf->length = 0;
+    node->clean = 0;
+    res = io->btread(io, node, 1000);
+    CHKSYS(res);
+    FAILIF(0 != strcmp(s, ccn_charbuf_as_string(node->buf)));
+    res = io->btclose(io, node);
+    CHKSYS(res);
+}
+
+/**
+ * Helper for test_btree_checkpoint()
+ *
+ * Counts the files in a directory.
+ */
+static int
+count_files(struct ccn_charbuf *dir)
+{
+    DIR *d;
+    struct dirent *de;
+    int n = 0;
+    
+    d = opendir(ccn_charbuf_as_string(dir));
+    CHKPTR(d);
+    while ((de = readdir(d)) != NULL)
+        n++;
+    closedir(d);
+    return(n);
+}
+
+/**
+ * Test that the directory store comes back as of the last checkpoint.
+ *
+ * A crash is simulated by destroying the io handle without a checkpoint.
+ */
+int
+test_btree_checkpoint(void)
+{
+    int res;
+    struct ccn_btree_node nodespace[2] = {{0}};
+    struct ccn_btree_node *node = nodespace;
+    struct ccn_btree_io *io = NULL;
+    struct ccn_charbuf *dir = NULL;
+    int nfiles;
+    
+    dir = ccn_charbuf_create();
+    CHKPTR(dir);
+    ccn_charbuf_putf(dir, "%s/ck", getenv("TEST_DIRECTORY"));
+    res = mkdir(ccn_charbuf_as_string(dir), 0777);
+    CHKSYS(res);
+    node[0].buf = ccn_charbuf_create();
+    node[1].buf = ccn_charbuf_create();
+    node[0].nodeid = 1;
+    node[1].nodeid = 2;
+    io = ccn_btree_io_from_directory(ccn_charbuf_as_string(dir), NULL);
+    CHKPTR(io);
+    FAILIF(io->checkpoint != NULL || io->btcheckpoint == NULL);
+    put_node(io, &node[0], "one");
+    res = io->btcheckpoint(io, "first");
+    CHKSYS(res);
+    /* Changes after the checkpoint, then crash */
+    put_node(io, &node[0], "uno");
+    put_node(io, &node[1], "dos");
+    check_node(io, &node[0], "uno");
+    res = io->btdestroy(&io);
+    CHKSYS(res);
+    io = ccn_btree_io_from_directory(ccn_charbuf_as_string(dir), NULL);
+    CHKPTR(io);
+    CHKPTR(io->checkpoint);
+    FAILIF(0 != strcmp("first", ccn_charbuf_as_string(io->checkpoint)));
+    FAILIF(io->maxnodeid != 2);
+    check_node(io, &node[0], "one");
+    check_node(io, &node[1], "");
+    /* Changes that are checkpointed survive */
+    put_node(io, &node[0], "eins");
+    put_node(io, &node[1], "zwei");
+    res = io->btcheckpoint(io, "second");
+    CHKSYS(res);
+    put_node(io, &node[1], "drei");
+    res = io->btcheckpoint(io, "third");
+    CHKSYS(res);
+    res = io->btdestroy(&io);
+    CHKSYS(res);
+    io = ccn_btree_io_from_directory(ccn_charbuf_as_string(dir), NULL);
+    CHKPTR(io);
+    FAILIF(0 != strcmp("third", ccn_charbuf_as_string(io->checkpoint)));
+    check_node(io, &node[0], "eins");
+    check_node(io, &node[1], "drei");
+    /* Writing back a clean node must not shadow it */
+    nfiles = count_files(dir);
+    res = io->btopen(io, &node[0]);
+    CHKSYS(res);
+    node[0].buf->length = 0;
+    res = io->btread(io, &node[0], 1000);
+    CHKSYS(res);
+    node[0].clean = node[0].buf->length;
+    res = io->btwrite(io, &node[0]);
+    CHKSYS(res);
+    res = io->btclose(io, &node[0]);
+    CHKSYS(res);
+    FAILIF(count_files(dir) != nfiles);
+    res = io->btdestroy(&io);
+    CHKSYS(res);
+    ccn_charbuf_destroy(&node[0].buf);
+    ccn_charbuf_destroy(&node[1].buf);
+    ccn_charbuf_destroy(&dir);
+    return(res);
+}
+
 struct entry_example {
     unsigned char p[CCN_BT_SIZE_UNITS];
     struct ccn_btree_entry_trailer t;
@@ -913,6 +1060,193 @@ test_insert_content(void)
     return(0);
 }
 
+/**
+ * Make an empty btree for loading, stored in dir if it is not NULL.
+ */
+static struct ccn_btree *
+testhelp_empty_btree(const char *dir)
+{
+    struct ccn_btree *btree = NULL;
+    struct ccn_btree_node *node = NULL;
+    int res;
+    
+    btree = ccn_btree_create();
+    CHKPTR(btree);
+    if (dir != NULL) {
+        btree->io = ccn_btree_io_from_directory(dir, NULL);
+        CHKPTR(btree->io);
+    }
+    node = ccn_btree_getnode(btree, btree->nextnodeid++, 0);
+    CHKPTR(node);
+    res = ccn_btree_init_node(node, 0, 'R', 0);
+    CHKSYS(res);
+    btree->full = btree->full0 = 199;
+    btree->nodebytes = 0;
+    return(btree);
+}
+
+static void
+testhelp_bulk_key(struct ccn_charbuf *c, unsigned i)
+{
+    c->length = 0;
+    ccn_charbuf_putf(c, "/bulk/%08u/%u", i * 7, i % 13);
+}
+
+static double
+testhelp_secs(struct timeval *t0)
+{
+    struct timeval t1;
+    
+    gettimeofday(&t1, NULL);
+    return((t1.tv_sec - t0->tv_sec) + (t1.tv_usec - t0->tv_usec) / 1e6);
+}
+
+/**
+ * Check that each of the n keys is in the btree with the right payload.
+ */
+static void
+testhelp_check_bulk_keys(struct ccn_btree *btree, unsigned n)
+{
+    struct ccn_charbuf *c = NULL;
+    struct ccn_btree_node *leaf = NULL;
+    unsigned char *p = NULL;
+    unsigned i;
+    int res;
+    
+    c = ccn_charbuf_create();
+    CHKPTR(c);
+    for (i = 0; i < n; i++) {
+        testhelp_bulk_key(c, i);
+        res = ccn_btree_lookup(btree, c->buf, c->length, &leaf);
+        CHKSYS(res);
+        FAILIF(!CCN_BT_SRCH_FOUND(res));
+        p = ccn_btree_node_getentry(ccn_btree_node_payloadsize(leaf),
+                                    leaf, CCN_BT_SRCH_INDEX(res));
+        CHKPTR(p);
+        FAILIF(0 != memcmp(p, &i, sizeof(i)));
+    }
+    ccn_charbuf_destroy(&c);
+}
+
+/**
+ * Load n keys in bulk, and compare with inserting them one at a time.
+ *
+ * Reports the time taken and the number of nodes used for each way.
+ * The bulk load is done at a few fill factors, and once more with
+ * storage, to check that the result can be read back.
+ */
+int
+test_btree_bulk_load(unsigned n)
+{
+    static const int fills[] = {100, 90, 70};
+    struct ccn_btree *btree = NULL;
+    struct ccn_btree_node *leaf = NULL;
+    struct ccn_btree_node *node = NULL;
+    struct ccn_btree_loader *loader = NULL;
+    struct ccn_charbuf *c = NULL;
+    struct ccn_charbuf *dir = NULL;
+    struct timeval t0;
+    double secs;
+    unsigned i;
+    int limit;
+    int k;
+    int res;
+    
+    c = ccn_charbuf_create();
+    CHKPTR(c);
+    /* One at a time */
+    btree = testhelp_empty_btree(NULL);
+    gettimeofday(&t0, NULL);
+    for (i = 0; i < n; i++) {
+        testhelp_bulk_key(c, i);
+        res = ccn_btree_lookup(btree, c->buf, c->length, &leaf);
+        CHKSYS(res);
+        FAILIF(CCN_BT_SRCH_FOUND(res));
+        res = ccn_btree_insert_entry(leaf, CCN_BT_SRCH_INDEX(res),
+                                     c->buf, c->length, &i, sizeof(i));
+        CHKSYS(res);
+        if (ccn_btree_oversize(btree, leaf)) {
+            res = ccn_btree_split(btree, leaf);
+            CHKSYS(res);
+            for (limit = 20; btree->nextsplit != 0; limit--) {
+                FAILIF(limit == 0);
+                node = ccn_btree_rnode(btree, btree->nextsplit);
+                CHKPTR(node);
+                res = ccn_btree_split(btree, node);
+                CHKSYS(res);
+            }
+        }
+    }
+    secs = testhelp_secs(&t0);
+    printf("%u keys inserted one at a time: %.3f seconds, %d nodes\n",
+           n, secs, hashtb_n(btree->resident));
+    res = ccn_btree_check(btree, NULL);
+    CHKSYS(res);
+    testhelp_check_bulk_keys(btree, n);
+    res = ccn_btree_destroy(&btree);
+    CHKSYS(res);
+    /* In bulk */
+    for (k = 0; k < sizeof(fills) / sizeof(fills[0]); k++) {
+        btree = testhelp_empty_btree(NULL);
+        gettimeofday(&t0, NULL);
+        loader = ccn_btree_loader_create(btree, fills[k]);
+        CHKPTR(loader);
+        for (i = 0; i < n; i++) {
+            testhelp_bulk_key(c, i);
+            res = ccn_btree_loader_add(loader, c->buf, c->length,
+                                       &i, sizeof(i));
+            CHKSYS(res);
+        }
+        /* Out of order keys are refused */
+        FAILIF(n > 0 && ccn_btree_loader_add(loader, c->buf, c->length,
+                                             &i, sizeof(i)) != -1);
+        res = ccn_btree_loader_finish(&loader);
+        CHKSYS(res);
+        secs = testhelp_secs(&t0);
+        printf("%u keys loaded in bulk at %d%% fill: %.3f seconds, %d nodes\n",
+               n, fills[k], secs, hashtb_n(btree->resident));
+        res = ccn_btree_check(btree, NULL);
+        CHKSYS(res);
+        testhelp_check_bulk_keys(btree, n);
+        res = ccn_btree_destroy(&btree);
+        CHKSYS(res);
+    }
+    /* With storage, and read back */
+    dir = ccn_charbuf_create();
+    CHKPTR(dir);
+    ccn_charbuf_putf(dir, "%s/bulk", getenv("TEST_DIRECTORY"));
+    res = mkdir(ccn_charbuf_as_string(dir), 0777);
+    CHKSYS(res);
+    btree = testhelp_empty_btree(ccn_charbuf_as_string(dir));
+    FAILIF(NULL != ccn_btree_loader_create(btree, 0));
+    loader = ccn_btree_loader_create(btree, 100);
+    CHKPTR(loader);
+    for (i = 0; i < n; i++) {
+        testhelp_bulk_key(c, i);
+        res = ccn_btree_loader_add(loader, c->buf, c->length, &i, sizeof(i));
+        CHKSYS(res);
+    }
+    res = ccn_btree_loader_finish(&loader);
+    CHKSYS(res);
+    FAILIF(NULL != ccn_btree_loader_create(btree, 100)); /* not empty */
+    FAILIF(hashtb_n(btree->resident) > 1);
+    res = ccn_btree_destroy(&btree);
+    CHKSYS(res);
+    btree = ccn_btree_create();
+    CHKPTR(btree);
+    btree->io = ccn_btree_io_from_directory(ccn_charbuf_as_string(dir), NULL);
+    CHKPTR(btree->io);
+    btree->nextnodeid = btree->io->maxnodeid + 1;
+    res = ccn_btree_check(btree, NULL);
+    CHKSYS(res);
+    testhelp_check_bulk_keys(btree, n);
+    res = ccn_btree_destroy(&btree);
+    CHKSYS(res);
+    ccn_charbuf_destroy(&dir);
+    ccn_charbuf_destroy(&c);
+    return(res);
+}
+
 int
 ccnbtreetest_main(int argc, char **argv)
 {
@@ -929,6 +1263,8 @@ ccnbtreetest_main(int argc, char **argv)
     CHKSYS(res);
     res = test_btree_lockfile();
     CHKSYS(res);
+    res = test_btree_checkpoint();
+    CHKSYS(res);
     res = test_structure_sizes();
     CHKSYS(res);
     res = test_btree_chknode();
@@ -949,6 +1285,8 @@ ccnbtreetest_main(int argc, char **argv)
     CHKSYS(res);
     res = test_insert_content();
     CHKSYS(res);
+    res = test_btree_bulk_load(argv[1] ? atoi(argv[1]) : 20000);
+    CHKSYS(res);
     if (res != 0)
         fprintf(stderr, "test_insert_content() => %d\n", res);
     return(0);
@@ -29,8 +29,8 @@ CSRC = ccn_bloom.c \
        ccn_charbuf.c ccn_client.c ccn_coding.c ccn_digest.c ccn_extend_dict.c \
        ccn_dtag_table.c ccn_indexbuf.c ccn_interest.c ccn_keystore.c \
        ccn_match.c ccn_reg_mgmt.c ccn_face_mgmt.c \
-       ccn_merkle_path_asn1.c ccn_name_util.c ccn_schedule.c \
-       ccn_seqwriter.c ccn_signing.c \
+       ccn_merkle_path_asn1.c ccn_name_util.c ccn_nametrie.c ccn_schedule.c \
+       ccn_seqwriter.c ccn_signing.c ccn_slab.c \
        ccn_sockcreate.c ccn_traverse.c ccn_uri.c \
        ccn_verifysig.c ccn_versioning.c \
        ccn_header.c \
@@ -49,7 +49,8 @@ LIB_OBJS = ccn_client.o ccn_charbuf.o ccn_indexbuf.o ccn_coding.o \
        ccn_match.o hashtb.o ccn_merkle_path_asn1.o \
        ccn_sockaddrutil.o ccn_setup_sockaddr_un.o \
        ccn_bulkdata.o ccn_versioning.o ccn_header.o ccn_fetch.o \
-       ccn_btree.o ccn_btree_content.o ccn_btree_store.o
+       ccn_btree.o ccn_btree_content.o ccn_btree_store.o ccn_slab.o \
+       ccn_nametrie.o
 
 default all: dtag_check lib $(PROGRAMS)
 # Don't try to build shared libs right now.
@@ -182,7 +183,8 @@ ccn_btree_content.o: ccn_btree_content.c ../include/ccn/btree.h \
   ../include/ccn/coding.h ../include/ccn/indexbuf.h \
   ../include/ccn/bloom.h ../include/ccn/uri.h
 ccn_btree_store.o: ccn_btree_store.c ../include/ccn/btree.h \
-  ../include/ccn/charbuf.h ../include/ccn/hashtb.h
+  ../include/ccn/charbuf.h ../include/ccn/hashtb.h \
+  ../include/ccn/indexbuf.h
 ccn_buf_decoder.o: ccn_buf_decoder.c ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
   ../include/ccn/indexbuf.h
@@ -198,8 +200,8 @@ ccn_client.o: ccn_client.c ../include/ccn/ccn.h ../include/ccn/coding.h \
   ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
   ../include/ccn/ccn_private.h ../include/ccn/ccnd.h \
   ../include/ccn/digest.h ../include/ccn/hashtb.h \
-  ../include/ccn/reg_mgmt.h ../include/ccn/signing.h \
-  ../include/ccn/keystore.h ../include/ccn/uri.h
+  ../include/ccn/nametrie.h ../include/ccn/reg_mgmt.h \
+  ../include/ccn/signing.h ../include/ccn/keystore.h ../include/ccn/uri.h
 ccn_coding.o: ccn_coding.c ../include/ccn/coding.h
 ccn_digest.o: ccn_digest.c ../include/ccn/digest.h
 ccn_extend_dict.o: ccn_extend_dict.c ../include/ccn/charbuf.h \
@@ -224,7 +226,10 @@ ccn_merkle_path_asn1.o: ccn_merkle_path_asn1.c \
   ../include/ccn/merklepathasn1.h
 ccn_name_util.o: ccn_name_util.c ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
-  ../include/ccn/indexbuf.h ../include/ccn/random.h
+  ../include/ccn/indexbuf.h ../include/ccn/random.h \
+  ../include/ccn/hashtb.h
+ccn_nametrie.o: ccn_nametrie.c ../include/ccn/hashtb.h ../include/ccn/indexbuf.h \
+  ../include/ccn/nametrie.h
 ccn_schedule.o: ccn_schedule.c ../include/ccn/schedule.h
 ccn_seqwriter.o: ccn_seqwriter.c ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
@@ -233,6 +238,7 @@ ccn_signing.o: ccn_signing.c ../include/ccn/merklepathasn1.h \
   ../include/ccn/ccn.h ../include/ccn/coding.h ../include/ccn/charbuf.h \
   ../include/ccn/indexbuf.h ../include/ccn/signing.h \
   ../include/ccn/random.h
+ccn_slab.o: ccn_slab.c ../include/ccn/slab.h
 ccn_sockcreate.o: ccn_sockcreate.c ../include/ccn/sockcreate.h
 ccn_traverse.o: ccn_traverse.c ../include/ccn/bloom.h \
   ../include/ccn/ccn.h ../include/ccn/coding.h ../include/ccn/charbuf.h \
@@ -258,7 +264,7 @@ encodedecodetest.o: encodedecodetest.c ../include/ccn/ccn.h \
   ../include/ccn/indexbuf.h ../include/ccn/bloom.h ../include/ccn/uri.h \
   ../include/ccn/digest.h ../include/ccn/keystore.h \
   ../include/ccn/signing.h ../include/ccn/random.h
-hashtb.o: hashtb.c ../include/ccn/hashtb.h
+hashtb.o: hashtb.c ../include/ccn/hashtb.h ../include/ccn/slab.h
 hashtbtest.o: hashtbtest.c ../include/ccn/hashtb.h
 signbenchtest.o: signbenchtest.c ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
@@ -23,6 +23,7 @@
 #include <string.h>
 
 #include <ccn/hashtb.h>
+#include <ccn/slab.h>
 
 struct node;
 struct node {
@@ -33,6 +34,7 @@ struct node {
     /* user data follows immediately, followed by key */
 };
 #define DATA(ht, p) ((void *)((p) + 1))
+#define NODESIZE(ht, p) (sizeof(*(p)) + (ht)->item_size + (p)->keysize + (p)->extsize)
 #define KEY(ht, p) ((unsigned char *)((p) + 1) + ht->item_size)
 
 #define CHECKHTE(ht, hte) ((uintptr_t)((hte)->priv[1]) == ~(uintptr_t)(ht))
@@ -48,16 +50,98 @@ struct hashtb {
     struct hashtb_param param;  /* saved client parameters */
 };
 
+/*
+ * The default hash works a 64-bit word at a time.  It is written as an
+ * incremental computation so that a key given in pieces (as for
+ * hashtb_seek_spliced) hashes the same as when it is contiguous.
+ */
+#define HASH_K1 0x9E3779B97F4A7C15ULL
+#define HASH_K2 0xC2B2AE3D27D4EB4FULL
+
+struct hash_state {
+    uint64_t h;
+    uint64_t pend;      /* bytes not yet making up a whole word */
+    unsigned npend;
+    size_t len;
+};
+
+static uint64_t
+hash_word(uint64_t h, uint64_t w)
+{
+    h ^= w * HASH_K2;
+    h = (h << 31) | (h >> 33);
+    return(h * HASH_K1);
+}
+
+static uint64_t
+load_word(const unsigned char *p)
+{
+    uint64_t w;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(&w, p, sizeof(w));
+#else
+    int i;
+    for (w = 0, i = 7; i >= 0; i--)
+        w = (w << 8) | p[i];
+#endif
+    return(w);
+}
+
+static void
+hash_init(struct hash_state *s)
+{
+    s->h = HASH_K1;
+    s->pend = 0;
+    s->npend = 0;
+    s->len = 0;
+}
+
+static void
+hash_update(struct hash_state *s, const unsigned char *p, size_t n)
+{
+    uint64_t h = s->h;
+    s->len += n;
+    for (; s->npend != 0 && n > 0; n--) {
+        s->pend |= (uint64_t)(*p++) << (8 * s->npend);
+        if (++(s->npend) == 8) {
+            h = hash_word(h, s->pend);
+            s->pend = 0;
+            s->npend = 0;
+        }
+    }
+    for (; n >= 8; n -= 8, p += 8)
+        h = hash_word(h, load_word(p));
+    for (; n > 0; n--)
+        s->pend |= (uint64_t)(*p++) << (8 * s->npend++);
+    s->h = h;
+}
+
+static size_t
+hash_final(struct hash_state *s)
+{
+    uint64_t h = s->h;
+    if (s->npend != 0)
+        h = hash_word(h, s->pend);
+    h ^= s->len;
+    h ^= h >> 33;
+    h *= HASH_K2;
+    h ^= h >> 29;
+    return((size_t)h);
+}
+
 size_t
 hashtb_hash(const unsigned char *key, size_t key_size)
 {
-    size_t h;
-    size_t i;
-    for (h = key_size + 23, i = 0; i < key_size; i++)
-        h = ((h << 6) ^ (h >> 27)) + key[i];
-    return(h);
+    struct hash_state s;
+    hash_init(&s);
+    hash_update(&s, key, key_size);
+    return(hash_final(&s));
 }
 
+#define HASH(ht, key, keysize) \
+    ((ht)->param.hash != NULL ? (*(ht)->param.hash)(key, keysize) : \
+                                hashtb_hash(key, keysize))
+
 struct hashtb *
 hashtb_create(size_t item_size, const struct hashtb_param *param)
 {
@@ -113,12 +197,19 @@ hashtb_n(struct hashtb *ht)
 
 void *
 hashtb_lookup(struct hashtb *ht, const void *key, size_t keysize)
+{
+    if (key == NULL)
+        return(NULL);
+    return(hashtb_lookup_hashed(ht, key, keysize, HASH(ht, key, keysize)));
+}
+
+void *
+hashtb_lookup_hashed(struct hashtb *ht, const void *key, size_t keysize,
+                     size_t h)
 {
     struct node *p;
-    size_t h;
     if (key == NULL)
         return(NULL);
-    h = hashtb_hash(key, keysize);
     for (p = ht->bucket[h % ht->n_buckets]; p != NULL; p = p->link) {
         if (p->hash < h)
             continue;
@@ -191,7 +282,7 @@ hashtb_end(struct hashtb_enumerator *hte)
                 (*f)(hte);
             p = ht->deferred;
             ht->deferred = p->link;
-            free(p);
+            ccn_slab_free(ht->param.slab, p, NODESIZE(ht, p));
         }
     }
     hte->priv[0] = 0;
@@ -213,40 +304,48 @@ hashtb_next(struct hashtb_enumerator *hte)
     setpos(hte, pp);
 }
 
-int
-hashtb_seek(struct hashtb_enumerator *hte, const void *key, size_t keysize, size_t extsize)
+/*
+ * Common part of the seeks; h is the hash of the spliced key.
+ */
+static int
+seek_node(struct hashtb_enumerator *hte,
+          const unsigned char *k, size_t splice_at,
+          const unsigned char *s, size_t splicesize,
+          size_t keysize, size_t extsize, size_t h)
 {
     struct node *p = NULL;
     struct hashtb *ht = hte->ht;
     struct node **pp;
-    size_t h;
-    if (key == NULL) {
-        setpos(hte, NULL);
-        return(-1);
-    }
+    size_t rest = keysize - splice_at - splicesize;
     if (ht->refcount == 1 && ht->n > ht->n_buckets * 3) {
         ht->refcount--;
         hashtb_rehash(ht, 2 * ht->n + 1);
         ht->refcount++;
     }
-    h = hashtb_hash(key, keysize);
     pp = &(ht->bucket[h % ht->n_buckets]);
     for (p = *pp; p != NULL; pp = &(p->link), p = p->link) {
         if (p->hash < h)
             continue;
         if (p->hash > h)
             break;
-        if (keysize == p->keysize && 0 == memcmp(key, KEY(ht, p), keysize)) {
+        if (keysize == p->keysize &&
+            0 == memcmp(k, KEY(ht, p), splice_at) &&
+            0 == memcmp(s, KEY(ht, p) + splice_at, splicesize) &&
+            0 == memcmp(k + splice_at, KEY(ht, p) + splice_at + splicesize, rest)) {
             setpos(hte, pp);
             return(HT_OLD_ENTRY);
         }
     }
-    p = calloc(1, sizeof(*p) + ht->item_size + keysize + extsize);
+    p = ccn_slab_calloc(ht->param.slab,
+                        sizeof(*p) + ht->item_size + keysize + extsize);
     if (p == NULL) {
         setpos(hte, NULL);
         return(-1);
     }
-    memcpy(KEY(ht, p), key, keysize + extsize);
+    memcpy(KEY(ht, p), k, splice_at);
+    memcpy(KEY(ht, p) + splice_at, s, splicesize);
+    memcpy(KEY(ht, p) + splice_at + splicesize, k + splice_at,
+           rest + extsize);
     p->hash = h;
     p->keysize = keysize;
     p->extsize = extsize;
@@ -257,6 +356,68 @@ hashtb_seek(struct hashtb_enumerator *hte, const void *key, size_t keysize, size
     return(HT_NEW_ENTRY);
 }
 
+int
+hashtb_seek(struct hashtb_enumerator *hte, const void *key, size_t keysize, size_t extsize)
+{
+    if (key == NULL) {
+        setpos(hte, NULL);
+        return(-1);
+    }
+    return(seek_node(hte, key, keysize, key, 0, keysize, extsize,
+                     HASH(hte->ht, key, keysize)));
+}
+
+int
+hashtb_seek_hashed(struct hashtb_enumerator *hte, const void *key,
+                   size_t keysize, size_t extsize, size_t hash)
+{
+    if (key == NULL) {
+        setpos(hte, NULL);
+        return(-1);
+    }
+    return(seek_node(hte, key, keysize, key, 0, keysize, extsize, hash));
+}
+
+int
+hashtb_seek_spliced(struct hashtb_enumerator *hte,
+                    const void *key, size_t splice_at,
+                    const void *splice, size_t splicesize,
+                    size_t keysize, size_t extsize)
+{
+    struct hashtb *ht = hte->ht;
+    const unsigned char *k = key;
+    const unsigned char *s = splice;
+    struct hash_state hs;
+    unsigned char *tmp;
+    size_t h;
+    if (key == NULL || splice_at + splicesize > keysize) {
+        setpos(hte, NULL);
+        return(-1);
+    }
+    if (ht->param.hash == NULL) {
+        hash_init(&hs);
+        hash_update(&hs, k, splice_at);
+        hash_update(&hs, s, splicesize);
+        hash_update(&hs, k + splice_at, keysize - splice_at - splicesize);
+        h = hash_final(&hs);
+    }
+    else {
+        /* A client hash needs the key in one piece */
+        tmp = malloc(keysize + 1);
+        if (tmp == NULL) {
+            setpos(hte, NULL);
+            return(-1);
+        }
+        memcpy(tmp, k, splice_at);
+        memcpy(tmp + splice_at, s, splicesize);
+        memcpy(tmp + splice_at + splicesize, k + splice_at,
+               keysize - splice_at - splicesize);
+        h = (*ht->param.hash)(tmp, keysize);
+        free(tmp);
+    }
+    return(seek_node(hte, k, splice_at, s, splicesize, keysize, extsize, h));
+}
+
 void
 hashtb_delete(struct hashtb_enumerator *hte)
 {
@@ -272,7 +433,7 @@ hashtb_delete(struct hashtb_enumerator *hte)
             hashtb_finalize_proc f = ht->param.finalize;
             if (f != NULL)
                 (*f)(hte);
-            free(p);
+            ccn_slab_free(ht->param.slab, p, NODESIZE(ht, p));
         }
         else {
             p->link = ht->deferred;
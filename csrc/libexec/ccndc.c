@@ -97,11 +97,13 @@ static void
 usage(const char *progname)
 {
     fprintf(stderr,
-            "%s [-d] [-v] (-f configfile | (add|del) uri (udp|tcp) host [port [flags [mcastttl [mcastif]]]])\n"
+            "%s [-d] [-v] (-f configfile | (add|del) uri (udp|tcp) host [port [flags [mcastttl [mcastif [rate [burst]]]]]])\n"
             "   -d enter dynamic mode and create FIB entries based on DNS SRV records\n"
             "   -f configfile add or delete FIB entries based on contents of configfile\n"
             "   -v increase logging level\n"
-            "	add|del add or delete FIB entry based on parameters\n",
+            "	add|del add or delete FIB entry based on parameters\n"
+            "	rate limits content sent on the face, in bytes per second\n"
+            "	- may be given for any optional parameter to skip it\n",
             progname);
     exit(1);
 }
@@ -232,7 +234,9 @@ static struct prefix_face_list_item *prefix_face_list_item_create(struct ccn_cha
                                                                   char *port,
                                                                   char *mcastif,
                                                                   int lifetime,
-                                                                  int flags)
+                                                                  int flags,
+                                                                  int rate,
+                                                                  int burst)
 {
     struct prefix_face_list_item *pfl = calloc(1, sizeof(struct prefix_face_list_item));
     struct ccn_face_instance *fi = calloc(1, sizeof(*fi));
@@ -254,6 +258,12 @@ static struct prefix_face_list_item *prefix_face_list_item_create(struct ccn_cha
     pfl->fi->descr.ipproto = ipproto;
     pfl->fi->descr.mcast_ttl = mcast_ttl;
     pfl->fi->lifetime = lifetime;
+    pfl->fi->rate = rate;
+    pfl->fi->burst = burst;
+    if (rate >= 0)
+        pfl->fi->limits |= CCN_FACE_RATE_LIMIT;
+    if (burst >= 0)
+        pfl->fi->limits |= CCN_FACE_BURST_LIMIT;
     pfl->flags = flags;
     
     ccn_charbuf_append(store, "newface", strlen("newface") + 1);
@@ -447,7 +457,9 @@ process_command_tokens(struct prefix_face_list_item *pfltail,
                        char *port,
                        char *flags,
                        char *mcastttl,
-                       char *mcastif)
+                       char *mcastif,
+                       char *rate,
+                       char *burst)
 {
     int lifetime;
     struct ccn_charbuf *prefix;
@@ -455,6 +467,10 @@ process_command_tokens(struct prefix_face_list_item *pfltail,
     int socktype;
     int iflags;
     int imcastttl;
+    int irate;
+    int iburst;
+    long lval;
+    char *ep = NULL;
     char rhostnamebuf[NI_MAXHOST];
     char rhostportbuf[NI_MAXSERV];
     struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_flags = (AI_ADDRCONFIG)};
@@ -464,6 +480,14 @@ process_command_tokens(struct prefix_face_list_item *pfltail,
     struct prefix_face_list_item *pflp;
     int res;
     
+    /* A lone - holds the place of an optional parameter */
+    if (port != NULL && strcmp(port, "-") == 0) port = NULL;
+    if (flags != NULL && strcmp(flags, "-") == 0) flags = NULL;
+    if (mcastttl != NULL && strcmp(mcastttl, "-") == 0) mcastttl = NULL;
+    if (mcastif != NULL && strcmp(mcastif, "-") == 0) mcastif = NULL;
+    if (rate != NULL && strcmp(rate, "-") == 0) rate = NULL;
+    if (burst != NULL && strcmp(burst, "-") == 0) burst = NULL;
+    
     if (cmd == NULL) {
         ccndc_warn(__LINE__, "command error (line %d), missing command\n", lineno);
         return (-1);
@@ -555,8 +579,30 @@ process_command_tokens(struct prefix_face_list_item *pfltail,
         }
     }
     
+    irate = -1;
+    if (rate != NULL) {
+        errno = 0;
+        lval = strtol(rate, &ep, 10);
+        if (ep == rate || ep[0] != 0 || errno != 0 || lval < 0 || lval > INT_MAX) {
+            ccndc_warn(__LINE__, "command error (line %d), invalid rate: %s\n", lineno, rate);
+            return (-1);
+        }
+        irate = lval;
+    }
+    
+    iburst = -1;
+    if (burst != NULL) {
+        errno = 0;
+        lval = strtol(burst, &ep, 10);
+        if (ep == burst || ep[0] != 0 || errno != 0 || lval <= 0 || lval > INT_MAX) {
+            ccndc_warn(__LINE__, "command error (line %d), invalid burst: %s\n", lineno, burst);
+            return (-1);
+        }
+        iburst = lval;
+    }
+    
     /* we have successfully parsed a command line */
-    pflp = prefix_face_list_item_create(prefix, ipproto, imcastttl, rhostnamebuf, rhostportbuf, mcastif, lifetime, iflags);
+    pflp = prefix_face_list_item_create(prefix, ipproto, imcastttl, rhostnamebuf, rhostportbuf, mcastif, lifetime, iflags, irate, iburst);
     if (pflp == NULL) {
         ccndc_fatal(__LINE__, "Unable to allocate prefix_face_list_item\n");
     }
@@ -577,6 +623,8 @@ read_configfile(const char *filename, struct prefix_face_list_item *pfltail)
     char *flags;
     char *mcastttl;
     char *mcastif;
+    char *rate;
+    char *burst;
     FILE *cfg;
     char buf[1024];
     const char *seps = " \t\n";
@@ -610,7 +658,9 @@ read_configfile(const char *filename, struct prefix_face_list_item *pfltail)
         flags = strtok_r(NULL, seps, &last);
         mcastttl = strtok_r(NULL, seps, &last);
         mcastif = strtok_r(NULL, seps, &last);
-        res = process_command_tokens(pfltail, lineno, cmd, uri, proto, host, port, flags, mcastttl, mcastif);
+        rate = strtok_r(NULL, seps, &last);
+        burst = strtok_r(NULL, seps, &last);
+        res = process_command_tokens(pfltail, lineno, cmd, uri, proto, host, port, flags, mcastttl, mcastif, rate, burst);
         if (res < 0) {
             configerrors--;
         } else {
@@ -815,7 +865,7 @@ incoming_interest(
                                  proto,
                                  host,
                                  portstring,
-                                 NULL, NULL, NULL);
+                                 NULL, NULL, NULL, NULL, NULL);
     if (res < 0)
         return (CCN_UPCALL_RESULT_ERR);
 
@@ -865,9 +915,9 @@ main(int argc, char **argv)
         if (configfile != NULL) {
             usage(progname);
         }
-        /* (add|delete) uri type host [port [flags [mcast-ttl [mcast-if]]]] */
+        /* (add|delete) uri type host [port [flags [mcast-ttl [mcast-if [rate [burst]]]]]] */
         
-        if (argc - optind < 4 || argc - optind > 8)
+        if (argc - optind < 4 || argc - optind > 10)
             usage(progname);
         
         res = process_command_tokens(pflhead, 0,
@@ -878,7 +928,9 @@ main(int argc, char **argv)
                                      (optind + 4) < argc ? argv[optind+4] : NULL,
                                      (optind + 5) < argc ? argv[optind+5] : NULL,
                                      (optind + 6) < argc ? argv[optind+6] : NULL,
-                                     (optind + 7) < argc ? argv[optind+7] : NULL);
+                                     (optind + 7) < argc ? argv[optind+7] : NULL,
+                                     (optind + 8) < argc ? argv[optind+8] : NULL,
+                                     (optind + 9) < argc ? argv[optind+9] : NULL);
         if (res < 0)
             usage(progname);
     }
@@ -141,6 +141,8 @@ public class CCNProtocolDTags {
 	public static final int ConfigSlice = 124;
 	public static final int ConfigSliceList = 125;
 	public static final int ConfigSliceOp = 126;
+	public static final int RateLimit = 127;
+	public static final int BurstLimit = 128;
 
 	// Remember to keep in sync with schema/tagnames.csvsdict
 	public static final int CCNProtocolDataUnit = 17702112;
@@ -168,7 +170,7 @@ public class CCNProtocolDTags {
 		"InfoString", null,
         "StatusResponse", "StatusCode", "StatusText", "SyncNode", "SyncNodeKind", "SyncNodeElement",
         "SyncVersion", "SyncNodeElements", "SyncContentHash", "SyncLeafCount", "SyncTreeDepth", "SyncByteCount",
-        "ConfigSlice", "ConfigSliceList", "ConfigSliceOp" };
+        "ConfigSlice", "ConfigSliceList", "ConfigSliceOp", "RateLimit", "BurstLimit" };
 	protected static final int TAG_MAP_LENGTH = _tagToStringMap.length;
 
 	